@@ -1,4 +1,5 @@
 #include <linux/notifier.h>
+#include <linux/async.h>
 
 /**
  * struct subsys_private - structure to hold the private to the driver core portions of the bus_type/class structure.
@@ -63,6 +64,8 @@ struct driver_private {
  *	binding of drivers which were unable to get all the resources needed by
  *	the device; typically because it depends on another driver getting
  *	probed first.
+ * @async_probe_cookie - cookie of the last asynchronous probe scheduled for
+ *	this device, used to order the probes of its children after it.
  * @driver_data - private pointer for driver specific info.  Will turn into a
  * list soon.
  * @device - pointer back to the struct class that this structure is
@@ -76,6 +79,7 @@ struct device_private {
 	struct klist_node knode_driver;
 	struct klist_node knode_bus;
 	struct list_head deferred_probe;
+	async_cookie_t async_probe_cookie;
 	void *driver_data;
 	struct device *device;
 };
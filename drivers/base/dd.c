@@ -24,6 +24,8 @@
 #include <linux/wait.h>
 #include <linux/async.h>
 #include <linux/pm_runtime.h>
+#include <linux/boot_timing.h>
+#include <linux/slab.h>
 
 #include "base.h"
 #include "power/power.h"
@@ -249,8 +251,10 @@ EXPORT_SYMBOL_GPL(device_bind_driver);
 static atomic_t probe_count = ATOMIC_INIT(0);
 static DECLARE_WAIT_QUEUE_HEAD(probe_waitqueue);
 
-static int really_probe(struct device *dev, struct device_driver *drv)
+static int really_probe(struct device *dev, struct device_driver *drv,
+			bool async)
 {
+	struct boot_timing_stamp stamp;
 	int ret = 0;
 
 	atomic_inc(&probe_count);
@@ -265,15 +269,14 @@ static int really_probe(struct device *dev, struct device_driver *drv)
 		goto probe_failed;
 	}
 
-	if (dev->bus->probe) {
+	boot_timing_start(&stamp);
+	if (dev->bus->probe)
 		ret = dev->bus->probe(dev);
-		if (ret)
-			goto probe_failed;
-	} else if (drv->probe) {
+	else if (drv->probe)
 		ret = drv->probe(dev);
-		if (ret)
-			goto probe_failed;
-	}
+	boot_timing_probe(&stamp, dev, drv, async, ret);
+	if (ret)
+		goto probe_failed;
 
 	driver_bound(dev);
 	ret = 1;
@@ -337,18 +340,8 @@ void wait_for_device_probe(void)
 }
 EXPORT_SYMBOL_GPL(wait_for_device_probe);
 
-/**
- * driver_probe_device - attempt to bind device & driver together
- * @drv: driver to bind a device to
- * @dev: device to try to bind to the driver
- *
- * This function returns -ENODEV if the device is not registered,
- * 1 if the device is bound successfully and 0 otherwise.
- *
- * This function must be called with @dev lock held.  When called for a
- * USB interface, @dev->parent lock must be held as well.
- */
-int driver_probe_device(struct device_driver *drv, struct device *dev)
+static int __driver_probe_device(struct device_driver *drv,
+				 struct device *dev, bool async)
 {
 	int ret = 0;
 
@@ -360,12 +353,28 @@ int driver_probe_device(struct device_driver *drv, struct device *dev)
 
 	pm_runtime_get_noresume(dev);
 	pm_runtime_barrier(dev);
-	ret = really_probe(dev, drv);
+	ret = really_probe(dev, drv, async);
 	pm_runtime_put_sync(dev);
 
 	return ret;
 }
 
+/**
+ * driver_probe_device - attempt to bind device & driver together
+ * @drv: driver to bind a device to
+ * @dev: device to try to bind to the driver
+ *
+ * This function returns -ENODEV if the device is not registered,
+ * 1 if the device is bound successfully and 0 otherwise.
+ *
+ * This function must be called with @dev lock held.  When called for a
+ * USB interface, @dev->parent lock must be held as well.
+ */
+int driver_probe_device(struct device_driver *drv, struct device *dev)
+{
+	return __driver_probe_device(drv, dev, false);
+}
+
 static int __device_attach(struct device_driver *drv, void *data)
 {
 	struct device *dev = data;
@@ -418,6 +427,118 @@ out_unlock:
 }
 EXPORT_SYMBOL_GPL(device_attach);
 
+/*
+ * Asynchronous probing.
+ *
+ * A driver that sets ->async_probe (or is named in driver_async_probe=)
+ * has the devices it matches at driver_attach() time probed from the
+ * async thread pool, so that slow probes of unrelated devices overlap
+ * instead of running back to back in do_initcalls(). The probe of a
+ * device first waits for any asynchronous probe of its parent, which
+ * keeps the parent-before-child order of the device hierarchy. Pending
+ * asynchronous probes count in probe_count, so wait_for_device_probe()
+ * and driver_probe_done() cover them as well.
+ *
+ * Devices registered after their driver are still probed synchronously
+ * from device_attach(); in that case the caller (usually the probe of the
+ * parent) is typically already running asynchronously.
+ */
+static LIST_HEAD(async_probe_domain);
+
+/*
+ * "driver_async_probe=name1,name2" on the command line opts the listed
+ * drivers into asynchronous probing without changing their code.
+ */
+static char async_probe_drivers[128];
+
+static int __init save_async_probe_drivers(char *buf)
+{
+	strlcpy(async_probe_drivers, buf, sizeof(async_probe_drivers));
+	return 1;
+}
+__setup("driver_async_probe=", save_async_probe_drivers);
+
+static bool driver_allows_async_probing(struct device_driver *drv)
+{
+	const char *p = async_probe_drivers;
+	size_t len = strlen(drv->name);
+
+	if (drv->async_probe)
+		return true;
+
+	while (*p) {
+		if (!strncmp(p, drv->name, len) &&
+		    (p[len] == ',' || p[len] == '\0'))
+			return true;
+		p = strchr(p, ',');
+		if (!p)
+			break;
+		p++;
+	}
+	return false;
+}
+
+struct async_probe_req {
+	struct device		*dev;
+	struct device_driver	*drv;
+};
+
+static void __driver_attach_locked(struct device_driver *drv,
+				   struct device *dev, bool async)
+{
+	if (dev->parent)	/* Needed for USB */
+		device_lock(dev->parent);
+	device_lock(dev);
+	if (!dev->driver)
+		__driver_probe_device(drv, dev, async);
+	device_unlock(dev);
+	if (dev->parent)
+		device_unlock(dev->parent);
+}
+
+static void __driver_attach_async(void *data, async_cookie_t cookie)
+{
+	struct async_probe_req *req = data;
+	struct device *dev = req->dev;
+	struct device *parent = dev->parent;
+
+	/*
+	 * Waiting for the cookies below the parent's includes the running
+	 * entries, this one too: only wait for a parent scheduled before us.
+	 */
+	if (parent && parent->p && parent->p->async_probe_cookie &&
+	    parent->p->async_probe_cookie < cookie)
+		async_synchronize_cookie_domain(
+				parent->p->async_probe_cookie + 1,
+				&async_probe_domain);
+
+	__driver_attach_locked(req->drv, dev, true);
+
+	put_device(dev);
+	kfree(req);
+
+	atomic_dec(&probe_count);
+	wake_up(&probe_waitqueue);
+}
+
+static bool driver_attach_async(struct device_driver *drv, struct device *dev)
+{
+	struct async_probe_req *req;
+
+	req = kmalloc(sizeof(*req), GFP_KERNEL);
+	if (!req)
+		return false;
+
+	req->dev = get_device(dev);
+	req->drv = drv;
+
+	atomic_inc(&probe_count);
+	dev->p->async_probe_cookie =
+		async_schedule_domain(__driver_attach_async, req,
+				      &async_probe_domain);
+	return true;
+}
+
 static int __driver_attach(struct device *dev, void *data)
 {
 	struct device_driver *drv = data;
@@ -435,14 +556,10 @@ static int __driver_attach(struct device *dev, void *data)
 	if (!driver_match_device(drv, dev))
 		return 0;
 
-	if (dev->parent)	/* Needed for USB */
-		device_lock(dev->parent);
-	device_lock(dev);
-	if (!dev->driver)
-		driver_probe_device(drv, dev);
-	device_unlock(dev);
-	if (dev->parent)
-		device_unlock(dev->parent);
+	if (driver_allows_async_probing(drv) && driver_attach_async(drv, dev))
+		return 0;
+
+	__driver_attach_locked(drv, dev, false);
 
 	return 0;
 }
@@ -527,6 +644,9 @@ void driver_detach(struct device_driver *drv)
 	struct device_private *dev_prv;
 	struct device *dev;
 
+	if (driver_allows_async_probing(drv))
+		async_synchronize_full_domain(&async_probe_domain);
+
 	for (;;) {
 		spin_lock(&drv->p->klist_devices.k_lock);
 		if (list_empty(&drv->p->klist_devices.k_list)) {
@@ -31,6 +31,18 @@
 #include <linux/swap.h>
 #include <linux/mm_types.h>
 #include <linux/dma-contiguous.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/freezer.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/moduleparam.h>
+#include <linux/seq_file.h>
+#include <linux/shrinker.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/cma.h>
 
 #ifndef SZ_1M
 #define SZ_1M (1 << 20)
@@ -40,6 +52,15 @@ struct cma {
 	unsigned long	base_pfn;
 	unsigned long	count;
 	unsigned long	*bitmap;
+	/*
+	 * Pages already taken from the page allocator by the background
+	 * migrator but not handed out yet, and a scratch bitmap for range
+	 * searches.  Like bitmap, protected by cma_mutex.
+	 */
+	unsigned long	*prepared;
+	unsigned long	*scratch;
+	unsigned long	nr_prepared;
+	unsigned long	prepare_next;
 };
 
 struct cma *dma_contiguous_default_area;
@@ -137,6 +158,9 @@ void __init dma_contiguous_reserve(phys_addr_t limit)
 
 static DEFINE_MUTEX(cma_mutex);
 
+static struct cma *cma_areas[MAX_CMA_AREAS];
+static unsigned cma_area_count;
+
 static __init int cma_activate_area(unsigned long base_pfn, unsigned long count)
 {
 	unsigned long pfn = base_pfn;
@@ -174,21 +198,28 @@ static __init struct cma *cma_create_area(unsigned long base_pfn,
 
 	cma->base_pfn = base_pfn;
 	cma->count = count;
+	cma->nr_prepared = 0;
+	cma->prepare_next = 0;
 	cma->bitmap = kzalloc(bitmap_size, GFP_KERNEL);
+	cma->prepared = kzalloc(bitmap_size, GFP_KERNEL);
+	cma->scratch = kzalloc(bitmap_size, GFP_KERNEL);
 
-	if (!cma->bitmap)
+	if (!cma->bitmap || !cma->prepared || !cma->scratch)
 		goto no_mem;
 
 	ret = cma_activate_area(base_pfn, count);
 	if (ret)
-		goto error;
+		goto no_mem;
+
+	cma_areas[cma_area_count++] = cma;
 
 	pr_debug("%s: returned %p\n", __func__, (void *)cma);
 	return cma;
 
-error:
-	kfree(cma->bitmap);
 no_mem:
+	kfree(cma->scratch);
+	kfree(cma->prepared);
+	kfree(cma->bitmap);
 	kfree(cma);
 	return ERR_PTR(ret);
 }
@@ -300,6 +331,95 @@ err:
 	return base;
 }
 
+/*
+ * Allocation statistics, protected by cma_mutex.  Latency is bucketed by
+ * log2 of microseconds, migrated pages by log2 of the page count.
+ */
+#define CMA_LATENCY_BUCKETS	20
+#define CMA_MIGRATED_BUCKETS	16
+
+static struct cma_stats {
+	unsigned long	allocs;
+	unsigned long	failures;
+	unsigned long	busy;
+	unsigned long	from_prepared;
+	unsigned long	migrated;
+	unsigned long	prepare_migrated;
+	unsigned long	latency_hist[CMA_LATENCY_BUCKETS];
+	unsigned long	migrated_hist[CMA_MIGRATED_BUCKETS];
+} cma_stats;
+
+static unsigned int cma_hist_bucket(u64 val, unsigned int nr_buckets)
+{
+	return val ? min_t(unsigned int, ilog2(val) + 1, nr_buckets - 1) : 0;
+}
+
+static unsigned int cma_prepare_percent = CONFIG_CMA_PREPARE_PERCENT;
+
+static void cma_wake_migrator(void);
+
+/*
+ * Take pages [pageno, pageno + count) of @cma for the caller.  Pages the
+ * background migrator already prepared are handed over as they are, the
+ * others are taken from the page allocator, migrating whatever occupies
+ * them.  Must be called with cma_mutex held.
+ */
+static int cma_claim_range(struct cma *cma, unsigned long pageno, int count,
+			   unsigned long *nr_migrated,
+			   unsigned long *nr_prepared)
+{
+	unsigned long end = pageno + count;
+	unsigned long run, run_end, taken = 0;
+	int ret;
+
+	for (run = find_next_zero_bit(cma->prepared, end, pageno); run < end;
+	     run = find_next_zero_bit(cma->prepared, end, run_end)) {
+		run_end = find_next_bit(cma->prepared, end, run);
+		ret = alloc_contig_range(cma->base_pfn + run,
+					 cma->base_pfn + run_end, MIGRATE_CMA,
+					 nr_migrated);
+		if (ret)
+			goto undo;
+		taken += run_end - run;
+	}
+
+	*nr_prepared = count - taken;
+	cma->nr_prepared -= *nr_prepared;
+	bitmap_clear(cma->prepared, pageno, count);
+	return 0;
+
+undo:
+	/* Give back what this request took before the failing run */
+	end = run;
+	for (run = find_next_zero_bit(cma->prepared, end, pageno); run < end;
+	     run = find_next_zero_bit(cma->prepared, end, run_end)) {
+		run_end = find_next_bit(cma->prepared, end, run);
+		free_contig_range(cma->base_pfn + run, run_end - run);
+	}
+	return ret;
+}
+
+/* Find a free range made only of prepared pages.  cma_mutex held. */
+static unsigned long cma_find_prepared(struct cma *cma, int count,
+				       unsigned long mask)
+{
+	if (cma->nr_prepared < count)
+		return cma->count;
+
+	bitmap_complement(cma->scratch, cma->prepared, cma->count);
+	bitmap_or(cma->scratch, cma->scratch, cma->bitmap, cma->count);
+	return bitmap_find_next_zero_area(cma->scratch, cma->count, 0, count,
+					  mask);
+}
+
+/*
+ * Busy pages are usually only pinned for a short while (under I/O or by
+ * get_user_pages()), so when every candidate range was busy wait a bit
+ * and go around the area again before failing the allocation.
+ */
+#define CMA_BUSY_RETRIES	2
+#define CMA_BUSY_RETRY_MS	10
+
 /**
  * dma_alloc_from_contiguous() - allocate pages from contiguous area
  * @dev:   Pointer to device for which the allocation is performed.
@@ -314,8 +434,14 @@ err:
 struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 				       unsigned int align)
 {
-	unsigned long mask, pfn, pageno, start = 0;
+	unsigned long mask, pfn = 0, pageno, start = 0;
+	unsigned long nr_migrated = 0, nr_prepared = 0;
+	unsigned int nr_busy = 0, retries = 0;
+	bool busy = false;
 	struct cma *cma = dev_get_cma_area(dev);
+	struct page *page = NULL;
+	ktime_t begin;
+	s64 latency;
 	int ret;
 
 	if (!cma || !cma->count)
@@ -331,38 +457,71 @@ struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 		return NULL;
 
 	mask = (1 << align) - 1;
+	begin = ktime_get();
 
 	mutex_lock(&cma_mutex);
 
+	/* A range the migrator already emptied needs no migration at all */
+	pageno = cma_find_prepared(cma, count, mask);
+
 	for (;;) {
-		pageno = bitmap_find_next_zero_area(cma->bitmap, cma->count,
-						    start, count, mask);
+		if (pageno >= cma->count)
+			pageno = bitmap_find_next_zero_area(cma->bitmap,
+							    cma->count, start,
+							    count, mask);
 		if (pageno >= cma->count) {
-			ret = -ENOMEM;
-			goto error;
+			if (!busy || retries++ == CMA_BUSY_RETRIES) {
+				ret = -ENOMEM;
+				break;
+			}
+			mutex_unlock(&cma_mutex);
+			msleep(CMA_BUSY_RETRY_MS);
+			mutex_lock(&cma_mutex);
+			busy = false;
+			start = 0;
+			continue;
 		}
 
 		pfn = cma->base_pfn + pageno;
-		ret = alloc_contig_range(pfn, pfn + count, MIGRATE_CMA);
+		ret = cma_claim_range(cma, pageno, count, &nr_migrated,
+				      &nr_prepared);
 		if (ret == 0) {
 			bitmap_set(cma->bitmap, pageno, count);
+			page = pfn_to_page(pfn);
 			break;
 		} else if (ret != -EBUSY) {
-			goto error;
+			break;
 		}
 		pr_debug("%s(): memory range at %p is busy, retrying\n",
 			 __func__, pfn_to_page(pfn));
+		nr_busy++;
+		busy = true;
 		/* try again with a bit different memory target */
 		start = pageno + mask + 1;
+		pageno = cma->count;
 	}
 
-	mutex_unlock(&cma_mutex);
+	latency = ktime_us_delta(ktime_get(), begin);
+	cma_stats.allocs++;
+	cma_stats.busy += nr_busy;
+	cma_stats.migrated += nr_migrated;
+	if (!page)
+		cma_stats.failures++;
+	else if (nr_prepared == count)
+		cma_stats.from_prepared++;
+	cma_stats.latency_hist[cma_hist_bucket(latency,
+					       CMA_LATENCY_BUCKETS)]++;
+	cma_stats.migrated_hist[cma_hist_bucket(nr_migrated,
+						CMA_MIGRATED_BUCKETS)]++;
 
-	pr_debug("%s(): returned %p\n", __func__, pfn_to_page(pfn));
-	return pfn_to_page(pfn);
-error:
 	mutex_unlock(&cma_mutex);
-	return NULL;
+
+	trace_cma_alloc(page ? pfn : 0, count, align, nr_migrated, nr_prepared,
+			nr_busy, latency);
+	cma_wake_migrator();
+
+	pr_debug("%s(): returned %p (%d)\n", __func__, page, ret);
+	return page;
 }
 
 /**
@@ -379,7 +538,7 @@ bool dma_release_from_contiguous(struct device *dev, struct page *pages,
 				 int count)
 {
 	struct cma *cma = dev_get_cma_area(dev);
-	unsigned long pfn;
+	unsigned long pfn, target, keep = 0;
 
 	if (!cma || !pages)
 		return false;
@@ -395,8 +554,284 @@ bool dma_release_from_contiguous(struct device *dev, struct page *pages,
 
 	mutex_lock(&cma_mutex);
 	bitmap_clear(cma->bitmap, pfn - cma->base_pfn, count);
-	free_contig_range(pfn, count);
+	/* Keep what the migrator would otherwise have to prepare again */
+	target = cma->count * ACCESS_ONCE(cma_prepare_percent) / 100;
+	if (cma->nr_prepared < target)
+		keep = min_t(unsigned long, count, target - cma->nr_prepared);
+	bitmap_set(cma->prepared, pfn - cma->base_pfn, keep);
+	cma->nr_prepared += keep;
+	free_contig_range(pfn + keep, count - keep);
 	mutex_unlock(&cma_mutex);
 
+	trace_cma_release(pfn, count);
+	cma_wake_migrator();
+
 	return true;
 }
+
+/*
+ * Background migrator
+ *
+ * Allocating from a CMA area full of page cache means migrating every
+ * page of the range first, which takes tens of milliseconds for a camera
+ * or display buffer.  To avoid that, a kernel thread keeps
+ * prepare_percent percent of each area taken out of the page allocator
+ * in advance, in chunks of the maximum CMA alignment, so that most
+ * allocations are served without migrating anything.
+ *
+ * Prepared pages are given back when reclaim asks for movable memory,
+ * and the thread backs off while the zone is below its high watermark.
+ */
+#define CMA_PREPARE_CHUNK	(1UL << CONFIG_CMA_ALIGNMENT)
+#define CMA_PREPARE_RETRY	(5 * HZ)
+
+static struct task_struct *cma_prepare_task;
+static DECLARE_WAIT_QUEUE_HEAD(cma_prepare_wait);
+static bool cma_prepare_pending;
+
+static void cma_wake_migrator(void)
+{
+	if (!cma_prepare_task || !ACCESS_ONCE(cma_prepare_percent))
+		return;
+
+	cma_prepare_pending = true;
+	wake_up_interruptible(&cma_prepare_wait);
+}
+
+static int cma_prepare_percent_set(const char *val,
+				   const struct kernel_param *kp)
+{
+	unsigned int percent;
+	int ret;
+
+	ret = kstrtouint(val, 0, &percent);
+	if (ret)
+		return ret;
+	if (percent > 100)
+		return -EINVAL;
+
+	cma_prepare_percent = percent;
+	if (cma_prepare_task) {
+		/* Also wakes it up to give pages back when lowered */
+		cma_prepare_pending = true;
+		wake_up_interruptible(&cma_prepare_wait);
+	}
+	return 0;
+}
+
+static struct kernel_param_ops cma_prepare_percent_ops = {
+	.set = cma_prepare_percent_set,
+	.get = param_get_uint,
+};
+module_param_cb(prepare_percent, &cma_prepare_percent_ops,
+		&cma_prepare_percent, 0644);
+MODULE_PARM_DESC(prepare_percent, "percentage of each CMA area kept free of "
+		 "movable pages in the background");
+
+/* Give up to @nr prepared pages of @cma back.  cma_mutex held. */
+static unsigned long cma_unprepare(struct cma *cma, unsigned long nr)
+{
+	unsigned long run, run_end, freed = 0;
+
+	for (run = find_first_bit(cma->prepared, cma->count);
+	     run < cma->count && freed < nr;
+	     run = find_next_bit(cma->prepared, cma->count, run_end)) {
+		run_end = find_next_zero_bit(cma->prepared, cma->count, run);
+		run_end = min(run_end, run + nr - freed);
+		bitmap_clear(cma->prepared, run, run_end - run);
+		free_contig_range(cma->base_pfn + run, run_end - run);
+		trace_cma_unprepare(cma->base_pfn + run, run_end - run);
+		freed += run_end - run;
+	}
+
+	cma->nr_prepared -= freed;
+	return freed;
+}
+
+/*
+ * Prepare one more chunk of @cma.  Returns 1 if the area needs more, 0
+ * if it reached its target or has no room left, and a negative error if
+ * it should be retried later.
+ */
+static int cma_prepare_chunk(struct cma *cma)
+{
+	struct zone *zone = page_zone(pfn_to_page(cma->base_pfn));
+	unsigned long target, pageno, nr, nr_migrated = 0;
+	int ret;
+
+	mutex_lock(&cma_mutex);
+
+	target = cma->count * ACCESS_ONCE(cma_prepare_percent) / 100;
+	if (cma->nr_prepared >= target) {
+		cma_unprepare(cma, cma->nr_prepared - target);
+		ret = 0;
+		goto out;
+	}
+
+	nr = min(target - cma->nr_prepared, CMA_PREPARE_CHUNK);
+	if (!zone_watermark_ok(zone, 0, high_wmark_pages(zone) + nr, 0, 0)) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	bitmap_or(cma->scratch, cma->bitmap, cma->prepared, cma->count);
+	pageno = bitmap_find_next_zero_area(cma->scratch, cma->count,
+					    cma->prepare_next, nr,
+					    CMA_PREPARE_CHUNK - 1);
+	if (pageno >= cma->count) {
+		/* Chunks past the cursor were busy, start over next time */
+		ret = cma->prepare_next ? -EBUSY : 0;
+		cma->prepare_next = 0;
+		goto out;
+	}
+
+	ret = alloc_contig_range(cma->base_pfn + pageno,
+				 cma->base_pfn + pageno + nr, MIGRATE_CMA,
+				 &nr_migrated);
+	trace_cma_prepare(cma->base_pfn + pageno, nr, nr_migrated, ret);
+	cma_stats.prepare_migrated += nr_migrated;
+	if (ret) {
+		cma->prepare_next = pageno + CMA_PREPARE_CHUNK;
+		ret = ret == -EBUSY ? 1 : ret;
+		goto out;
+	}
+
+	bitmap_set(cma->prepared, pageno, nr);
+	cma->nr_prepared += nr;
+	ret = cma->nr_prepared < target;
+out:
+	mutex_unlock(&cma_mutex);
+	return ret;
+}
+
+static int cma_prepare_thread(void *unused)
+{
+	/*
+	 * The thread migrates with cma_mutex held, which allocations wait
+	 * for: it runs at normal priority, so that a busy CPU can't keep
+	 * an allocation waiting behind it.
+	 */
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		long timeout = MAX_SCHEDULE_TIMEOUT;
+		unsigned i;
+		int ret;
+
+		cma_prepare_pending = false;
+
+		for (i = 0; i < cma_area_count; i++) {
+			do {
+				ret = cma_prepare_chunk(cma_areas[i]);
+				cond_resched();
+			} while (ret > 0 && !kthread_should_stop() &&
+				 !freezing(current));
+			if (ret < 0)
+				timeout = CMA_PREPARE_RETRY;
+		}
+
+		wait_event_freezable_timeout(cma_prepare_wait,
+					     cma_prepare_pending ||
+					     kthread_should_stop(), timeout);
+	}
+	return 0;
+}
+
+static int cma_prepare_shrink(struct shrinker *shrink,
+			      struct shrink_control *sc)
+{
+	unsigned long nr = 0;
+	unsigned i;
+
+	/* Prepared pages can only serve movable allocations */
+	if (!(sc->gfp_mask & __GFP_MOVABLE))
+		return 0;
+
+	if (sc->nr_to_scan) {
+		unsigned long left = sc->nr_to_scan;
+
+		/* Allocations may reclaim with cma_mutex held */
+		if (!mutex_trylock(&cma_mutex))
+			return -1;
+		for (i = 0; i < cma_area_count && left; i++)
+			left -= cma_unprepare(cma_areas[i], left);
+		mutex_unlock(&cma_mutex);
+	}
+
+	for (i = 0; i < cma_area_count; i++)
+		nr += ACCESS_ONCE(cma_areas[i]->nr_prepared);
+	return min_t(unsigned long, nr, INT_MAX);
+}
+
+static struct shrinker cma_prepare_shrinker = {
+	.shrink = cma_prepare_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int cma_stats_show(struct seq_file *m, void *v)
+{
+	unsigned i;
+
+	mutex_lock(&cma_mutex);
+
+	for (i = 0; i < cma_area_count; i++) {
+		struct cma *cma = cma_areas[i];
+
+		seq_printf(m, "area%u: pfn %lx pages %lu allocated %d "
+			   "prepared %lu\n", i, cma->base_pfn, cma->count,
+			   bitmap_weight(cma->bitmap, cma->count),
+			   cma->nr_prepared);
+	}
+
+	seq_printf(m, "allocs %lu failures %lu busy %lu from_prepared %lu\n",
+		   cma_stats.allocs, cma_stats.failures, cma_stats.busy,
+		   cma_stats.from_prepared);
+	seq_printf(m, "migrated %lu prepare_migrated %lu\n",
+		   cma_stats.migrated, cma_stats.prepare_migrated);
+
+	seq_puts(m, "latency us:");
+	for (i = 0; i < CMA_LATENCY_BUCKETS - 1; i++)
+		seq_printf(m, " <%lu:%lu", 1UL << i, cma_stats.latency_hist[i]);
+	seq_printf(m, " >=%lu:%lu\n", 1UL << (i - 1), cma_stats.latency_hist[i]);
+
+	seq_puts(m, "migrated pages:");
+	for (i = 0; i < CMA_MIGRATED_BUCKETS - 1; i++)
+		seq_printf(m, " <%lu:%lu", 1UL << i, cma_stats.migrated_hist[i]);
+	seq_printf(m, " >=%lu:%lu\n", 1UL << (i - 1),
+		   cma_stats.migrated_hist[i]);
+
+	mutex_unlock(&cma_mutex);
+	return 0;
+}
+
+static int cma_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, cma_stats_show, NULL);
+}
+
+static const struct file_operations cma_stats_fops = {
+	.open		= cma_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init cma_prepare_init(void)
+{
+	struct task_struct *task;
+
+	if (!cma_area_count)
+		return 0;
+
+	debugfs_create_file("cma", S_IRUSR, NULL, NULL, &cma_stats_fops);
+
+	task = kthread_run(cma_prepare_thread, NULL, "kcmad");
+	if (IS_ERR(task)) {
+		pr_err("failed to start background migrator\n");
+		return PTR_ERR(task);
+	}
+	cma_prepare_task = task;
+	register_shrinker(&cma_prepare_shrinker);
+	return 0;
+}
+late_initcall(cma_prepare_init);
@@ -21,6 +21,15 @@
 #include <linux/firmware.h>
 #include <linux/slab.h>
 #include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/initrd.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/kref.h>
+#include <linux/suspend.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #define to_dev(obj) container_of(obj, struct device, kobj)
 
@@ -470,9 +479,446 @@ fw_create_instance(struct firmware *firmware, const char *fw_name,
 	return fw_priv;
 }
 
+/* Direct loading from the filesystem */
+
+static char fw_path[256] = CONFIG_FW_LOADER_PATH;
+module_param_string(path, fw_path, sizeof(fw_path), 0644);
+MODULE_PARM_DESC(path, "colon separated list of directories searched for "
+		 "firmware before falling back to the userspace helper");
+
+/* Set between suspend prepare and resume completion, see fw_pm_notify() */
+static bool fw_suspended;
+
+static bool fw_read_file_contents(struct file *file, struct firmware *fw)
+{
+	loff_t size = i_size_read(file->f_path.dentry->d_inode);
+	struct page **pages;
+	int nr_pages, i;
+	loff_t pos;
+
+	if (size <= 0 || size > INT_MAX)
+		return false;
+
+	nr_pages = PFN_UP(size);
+	pages = kcalloc(nr_pages, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return false;
+
+	for (i = 0, pos = 0; i < nr_pages; i++, pos += PAGE_SIZE) {
+		unsigned long len = min_t(loff_t, PAGE_SIZE, size - pos);
+		char *kaddr;
+		int ret;
+
+		pages[i] = alloc_page(GFP_KERNEL | __GFP_HIGHMEM);
+		if (!pages[i])
+			goto err;
+
+		kaddr = kmap(pages[i]);
+		ret = kernel_read(file, pos, kaddr, len);
+		kunmap(pages[i]);
+		if (ret != len)
+			goto err;
+	}
+
+	fw->data = vmap(pages, nr_pages, 0, PAGE_KERNEL_RO);
+	if (!fw->data)
+		goto err;
+	fw->pages = pages;
+	fw->size = size;
+	return true;
+
+err:
+	for (i = 0; i < nr_pages; i++)
+		if (pages[i])
+			__free_page(pages[i]);
+	kfree(pages);
+	return false;
+}
+
+/* Open the first regular file called @name in the search path */
+static struct file *fw_open_filesystem_firmware(const char *name)
+{
+	char *paths, *next, *dir, *path;
+	struct file *found = NULL;
+
+	if (fw_suspended)
+		return NULL;
+
+	/* The image may be part of an initramfs still being unpacked */
+	wait_for_initramfs();
+
+	kparam_block_sysfs_write(path);
+	paths = kstrdup(fw_path, GFP_KERNEL);
+	kparam_unblock_sysfs_write(path);
+	if (!paths)
+		return NULL;
+
+	path = __getname();
+	if (!path)
+		goto out;
+
+	next = paths;
+	while (!found && (dir = strsep(&next, ":")) != NULL) {
+		struct file *file;
+
+		if (!*dir)
+			continue;
+		if (snprintf(path, PATH_MAX, "%s/%s", dir, name) >= PATH_MAX)
+			continue;
+
+		file = filp_open(path, O_RDONLY, 0);
+		if (IS_ERR(file))
+			continue;
+		if (S_ISREG(file->f_path.dentry->d_inode->i_mode))
+			found = file;
+		else
+			fput(file);
+	}
+
+	__putname(path);
+out:
+	kfree(paths);
+	return found;
+}
+
+/* Read @name from the search path; @mtime, if set, gets the file's mtime */
+static bool fw_get_filesystem_firmware(struct firmware *fw, const char *name,
+				       struct timespec *mtime)
+{
+	struct file *file;
+	bool found;
+
+	file = fw_open_filesystem_firmware(name);
+	if (!file)
+		return false;
+
+	found = fw_read_file_contents(file, fw);
+	if (mtime)
+		*mtime = file->f_path.dentry->d_inode->i_mtime;
+	fput(file);
+
+	return found;
+}
+
+/* Per image statistics and the suspend cache */
+
+enum fw_source {
+	FW_SRC_BUILTIN,
+	FW_SRC_CACHE,
+	FW_SRC_FS,
+	FW_SRC_USERHELPER,
+};
+
+static const char * const fw_source_names[] = {
+	[FW_SRC_BUILTIN]	= "builtin",
+	[FW_SRC_CACHE]		= "cache",
+	[FW_SRC_FS]		= "fs",
+	[FW_SRC_USERHELPER]	= "helper",
+};
+
+/* A cached image, shared by every struct firmware handed out from it */
+struct fw_cache_buf {
+	struct kref ref;
+	struct timespec mtime;	/* of the file it was read from */
+	struct firmware fw;
+};
+
+struct fw_image {
+	struct list_head list;
+	struct fw_cache_buf *cached;
+	enum fw_source last_source;
+	size_t size;
+	unsigned int loads;
+	unsigned int failures;
+	s64 last_us;
+	s64 max_us;
+	s64 total_us;
+	char name[];
+};
+
+static LIST_HEAD(fw_images);
+static DEFINE_MUTEX(fw_cache_lock);
+
+static struct fw_image *fw_lookup_image(const char *name)
+{
+	struct fw_image *img;
+
+	list_for_each_entry(img, &fw_images, list)
+		if (!strcmp(img->name, name))
+			return img;
+	return NULL;
+}
+
+static void fw_cache_buf_release(struct kref *ref)
+{
+	struct fw_cache_buf *buf = container_of(ref, struct fw_cache_buf, ref);
+
+	firmware_free_data(&buf->fw);
+	kfree(buf);
+}
+
+/* Whether the file a cached image was read from is gone or has changed */
+static bool fw_cache_buf_stale(struct fw_cache_buf *buf, const char *name)
+{
+	struct inode *inode;
+	struct file *file;
+	bool stale;
+
+	file = fw_open_filesystem_firmware(name);
+	if (!file)
+		return true;
+
+	inode = file->f_path.dentry->d_inode;
+	stale = i_size_read(inode) != buf->fw.size ||
+		!timespec_equal(&inode->i_mtime, &buf->mtime);
+	fput(file);
+
+	return stale;
+}
+
+static void fw_cache_buf_drop(struct fw_image *img)
+{
+	kref_put(&img->cached->ref, fw_cache_buf_release);
+	img->cached = NULL;
+}
+
+/*
+ * While suspended the cache is used as is.  Otherwise the file is checked
+ * first, which costs a lookup but no read; that is done holding a
+ * reference to the cached image rather than fw_cache_lock, so loads of
+ * other images don't wait behind the filesystem.
+ */
+static bool fw_get_cached_firmware(struct firmware *fw, const char *name)
+{
+	struct fw_cache_buf *buf = NULL;
+	struct fw_image *img;
+
+	mutex_lock(&fw_cache_lock);
+	img = fw_lookup_image(name);
+	if (img && img->cached) {
+		buf = img->cached;
+		kref_get(&buf->ref);
+	}
+	mutex_unlock(&fw_cache_lock);
+
+	if (!buf)
+		return false;
+
+	if (!fw_suspended && fw_cache_buf_stale(buf, name)) {
+		mutex_lock(&fw_cache_lock);
+		if (img->cached == buf)
+			fw_cache_buf_drop(img);
+		mutex_unlock(&fw_cache_lock);
+		kref_put(&buf->ref, fw_cache_buf_release);
+		return false;
+	}
+
+	/* The reference taken above is the one fw->priv holds */
+	fw->size = buf->fw.size;
+	fw->data = buf->fw.data;
+	fw->priv = buf;
+	return true;
+}
+
+static void fw_record_load(const char *name, enum fw_source source,
+			   ktime_t start, const struct firmware *fw, int ret)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	struct fw_image *img;
+
+	mutex_lock(&fw_cache_lock);
+	img = fw_lookup_image(name);
+	if (!img) {
+		img = kzalloc(sizeof(*img) + strlen(name) + 1, GFP_KERNEL);
+		if (!img)
+			goto out;
+		strcpy(img->name, name);
+		list_add_tail(&img->list, &fw_images);
+	}
+
+	img->loads++;
+	img->last_source = source;
+	img->last_us = us;
+	img->max_us = max(img->max_us, us);
+	img->total_us += us;
+	if (ret)
+		img->failures++;
+	else
+		img->size = fw->size;
+out:
+	mutex_unlock(&fw_cache_lock);
+}
+
+#ifdef CONFIG_PM_SLEEP
+/*
+ * Make sure every image loaded so far (other than builtin ones) is in
+ * memory while the filesystems and the userspace helper are still usable,
+ * so that drivers reloading firmware on resume get it without any I/O.
+ * Images stay cached across suspends; only those not cached yet, or whose
+ * file changed, are read.  fw_images entries are never freed, so the list
+ * can be walked with the lock dropped around the file checks and reads.
+ */
+static void fw_cache_populate(void)
+{
+	struct fw_cache_buf *buf, *old;
+	struct fw_image *img;
+	bool stale;
+
+	mutex_lock(&fw_cache_lock);
+	list_for_each_entry(img, &fw_images, list) {
+		if (!img->size || img->last_source == FW_SRC_BUILTIN)
+			continue;
+		old = img->cached;
+		if (old)
+			kref_get(&old->ref);
+		mutex_unlock(&fw_cache_lock);
+
+		stale = !old || fw_cache_buf_stale(old, img->name);
+		if (old)
+			kref_put(&old->ref, fw_cache_buf_release);
+
+		buf = stale ? kzalloc(sizeof(*buf), GFP_KERNEL) : NULL;
+		if (buf) {
+			kref_init(&buf->ref);
+			if (!fw_get_filesystem_firmware(&buf->fw, img->name,
+							&buf->mtime)) {
+				pr_debug("firmware: %s not cached\n",
+					 img->name);
+				kfree(buf);
+				buf = NULL;
+			}
+		}
+
+		mutex_lock(&fw_cache_lock);
+		if (!stale)
+			continue;
+		if (img->cached)
+			fw_cache_buf_drop(img);
+		img->cached = buf;
+	}
+	mutex_unlock(&fw_cache_lock);
+}
+
+static unsigned long fw_cache_drop(void)
+{
+	struct fw_image *img;
+	unsigned long pages = 0;
+
+	list_for_each_entry(img, &fw_images, list) {
+		if (img->cached) {
+			pages += PFN_UP(img->cached->fw.size);
+			fw_cache_buf_drop(img);
+		}
+	}
+
+	return pages;
+}
+
+/* Under memory pressure the cache goes, to be read again at next suspend */
+static int fw_cache_shrink(struct shrinker *shrink, struct shrink_control *sc)
+{
+	struct fw_image *img;
+	int pages = 0;
+
+	if (fw_suspended || !mutex_trylock(&fw_cache_lock))
+		return sc->nr_to_scan ? -1 : 0;
+
+	if (sc->nr_to_scan)
+		fw_cache_drop();
+	else
+		list_for_each_entry(img, &fw_images, list)
+			if (img->cached)
+				pages += PFN_UP(img->cached->fw.size);
+	mutex_unlock(&fw_cache_lock);
+
+	return pages;
+}
+
+static struct shrinker fw_cache_shrinker = {
+	.shrink = fw_cache_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int fw_pm_notify(struct notifier_block *nb, unsigned long action,
+			void *unused)
+{
+	switch (action) {
+	case PM_HIBERNATION_PREPARE:
+	case PM_SUSPEND_PREPARE:
+	case PM_RESTORE_PREPARE:
+		fw_cache_populate();
+		fw_suspended = true;
+		break;
+	case PM_POST_HIBERNATION:
+	case PM_POST_SUSPEND:
+	case PM_POST_RESTORE:
+		fw_suspended = false;
+		break;
+	}
+
+	return 0;
+}
+
+static struct notifier_block fw_pm_nb = {
+	.notifier_call = fw_pm_notify,
+};
+
+static void fw_cache_init(void)
+{
+	register_shrinker(&fw_cache_shrinker);
+	register_pm_notifier(&fw_pm_nb);
+}
+
+static void fw_cache_exit(void)
+{
+	unregister_pm_notifier(&fw_pm_nb);
+	unregister_shrinker(&fw_cache_shrinker);
+	mutex_lock(&fw_cache_lock);
+	fw_cache_drop();
+	mutex_unlock(&fw_cache_lock);
+}
+#else
+static inline void fw_cache_init(void) { }
+static inline void fw_cache_exit(void) { }
+#endif
+
+static int fw_stats_show(struct seq_file *m, void *v)
+{
+	struct fw_image *img;
+
+	seq_puts(m, "# loads fails src      size     last_us  max_us   avg_us   cached name\n");
+
+	mutex_lock(&fw_cache_lock);
+	list_for_each_entry(img, &fw_images, list)
+		seq_printf(m, "%7u %5u %-7s %8zu %8lld %8lld %8lld %-6s %s\n",
+			   img->loads, img->failures,
+			   fw_source_names[img->last_source], img->size,
+			   img->last_us, img->max_us,
+			   div_s64(img->total_us, img->loads),
+			   img->cached ? "yes" : "no", img->name);
+	mutex_unlock(&fw_cache_lock);
+
+	return 0;
+}
+
+static int fw_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fw_stats_show, NULL);
+}
+
+static const struct file_operations fw_stats_fops = {
+	.open		= fw_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static struct dentry *fw_stats_dentry;
+
 static struct firmware_priv *
 _request_firmware_prepare(const struct firmware **firmware_p, const char *name,
-			  struct device *device, bool uevent, bool nowait)
+			  struct device *device, bool uevent, bool nowait,
+			  enum fw_source *source)
 {
 	struct firmware *firmware;
 	struct firmware_priv *fw_priv;
@@ -489,9 +935,24 @@ _request_firmware_prepare(const struct firmware **firmware_p, const char *name,
 
 	if (fw_get_builtin_firmware(firmware, name)) {
 		dev_dbg(device, "firmware: using built-in firmware %s\n", name);
+		*source = FW_SRC_BUILTIN;
+		return NULL;
+	}
+
+	if (fw_get_cached_firmware(firmware, name)) {
+		dev_dbg(device, "firmware: using cached firmware %s\n", name);
+		*source = FW_SRC_CACHE;
+		return NULL;
+	}
+
+	if (fw_get_filesystem_firmware(firmware, name, NULL)) {
+		dev_dbg(device, "firmware: direct-loading firmware %s\n", name);
+		*source = FW_SRC_FS;
 		return NULL;
 	}
 
+	*source = FW_SRC_USERHELPER;
+
 	fw_priv = fw_create_instance(firmware, name, device, uevent, nowait);
 	if (IS_ERR(fw_priv)) {
 		release_firmware(firmware);
@@ -586,12 +1047,16 @@ request_firmware(const struct firmware **firmware_p, const char *name,
                  struct device *device)
 {
 	struct firmware_priv *fw_priv;
+	enum fw_source source;
+	ktime_t start = ktime_get();
 	int ret;
 
 	fw_priv = _request_firmware_prepare(firmware_p, name, device, true,
-					    false);
-	if (IS_ERR_OR_NULL(fw_priv))
-		return PTR_RET(fw_priv);
+					    false, &source);
+	if (IS_ERR_OR_NULL(fw_priv)) {
+		ret = PTR_RET(fw_priv);
+		goto out;
+	}
 
 	ret = usermodehelper_read_trylock();
 	if (WARN_ON(ret)) {
@@ -603,7 +1068,9 @@ request_firmware(const struct firmware **firmware_p, const char *name,
 	}
 	if (ret)
 		_request_firmware_cleanup(firmware_p);
-
+out:
+	if (!IS_ERR(fw_priv))
+		fw_record_load(name, source, start, *firmware_p, ret);
 	return ret;
 }
 
@@ -614,7 +1081,10 @@ request_firmware(const struct firmware **firmware_p, const char *name,
 void release_firmware(const struct firmware *fw)
 {
 	if (fw) {
-		if (!fw_is_builtin_firmware(fw))
+		if (fw->priv)
+			kref_put(&((struct fw_cache_buf *)fw->priv)->ref,
+				 fw_cache_buf_release);
+		else if (!fw_is_builtin_firmware(fw))
 			firmware_free_data(fw);
 		kfree(fw);
 	}
@@ -636,12 +1106,14 @@ static void request_firmware_work_func(struct work_struct *work)
 	struct firmware_work *fw_work;
 	const struct firmware *fw;
 	struct firmware_priv *fw_priv;
+	enum fw_source source;
+	ktime_t start = ktime_get();
 	long timeout;
 	int ret;
 
 	fw_work = container_of(work, struct firmware_work, work);
 	fw_priv = _request_firmware_prepare(&fw, fw_work->name, fw_work->device,
-			fw_work->uevent, true);
+			fw_work->uevent, true, &source);
 	if (IS_ERR_OR_NULL(fw_priv)) {
 		ret = PTR_RET(fw_priv);
 		goto out;
@@ -660,6 +1132,8 @@ static void request_firmware_work_func(struct work_struct *work)
 		_request_firmware_cleanup(&fw);
 
  out:
+	if (!IS_ERR(fw_priv))
+		fw_record_load(fw_work->name, source, start, fw, ret);
 	fw_work->cont(fw, fw_work->context);
 
 	module_put(fw_work->module);
@@ -714,11 +1188,20 @@ request_firmware_nowait(
 
 static int __init firmware_class_init(void)
 {
+	fw_cache_init();
+	fw_stats_dentry = debugfs_create_file("firmware_stats", S_IRUSR, NULL,
+					      NULL, &fw_stats_fops);
 	return class_register(&firmware_class);
 }
 
 static void __exit firmware_class_exit(void)
 {
+	struct fw_image *img, *tmp;
+
+	debugfs_remove(fw_stats_dentry);
+	fw_cache_exit();
+	list_for_each_entry_safe(img, tmp, &fw_images, list)
+		kfree(img);
 	class_unregister(&firmware_class);
 }
 
@@ -104,10 +104,13 @@ static u64 boostpulse_endtime;
 
 /*
  * Max additional time to wait in idle, beyond timer_rate, at speeds above
- * minimum before wakeup to reduce speed, or -1 if unnecessary.
+ * minimum before wakeup to reduce speed, or -1 if unnecessary. The slack
+ * timer is armed at timer_rate and attached to this domain, which lets it
+ * expire anywhere up to slack later, where it coalesces with other timers.
  */
 #define DEFAULT_TIMER_SLACK (4 * DEFAULT_TIMER_RATE)
-static int timer_slack_val = DEFAULT_TIMER_SLACK;
+static DEFINE_TIMER_SLACK_DOMAIN(timer_slack, "cpufreq_interactive",
+				 DEFAULT_TIMER_SLACK);
 
 static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		unsigned int event);
@@ -127,6 +130,7 @@ static void cpufreq_interactive_timer_resched(
 {
 	unsigned long expires;
 	unsigned long flags;
+	int slack_us = ACCESS_ONCE(timer_slack.slack_us);
 
 	spin_lock_irqsave(&pcpu->load_lock, flags);
 	pcpu->time_in_idle =
@@ -137,10 +141,9 @@ static void cpufreq_interactive_timer_resched(
 	expires = jiffies + usecs_to_jiffies(timer_rate);
 	mod_timer_pinned(&pcpu->cpu_timer, expires);
 
-	if (timer_slack_val >= 0 && pcpu->target_freq > pcpu->policy->min) {
-		expires += usecs_to_jiffies(timer_slack_val);
+	/* The slack itself is added by the timer's slack domain */
+	if (slack_us >= 0 && pcpu->target_freq > pcpu->policy->min)
 		mod_timer_pinned(&pcpu->cpu_slack_timer, expires);
-	}
 
 	spin_unlock_irqrestore(&pcpu->load_lock, flags);
 }
@@ -776,7 +779,7 @@ static struct global_attr timer_rate_attr = __ATTR(timer_rate, 0644,
 static ssize_t show_timer_slack(
 	struct kobject *kobj, struct attribute *attr, char *buf)
 {
-	return sprintf(buf, "%d\n", timer_slack_val);
+	return sprintf(buf, "%d\n", timer_slack.slack_us);
 }
 
 static ssize_t store_timer_slack(
@@ -790,11 +793,12 @@ static ssize_t store_timer_slack(
 	if (ret < 0)
 		return ret;
 
-	timer_slack_val = val;
+	ACCESS_ONCE(timer_slack.slack_us) = val;
 	return count;
 }
 
-define_one_global_rw(timer_slack);
+static struct global_attr timer_slack_attr = __ATTR(timer_slack, 0644,
+		show_timer_slack, store_timer_slack);
 
 static ssize_t show_boost(struct kobject *kobj, struct attribute *attr,
 			  char *buf)
@@ -875,7 +879,7 @@ static struct attribute *interactive_attributes[] = {
 	&above_hispeed_delay.attr,
 	&min_sample_time_attr.attr,
 	&timer_rate_attr.attr,
-	&timer_slack.attr,
+	&timer_slack_attr.attr,
 	&boost.attr,
 	&boostpulse.attr,
 	&boostpulse_duration.attr,
@@ -914,6 +918,7 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 	unsigned int j;
 	struct cpufreq_interactive_cpuinfo *pcpu;
 	struct cpufreq_frequency_table *freq_table;
+	int slack_us;
 
 	switch (event) {
 	case CPUFREQ_GOV_START:
@@ -943,8 +948,9 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 			expires = jiffies + usecs_to_jiffies(timer_rate);
 			pcpu->cpu_timer.expires = expires;
 			add_timer_on(&pcpu->cpu_timer, j);
-			if (timer_slack_val >= 0) {
-				expires += usecs_to_jiffies(timer_slack_val);
+			slack_us = ACCESS_ONCE(timer_slack.slack_us);
+			if (slack_us >= 0) {
+				expires += usecs_to_jiffies(slack_us);
 				pcpu->cpu_slack_timer.expires = expires;
 				add_timer_on(&pcpu->cpu_slack_timer, j);
 			}
@@ -1029,6 +1035,7 @@ static int __init cpufreq_interactive_init(void)
 		pcpu->cpu_timer.data = i;
 		init_timer(&pcpu->cpu_slack_timer);
 		pcpu->cpu_slack_timer.function = cpufreq_interactive_nop_timer;
+		set_timer_slack_domain(&pcpu->cpu_slack_timer, &timer_slack);
 		spin_lock_init(&pcpu->load_lock);
 		init_rwsem(&pcpu->enable_sem);
 	}
@@ -1048,6 +1055,8 @@ static int __init cpufreq_interactive_init(void)
 	/* NB: wake up so the thread does not look hung to the freezer */
 	wake_up_process(speedchange_task);
 
+	register_timer_slack_domain(&timer_slack);
+
 	return cpufreq_register_governor(&cpufreq_gov_interactive);
 }
 
@@ -1060,6 +1069,7 @@ module_init(cpufreq_interactive_init);
 static void __exit cpufreq_interactive_exit(void)
 {
 	cpufreq_unregister_governor(&cpufreq_gov_interactive);
+	unregister_timer_slack_domain(&timer_slack);
 	kthread_stop(speedchange_task);
 	put_task_struct(speedchange_task);
 }
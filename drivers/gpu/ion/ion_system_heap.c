@@ -36,17 +36,15 @@ static int ion_system_heap_allocate(struct ion_heap *heap,
 	if (!page_list)
 		return -ENOMEM;
 
-	for (i = 0; i < n_pages; i++) {
-		page_list[i] = alloc_page(gfp_mask);
-		if (page_list[i] == NULL)
-			goto out;
-	}
+	i = alloc_pages_bulk(gfp_mask, n_pages, page_list);
+	if (i < n_pages)
+		goto out;
 
 	buffer->priv_virt = page_list;
 	return 0;
 
 out:
-	/* failed on i, so go to i-1 */
+	/* got i pages, so free 0 to i-1 */
 	for (i -= 1; i >= 0; i--)
 		__free_page(page_list[i]);
 
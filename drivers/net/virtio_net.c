@@ -117,6 +117,23 @@ static void give_pages(struct virtnet_info *vi, struct page *page)
 	vi->pages = page;
 }
 
+/*
+ * Refill the empty page list with enough pages for a big packet in one
+ * call into the page allocator instead of one alloc_page() per page.
+ * Mergeable buffers take a single page each and don't use this.
+ */
+static void alloc_pages_to_list(struct virtnet_info *vi, gfp_t gfp_mask)
+{
+	struct page *pages[MAX_SKB_FRAGS + 2];
+	unsigned long i, nr;
+
+	nr = alloc_pages_bulk(gfp_mask, ARRAY_SIZE(pages), pages);
+	for (i = 0; i < nr; i++) {
+		pages[i]->private = (unsigned long)vi->pages;
+		vi->pages = pages[i];
+	}
+}
+
 static struct page *get_a_page(struct virtnet_info *vi, gfp_t gfp_mask)
 {
 	struct page *p = vi->pages;
@@ -383,6 +400,9 @@ static int add_recvbuf_big(struct virtnet_info *vi, gfp_t gfp)
 	char *p;
 	int i, err, offset;
 
+	if (!vi->pages)
+		alloc_pages_to_list(vi, gfp);
+
 	/* page in vi->rx_sg[MAX_SKB_FRAGS + 1] is list tail */
 	for (i = MAX_SKB_FRAGS + 1; i > 1; --i) {
 		first = get_a_page(vi, gfp);
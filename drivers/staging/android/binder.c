@@ -608,6 +608,19 @@ static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 	return NULL;
 }
 
+static void binder_free_unmapped_pages(struct binder_proc *proc,
+				       void *start, void *end)
+{
+	void *page_addr;
+	struct page **page;
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		__free_page(*page);
+		*page = NULL;
+	}
+}
+
 static int binder_update_page_range(struct binder_proc *proc, int allocate,
 				    void *start, void *end,
 				    struct vm_area_struct *vma)
@@ -617,6 +630,7 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	struct vm_struct tmp_area;
 	struct page **page;
 	struct mm_struct *mm;
+	unsigned long nr_pages, nr_alloced;
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: %s pages %p-%p\n", proc->pid,
@@ -649,18 +663,27 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		goto err_no_vma;
 	}
 
+	/* Allocate the whole range in one go, then map it page by page */
+	nr_pages = (end - start) / PAGE_SIZE;
+	page = &proc->pages[(start - proc->buffer) / PAGE_SIZE];
+	for (nr_alloced = 0; nr_alloced < nr_pages; nr_alloced++)
+		BUG_ON(page[nr_alloced]);
+	nr_alloced = alloc_pages_bulk(GFP_KERNEL | __GFP_HIGHMEM | __GFP_ZERO,
+				      nr_pages, page);
+	if (nr_alloced < nr_pages) {
+		printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
+		       "for page at %p\n", proc->pid,
+		       start + nr_alloced * PAGE_SIZE);
+		binder_free_unmapped_pages(proc, start,
+					   start + nr_alloced * PAGE_SIZE);
+		goto err_no_vma;
+	}
+
 	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
 		int ret;
 		struct page **page_array_ptr;
 		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
 
-		BUG_ON(*page);
-		*page = alloc_page(GFP_KERNEL | __GFP_HIGHMEM | __GFP_ZERO);
-		if (*page == NULL) {
-			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
-			       "for page at %p\n", proc->pid, page_addr);
-			goto err_alloc_page_failed;
-		}
 		tmp_area.addr = page_addr;
 		tmp_area.size = PAGE_SIZE + PAGE_SIZE /* guard page? */;
 		page_array_ptr = page;
@@ -669,6 +692,8 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
 			       "to map page at %p in kernel\n",
 			       proc->pid, page_addr);
+			binder_free_unmapped_pages(proc, page_addr + PAGE_SIZE,
+						   end);
 			goto err_map_kernel_failed;
 		}
 		user_page_addr =
@@ -678,6 +703,8 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
 			       "to map page at %lx in userspace\n",
 			       proc->pid, user_page_addr);
+			binder_free_unmapped_pages(proc, page_addr + PAGE_SIZE,
+						   end);
 			goto err_vm_insert_page_failed;
 		}
 		/* vm_insert_page does not seem to increment the refcount */
@@ -700,8 +727,6 @@ err_vm_insert_page_failed:
 err_map_kernel_failed:
 		__free_page(*page);
 		*page = NULL;
-err_alloc_page_failed:
-		;
 	}
 err_no_vma:
 	if (mm) {
@@ -910,6 +910,9 @@ struct ext4_inode_info {
 	 */
 	tid_t i_sync_tid;
 	tid_t i_datasync_tid;
+
+	/* Transaction with changes a fast commit can't record */
+	tid_t i_fc_ineligible_tid;
 };
 
 /*
@@ -953,6 +956,7 @@ struct ext4_inode_info {
 #define EXT4_MOUNT_DIOREAD_NOLOCK	0x400000 /* Enable support for dio read nolocking */
 #define EXT4_MOUNT_JOURNAL_CHECKSUM	0x800000 /* Journal checksums */
 #define EXT4_MOUNT_JOURNAL_ASYNC_COMMIT	0x1000000 /* Journal Async Commit */
+#define EXT4_MOUNT_FAST_COMMIT		0x2000000 /* Fast commits for fsync */
 #define EXT4_MOUNT_MBLK_IO_SUBMIT	0x4000000 /* multi-block io submits */
 #define EXT4_MOUNT_DELALLOC		0x8000000 /* Delalloc support */
 #define EXT4_MOUNT_DATA_ERR_ABORT	0x10000000 /* Abort on file data write */
@@ -1127,6 +1131,10 @@ struct ext4_super_block {
  */
 #define EXT4_MF_MNTDIR_SAMPLED	0x0001
 #define EXT4_MF_FS_ABORTED	0x0002	/* Fatal error detected */
+#define EXT4_MF_FC_INELIGIBLE	0x0004	/* s_fc_ineligible_tid is valid */
+
+/* fsync latency histogram: slot n counts fsyncs under 2^n us */
+#define EXT4_FSYNC_LAT_SLOTS	21
 
 /*
  * fourth extended-fs super-block data in memory
@@ -1211,6 +1219,9 @@ struct ext4_sb_info {
 	spinlock_t s_md_lock;
 	unsigned short *s_mb_offsets;
 	unsigned int *s_mb_maxs;
+	/* groups indexed by order of their largest free extent */
+	struct list_head *s_mb_largest_free_orders;
+	rwlock_t *s_mb_largest_free_orders_locks;
 
 	/* tunables */
 	unsigned long s_stripe;
@@ -1220,6 +1231,7 @@ struct ext4_sb_info {
 	unsigned int s_mb_stats;
 	unsigned int s_mb_order2_reqs;
 	unsigned int s_mb_group_prealloc;
+	unsigned int s_mb_optimize_scan;
 	unsigned int s_max_writeback_mb_bump;
 	/* where last allocation was done - for stream allocation */
 	unsigned long s_mb_last_group;
@@ -1233,6 +1245,8 @@ struct ext4_sb_info {
 	atomic_t s_bal_goals;	/* goal hits */
 	atomic_t s_bal_breaks;	/* too long searches */
 	atomic_t s_bal_2orders;	/* 2^order hits */
+	atomic_t s_bal_groups_scanned;	/* groups looked at */
+	atomic_t s_bal_index_hits;	/* found via largest free order index */
 	spinlock_t s_bal_lock;
 	unsigned long s_mb_buddies_generated;
 	unsigned long long s_mb_generation_time;
@@ -1267,6 +1281,19 @@ struct ext4_sb_info {
 
 	/* record the last minlen when FITRIM is called. */
 	atomic_t s_last_trim_minblks;
+
+	/* Fast commits */
+	tid_t s_fc_ineligible_tid;	/* transaction none can be done for */
+	tid_t s_fc_tid;			/* transaction of the last record */
+	unsigned int s_fc_seq;		/* number of the next record in it */
+
+	/* fsync statistics */
+	atomic_t s_fsync_fast_commits;
+	atomic_t s_fsync_full_commits;
+	atomic_t s_fsync_fc_fallbacks;	/* fast commits that weren't possible */
+	atomic_t s_fsync_flush_only;	/* fdatasyncs that only flushed the cache */
+	atomic_t s_fsync_commits_avoided; /* ... where fsync would have committed */
+	atomic_t s_fsync_lat[EXT4_FSYNC_LAT_SLOTS];	/* log2 buckets, us */
 };
 
 static inline struct ext4_sb_info *EXT4_SB(struct super_block *sb)
@@ -1315,6 +1342,7 @@ enum {
 	EXT4_STATE_DIO_UNWRITTEN,	/* need convert on dio done*/
 	EXT4_STATE_NEWENTRY,		/* File just added to dir */
 	EXT4_STATE_DELALLOC_RESERVED,	/* blks already reserved for delalloc */
+	EXT4_STATE_FC_INELIGIBLE,	/* i_fc_ineligible_tid is valid */
 };
 
 #define EXT4_INODE_BIT_FNS(name, field, offset)				\
@@ -1495,6 +1523,11 @@ static inline void ext4_clear_state_flags(struct ext4_inode_info *ei)
 #define EXT4_DEF_MIN_BATCH_TIME	0
 #define EXT4_DEF_MAX_BATCH_TIME	15000 /* 15ms */
 
+/*
+ * Default size of the journal fast commit area, in blocks
+ */
+#define EXT4_DEF_FC_BLOCKS	256
+
 /*
  * Minimum number of groups in a flexgroup before we separate out
  * directories into the first block group of a flexgroup
@@ -1843,6 +1876,14 @@ extern void ext4_htree_free_dir_info(struct dir_private_info *p);
 /* fsync.c */
 extern int ext4_sync_file(struct file *, loff_t, loff_t, int);
 extern int ext4_flush_completed_IO(struct inode *);
+extern const struct file_operations ext4_seq_fsync_stats_fops;
+
+/* fast_commit.c */
+extern void ext4_fc_mark_ineligible(handle_t *handle, struct inode *inode);
+extern void ext4_fc_mark_sb_ineligible(handle_t *handle,
+				       struct super_block *sb);
+extern int ext4_fc_commit(struct inode *inode, tid_t tid);
+extern int ext4_fc_replay(struct super_block *sb);
 
 /* hash.c */
 extern int ext4fs_dirhash(const char *name, int len, struct
@@ -2157,7 +2198,9 @@ struct ext4_group_info {
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
 	ext4_grpblk_t	bb_largest_free_order;/* order of largest frag in BG */
+	ext4_group_t	bb_group;	/* group number */
 	struct          list_head bb_prealloc_list;
+	struct          list_head bb_largest_free_order_node;
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
 #endif
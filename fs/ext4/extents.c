@@ -4907,6 +4907,8 @@ int ext4_ext_punch_hole(struct file *file, loff_t offset, loff_t length)
 
 	up_write(&EXT4_I(inode)->i_data_sem);
 
+	/* The blocks are gone: fdatasync() must commit the removal */
+	ext4_update_inode_fsync_trans(handle, inode, 1);
 out:
 	ext4_orphan_del(handle, inode);
 	inode->i_mtime = inode->i_ctime = ext4_current_time(inode);
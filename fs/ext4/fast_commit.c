@@ -0,0 +1,549 @@
+/*
+ *  linux/fs/ext4/fast_commit.c
+ *
+ * Fast commits: fsync() of a regular file whose changes in the running
+ * transaction are limited to its inode and extent tree (size, timestamps,
+ * blocks allocated to it) writes a record of the inode to the fast commit
+ * area of the journal, instead of committing the whole transaction.  The
+ * transaction is committed later as usual.
+ *
+ * A record is a copy of the on-disk inode and of its extent tree leaves,
+ * so only trees of depth 0 or 1 are recorded.  Everything else the record
+ * can't describe (freed blocks, directory entries, xattr blocks, new
+ * inodes, ...) marks the inode, or the whole filesystem, ineligible for
+ * the rest of the running transaction, and fsync() commits it in full.
+ *
+ * At mount, after journal recovery, the records of the transaction that
+ * was running at the crash are replayed: inodes and leaves are written in
+ * place, and the blocks they reference are marked in use in the block
+ * bitmaps.
+ */
+
+#include <linux/fs.h>
+#include <linux/jbd2.h>
+#include <linux/crc32.h>
+#include <linux/pagemap.h>
+#include <linux/quotaops.h>
+#include <linux/blkdev.h>
+#include "ext4.h"
+#include "ext4_jbd2.h"
+#include "ext4_extents.h"
+#include "fast_commit.h"
+
+/*
+ * @inode was changed in the running transaction in a way a fast commit
+ * record can't describe.
+ */
+void ext4_fc_mark_ineligible(handle_t *handle, struct inode *inode)
+{
+	if (!ext4_handle_valid(handle))
+		return;
+	EXT4_I(inode)->i_fc_ineligible_tid = handle->h_transaction->t_tid;
+	ext4_set_inode_state(inode, EXT4_STATE_FC_INELIGIBLE);
+}
+
+/* Same for a change of the filesystem as a whole */
+void ext4_fc_mark_sb_ineligible(handle_t *handle, struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	if (!ext4_handle_valid(handle))
+		return;
+	sbi->s_fc_ineligible_tid = handle->h_transaction->t_tid;
+	sbi->s_mount_flags |= EXT4_MF_FC_INELIGIBLE;
+}
+
+static u32 ext4_fc_csum(struct super_block *sb, struct buffer_head **bhs,
+			int nr)
+{
+	u32 crc = ~0;
+	int i;
+
+	for (i = 0; i < nr; i++)
+		crc = crc32_le(crc, bhs[i]->b_data, sb->s_blocksize);
+	return crc;
+}
+
+/* Called with i_data_sem held for reading */
+static int ext4_fc_eligible(struct inode *inode, tid_t tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+	if ((sbi->s_mount_flags & EXT4_MF_FC_INELIGIBLE) &&
+	    sbi->s_fc_ineligible_tid == tid)
+		return 0;
+	if (ext4_test_inode_state(inode, EXT4_STATE_FC_INELIGIBLE) &&
+	    EXT4_I(inode)->i_fc_ineligible_tid == tid)
+		return 0;
+	if (ext_depth(inode) > 1 || atomic_read(&inode->i_dio_count))
+		return 0;
+
+	/*
+	 * Blocks must hold their data before a record points to them.
+	 * Writeback allocates blocks under i_data_sem, and the pages it
+	 * allocated them for stay tagged dirty until they are under
+	 * writeback: with no dirty page left, waiting for writeback is
+	 * enough.
+	 */
+	if (mapping_tagged(inode->i_mapping, PAGECACHE_TAG_DIRTY))
+		return 0;
+	return !filemap_fdatawait(inode->i_mapping);
+}
+
+/* Called with i_data_sem held for reading */
+static int ext4_fc_write_record(struct inode *inode, tid_t tid)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	journal_t *journal = sbi->s_journal;
+	struct buffer_head *bhs[1 + EXT4_FC_MAX_LEAVES];
+	struct ext4_extent_header *eh;
+	struct ext4_extent_idx *ix;
+	struct ext4_fc_head *head;
+	struct ext4_inode *raw;
+	struct ext4_iloc iloc;
+	int i, nr_leaves = 0;
+	int err;
+
+	err = ext4_get_inode_loc(inode, &iloc);
+	if (err)
+		return err;
+	err = jbd2_fc_get_buf(journal, &bhs[0]);
+	if (err)
+		goto out;
+	head = (struct ext4_fc_head *)bhs[0]->b_data;
+	raw = (struct ext4_inode *)(head + 1);
+	memcpy(raw, ext4_raw_inode(&iloc), EXT4_INODE_SIZE(sb));
+
+	eh = (struct ext4_extent_header *)raw->i_block;
+	if (eh->eh_depth) {
+		nr_leaves = le16_to_cpu(eh->eh_entries);
+		if (nr_leaves > EXT4_FC_MAX_LEAVES) {
+			err = -EINVAL;
+			goto out;
+		}
+	}
+	for (i = 0, ix = EXT_FIRST_INDEX(eh); i < nr_leaves; i++, ix++) {
+		ext4_fsblk_t blk = ext4_idx_pblock(ix);
+		struct buffer_head *bh;
+
+		bh = sb_bread(sb, blk);
+		if (!bh) {
+			err = -EIO;
+			goto out;
+		}
+		err = jbd2_fc_get_buf(journal, &bhs[i + 1]);
+		if (!err)
+			memcpy(bhs[i + 1]->b_data, bh->b_data, sb->s_blocksize);
+		brelse(bh);
+		if (err)
+			goto out;
+		head->fc_leaves[i] = cpu_to_le64(blk);
+	}
+
+	if (sbi->s_fc_tid != tid) {
+		sbi->s_fc_tid = tid;
+		sbi->s_fc_seq = 0;
+	}
+	head->fc_magic = cpu_to_le32(EXT4_FC_MAGIC);
+	head->fc_tid = cpu_to_le32(tid);
+	head->fc_seq = cpu_to_le32(sbi->s_fc_seq++);
+	head->fc_blocks = cpu_to_le32(1 + nr_leaves);
+	head->fc_ino = cpu_to_le32(inode->i_ino);
+	head->fc_inode_size = cpu_to_le16(EXT4_INODE_SIZE(sb));
+	head->fc_nr_leaves = cpu_to_le16(nr_leaves);
+	head->fc_crc = cpu_to_le32(ext4_fc_csum(sb, bhs, 1 + nr_leaves));
+out:
+	brelse(iloc.bh);
+	return err;
+}
+
+/**
+ * ext4_fc_commit() - fast commit the changes of an inode
+ * @inode: Inode to commit
+ * @tid: Running transaction holding the changes
+ *
+ * Returns 0 if the changes are on stable storage, -EALREADY if @tid got
+ * committed meanwhile, and another error if @tid must be committed in
+ * full.  Called from fsync() with i_mutex held.
+ */
+int ext4_fc_commit(struct inode *inode, tid_t tid)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	int err;
+
+	if (!test_opt(sb, FAST_COMMIT) || !S_ISREG(inode->i_mode) ||
+	    !ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS) ||
+	    ext4_should_journal_data(inode) ||
+	    EXT4_HAS_RO_COMPAT_FEATURE(sb, EXT4_FEATURE_RO_COMPAT_BIGALLOC) ||
+	    EXT4_INODE_SIZE(sb) + sizeof(struct ext4_fc_head) >
+	    sb->s_blocksize || sb_any_quota_loaded(sb))
+		return -EOPNOTSUPP;
+
+	err = jbd2_fc_begin_commit(journal, tid);
+	if (err)
+		return err;
+
+	down_read(&ei->i_data_sem);
+	if (ext4_fc_eligible(inode, tid))
+		err = ext4_fc_write_record(inode, tid);
+	else
+		err = -EINVAL;
+	up_read(&ei->i_data_sem);
+
+	if (err) {
+		jbd2_fc_end_commit_fallback(journal);
+		return err;
+	}
+	return jbd2_fc_end_commit(journal);
+}
+
+/*
+ * Replay
+ */
+
+/*
+ * Find @block in the extent tree below @eh, as committed to disk.  Returns
+ * 1 and sets @end past the extent or tree block holding it if the tree
+ * owns @block, 0 if it doesn't, or a negative error.
+ */
+static int ext4_fc_owned(struct super_block *sb,
+			 struct ext4_extent_header *eh, int max, int depth,
+			 ext4_fsblk_t block, ext4_fsblk_t *end)
+{
+	struct ext4_extent *ex;
+	struct ext4_extent_idx *ix;
+	struct buffer_head *bh;
+	ext4_fsblk_t start;
+	int i, ret;
+
+	if (eh->eh_magic != EXT4_EXT_MAGIC ||
+	    le16_to_cpu(eh->eh_depth) != depth ||
+	    le16_to_cpu(eh->eh_entries) > max)
+		return -EIO;
+
+	if (!depth) {
+		ex = EXT_FIRST_EXTENT(eh);
+		for (i = 0; i < le16_to_cpu(eh->eh_entries); i++, ex++) {
+			start = ext4_ext_pblock(ex);
+			if (block >= start &&
+			    block < start + ext4_ext_get_actual_len(ex)) {
+				*end = start + ext4_ext_get_actual_len(ex);
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	ix = EXT_FIRST_INDEX(eh);
+	for (i = 0; i < le16_to_cpu(eh->eh_entries); i++, ix++) {
+		start = ext4_idx_pblock(ix);
+		if (block == start) {
+			*end = start + 1;
+			return 1;
+		}
+		bh = sb_bread(sb, start);
+		if (!bh)
+			return -EIO;
+		ret = ext4_fc_owned(sb, ext_block_hdr(bh),
+			(sb->s_blocksize - sizeof(*eh)) /
+			sizeof(struct ext4_extent), depth - 1, block, end);
+		brelse(bh);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/*
+ * Mark blocks in use in the block bitmaps, as an allocation would.  A
+ * block already in use must belong to @old, the inode as committed to
+ * disk: the record only adds blocks the running transaction allocated to
+ * the inode, so a block in use by anything else means the record and the
+ * committed filesystem disagree, and replaying it would cross-link them.
+ */
+static int ext4_fc_mark_used(struct super_block *sb, struct ext4_inode *old,
+			     ext4_fsblk_t block, unsigned int count)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_extent_header *old_eh;
+	struct buffer_head *bitmap_bh, *gd_bh;
+	struct ext4_group_desc *gdp;
+	ext4_fsblk_t owned_end = 0;
+	ext4_group_t group;
+	ext4_grpblk_t bit;
+	unsigned int i, n, set;
+	int ret;
+
+	if (!ext4_data_block_valid(sbi, block, count))
+		return -EIO;
+
+	while (count) {
+		ext4_get_group_no_and_offset(sb, block, &group, &bit);
+		n = min_t(unsigned int, count, EXT4_BLOCKS_PER_GROUP(sb) - bit);
+
+		gdp = ext4_get_group_desc(sb, group, &gd_bh);
+		if (!gdp)
+			return -EIO;
+		bitmap_bh = ext4_read_block_bitmap(sb, group);
+		if (!bitmap_bh)
+			return -EIO;
+
+		for (i = 0; i < n; i++) {
+			if (!ext4_test_bit(bit + i, bitmap_bh->b_data) ||
+			    block + i < owned_end)
+				continue;
+			old_eh = (struct ext4_extent_header *)old->i_block;
+			ret = 0;
+			if (le32_to_cpu(old->i_flags) & EXT4_EXTENTS_FL)
+				ret = ext4_fc_owned(sb, old_eh,
+					(sizeof(old->i_block) - sizeof(*old_eh)) /
+					sizeof(struct ext4_extent),
+					le16_to_cpu(old_eh->eh_depth),
+					block + i, &owned_end);
+			if (ret <= 0) {
+				brelse(bitmap_bh);
+				if (!ret)
+					ext4_error(sb, "fast commit replay: "
+						   "block %llu already in use",
+						   (unsigned long long)(block + i));
+				return -EIO;
+			}
+		}
+
+		for (i = 0, set = 0; i < n; i++)
+			if (!ext4_test_and_set_bit(bit + i, bitmap_bh->b_data))
+				set++;
+		if (set) {
+			ext4_free_group_clusters_set(sb, gdp,
+				ext4_free_group_clusters(sb, gdp) - set);
+			gdp->bg_flags &= cpu_to_le16(~EXT4_BG_BLOCK_UNINIT);
+			gdp->bg_checksum = ext4_group_desc_csum(sbi, group, gdp);
+			if (sbi->s_log_groups_per_flex)
+				atomic64_sub(set, &sbi->s_flex_groups[
+					ext4_flex_group(sbi, group)].free_clusters);
+			mark_buffer_dirty(bitmap_bh);
+			mark_buffer_dirty(gd_bh);
+		}
+		brelse(bitmap_bh);
+
+		block += n;
+		count -= n;
+	}
+	return 0;
+}
+
+static int ext4_fc_mark_extents(struct super_block *sb,
+				struct ext4_inode *old,
+				struct ext4_extent_header *eh, int max)
+{
+	struct ext4_extent *ex;
+	int i, err;
+
+	if (eh->eh_magic != EXT4_EXT_MAGIC || eh->eh_depth ||
+	    le16_to_cpu(eh->eh_entries) > max)
+		return -EIO;
+
+	ex = EXT_FIRST_EXTENT(eh);
+	for (i = 0; i < le16_to_cpu(eh->eh_entries); i++, ex++) {
+		err = ext4_fc_mark_used(sb, old, ext4_ext_pblock(ex),
+					ext4_ext_get_actual_len(ex));
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
+static int ext4_fc_replay_record(struct super_block *sb,
+				 struct buffer_head **bhs)
+{
+	struct ext4_fc_head *head = (struct ext4_fc_head *)bhs[0]->b_data;
+	struct ext4_inode *raw = (struct ext4_inode *)(head + 1);
+	struct ext4_extent_header *eh;
+	struct ext4_extent_idx *ix;
+	struct ext4_group_desc *gdp;
+	struct ext4_inode *old;
+	struct buffer_head *bh, *inode_bh;
+	unsigned long ino = le32_to_cpu(head->fc_ino);
+	unsigned int offset;
+	ext4_fsblk_t blk;
+	int i, nr_leaves = le16_to_cpu(head->fc_nr_leaves);
+	int err = 0;
+
+	if (!(le32_to_cpu(raw->i_flags) & EXT4_EXTENTS_FL) ||
+	    ino == le32_to_cpu(EXT4_SB(sb)->s_es->s_journal_inum))
+		return -EIO;
+
+	gdp = ext4_get_group_desc(sb, (ino - 1) / EXT4_INODES_PER_GROUP(sb),
+				  NULL);
+	if (!gdp)
+		return -EIO;
+	offset = ((ino - 1) % EXT4_INODES_PER_GROUP(sb)) * EXT4_INODE_SIZE(sb);
+	inode_bh = sb_bread(sb, ext4_inode_table(sb, gdp) +
+			    (offset >> EXT4_BLOCK_SIZE_BITS(sb)));
+	if (!inode_bh)
+		return -EIO;
+	old = (struct ext4_inode *)(inode_bh->b_data +
+				    (offset & (sb->s_blocksize - 1)));
+
+	/*
+	 * Mark the blocks in use while the committed inode and its leaves
+	 * are still on disk to check them against, then write the record.
+	 */
+	eh = (struct ext4_extent_header *)raw->i_block;
+	if (!eh->eh_depth) {
+		err = ext4_fc_mark_extents(sb, old, eh,
+			(sizeof(raw->i_block) - sizeof(*eh)) /
+			sizeof(struct ext4_extent));
+		goto out;
+	}
+	if (eh->eh_magic != EXT4_EXT_MAGIC || le16_to_cpu(eh->eh_depth) > 1 ||
+	    le16_to_cpu(eh->eh_entries) != nr_leaves) {
+		err = -EIO;
+		goto out;
+	}
+
+	for (i = 0, ix = EXT_FIRST_INDEX(eh); i < nr_leaves; i++, ix++) {
+		blk = ext4_idx_pblock(ix);
+		if (blk != le64_to_cpu(head->fc_leaves[i])) {
+			err = -EIO;
+			goto out;
+		}
+		err = ext4_fc_mark_used(sb, old, blk, 1);
+		if (!err)
+			err = ext4_fc_mark_extents(sb, old,
+				ext_block_hdr(bhs[i + 1]),
+				(sb->s_blocksize - sizeof(*eh)) /
+				sizeof(struct ext4_extent));
+		if (err)
+			goto out;
+	}
+
+	for (i = 0, ix = EXT_FIRST_INDEX(eh); i < nr_leaves; i++, ix++) {
+		bh = sb_getblk(sb, ext4_idx_pblock(ix));
+		if (!bh) {
+			err = -ENOMEM;
+			goto out;
+		}
+		lock_buffer(bh);
+		memcpy(bh->b_data, bhs[i + 1]->b_data, sb->s_blocksize);
+		set_buffer_uptodate(bh);
+		unlock_buffer(bh);
+		mark_buffer_dirty(bh);
+		brelse(bh);
+	}
+out:
+	if (!err) {
+		lock_buffer(inode_bh);
+		memcpy(old, raw, EXT4_INODE_SIZE(sb));
+		unlock_buffer(inode_bh);
+		mark_buffer_dirty(inode_bh);
+	}
+	brelse(inode_bh);
+	return err;
+}
+
+/*
+ * Read the record at @off of the fast commit area into @bhs.  Returns its
+ * size in blocks, or 0 if there is no valid record @seq of @tid there.
+ */
+static int ext4_fc_read_record(struct super_block *sb, unsigned long off,
+			       tid_t tid, unsigned int seq,
+			       struct buffer_head **bhs)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	unsigned long nr = journal->j_fc_last - journal->j_fc_first;
+	struct ext4_fc_head *head;
+	unsigned long ino;
+	u32 crc;
+	int i, blocks, err;
+
+	err = jbd2_fc_read_block(journal, off, &bhs[0]);
+	if (err)
+		return err;
+	head = (struct ext4_fc_head *)bhs[0]->b_data;
+	blocks = le32_to_cpu(head->fc_blocks);
+	ino = le32_to_cpu(head->fc_ino);
+	if (le32_to_cpu(head->fc_magic) != EXT4_FC_MAGIC ||
+	    le32_to_cpu(head->fc_tid) != tid ||
+	    le32_to_cpu(head->fc_seq) != seq ||
+	    le16_to_cpu(head->fc_nr_leaves) > EXT4_FC_MAX_LEAVES ||
+	    blocks != 1 + le16_to_cpu(head->fc_nr_leaves) ||
+	    off + blocks > nr ||
+	    le16_to_cpu(head->fc_inode_size) != EXT4_INODE_SIZE(sb) ||
+	    ino < EXT4_FIRST_INO(sb) ||
+	    ino > le32_to_cpu(EXT4_SB(sb)->s_es->s_inodes_count)) {
+		brelse(bhs[0]);
+		return 0;
+	}
+
+	for (i = 1; i < blocks; i++) {
+		err = jbd2_fc_read_block(journal, off + i, &bhs[i]);
+		if (err) {
+			while (--i >= 0)
+				brelse(bhs[i]);
+			return err;
+		}
+	}
+
+	crc = le32_to_cpu(head->fc_crc);
+	head->fc_crc = 0;
+	if (ext4_fc_csum(sb, bhs, blocks) != crc) {
+		for (i = 0; i < blocks; i++)
+			brelse(bhs[i]);
+		return 0;
+	}
+	return blocks;
+}
+
+/**
+ * ext4_fc_replay() - replay fast commit records after journal recovery
+ * @sb: Filesystem being mounted
+ *
+ * Records are replayed in order until the first one that is invalid,
+ * which is where the last fast commit before the crash ended.
+ */
+int ext4_fc_replay(struct super_block *sb)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	struct buffer_head *bhs[1 + EXT4_FC_MAX_LEAVES];
+	unsigned long off = 0;
+	unsigned int seq = 0;
+	int i, blocks, err = 0;
+
+	if (!(journal->j_flags & JBD2_FC_REPLAY))
+		return 0;
+
+	while (off < journal->j_fc_last - journal->j_fc_first) {
+		blocks = ext4_fc_read_record(sb, off, journal->j_fc_replay_tid,
+					     seq, bhs);
+		if (blocks <= 0) {
+			err = blocks;
+			break;
+		}
+		err = ext4_fc_replay_record(sb, bhs);
+		for (i = 0; i < blocks; i++)
+			brelse(bhs[i]);
+		if (err)
+			break;
+		off += blocks;
+		seq++;
+	}
+	if (err) {
+		ext4_msg(sb, KERN_ERR, "error %d replaying fast commit "
+			 "record %u", err, seq);
+		return err;
+	}
+	if (!seq)
+		return 0;
+
+	err = sync_blockdev(sb->s_bdev);
+	if (!err && test_opt(sb, BARRIER))
+		err = blkdev_issue_flush(sb->s_bdev, GFP_KERNEL, NULL);
+	if (!err)
+		ext4_msg(sb, KERN_INFO, "replayed %u fast commit record%s",
+			 seq, seq == 1 ? "" : "s");
+	return err;
+}
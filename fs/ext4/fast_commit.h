@@ -0,0 +1,35 @@
+/*
+ * linux/fs/ext4/fast_commit.h
+ *
+ * On-disk format of the fast commit records fsync() writes to the fast
+ * commit area of the journal.
+ */
+
+#ifndef _EXT4_FAST_COMMIT_H
+#define _EXT4_FAST_COMMIT_H
+
+#define EXT4_FC_MAGIC		0xEF4FC0DE
+
+/* Extent leaves of a depth 1 tree: as many as index entries in i_block */
+#define EXT4_FC_MAX_LEAVES	4
+
+/*
+ * A record holds the state of one inode.  Its first block is this header
+ * followed by a copy of the on-disk inode, the next fc_nr_leaves blocks
+ * are images of the extent tree leaves, in the order of fc_leaves.  The
+ * crc covers all the blocks of the record, computed with fc_crc zeroed.
+ */
+struct ext4_fc_head {
+	__le32	fc_magic;
+	__le32	fc_tid;		/* Transaction the record belongs to */
+	__le32	fc_seq;		/* Number of the record in the transaction */
+	__le32	fc_blocks;	/* Blocks in the record, this one included */
+	__le32	fc_crc;
+	__le32	fc_ino;
+	__le16	fc_inode_size;	/* Bytes of inode following this header */
+	__le16	fc_nr_leaves;
+	__le32	fc_reserved;
+	__le64	fc_leaves[EXT4_FC_MAX_LEAVES];	/* Leaf block numbers */
+};
+
+#endif	/* _EXT4_FAST_COMMIT_H */
@@ -26,8 +26,12 @@
 #include <linux/fs.h>
 #include <linux/sched.h>
 #include <linux/writeback.h>
+#include <linux/module.h>
 #include <linux/jbd2.h>
 #include <linux/blkdev.h>
+#include <linux/ktime.h>
+#include <linux/seq_file.h>
+#include <linux/proc_fs.h>
 
 #include "ext4.h"
 #include "ext4_jbd2.h"
@@ -191,6 +195,15 @@ static int __sync_inode(struct inode *inode, int datasync)
 	return ret;
 }
 
+/* Count an fsync in the log2 latency histogram of /proc/fs/ext4/<dev> */
+static void ext4_fsync_account(struct ext4_sb_info *sbi, ktime_t stime)
+{
+	s64 us = ktime_us_delta(ktime_get(), stime);
+	int slot = us > 0 ? fls64(us) : 0;
+
+	atomic_inc(&sbi->s_fsync_lat[min(slot, EXT4_FSYNC_LAT_SLOTS - 1)]);
+}
+
 /*
  * akpm: A new design for ext4_sync_file().
  *
@@ -209,10 +222,12 @@ int ext4_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 {
 	struct inode *inode = file->f_mapping->host;
 	struct ext4_inode_info *ei = EXT4_I(inode);
-	journal_t *journal = EXT4_SB(inode->i_sb)->s_journal;
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	journal_t *journal = sbi->s_journal;
 	int ret;
 	tid_t commit_tid;
 	bool needs_barrier = false;
+	ktime_t stime = ktime_get();
 
 	J_ASSERT(ext4_journal_current_handle() == NULL);
 
@@ -257,14 +272,85 @@ int ext4_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 	}
 
 	commit_tid = datasync ? ei->i_datasync_tid : ei->i_sync_tid;
+
+	/*
+	 * i_datasync_tid only moves when something needed to find the
+	 * data changes: size, block mapping, written state of extents.
+	 * If that is committed already (overwrites of allocated blocks,
+	 * timestamp updates), fdatasync() only has to get the data the
+	 * caller wrote out of the disk cache.
+	 */
+	if (datasync && jbd2_transaction_committed(journal, commit_tid)) {
+		atomic_inc(&sbi->s_fsync_flush_only);
+		if (!jbd2_transaction_committed(journal, ei->i_sync_tid))
+			atomic_inc(&sbi->s_fsync_commits_avoided);
+		if (journal->j_flags & JBD2_BARRIER)
+			ret = blkdev_issue_flush(inode->i_sb->s_bdev,
+						 GFP_KERNEL, NULL);
+		goto out;
+	}
+
+	/*
+	 * If the running transaction holds nothing for this inode a
+	 * record can't describe, write the record and leave the commit
+	 * to the journal thread.
+	 */
+	ret = ext4_fc_commit(inode, commit_tid);
+	if (!ret) {
+		atomic_inc(&sbi->s_fsync_fast_commits);
+		goto out;
+	}
+	if (ret != -EALREADY && ret != -EOPNOTSUPP)
+		atomic_inc(&sbi->s_fsync_fc_fallbacks);
+
 	if (journal->j_flags & JBD2_BARRIER &&
 	    !jbd2_trans_will_send_data_barrier(journal, commit_tid))
 		needs_barrier = true;
 	ret = jbd2_complete_transaction(journal, commit_tid);
 	if (needs_barrier)
 		blkdev_issue_flush(inode->i_sb->s_bdev, GFP_KERNEL, NULL);
+	atomic_inc(&sbi->s_fsync_full_commits);
  out:
 	mutex_unlock(&inode->i_mutex);
+	ext4_fsync_account(sbi, stime);
 	trace_ext4_sync_file_exit(inode, ret);
 	return ret;
 }
+
+static int ext4_seq_fsync_stats_show(struct seq_file *seq, void *v)
+{
+	struct super_block *sb = seq->private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int i;
+
+	seq_printf(seq, "fast_commits: %u\n",
+		   atomic_read(&sbi->s_fsync_fast_commits));
+	seq_printf(seq, "full_commits: %u\n",
+		   atomic_read(&sbi->s_fsync_full_commits));
+	seq_printf(seq, "fast_commit_fallbacks: %u\n",
+		   atomic_read(&sbi->s_fsync_fc_fallbacks));
+	seq_printf(seq, "flush_only: %u\n",
+		   atomic_read(&sbi->s_fsync_flush_only));
+	seq_printf(seq, "commits_avoided: %u\n",
+		   atomic_read(&sbi->s_fsync_commits_avoided));
+	seq_puts(seq, "latency_us:\n");
+	for (i = 0; i < EXT4_FSYNC_LAT_SLOTS - 1; i++)
+		seq_printf(seq, "  <%u: %u\n", 1U << i,
+			   atomic_read(&sbi->s_fsync_lat[i]));
+	seq_printf(seq, "  >=%u: %u\n", 1U << i,
+		   atomic_read(&sbi->s_fsync_lat[i]));
+	return 0;
+}
+
+static int ext4_seq_fsync_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ext4_seq_fsync_stats_show, PDE(inode)->data);
+}
+
+const struct file_operations ext4_seq_fsync_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ext4_seq_fsync_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
@@ -884,6 +884,7 @@ got:
 		ei->i_sync_tid = handle->h_transaction->t_tid;
 		ei->i_datasync_tid = handle->h_transaction->t_tid;
 	}
+	ext4_fc_mark_ineligible(handle, inode);
 
 	err = ext4_mark_inode_dirty(handle, inode);
 	if (err) {
@@ -24,6 +24,7 @@
 #include "ext4_jbd2.h"
 #include "mballoc.h"
 #include <linux/debugfs.h>
+#include <linux/log2.h>
 #include <linux/slab.h>
 #include <trace/events/ext4.h>
 
@@ -684,23 +685,40 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 
 /*
  * Cache the order of the largest free extent we have available in this block
- * group.
+ * group, and keep the group on the index list of that order.
+ *
+ * Called with the group locked.
  */
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int old = grp->bb_largest_free_order;
+	int new = -1; /* uninit */
 	int i;
-	int bits;
 
-	grp->bb_largest_free_order = -1; /* uninit */
-
-	bits = sb->s_blocksize_bits + 1;
-	for (i = bits; i >= 0; i--) {
+	for (i = MB_NUM_ORDERS(sb) - 1; i >= 0; i--) {
 		if (grp->bb_counters[i] > 0) {
-			grp->bb_largest_free_order = i;
+			new = i;
 			break;
 		}
 	}
+
+	if (new == old)
+		return;
+
+	if (old >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[old]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[old]);
+	}
+	grp->bb_largest_free_order = new;
+	if (new >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[new]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[new]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[new]);
+	}
 }
 
 static noinline_for_stack
@@ -1892,6 +1910,16 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 
 		return 1;
 	case 1:
+		/*
+		 * No free run is as long as 2^(order + 2) - 1 without a
+		 * free buddy of order + 1, so the group can't have a long
+		 * enough extent
+		 */
+		if (EXT4_SB(ac->ac_sb)->s_mb_optimize_scan &&
+		    grp->bb_largest_free_order >= 0 &&
+		    ac->ac_g_ex.fe_len >
+		    (2 << (grp->bb_largest_free_order + 1)) - 2)
+			return 0;
 		if ((free / fragments) >= ac->ac_g_ex.fe_len)
 			return 1;
 		break;
@@ -1908,6 +1936,119 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	return 0;
 }
 
+/*
+ * Load the buddy of @group and scan it with criteria @cr, if the group
+ * still looks good once locked.
+ */
+static int ext4_mb_scan_group(struct ext4_allocation_context *ac,
+			      ext4_group_t group, int cr)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_buddy e4b;
+	int err;
+
+	err = ext4_mb_load_buddy(sb, group, &e4b);
+	if (err)
+		return err;
+
+	ext4_lock_group(sb, group);
+
+	/*
+	 * We need to check again after locking the
+	 * block group
+	 */
+	if (!ext4_mb_good_group(ac, group, cr)) {
+		ext4_unlock_group(sb, group);
+		ext4_mb_unload_buddy(&e4b);
+		return 0;
+	}
+
+	ac->ac_groups_scanned++;
+	if (cr == 0)
+		ext4_mb_simple_scan_group(ac, &e4b);
+	else if (cr == 1 && sbi->s_stripe &&
+			!(ac->ac_g_ex.fe_len % sbi->s_stripe))
+		ext4_mb_scan_aligned(ac, &e4b);
+	else
+		ext4_mb_complex_scan_group(ac, &e4b);
+
+	ext4_unlock_group(sb, group);
+	ext4_mb_unload_buddy(&e4b);
+
+	return 0;
+}
+
+/*
+ * Take up to MB_INDEX_CANDIDATES groups from the index, starting with
+ * those whose largest free extent is of @order, that pass criteria @cr.
+ * Groups not initialized yet are not on the index.
+ */
+static int ext4_mb_index_candidates(struct ext4_allocation_context *ac,
+				    int order, int cr, ext4_group_t ngroups,
+				    ext4_group_t *groups)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_info *grp;
+	int nr = 0;
+
+	for (; order < MB_NUM_ORDERS(sb) && nr < MB_INDEX_CANDIDATES;
+	     order++) {
+		if (list_empty(&sbi->s_mb_largest_free_orders[order]))
+			continue;
+
+		read_lock(&sbi->s_mb_largest_free_orders_locks[order]);
+		list_for_each_entry(grp, &sbi->s_mb_largest_free_orders[order],
+				    bb_largest_free_order_node) {
+			if (grp->bb_group >= ngroups ||
+			    EXT4_MB_GRP_NEED_INIT(grp) ||
+			    !ext4_mb_good_group(ac, grp->bb_group, cr))
+				continue;
+			groups[nr++] = grp->bb_group;
+			if (nr == MB_INDEX_CANDIDATES)
+				break;
+		}
+		read_unlock(&sbi->s_mb_largest_free_orders_locks[order]);
+	}
+
+	return nr;
+}
+
+/*
+ * Try the groups the index says have a large enough free extent for
+ * criteria 0 (a free buddy of the request's order) or 1 (a free extent
+ * at least as long as the request).
+ */
+static int ext4_mb_scan_index(struct ext4_allocation_context *ac, int cr,
+			      ext4_group_t ngroups)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	ext4_group_t groups[MB_INDEX_CANDIDATES];
+	int order, nr, i, err;
+
+	if (cr == 0)
+		order = ac->ac_2order;
+	else
+		order = order_base_2(ac->ac_g_ex.fe_len);
+
+	nr = ext4_mb_index_candidates(ac, order, cr, ngroups, groups);
+	for (i = 0; i < nr; i++) {
+		err = ext4_mb_scan_group(ac, groups[i], cr);
+		if (err)
+			return err;
+		if (ac->ac_status == AC_STATUS_FOUND) {
+			if (sbi->s_mb_stats)
+				atomic_inc(&sbi->s_bal_index_hits);
+			break;
+		}
+		if (ac->ac_status != AC_STATUS_CONTINUE)
+			break;
+	}
+
+	return 0;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
@@ -1973,6 +2114,16 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 repeat:
 	for (; cr < 4 && ac->ac_status == AC_STATUS_CONTINUE; cr++) {
 		ac->ac_criteria = cr;
+
+		/* Go straight to groups known to have what we look for */
+		if (cr < 2 && sbi->s_mb_optimize_scan) {
+			err = ext4_mb_scan_index(ac, cr, ngroups);
+			if (err)
+				goto out;
+			if (ac->ac_status != AC_STATUS_CONTINUE)
+				break;
+		}
+
 		/*
 		 * searching for the right group start
 		 * from the goal value specified
@@ -1991,34 +2142,10 @@ repeat:
 			if (!ext4_mb_good_group(ac, group, cr))
 				continue;
 
-			err = ext4_mb_load_buddy(sb, group, &e4b);
+			err = ext4_mb_scan_group(ac, group, cr);
 			if (err)
 				goto out;
 
-			ext4_lock_group(sb, group);
-
-			/*
-			 * We need to check again after locking the
-			 * block group
-			 */
-			if (!ext4_mb_good_group(ac, group, cr)) {
-				ext4_unlock_group(sb, group);
-				ext4_mb_unload_buddy(&e4b);
-				continue;
-			}
-
-			ac->ac_groups_scanned++;
-			if (cr == 0)
-				ext4_mb_simple_scan_group(ac, &e4b);
-			else if (cr == 1 && sbi->s_stripe &&
-					!(ac->ac_g_ex.fe_len % sbi->s_stripe))
-				ext4_mb_scan_aligned(ac, &e4b);
-			else
-				ext4_mb_complex_scan_group(ac, &e4b);
-
-			ext4_unlock_group(sb, group);
-			ext4_mb_unload_buddy(&e4b);
-
 			if (ac->ac_status != AC_STATUS_CONTINUE)
 				break;
 		}
@@ -2152,6 +2279,51 @@ static const struct file_operations ext4_mb_seq_groups_fops = {
 	.release	= seq_release,
 };
 
+static int ext4_mb_seq_stats_show(struct seq_file *seq, void *v)
+{
+	struct super_block *sb = seq->private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	unsigned int reqs = atomic_read(&sbi->s_bal_reqs);
+	unsigned int scanned = atomic_read(&sbi->s_bal_groups_scanned);
+
+	if (!sbi->s_mb_stats) {
+		seq_puts(seq, "mb_stats disabled, "
+			 "enable with /sys/fs/ext4/<partition>/mb_stats\n");
+		return 0;
+	}
+
+	seq_printf(seq, "reqs: %u\n", reqs);
+	seq_printf(seq, "success: %u\n", atomic_read(&sbi->s_bal_success));
+	seq_printf(seq, "blocks_allocated: %u\n",
+		   atomic_read(&sbi->s_bal_allocated));
+	seq_printf(seq, "groups_scanned: %u\n", scanned);
+	seq_printf(seq, "groups_per_req: %u.%02u\n",
+		   reqs ? scanned / reqs : 0,
+		   reqs ? (scanned % reqs) * 100 / reqs : 0);
+	seq_printf(seq, "index_hits: %u\n",
+		   atomic_read(&sbi->s_bal_index_hits));
+	seq_printf(seq, "extents_scanned: %u\n",
+		   atomic_read(&sbi->s_bal_ex_scanned));
+	seq_printf(seq, "goal_hits: %u\n", atomic_read(&sbi->s_bal_goals));
+	seq_printf(seq, "2^n_hits: %u\n", atomic_read(&sbi->s_bal_2orders));
+	seq_printf(seq, "breaks: %u\n", atomic_read(&sbi->s_bal_breaks));
+	seq_printf(seq, "lost: %u\n", atomic_read(&sbi->s_mb_lost_chunks));
+	return 0;
+}
+
+static int ext4_mb_seq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ext4_mb_seq_stats_show, PDE(inode)->data);
+}
+
+static const struct file_operations ext4_mb_seq_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ext4_mb_seq_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static struct kmem_cache *get_groupinfo_cache(int blocksize_bits)
 {
 	int cache_index = blocksize_bits - EXT4_MIN_BLOCK_LOG_SIZE;
@@ -2215,9 +2387,11 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	}
 
 	INIT_LIST_HEAD(&meta_group_info[i]->bb_prealloc_list);
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_group = group;
 
 #ifdef DOUBLE_CHECK
 	{
@@ -2421,6 +2595,21 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 		i++;
 	} while (i <= sb->s_blocksize_bits + 1);
 
+	sbi->s_mb_largest_free_orders =
+		kmalloc(MB_NUM_ORDERS(sb) * sizeof(struct list_head),
+			GFP_KERNEL);
+	sbi->s_mb_largest_free_orders_locks =
+		kmalloc(MB_NUM_ORDERS(sb) * sizeof(rwlock_t), GFP_KERNEL);
+	if (!sbi->s_mb_largest_free_orders ||
+	    !sbi->s_mb_largest_free_orders_locks) {
+		ret = -ENOMEM;
+		goto out_free_groupinfo_slab;
+	}
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+
 	spin_lock_init(&sbi->s_md_lock);
 	spin_lock_init(&sbi->s_bal_lock);
 
@@ -2429,6 +2618,7 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 	sbi->s_mb_stats = MB_DEFAULT_STATS;
 	sbi->s_mb_stream_request = MB_DEFAULT_STREAM_THRESHOLD;
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
+	sbi->s_mb_optimize_scan = MB_DEFAULT_OPTIMIZE_SCAN;
 	/*
 	 * The default group preallocation is 512, which for 4k block
 	 * sizes translates to 2 megabytes.  However for bigalloc file
@@ -2475,9 +2665,12 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 	if (ret != 0)
 		goto out_free_locality_groups;
 
-	if (sbi->s_proc)
+	if (sbi->s_proc) {
 		proc_create_data("mb_groups", S_IRUGO, sbi->s_proc,
 				 &ext4_mb_seq_groups_fops, sb);
+		proc_create_data("mb_stats", S_IRUGO, sbi->s_proc,
+				 &ext4_mb_seq_stats_fops, sb);
+	}
 
 	return 0;
 
@@ -2486,6 +2679,10 @@ out_free_locality_groups:
 	sbi->s_locality_groups = NULL;
 out_free_groupinfo_slab:
 	ext4_groupinfo_destroy_slabs();
+	kfree(sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = NULL;
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = NULL;
 out:
 	kfree(sbi->s_mb_offsets);
 	sbi->s_mb_offsets = NULL;
@@ -2521,8 +2718,10 @@ int ext4_mb_release(struct super_block *sb)
 	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	struct kmem_cache *cachep = get_groupinfo_cache(sb->s_blocksize_bits);
 
-	if (sbi->s_proc)
+	if (sbi->s_proc) {
+		remove_proc_entry("mb_stats", sbi->s_proc);
 		remove_proc_entry("mb_groups", sbi->s_proc);
+	}
 
 	if (sbi->s_group_info) {
 		for (i = 0; i < ngroups; i++) {
@@ -2544,6 +2743,8 @@ int ext4_mb_release(struct super_block *sb)
 	}
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
 	if (sbi->s_buddy_cache)
 		iput(sbi->s_buddy_cache);
 	if (sbi->s_mb_stats) {
@@ -2560,6 +2761,10 @@ int ext4_mb_release(struct super_block *sb)
 				atomic_read(&sbi->s_bal_2orders),
 				atomic_read(&sbi->s_bal_breaks),
 				atomic_read(&sbi->s_mb_lost_chunks));
+		ext4_msg(sb, KERN_INFO,
+		      "mballoc: %u groups scanned, %u index hits",
+				atomic_read(&sbi->s_bal_groups_scanned),
+				atomic_read(&sbi->s_bal_index_hits));
 		ext4_msg(sb, KERN_INFO,
 		       "mballoc: %lu generated and it took %Lu",
 				sbi->s_mb_buddies_generated,
@@ -3054,6 +3259,7 @@ static void ext4_mb_collect_stats(struct ext4_allocation_context *ac)
 		if (ac->ac_b_ex.fe_len >= ac->ac_o_ex.fe_len)
 			atomic_inc(&sbi->s_bal_success);
 		atomic_add(ac->ac_found, &sbi->s_bal_ex_scanned);
+		atomic_add(ac->ac_groups_scanned, &sbi->s_bal_groups_scanned);
 		if (ac->ac_g_ex.fe_start == ac->ac_b_ex.fe_start &&
 				ac->ac_g_ex.fe_group == ac->ac_b_ex.fe_group)
 			atomic_inc(&sbi->s_bal_goals);
@@ -4513,6 +4719,7 @@ void ext4_free_blocks(handle_t *handle, struct inode *inode,
 
 	ext4_debug("freeing block %llu\n", block);
 	trace_ext4_free_blocks(inode, block, count, flags);
+	ext4_fc_mark_ineligible(handle, inode);
 
 	if (flags & EXT4_FREE_BLOCKS_FORGET) {
 		struct buffer_head *tbh = bh;
@@ -4541,6 +4748,14 @@ void ext4_free_blocks(handle_t *handle, struct inode *inode,
 	if (!ext4_should_writeback_data(inode))
 		flags |= EXT4_FREE_BLOCKS_METADATA;
 
+	/*
+	 * Blocks freed without the deferral can go to another inode in
+	 * this transaction, and a fast commit record of that inode would
+	 * claim blocks the committed tree still gives to this one.
+	 */
+	if (!(flags & EXT4_FREE_BLOCKS_METADATA))
+		ext4_fc_mark_sb_ineligible(handle, sb);
+
 	/*
 	 * If the extent to be freed does not begin on a cluster
 	 * boundary, we need to deal with partial clusters at the
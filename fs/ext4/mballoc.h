@@ -94,6 +94,21 @@ extern u8 mb_enable_debug;
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * pick groups for exact (2^N) and good-enough allocations from the index
+ * of groups by largest free order instead of trying them all in turn
+ */
+#define MB_DEFAULT_OPTIMIZE_SCAN	1
+
+/*
+ * how many groups are taken from the index per allocation before
+ * falling back to trying groups in turn
+ */
+#define MB_INDEX_CANDIDATES		8
+
+/* orders of buddy data, 0 being the bitmap itself */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
 
 struct ext4_free_data {
 	/* MUST be the first member */
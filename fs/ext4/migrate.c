@@ -326,6 +326,7 @@ static int ext4_ext_swap_inode_data(handle_t *handle, struct inode *inode,
 		if (retval)
 			goto err_out;
 	}
+	ext4_fc_mark_ineligible(handle, inode);
 
 	i_data[0] = ei->i_data[EXT4_IND_BLOCK];
 	i_data[1] = ei->i_data[EXT4_DIND_BLOCK];
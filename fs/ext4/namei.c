@@ -1983,6 +1983,7 @@ int ext4_orphan_add(handle_t *handle, struct inode *inode)
 	if (!ext4_handle_valid(handle))
 		return 0;
 
+	ext4_fc_mark_ineligible(handle, inode);
 	mutex_lock(&EXT4_SB(sb)->s_orphan_lock);
 	if (!list_empty(&EXT4_I(inode)->i_orphan))
 		goto out_unlock;
@@ -2059,6 +2060,8 @@ int ext4_orphan_del(handle_t *handle, struct inode *inode)
 	    !(EXT4_SB(inode->i_sb)->s_mount_state & EXT4_ORPHAN_FS))
 		return 0;
 
+	if (handle)
+		ext4_fc_mark_ineligible(handle, inode);
 	mutex_lock(&EXT4_SB(inode->i_sb)->s_orphan_lock);
 	if (list_empty(&ei->i_orphan))
 		goto out;
@@ -2221,6 +2224,7 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 	retval = ext4_delete_entry(handle, dir, de, bh);
 	if (retval)
 		goto end_unlink;
+	ext4_fc_mark_ineligible(handle, inode);
 	dir->i_ctime = dir->i_mtime = ext4_current_time(dir);
 	ext4_update_dx_flag(dir);
 	ext4_mark_inode_dirty(handle, dir);
@@ -2366,6 +2370,7 @@ retry:
 	if (IS_DIRSYNC(dir))
 		ext4_handle_sync(handle);
 
+	ext4_fc_mark_ineligible(handle, inode);
 	inode->i_ctime = ext4_current_time(inode);
 	ext4_inc_count(handle, inode);
 	ihold(inode);
@@ -2431,6 +2436,9 @@ static int ext4_rename(struct inode *old_dir, struct dentry *old_dentry,
 		goto end_rename;
 
 	new_inode = new_dentry->d_inode;
+	ext4_fc_mark_ineligible(handle, old_inode);
+	if (new_inode)
+		ext4_fc_mark_ineligible(handle, new_inode);
 	new_bh = ext4_find_entry(new_dir, &new_dentry->d_name, &new_de);
 	if (new_bh) {
 		if (!new_inode) {
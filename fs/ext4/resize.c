@@ -448,6 +448,7 @@ static int setup_new_flex_group_blocks(struct super_block *sb,
 	handle = ext4_journal_start_sb(sb, EXT4_MAX_TRANS_DATA);
 	if (IS_ERR(handle))
 		return PTR_ERR(handle);
+	ext4_fc_mark_sb_ineligible(handle, sb);
 
 	group = group_data[0].group;
 	for (i = 0; i < flex_gd->count; i++, group++) {
@@ -1278,6 +1279,7 @@ static int ext4_flex_group_add(struct super_block *sb,
 		err = PTR_ERR(handle);
 		goto exit;
 	}
+	ext4_fc_mark_sb_ineligible(handle, sb);
 
 	err = ext4_journal_get_write_access(handle, sbi->s_sbh);
 	if (err)
@@ -1480,6 +1482,7 @@ static int ext4_group_extend_no_check(struct super_block *sb,
 		ext4_warning(sb, "error %d on journal start", err);
 		return err;
 	}
+	ext4_fc_mark_sb_ineligible(handle, sb);
 
 	err = ext4_journal_get_write_access(handle, EXT4_SB(sb)->s_sbh);
 	if (err) {
@@ -861,6 +861,7 @@ static void ext4_put_super(struct super_block *sb)
 		ext4_commit_super(sb, 1);
 
 	if (sbi->s_proc) {
+		remove_proc_entry("fsync_stats", sbi->s_proc);
 		remove_proc_entry("options", sbi->s_proc);
 		remove_proc_entry(sb->s_id, ext4_proc_root);
 	}
@@ -1191,6 +1192,7 @@ enum {
 	Opt_inode_readahead_blks, Opt_journal_ioprio,
 	Opt_dioread_nolock, Opt_dioread_lock,
 	Opt_discard, Opt_nodiscard, Opt_init_itable, Opt_noinit_itable,
+	Opt_fast_commit,
 };
 
 static const match_table_t tokens = {
@@ -1264,6 +1266,7 @@ static const match_table_t tokens = {
 	{Opt_init_itable, "init_itable=%u"},
 	{Opt_init_itable, "init_itable"},
 	{Opt_noinit_itable, "noinit_itable"},
+	{Opt_fast_commit, "fast_commit"},
 	{Opt_removed, "check=none"},	/* mount option from ext2/3 */
 	{Opt_removed, "nocheck"},	/* mount option from ext2/3 */
 	{Opt_removed, "reservation"},	/* mount option from ext2/3 */
@@ -1405,6 +1408,7 @@ static const struct mount_opts {
 	{Opt_noauto_da_alloc, EXT4_MOUNT_NO_AUTO_DA_ALLOC, MOPT_SET},
 	{Opt_auto_da_alloc, EXT4_MOUNT_NO_AUTO_DA_ALLOC, MOPT_CLEAR},
 	{Opt_noinit_itable, EXT4_MOUNT_INIT_INODE_TABLE, MOPT_CLEAR},
+	{Opt_fast_commit, EXT4_MOUNT_FAST_COMMIT, MOPT_SET},
 	{Opt_commit, 0, MOPT_GTE0},
 	{Opt_max_batch_time, 0, MOPT_GTE0},
 	{Opt_min_batch_time, 0, MOPT_GTE0},
@@ -2447,6 +2451,7 @@ EXT4_RW_ATTR_SBI_UI(mb_min_to_scan, s_mb_min_to_scan);
 EXT4_RW_ATTR_SBI_UI(mb_order2_req, s_mb_order2_reqs);
 EXT4_RW_ATTR_SBI_UI(mb_stream_req, s_mb_stream_request);
 EXT4_RW_ATTR_SBI_UI(mb_group_prealloc, s_mb_group_prealloc);
+EXT4_RW_ATTR_SBI_UI(mb_optimize_scan, s_mb_optimize_scan);
 EXT4_RW_ATTR_SBI_UI(max_writeback_mb_bump, s_max_writeback_mb_bump);
 
 static struct attribute *ext4_attrs[] = {
@@ -2461,6 +2466,7 @@ static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(mb_order2_req),
 	ATTR_LIST(mb_stream_req),
 	ATTR_LIST(mb_group_prealloc),
+	ATTR_LIST(mb_optimize_scan),
 	ATTR_LIST(max_writeback_mb_bump),
 	NULL,
 };
@@ -3508,9 +3514,12 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	if (ext4_proc_root)
 		sbi->s_proc = proc_mkdir(sb->s_id, ext4_proc_root);
 
-	if (sbi->s_proc)
+	if (sbi->s_proc) {
 		proc_create_data("options", S_IRUGO, sbi->s_proc,
 				 &ext4_seq_options_fops, sb);
+		proc_create_data("fsync_stats", S_IRUGO, sbi->s_proc,
+				 &ext4_seq_fsync_stats_fops, sb);
+	}
 
 	bgl_lock_init(sbi->s_blockgroup_lock);
 
@@ -3604,6 +3613,8 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	    EXT4_HAS_COMPAT_FEATURE(sb, EXT4_FEATURE_COMPAT_HAS_JOURNAL)) {
 		if (ext4_load_journal(sb, es, journal_devnum))
 			goto failed_mount3;
+		if (ext4_fc_replay(sb))
+			goto failed_mount_wq;
 	} else if (test_opt(sb, NOLOAD) && !(sb->s_flags & MS_RDONLY) &&
 	      EXT4_HAS_INCOMPAT_FEATURE(sb, EXT4_FEATURE_INCOMPAT_RECOVER)) {
 		ext4_msg(sb, KERN_ERR, "required journal recovery "
@@ -3666,6 +3677,21 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	}
 	set_task_ioprio(sbi->s_journal->j_task, journal_ioprio);
 
+	if (test_opt(sb, FAST_COMMIT) && !(sb->s_flags & MS_RDONLY)) {
+		err = jbd2_fc_init(sbi->s_journal, EXT4_DEF_FC_BLOCKS);
+		if (err) {
+			ext4_msg(sb, KERN_WARNING, "can't enable fast "
+				 "commits (%d)", err);
+			clear_opt(sb, FAST_COMMIT);
+		}
+	} else if (!(sb->s_flags & MS_RDONLY)) {
+		/* Records were replayed above, the area isn't needed */
+		err = jbd2_fc_disable(sbi->s_journal);
+		if (err)
+			ext4_msg(sb, KERN_WARNING, "can't remove fast "
+				 "commit area (%d)", err);
+	}
+
 	sbi->s_journal->j_commit_callback = ext4_journal_commit_callback;
 
 	/*
@@ -3848,6 +3874,7 @@ failed_mount2:
 	ext4_kvfree(sbi->s_group_desc);
 failed_mount:
 	if (sbi->s_proc) {
+		remove_proc_entry("fsync_stats", sbi->s_proc);
 		remove_proc_entry("options", sbi->s_proc);
 		remove_proc_entry(sb->s_id, ext4_proc_root);
 	}
@@ -10,6 +10,7 @@
 
 #include <linux/init.h>
 #include <linux/module.h>
+#include <linux/slab.h>
 
 #define FUSE_CTL_SUPER_MAGIC 0x65735543
 
@@ -61,6 +62,55 @@ static ssize_t fuse_conn_waiting_read(struct file *file, char __user *buf,
 	return simple_read_from_buffer(buf, len, ppos, tmp, size);
 }
 
+/* Longest line of the "queues" file */
+#define FUSE_CTL_QUEUE_LINE 96
+
+static ssize_t fuse_conn_queues_read(struct file *file, char __user *buf,
+				     size_t len, loff_t *ppos)
+{
+	struct fuse_queue_stats stats;
+	struct fuse_conn *fc;
+	size_t bufsize;
+	size_t size;
+	ssize_t ret;
+	char *tmp;
+	int cpu;
+
+	fc = fuse_ctl_file_conn_get(file);
+	if (!fc)
+		return 0;
+
+	bufsize = (nr_cpu_ids + 1) * FUSE_CTL_QUEUE_LINE;
+	tmp = kmalloc(bufsize, GFP_KERNEL);
+	if (!tmp) {
+		fuse_conn_put(fc);
+		return -ENOMEM;
+	}
+
+	size = scnprintf(tmp, bufsize,
+			 "queue pending processing completed avg_us max_us\n");
+	for_each_possible_cpu(cpu) {
+		u64 avg = 0;
+
+		fuse_queue_get_stats(fc, cpu, &stats);
+		if (stats.completed)
+			avg = div64_u64(stats.latency_ns, stats.completed);
+		size += scnprintf(tmp + size, bufsize - size,
+				  "cpu%d %u %u %llu %llu %llu\n", cpu,
+				  stats.pending, stats.processing,
+				  (unsigned long long) stats.completed,
+				  (unsigned long long) div_u64(avg, NSEC_PER_USEC),
+				  (unsigned long long) div_u64(stats.max_latency_ns,
+							       NSEC_PER_USEC));
+	}
+	fuse_conn_put(fc);
+
+	ret = simple_read_from_buffer(buf, len, ppos, tmp, size);
+	kfree(tmp);
+
+	return ret;
+}
+
 static ssize_t fuse_conn_limit_read(struct file *file, char __user *buf,
 				    size_t len, loff_t *ppos, unsigned val)
 {
@@ -188,6 +238,12 @@ static const struct file_operations fuse_ctl_waiting_ops = {
 	.llseek = no_llseek,
 };
 
+static const struct file_operations fuse_ctl_queues_ops = {
+	.open = nonseekable_open,
+	.read = fuse_conn_queues_read,
+	.llseek = no_llseek,
+};
+
 static const struct file_operations fuse_conn_max_background_ops = {
 	.open = nonseekable_open,
 	.read = fuse_conn_max_background_read,
@@ -266,7 +322,9 @@ int fuse_ctl_add_conn(struct fuse_conn *fc)
 				 1, NULL, &fuse_conn_max_background_ops) ||
 	    !fuse_ctl_add_dentry(parent, fc, "congestion_threshold",
 				 S_IFREG | 0600, 1, NULL,
-				 &fuse_conn_congestion_threshold_ops))
+				 &fuse_conn_congestion_threshold_ops) ||
+	    !fuse_ctl_add_dentry(parent, fc, "queues", S_IFREG | 0400, 1,
+				 NULL, &fuse_ctl_queues_ops))
 		goto err;
 
 	return 0;
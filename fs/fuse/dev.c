@@ -35,34 +35,55 @@ static struct fuse_conn *fuse_get_conn(struct file *file)
 	return file->private_data;
 }
 
-static void fuse_request_init(struct fuse_req *req)
+static void fuse_request_init(struct fuse_req *req, struct page **pages,
+			      unsigned npages)
 {
 	memset(req, 0, sizeof(*req));
+	memset(pages, 0, sizeof(*pages) * npages);
 	INIT_LIST_HEAD(&req->list);
 	INIT_LIST_HEAD(&req->intr_entry);
 	init_waitqueue_head(&req->waitq);
 	atomic_set(&req->count, 1);
+	req->pages = pages;
+	req->max_pages = npages;
 }
 
-struct fuse_req *fuse_request_alloc(void)
+static struct fuse_req *__fuse_request_alloc(unsigned npages, gfp_t flags)
 {
-	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, GFP_KERNEL);
-	if (req)
-		fuse_request_init(req);
+	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, flags);
+	if (req) {
+		struct page **pages;
+
+		if (npages <= FUSE_REQ_INLINE_PAGES)
+			pages = req->inline_pages;
+		else
+			pages = kmalloc(sizeof(struct page *) * npages, flags);
+
+		if (!pages) {
+			kmem_cache_free(fuse_req_cachep, req);
+			return NULL;
+		}
+
+		fuse_request_init(req, pages, npages);
+	}
 	return req;
 }
+
+struct fuse_req *fuse_request_alloc(unsigned npages)
+{
+	return __fuse_request_alloc(npages, GFP_KERNEL);
+}
 EXPORT_SYMBOL_GPL(fuse_request_alloc);
 
-struct fuse_req *fuse_request_alloc_nofs(void)
+struct fuse_req *fuse_request_alloc_nofs(unsigned npages)
 {
-	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, GFP_NOFS);
-	if (req)
-		fuse_request_init(req);
-	return req;
+	return __fuse_request_alloc(npages, GFP_NOFS);
 }
 
 void fuse_request_free(struct fuse_req *req)
 {
+	if (req->pages != req->inline_pages)
+		kfree(req->pages);
 	kmem_cache_free(fuse_req_cachep, req);
 }
 
@@ -98,7 +119,7 @@ static void fuse_req_init_context(struct fuse_req *req)
 	req->in.h.pid = current->pid;
 }
 
-struct fuse_req *fuse_get_req(struct fuse_conn *fc)
+struct fuse_req *fuse_get_req(struct fuse_conn *fc, unsigned npages)
 {
 	struct fuse_req *req;
 	sigset_t oldset;
@@ -117,7 +138,7 @@ struct fuse_req *fuse_get_req(struct fuse_conn *fc)
 	if (!fc->connected)
 		goto out;
 
-	req = fuse_request_alloc();
+	req = fuse_request_alloc(npages);
 	err = -ENOMEM;
 	if (!req)
 		goto out;
@@ -167,7 +188,7 @@ static void put_reserved_req(struct fuse_conn *fc, struct fuse_req *req)
 	struct fuse_file *ff = file->private_data;
 
 	spin_lock(&fc->lock);
-	fuse_request_init(req);
+	fuse_request_init(req, req->pages, req->max_pages);
 	BUG_ON(ff->reserved_req);
 	ff->reserved_req = req;
 	wake_up_all(&fc->reserved_req_waitq);
@@ -194,7 +215,7 @@ struct fuse_req *fuse_get_req_nofail(struct fuse_conn *fc, struct file *file)
 
 	atomic_inc(&fc->num_waiting);
 	wait_event(fc->blocked_waitq, !fc->blocked);
-	req = fuse_request_alloc();
+	req = fuse_request_alloc(0);
 	if (!req)
 		req = get_reserved_req(fc, file);
 
@@ -209,6 +230,10 @@ void fuse_put_request(struct fuse_conn *fc, struct fuse_req *req)
 		if (req->waiting)
 			atomic_dec(&fc->num_waiting);
 
+		/* Backing file of an open that was not completed */
+		if (req->passthrough_filp)
+			fput(req->passthrough_filp);
+
 		if (req->stolen_file)
 			put_reserved_req(fc, req);
 		else
@@ -228,21 +253,54 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 	return nbytes;
 }
 
-static u64 fuse_get_unique(struct fuse_conn *fc)
+/* The queue of the CPU we are running on */
+static struct fuse_queue *fuse_queue_this_cpu(struct fuse_conn *fc)
+{
+	return per_cpu_ptr(fc->queues, raw_smp_processor_id());
+}
+
+/*
+ * The CPU of the queue is in the low bits of the unique ID, just above
+ * FUSE_INT_REQ_BIT, and the request counter of the queue above it.  So
+ * the ID is never zero, which is special.
+ *
+ * Called with fq->lock held
+ */
+static u64 fuse_get_unique(struct fuse_conn *fc, struct fuse_queue *fq)
+{
+	fq->reqctr++;
+	return ((fq->reqctr << fc->queue_shift) | fq->cpu) * FUSE_REQ_ID_STEP;
+}
+
+/* Find the queue that handed out a unique ID, if any */
+static struct fuse_queue *fuse_unique_queue(struct fuse_conn *fc, u64 unique)
 {
-	fc->reqctr++;
-	/* zero is special */
-	if (fc->reqctr == 0)
-		fc->reqctr = 1;
+	unsigned cpu;
+
+	cpu = (unique / FUSE_REQ_ID_STEP) & ((1ULL << fc->queue_shift) - 1);
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return NULL;
+
+	return per_cpu_ptr(fc->queues, cpu);
+}
 
-	return fc->reqctr;
+static unsigned fuse_req_hash(struct fuse_conn *fc, u64 unique)
+{
+	return ((unique / FUSE_REQ_ID_STEP) >> fc->queue_shift) &
+		(FUSE_PQ_HASH_SIZE - 1);
 }
 
-static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
+/*
+ * Called with fq->lock held, after the unique ID has been set
+ */
+static void queue_request(struct fuse_conn *fc, struct fuse_queue *fq,
+			  struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	req->fq = fq;
+	req->queue_time = ktime_get();
+	list_add_tail(&req->list, &fq->pending);
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
@@ -255,23 +313,30 @@ static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
+	struct fuse_queue *fq = fuse_queue_this_cpu(fc);
+
 	forget->forget_one.nodeid = nodeid;
 	forget->forget_one.nlookup = nlookup;
 
-	spin_lock(&fc->lock);
+	spin_lock(&fq->lock);
 	if (fc->connected) {
-		fc->forget_list_tail->next = forget;
-		fc->forget_list_tail = forget;
+		fq->forget_list_tail->next = forget;
+		fq->forget_list_tail = forget;
 		wake_up(&fc->waitq);
 		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 	} else {
 		kfree(forget);
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 }
 
+/*
+ * Called with fc->lock held
+ */
 static void flush_bg_queue(struct fuse_conn *fc)
 {
+	struct fuse_queue *fq = fuse_queue_this_cpu(fc);
+
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
 		struct fuse_req *req;
@@ -279,8 +344,10 @@ static void flush_bg_queue(struct fuse_conn *fc)
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		spin_lock(&fq->lock);
+		req->in.h.unique = fuse_get_unique(fc, fq);
+		queue_request(fc, fq, req);
+		spin_unlock(&fq->lock);
 	}
 }
 
@@ -292,17 +359,29 @@ static void flush_bg_queue(struct fuse_conn *fc)
  * the 'end' callback is called if given, else the reference to the
  * request is released
  *
- * Called with fc->lock, unlocks it
+ * Called with the lock of the request's queue, unlocks it.  A request
+ * that was never queued is ended without any lock held.
  */
 static void request_end(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
+__releases(req->fq->lock)
 {
+	struct fuse_queue *fq = req->fq;
 	void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 	req->end = NULL;
 	list_del(&req->list);
 	list_del(&req->intr_entry);
 	req->state = FUSE_REQ_FINISHED;
+	if (fq) {
+		u64 ns = ktime_to_ns(ktime_sub(ktime_get(), req->queue_time));
+
+		fq->completed++;
+		fq->latency_ns += ns;
+		if (ns > fq->max_latency_ns)
+			fq->max_latency_ns = ns;
+		spin_unlock(&fq->lock);
+	}
 	if (req->background) {
+		spin_lock(&fc->lock);
 		if (fc->num_background == fc->max_background) {
 			fc->blocked = 0;
 			wake_up_all(&fc->blocked_waitq);
@@ -315,41 +394,44 @@ __releases(fc->lock)
 		fc->num_background--;
 		fc->active_background--;
 		flush_bg_queue(fc);
+		spin_unlock(&fc->lock);
 	}
-	spin_unlock(&fc->lock);
 	wake_up(&req->waitq);
 	if (end)
 		end(fc, req);
 	fuse_put_request(fc, req);
 }
 
-static void wait_answer_interruptible(struct fuse_conn *fc,
+static void wait_answer_interruptible(struct fuse_queue *fq,
 				      struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+__releases(fq->lock)
+__acquires(fq->lock)
 {
 	if (signal_pending(current))
 		return;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 	wait_event_interruptible(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	spin_lock(&fq->lock);
 }
 
-static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
+static void queue_interrupt(struct fuse_conn *fc, struct fuse_queue *fq,
+			    struct fuse_req *req)
 {
-	list_add_tail(&req->intr_entry, &fc->interrupts);
+	list_add_tail(&req->intr_entry, &fq->interrupts);
 	wake_up(&fc->waitq);
 	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 }
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+__releases(req->fq->lock)
+__acquires(req->fq->lock)
 {
+	struct fuse_queue *fq = req->fq;
+
 	if (!fc->no_interrupt) {
 		/* Any signal may interrupt this */
-		wait_answer_interruptible(fc, req);
+		wait_answer_interruptible(fq, req);
 
 		if (req->aborted)
 			goto aborted;
@@ -358,7 +440,7 @@ __acquires(fc->lock)
 
 		req->interrupted = 1;
 		if (req->state == FUSE_REQ_SENT)
-			queue_interrupt(fc, req);
+			queue_interrupt(fc, fq, req);
 	}
 
 	if (!req->force) {
@@ -366,7 +448,7 @@ __acquires(fc->lock)
 
 		/* Only fatal signals may interrupt this */
 		block_sigs(&oldset);
-		wait_answer_interruptible(fc, req);
+		wait_answer_interruptible(fq, req);
 		restore_sigs(&oldset);
 
 		if (req->aborted)
@@ -387,12 +469,12 @@ __acquires(fc->lock)
 	 * Either request is already in userspace, or it was forced.
 	 * Wait it out.
 	 */
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 
 	while (req->state != FUSE_REQ_FINISHED)
 		wait_event_freezable(req->waitq,
 				     req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	spin_lock(&fq->lock);
 
 	if (!req->aborted)
 		return;
@@ -405,30 +487,32 @@ __acquires(fc->lock)
 		   locked state, there mustn't be any filesystem
 		   operation (e.g. page fault), since that could lead
 		   to deadlock */
-		spin_unlock(&fc->lock);
+		spin_unlock(&fq->lock);
 		wait_event(req->waitq, !req->locked);
-		spin_lock(&fc->lock);
+		spin_lock(&fq->lock);
 	}
 }
 
 void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_queue *fq = fuse_queue_this_cpu(fc);
+
 	req->isreply = 1;
-	spin_lock(&fc->lock);
+	spin_lock(&fq->lock);
 	if (!fc->connected)
 		req->out.h.error = -ENOTCONN;
 	else if (fc->conn_error)
 		req->out.h.error = -ECONNREFUSED;
 	else {
-		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		req->in.h.unique = fuse_get_unique(fc, fq);
+		queue_request(fc, fq, req);
 		/* acquire extra reference, since request is still needed
 		   after request_end() */
 		__fuse_get_request(req);
 
 		request_wait_answer(fc, req);
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 }
 EXPORT_SYMBOL_GPL(fuse_request_send);
 
@@ -455,6 +539,7 @@ static void fuse_request_send_nowait(struct fuse_conn *fc, struct fuse_req *req)
 		fuse_request_send_nowait_locked(fc, req);
 		spin_unlock(&fc->lock);
 	} else {
+		spin_unlock(&fc->lock);
 		req->out.h.error = -ENOTCONN;
 		request_end(fc, req);
 	}
@@ -470,16 +555,17 @@ EXPORT_SYMBOL_GPL(fuse_request_send_background);
 static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 					  struct fuse_req *req, u64 unique)
 {
+	struct fuse_queue *fq = fuse_queue_this_cpu(fc);
 	int err = -ENODEV;
 
 	req->isreply = 0;
 	req->in.h.unique = unique;
-	spin_lock(&fc->lock);
+	spin_lock(&fq->lock);
 	if (fc->connected) {
-		queue_request(fc, req);
+		queue_request(fc, fq, req);
 		err = 0;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 
 	return err;
 }
@@ -501,16 +587,16 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
  * anything that could cause a page-fault.  If the request was already
  * aborted bail out.
  */
-static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
+static int lock_request(struct fuse_req *req)
 {
 	int err = 0;
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->fq->lock);
 		if (req->aborted)
 			err = -ENOENT;
 		else
 			req->locked = 1;
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->fq->lock);
 	}
 	return err;
 }
@@ -520,14 +606,14 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
  * requester thread is currently waiting for it to be unlocked, so
  * wake it up.
  */
-static void unlock_request(struct fuse_conn *fc, struct fuse_req *req)
+static void unlock_request(struct fuse_req *req)
 {
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->fq->lock);
 		req->locked = 0;
 		if (req->aborted)
 			wake_up(&req->waitq);
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->fq->lock);
 	}
 }
 
@@ -594,7 +680,7 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 	unsigned long offset;
 	int err;
 
-	unlock_request(cs->fc, cs->req);
+	unlock_request(cs->req);
 	fuse_copy_finish(cs);
 	if (cs->pipebufs) {
 		struct pipe_buffer *buf = cs->pipebufs;
@@ -652,7 +738,7 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 		cs->addr += cs->len;
 	}
 
-	return lock_request(cs->fc, cs->req);
+	return lock_request(cs->req);
 }
 
 /* Do as much copy to/from userspace buffer as we can */
@@ -700,7 +786,7 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 	struct address_space *mapping;
 	pgoff_t index;
 
-	unlock_request(cs->fc, cs->req);
+	unlock_request(cs->req);
 	fuse_copy_finish(cs);
 
 	err = buf->ops->confirm(cs->pipe, buf);
@@ -757,12 +843,12 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 		lru_cache_add_file(newpage);
 
 	err = 0;
-	spin_lock(&cs->fc->lock);
+	spin_lock(&cs->req->fq->lock);
 	if (cs->req->aborted)
 		err = -ENOENT;
 	else
 		*pagep = newpage;
-	spin_unlock(&cs->fc->lock);
+	spin_unlock(&cs->req->fq->lock);
 
 	if (err) {
 		unlock_page(newpage);
@@ -782,7 +868,7 @@ out_fallback:
 	cs->mapaddr = buf->ops->map(cs->pipe, buf, 1);
 	cs->buf = cs->mapaddr + buf->offset;
 
-	err = lock_request(cs->fc, cs->req);
+	err = lock_request(cs->req);
 	if (err)
 		return err;
 
@@ -797,7 +883,7 @@ static int fuse_ref_page(struct fuse_copy_state *cs, struct page *page,
 	if (cs->nr_segs == cs->pipe->buffers)
 		return -EIO;
 
-	unlock_request(cs->fc, cs->req);
+	unlock_request(cs->req);
 	fuse_copy_finish(cs);
 
 	buf = cs->pipebufs;
@@ -910,36 +996,71 @@ static int fuse_copy_args(struct fuse_copy_state *cs, unsigned numargs,
 	return err;
 }
 
-static int forget_pending(struct fuse_conn *fc)
+static int forget_pending(struct fuse_queue *fq)
 {
-	return fc->forget_list_head.next != NULL;
+	return fq->forget_list_head.next != NULL;
 }
 
-static int request_pending(struct fuse_conn *fc)
+static int request_pending(struct fuse_queue *fq)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
-		forget_pending(fc);
+	return !list_empty(&fq->pending) || !list_empty(&fq->interrupts) ||
+		forget_pending(fq);
 }
 
-/* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+/*
+ * Find a queue with something for userspace, the one of the current
+ * CPU first.  Lockless, the caller checks again under the queue lock.
+ */
+static struct fuse_queue *fuse_pending_queue(struct fuse_conn *fc)
 {
-	DECLARE_WAITQUEUE(wait, current);
+	int this_cpu = raw_smp_processor_id();
+	struct fuse_queue *fq = per_cpu_ptr(fc->queues, this_cpu);
+	int cpu;
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
-	while (fc->connected && !request_pending(fc)) {
-		set_current_state(TASK_INTERRUPTIBLE);
-		if (signal_pending(current))
-			break;
+	if (request_pending(fq))
+		return fq;
 
-		spin_unlock(&fc->lock);
-		schedule();
-		spin_lock(&fc->lock);
+	for_each_possible_cpu(cpu) {
+		fq = per_cpu_ptr(fc->queues, cpu);
+		if (cpu != this_cpu && request_pending(fq))
+			return fq;
+	}
+	return NULL;
+}
+
+/*
+ * Wait until a request is available on one of the queues.  Returns
+ * that queue locked, or NULL with the error in *errp.
+ */
+static struct fuse_queue *request_wait(struct fuse_conn *fc, struct file *file,
+				       int *errp)
+{
+	struct fuse_queue *fq;
+
+	for (;;) {
+		*errp = -ENODEV;
+		if (!fc->connected)
+			return NULL;
+
+		fq = fuse_pending_queue(fc);
+		if (fq) {
+			spin_lock(&fq->lock);
+			if (fc->connected && request_pending(fq))
+				return fq;
+			/* Someone else was faster, look again */
+			spin_unlock(&fq->lock);
+			continue;
+		}
+
+		*errp = -EAGAIN;
+		if (file->f_flags & O_NONBLOCK)
+			return NULL;
+
+		*errp = -ERESTARTSYS;
+		if (wait_event_interruptible_exclusive(fc->waitq,
+				!fc->connected || fuse_pending_queue(fc)))
+			return NULL;
 	}
-	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
 }
 
 /*
@@ -948,11 +1069,12 @@ __acquires(fc->lock)
  * Unlike other requests this is assembled on demand, without a need
  * to allocate a separate fuse_req structure.
  *
- * Called with fc->lock held, releases it
+ * Called with fq->lock held, releases it
  */
-static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_copy_state *cs,
+static int fuse_read_interrupt(struct fuse_queue *fq,
+			       struct fuse_copy_state *cs,
 			       size_t nbytes, struct fuse_req *req)
-__releases(fc->lock)
+__releases(fq->lock)
 {
 	struct fuse_in_header ih;
 	struct fuse_interrupt_in arg;
@@ -960,15 +1082,14 @@ __releases(fc->lock)
 	int err;
 
 	list_del_init(&req->intr_entry);
-	req->intr_unique = fuse_get_unique(fc);
 	memset(&ih, 0, sizeof(ih));
 	memset(&arg, 0, sizeof(arg));
 	ih.len = reqsize;
 	ih.opcode = FUSE_INTERRUPT;
-	ih.unique = req->intr_unique;
+	ih.unique = req->in.h.unique | FUSE_INT_REQ_BIT;
 	arg.unique = req->in.h.unique;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 	if (nbytes < reqsize)
 		return -EINVAL;
 
@@ -980,21 +1101,21 @@ __releases(fc->lock)
 	return err ? err : reqsize;
 }
 
-static struct fuse_forget_link *dequeue_forget(struct fuse_conn *fc,
+static struct fuse_forget_link *dequeue_forget(struct fuse_queue *fq,
 					       unsigned max,
 					       unsigned *countp)
 {
-	struct fuse_forget_link *head = fc->forget_list_head.next;
+	struct fuse_forget_link *head = fq->forget_list_head.next;
 	struct fuse_forget_link **newhead = &head;
 	unsigned count;
 
 	for (count = 0; *newhead != NULL && count < max; count++)
 		newhead = &(*newhead)->next;
 
-	fc->forget_list_head.next = *newhead;
+	fq->forget_list_head.next = *newhead;
 	*newhead = NULL;
-	if (fc->forget_list_head.next == NULL)
-		fc->forget_list_tail = &fc->forget_list_head;
+	if (fq->forget_list_head.next == NULL)
+		fq->forget_list_tail = &fq->forget_list_head;
 
 	if (countp != NULL)
 		*countp = count;
@@ -1003,23 +1124,24 @@ static struct fuse_forget_link *dequeue_forget(struct fuse_conn *fc,
 }
 
 static int fuse_read_single_forget(struct fuse_conn *fc,
+				   struct fuse_queue *fq,
 				   struct fuse_copy_state *cs,
 				   size_t nbytes)
-__releases(fc->lock)
+__releases(fq->lock)
 {
 	int err;
-	struct fuse_forget_link *forget = dequeue_forget(fc, 1, NULL);
+	struct fuse_forget_link *forget = dequeue_forget(fq, 1, NULL);
 	struct fuse_forget_in arg = {
 		.nlookup = forget->forget_one.nlookup,
 	};
 	struct fuse_in_header ih = {
 		.opcode = FUSE_FORGET,
 		.nodeid = forget->forget_one.nodeid,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_unique(fc, fq),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 	kfree(forget);
 	if (nbytes < ih.len)
 		return -EINVAL;
@@ -1036,8 +1158,9 @@ __releases(fc->lock)
 }
 
 static int fuse_read_batch_forget(struct fuse_conn *fc,
-				   struct fuse_copy_state *cs, size_t nbytes)
-__releases(fc->lock)
+				  struct fuse_queue *fq,
+				  struct fuse_copy_state *cs, size_t nbytes)
+__releases(fq->lock)
 {
 	int err;
 	unsigned max_forgets;
@@ -1046,18 +1169,18 @@ __releases(fc->lock)
 	struct fuse_batch_forget_in arg = { .count = 0 };
 	struct fuse_in_header ih = {
 		.opcode = FUSE_BATCH_FORGET,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_unique(fc, fq),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
 	if (nbytes < ih.len) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&fq->lock);
 		return -EINVAL;
 	}
 
 	max_forgets = (nbytes - ih.len) / sizeof(struct fuse_forget_one);
-	head = dequeue_forget(fc, max_forgets, &count);
-	spin_unlock(&fc->lock);
+	head = dequeue_forget(fq, max_forgets, &count);
+	spin_unlock(&fq->lock);
 
 	arg.count = count;
 	ih.len += count * sizeof(struct fuse_forget_one);
@@ -1084,14 +1207,14 @@ __releases(fc->lock)
 	return ih.len;
 }
 
-static int fuse_read_forget(struct fuse_conn *fc, struct fuse_copy_state *cs,
-			    size_t nbytes)
-__releases(fc->lock)
+static int fuse_read_forget(struct fuse_conn *fc, struct fuse_queue *fq,
+			    struct fuse_copy_state *cs, size_t nbytes)
+__releases(fq->lock)
 {
-	if (fc->minor < 16 || fc->forget_list_head.next->next == NULL)
-		return fuse_read_single_forget(fc, cs, nbytes);
+	if (fc->minor < 16 || fq->forget_list_head.next->next == NULL)
+		return fuse_read_single_forget(fc, fq, cs, nbytes);
 	else
-		return fuse_read_batch_forget(fc, cs, nbytes);
+		return fuse_read_batch_forget(fc, fq, cs, nbytes);
 }
 
 /*
@@ -1107,42 +1230,33 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_queue *fq;
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
 
  restart:
-	spin_lock(&fc->lock);
-	err = -EAGAIN;
-	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
-	    !request_pending(fc))
-		goto err_unlock;
-
-	request_wait(fc);
-	err = -ENODEV;
-	if (!fc->connected)
-		goto err_unlock;
-	err = -ERESTARTSYS;
-	if (!request_pending(fc))
-		goto err_unlock;
+	fq = request_wait(fc, file, &err);
+	if (!fq)
+		return err;
 
-	if (!list_empty(&fc->interrupts)) {
-		req = list_entry(fc->interrupts.next, struct fuse_req,
+	if (!list_empty(&fq->interrupts)) {
+		req = list_entry(fq->interrupts.next, struct fuse_req,
 				 intr_entry);
-		return fuse_read_interrupt(fc, cs, nbytes, req);
+		return fuse_read_interrupt(fq, cs, nbytes, req);
 	}
 
-	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
-			return fuse_read_forget(fc, cs, nbytes);
+	if (forget_pending(fq)) {
+		if (list_empty(&fq->pending) || fq->forget_batch-- > 0)
+			return fuse_read_forget(fc, fq, cs, nbytes);
 
-		if (fc->forget_batch <= -8)
-			fc->forget_batch = 16;
+		if (fq->forget_batch <= -8)
+			fq->forget_batch = 16;
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	req = list_entry(fq->pending.next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &fq->io);
 
 	in = &req->in;
 	reqsize = in->h.len;
@@ -1155,14 +1269,14 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 		goto restart;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 	cs->req = req;
 	err = fuse_copy_one(cs, &in->h, sizeof(in->h));
 	if (!err)
 		err = fuse_copy_args(cs, in->numargs, in->argpages,
 				     (struct fuse_arg *) in->args, 0);
 	fuse_copy_finish(cs);
-	spin_lock(&fc->lock);
+	spin_lock(&fq->lock);
 	req->locked = 0;
 	if (req->aborted) {
 		request_end(fc, req);
@@ -1177,16 +1291,13 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 	else {
 		req->state = FUSE_REQ_SENT;
-		list_move_tail(&req->list, &fc->processing);
+		list_move_tail(&req->list,
+			       &fq->processing[fuse_req_hash(fc, in->h.unique)]);
 		if (req->interrupted)
-			queue_interrupt(fc, req);
-		spin_unlock(&fc->lock);
+			queue_interrupt(fc, fq, req);
+		spin_unlock(&fq->lock);
 	}
 	return reqsize;
-
- err_unlock:
-	spin_unlock(&fc->lock);
-	return err;
 }
 
 static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
@@ -1545,14 +1656,25 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 	loff_t file_size;
 	unsigned int num;
 	unsigned int offset;
+	unsigned int num_pages;
 	size_t total_len = 0;
 
-	req = fuse_get_req(fc);
+	offset = outarg->offset & ~PAGE_CACHE_MASK;
+	file_size = i_size_read(inode);
+
+	num = outarg->size;
+	if (outarg->offset > file_size)
+		num = 0;
+	else if (outarg->offset + num > file_size)
+		num = file_size - outarg->offset;
+
+	num_pages = (num + offset + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+	num_pages = min(num_pages, fc->max_pages);
+
+	req = fuse_get_req(fc, num_pages);
 	if (IS_ERR(req))
 		return PTR_ERR(req);
 
-	offset = outarg->offset & ~PAGE_CACHE_MASK;
-
 	req->in.h.opcode = FUSE_NOTIFY_REPLY;
 	req->in.h.nodeid = outarg->nodeid;
 	req->in.numargs = 2;
@@ -1561,14 +1683,8 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 	req->end = fuse_retrieve_end;
 
 	index = outarg->offset >> PAGE_CACHE_SHIFT;
-	file_size = i_size_read(inode);
-	num = outarg->size;
-	if (outarg->offset > file_size)
-		num = 0;
-	else if (outarg->offset + num > file_size)
-		num = file_size - outarg->offset;
 
-	while (num && req->num_pages < FUSE_MAX_PAGES_PER_REQ) {
+	while (num && req->num_pages < num_pages) {
 		struct page *page;
 		unsigned int this_num;
 
@@ -1664,14 +1780,14 @@ static int fuse_notify(struct fuse_conn *fc, enum fuse_notify_code code,
 }
 
 /* Look up request on processing list by unique ID */
-static struct fuse_req *request_find(struct fuse_conn *fc, u64 unique)
+static struct fuse_req *request_find(struct fuse_conn *fc,
+				     struct fuse_queue *fq, u64 unique)
 {
-	struct list_head *entry;
+	struct fuse_req *req;
 
-	list_for_each(entry, &fc->processing) {
-		struct fuse_req *req;
-		req = list_entry(entry, struct fuse_req, list);
-		if (req->in.h.unique == unique || req->intr_unique == unique)
+	list_for_each_entry(req, &fq->processing[fuse_req_hash(fc, unique)],
+			    list) {
+		if (req->in.h.unique == unique)
 			return req;
 	}
 	return NULL;
@@ -1703,7 +1819,7 @@ static int copy_out_args(struct fuse_copy_state *cs, struct fuse_out *out,
 /*
  * Write a single reply to a request.  First the header is copied from
  * the write buffer.  The request is then searched on the processing
- * list by the unique ID found in the header.  If found, then remove
+ * list of its queue by the unique ID found in the header.  If found, then remove
  * it from the list and copy the rest of the buffer to the request.
  * The request is finished by calling request_end()
  */
@@ -1711,6 +1827,7 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 				 struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_queue *fq;
 	struct fuse_req *req;
 	struct fuse_out_header oh;
 
@@ -1738,24 +1855,28 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	if (oh.error <= -1000 || oh.error > 0)
 		goto err_finish;
 
-	spin_lock(&fc->lock);
 	err = -ENOENT;
+	fq = fuse_unique_queue(fc, oh.unique);
+	if (!fq)
+		goto err_finish;
+
+	spin_lock(&fq->lock);
 	if (!fc->connected)
 		goto err_unlock;
 
-	req = request_find(fc, oh.unique);
+	req = request_find(fc, fq, oh.unique & ~FUSE_INT_REQ_BIT);
 	if (!req)
 		goto err_unlock;
 
 	if (req->aborted) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&fq->lock);
 		fuse_copy_finish(cs);
-		spin_lock(&fc->lock);
+		spin_lock(&fq->lock);
 		request_end(fc, req);
 		return -ENOENT;
 	}
 	/* Is it an interrupt reply? */
-	if (req->intr_unique == oh.unique) {
+	if (oh.unique & FUSE_INT_REQ_BIT) {
 		err = -EINVAL;
 		if (nbytes != sizeof(struct fuse_out_header))
 			goto err_unlock;
@@ -1763,26 +1884,28 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 		if (oh.error == -ENOSYS)
 			fc->no_interrupt = 1;
 		else if (oh.error == -EAGAIN)
-			queue_interrupt(fc, req);
+			queue_interrupt(fc, fq, req);
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&fq->lock);
 		fuse_copy_finish(cs);
 		return nbytes;
 	}
 
 	req->state = FUSE_REQ_WRITING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &fq->io);
 	req->out.h = oh;
 	req->locked = 1;
 	cs->req = req;
 	if (!req->out.page_replace)
 		cs->move_pages = 0;
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
 
 	err = copy_out_args(cs, &req->out, nbytes);
 	fuse_copy_finish(cs);
+	if (!err)
+		fuse_passthrough_setup(fc, req);
 
-	spin_lock(&fc->lock);
+	spin_lock(&fq->lock);
 	req->locked = 0;
 	if (!err) {
 		if (req->aborted)
@@ -1794,7 +1917,7 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	return err ? err : nbytes;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&fq->lock);
  err_finish:
 	fuse_copy_finish(cs);
 	return err;
@@ -1900,12 +2023,10 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &fc->waitq, wait);
 
-	spin_lock(&fc->lock);
 	if (!fc->connected)
 		mask = POLLERR;
-	else if (request_pending(fc))
+	else if (fuse_pending_queue(fc))
 		mask |= POLLIN | POLLRDNORM;
-	spin_unlock(&fc->lock);
 
 	return mask;
 }
@@ -1913,18 +2034,19 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 /*
  * Abort all requests on the given list (pending or processing)
  *
- * This function releases and reacquires fc->lock
+ * This function releases and reacquires fq->lock
  */
-static void end_requests(struct fuse_conn *fc, struct list_head *head)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_requests(struct fuse_conn *fc, struct fuse_queue *fq,
+			 struct list_head *head)
+__releases(fq->lock)
+__acquires(fq->lock)
 {
 	while (!list_empty(head)) {
 		struct fuse_req *req;
 		req = list_entry(head->next, struct fuse_req, list);
 		req->out.h.error = -ECONNABORTED;
 		request_end(fc, req);
-		spin_lock(&fc->lock);
+		spin_lock(&fq->lock);
 	}
 }
 
@@ -1939,13 +2061,13 @@ __acquires(fc->lock)
  * called after waiting for the request to be unlocked (if it was
  * locked).
  */
-static void end_io_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_io_requests(struct fuse_conn *fc, struct fuse_queue *fq)
+__releases(fq->lock)
+__acquires(fq->lock)
 {
-	while (!list_empty(&fc->io)) {
+	while (!list_empty(&fq->io)) {
 		struct fuse_req *req =
-			list_entry(fc->io.next, struct fuse_req, list);
+			list_entry(fq->io.next, struct fuse_req, list);
 		void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 
 		req->aborted = 1;
@@ -1956,25 +2078,46 @@ __acquires(fc->lock)
 		if (end) {
 			req->end = NULL;
 			__fuse_get_request(req);
-			spin_unlock(&fc->lock);
+			spin_unlock(&fq->lock);
 			wait_event(req->waitq, !req->locked);
 			end(fc, req);
 			fuse_put_request(fc, req);
-			spin_lock(&fc->lock);
+			spin_lock(&fq->lock);
 		}
 	}
 }
 
-static void end_queued_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_queued_requests(struct fuse_conn *fc, struct fuse_queue *fq)
+__releases(fq->lock)
+__acquires(fq->lock)
 {
-	fc->max_background = UINT_MAX;
-	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
-	end_requests(fc, &fc->processing);
-	while (forget_pending(fc))
-		kfree(dequeue_forget(fc, 1, NULL));
+	int i;
+
+	end_requests(fc, fq, &fq->pending);
+	for (i = 0; i < FUSE_PQ_HASH_SIZE; i++)
+		end_requests(fc, fq, &fq->processing[i]);
+	while (forget_pending(fq))
+		kfree(dequeue_forget(fq, 1, NULL));
+}
+
+/*
+ * End the requests on all queues, including those under I/O if @io.
+ * The connection must already be marked disconnected so that no more
+ * requests are queued meanwhile.
+ */
+static void end_queues(struct fuse_conn *fc, bool io)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_queue *fq = per_cpu_ptr(fc->queues, cpu);
+
+		spin_lock(&fq->lock);
+		if (io)
+			end_io_requests(fc, fq);
+		end_queued_requests(fc, fq);
+		spin_unlock(&fq->lock);
+	}
 }
 
 static void end_polls(struct fuse_conn *fc)
@@ -1992,6 +2135,19 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/*
+ * Disconnect and move the background requests onto the queues, so
+ * that they are ended with the rest.  Called with fc->lock held.
+ */
+static void fuse_disconnect(struct fuse_conn *fc)
+{
+	fc->connected = 0;
+	fc->blocked = 0;
+	fc->max_background = UINT_MAX;
+	flush_bg_queue(fc);
+	end_polls(fc);
+}
+
 /*
  * Abort all requests.
  *
@@ -2005,7 +2161,9 @@ static void end_polls(struct fuse_conn *fc)
  *
  * During the aborting, progression of requests from the pending and
  * processing lists onto the io list, and progression of new requests
- * onto the pending list is prevented by req->connected being false.
+ * onto the pending list is prevented by fc->connected being false.
+ * It is checked under the lock of the queue, so once that lock has
+ * been taken here, nothing more is added to the queue.
  *
  * Progression of requests under I/O to the processing list is
  * prevented by the req->aborted flag being true for these requests.
@@ -2014,31 +2172,50 @@ static void end_polls(struct fuse_conn *fc)
 void fuse_abort_conn(struct fuse_conn *fc)
 {
 	spin_lock(&fc->lock);
-	if (fc->connected) {
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_io_requests(fc);
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->waitq);
-		wake_up_all(&fc->blocked_waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	if (!fc->connected) {
+		spin_unlock(&fc->lock);
+		return;
 	}
+	fuse_disconnect(fc);
 	spin_unlock(&fc->lock);
+
+	end_queues(fc, true);
+	wake_up_all(&fc->waitq);
+	wake_up_all(&fc->blocked_waitq);
+	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 }
 EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
+void fuse_queue_get_stats(struct fuse_conn *fc, int cpu,
+			  struct fuse_queue_stats *stats)
+{
+	struct fuse_queue *fq = per_cpu_ptr(fc->queues, cpu);
+	struct fuse_req *req;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	spin_lock(&fq->lock);
+	list_for_each_entry(req, &fq->pending, list)
+		stats->pending++;
+	for (i = 0; i < FUSE_PQ_HASH_SIZE; i++) {
+		list_for_each_entry(req, &fq->processing[i], list)
+			stats->processing++;
+	}
+	stats->completed = fq->completed;
+	stats->latency_ns = fq->latency_ns;
+	stats->max_latency_ns = fq->max_latency_ns;
+	spin_unlock(&fq->lock);
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_conn *fc = fuse_get_conn(file);
 	if (fc) {
 		spin_lock(&fc->lock);
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->blocked_waitq);
+		fuse_disconnect(fc);
 		spin_unlock(&fc->lock);
+		end_queues(fc, false);
+		wake_up_all(&fc->blocked_waitq);
 		fuse_conn_put(fc);
 	}
 
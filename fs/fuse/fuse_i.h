@@ -22,9 +22,19 @@
 #include <linux/rbtree.h>
 #include <linux/poll.h>
 #include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/percpu.h>
 
-/** Max number of pages that can be used in a single read request */
-#define FUSE_MAX_PAGES_PER_REQ 32
+#define FUSE_SUPER_MAGIC 0x65735546
+
+/** Default max number of pages that can be used in a single request */
+#define FUSE_DEFAULT_MAX_PAGES_PER_REQ 32
+
+/** Upper limit the filesystem may raise max_pages to at INIT (1MB) */
+#define FUSE_MAX_MAX_PAGES 256
+
+/** Number of page pointers embedded in fuse_req */
+#define FUSE_REQ_INLINE_PAGES 1
 
 /** Bias for fi->writectr, meaning new writepages must not be sent */
 #define FUSE_NOWRITE INT_MIN
@@ -33,7 +43,16 @@
 #define FUSE_NAME_MAX 1024
 
 /** Number of dentries for each connection in the control filesystem */
-#define FUSE_CTL_NUM_DENTRIES 5
+#define FUSE_CTL_NUM_DENTRIES 6
+
+/** Number of hash buckets for the requests being processed in a queue */
+#define FUSE_PQ_HASH_BITS 6
+#define FUSE_PQ_HASH_SIZE (1 << FUSE_PQ_HASH_BITS)
+
+/** Unique IDs of requests are even.  An INTERRUPT reuses the ID of the
+    request it interrupts with the lowest bit set */
+#define FUSE_INT_REQ_BIT (1ULL << 0)
+#define FUSE_REQ_ID_STEP (1ULL << 1)
 
 /** If the FUSE_DEFAULT_PERMISSIONS flag is given, the filesystem
     module will check permissions based on the file mode.  Otherwise no
@@ -150,6 +169,9 @@ struct fuse_file {
 
 	/** Has flock been performed on this file? */
 	bool flock:1;
+
+	/** Backing file for FOPEN_PASSTHROUGH, or NULL */
+	struct file *passthrough_filp;
 };
 
 /** One input argument of a request */
@@ -224,7 +246,7 @@ enum fuse_req_state {
  */
 struct fuse_req {
 	/** This can be on either pending processing or io lists in
-	    fuse_conn */
+	    fuse_queue */
 	struct list_head list;
 
 	/** Entry on the interrupts list  */
@@ -233,13 +255,16 @@ struct fuse_req {
 	/** refcount */
 	atomic_t count;
 
-	/** Unique ID for the interrupt request */
-	u64 intr_unique;
+	/** Queue the request was sent on, set when first queued */
+	struct fuse_queue *fq;
+
+	/** Time the request was queued for userspace */
+	ktime_t queue_time;
 
 	/*
 	 * The following bitfields are either set once before the
 	 * request is queued or setting/clearing them is protected by
-	 * fuse_conn->lock
+	 * fuse_queue->lock
 	 */
 
 	/** True if the request has reply */
@@ -300,7 +325,13 @@ struct fuse_req {
 	} misc;
 
 	/** page vector */
-	struct page *pages[FUSE_MAX_PAGES_PER_REQ];
+	struct page **pages;
+
+	/** size of the 'pages' array */
+	unsigned max_pages;
+
+	/** inline page vector, used for requests of few pages */
+	struct page *inline_pages[FUSE_REQ_INLINE_PAGES];
 
 	/** number of pages in vector */
 	unsigned num_pages;
@@ -322,6 +353,66 @@ struct fuse_req {
 
 	/** Request is stolen from fuse_file->reserved_req */
 	struct file *stolen_file;
+
+	/** Backing file from an OPEN or CREATE reply with FOPEN_PASSTHROUGH */
+	struct file *passthrough_filp;
+};
+
+/**
+ * A queue of requests to userspace.
+ *
+ * There is one for each possible CPU of a connection.  Requests are
+ * queued on the one of the CPU they are sent from and the readers of
+ * the device serve the queue of the CPU they run on first, so a daemon
+ * with a thread per CPU does not contend on a single list and lock.
+ * The queue of a request is encoded in its unique ID, so replies may
+ * come through any reader.
+ */
+struct fuse_queue {
+	/** Lock protecting the lists, the counters and the state of
+	    the requests on them */
+	spinlock_t lock;
+
+	/** CPU this queue belongs to */
+	unsigned cpu;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** Requests being processed, hashed by unique ID */
+	struct list_head processing[FUSE_PQ_HASH_SIZE];
+
+	/** The list of requests under I/O */
+	struct list_head io;
+
+	/** Pending interrupts */
+	struct list_head interrupts;
+
+	/** Queue of pending forgets */
+	struct fuse_forget_link forget_list_head;
+	struct fuse_forget_link *forget_list_tail;
+
+	/** Batching of FORGET requests (positive indicates FORGET batch) */
+	int forget_batch;
+
+	/** The counter of unique request IDs */
+	u64 reqctr;
+
+	/** Number of requests completed */
+	u64 completed;
+
+	/** Total and worst time from queuing to completion */
+	u64 latency_ns;
+	u64 max_latency_ns;
+};
+
+/** Snapshot of the state of a fuse_queue */
+struct fuse_queue_stats {
+	unsigned pending;
+	unsigned processing;
+	u64 completed;
+	u64 latency_ns;
+	u64 max_latency_ns;
 };
 
 /**
@@ -356,17 +447,17 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
+	/** Maximum number of pages that can be used in a single request */
+	unsigned max_pages;
+
 	/** Readers of the connection are waiting on this */
 	wait_queue_head_t waitq;
 
-	/** The list of pending requests */
-	struct list_head pending;
+	/** Per-CPU request queues */
+	struct fuse_queue __percpu *queues;
 
-	/** The list of requests being processed */
-	struct list_head processing;
-
-	/** The list of requests under I/O */
-	struct list_head io;
+	/** Number of bits of the CPU in the unique request IDs */
+	unsigned queue_shift;
 
 	/** The next unique kernel file handle */
 	u64 khctr;
@@ -389,16 +480,6 @@ struct fuse_conn {
 	/** The list of background requests set aside for later queuing */
 	struct list_head bg_queue;
 
-	/** Pending interrupts */
-	struct list_head interrupts;
-
-	/** Queue of pending forgets */
-	struct fuse_forget_link forget_list_head;
-	struct fuse_forget_link *forget_list_tail;
-
-	/** Batching of FORGET requests (positive indicates FORGET batch) */
-	int forget_batch;
-
 	/** Flag indicating if connection is blocked.  This will be
 	    the case before the INIT reply is received, and if there
 	    are too many outstading backgrounds requests */
@@ -410,9 +491,6 @@ struct fuse_conn {
 	/** waitq for reserved requests */
 	wait_queue_head_t reserved_req_waitq;
 
-	/** The next unique request id */
-	u64 reqctr;
-
 	/** Connection established, cleared on umount, connection
 	    abort and device release */
 	unsigned connected;
@@ -490,6 +568,12 @@ struct fuse_conn {
 	/** Are BSD file locking primitives not implemented by fs? */
 	unsigned no_flock:1;
 
+	/** Cache buffered writes in the page cache?  Only set in INIT */
+	unsigned writeback_cache:1;
+
+	/** May open return a backing file?  Only set in INIT */
+	unsigned passthrough:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -659,11 +743,11 @@ int fuse_ctl_init(void);
 void fuse_ctl_cleanup(void);
 
 /**
- * Allocate a request
+ * Allocate a request with room for @npages pages
  */
-struct fuse_req *fuse_request_alloc(void);
+struct fuse_req *fuse_request_alloc(unsigned npages);
 
-struct fuse_req *fuse_request_alloc_nofs(void);
+struct fuse_req *fuse_request_alloc_nofs(unsigned npages);
 
 /**
  * Free a request
@@ -671,9 +755,14 @@ struct fuse_req *fuse_request_alloc_nofs(void);
 void fuse_request_free(struct fuse_req *req);
 
 /**
- * Get a request, may fail with -ENOMEM
+ * Get a request with room for @npages pages, may fail with -ENOMEM
  */
-struct fuse_req *fuse_get_req(struct fuse_conn *fc);
+struct fuse_req *fuse_get_req(struct fuse_conn *fc, unsigned npages);
+
+static inline struct fuse_req *fuse_get_req_nopages(struct fuse_conn *fc)
+{
+	return fuse_get_req(fc, 0);
+}
 
 /**
  * Gets a requests for a file operation, always succeeds
@@ -702,6 +791,12 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
 /* Abort all requests */
 void fuse_abort_conn(struct fuse_conn *fc);
 
+/**
+ * Get the state of the queue of @cpu
+ */
+void fuse_queue_get_stats(struct fuse_conn *fc, int cpu,
+			  struct fuse_queue_stats *stats);
+
 /**
  * Invalidate inode attributes
  */
@@ -719,7 +814,7 @@ void fuse_conn_kill(struct fuse_conn *fc);
 /**
  * Initialize fuse_conn
  */
-void fuse_conn_init(struct fuse_conn *fc);
+int fuse_conn_init(struct fuse_conn *fc);
 
 /**
  * Release reference to fuse_conn
@@ -790,4 +885,19 @@ int fuse_dev_release(struct inode *inode, struct file *file);
 
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
+int fuse_flush_times(struct inode *inode, struct fuse_file *ff);
+int fuse_write_inode(struct inode *inode, struct writeback_control *wbc);
+
+/* passthrough.c */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req);
+void fuse_passthrough_open(struct fuse_file *ff, struct fuse_req *req,
+			   int flags);
+void fuse_passthrough_finish_open(struct inode *inode, struct fuse_file *ff);
+void fuse_passthrough_release(struct fuse_file *ff);
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos);
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
@@ -0,0 +1,192 @@
+/*
+  FUSE: Filesystem in Userspace
+
+  Passthrough of read, write and mmap to a backing file supplied by
+  the filesystem daemon at open time.
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+#include "fuse_i.h"
+
+#include <linux/aio.h>
+#include <linux/cred.h>
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/uio.h>
+
+/*
+ * Called from fuse_dev_do_write() in the context of the filesystem
+ * daemon replying to an OPEN or CREATE request, so passthrough_fd is
+ * looked up in the daemon's file table.  A file that can't be used
+ * for passthrough is ignored and the open falls back to normal IO.
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_open_out *outarg;
+	struct file *backing;
+	struct inode *inode;
+
+	if (!fc->passthrough || req->out.h.error)
+		return;
+
+	if (req->in.h.opcode == FUSE_OPEN)
+		outarg = req->out.args[0].value;
+	else if (req->in.h.opcode == FUSE_CREATE)
+		outarg = req->out.args[1].value;
+	else
+		return;
+
+	if (!(outarg->open_flags & FOPEN_PASSTHROUGH) ||
+	    (outarg->open_flags & FOPEN_DIRECT_IO))
+		return;
+
+	backing = fget(outarg->passthrough_fd);
+	if (!backing)
+		return;
+
+	/* No stacking on FUSE itself, and the backing fs must do aio */
+	inode = backing->f_path.dentry->d_inode;
+	if (!S_ISREG(inode->i_mode) ||
+	    inode->i_sb->s_magic == FUSE_SUPER_MAGIC ||
+	    !backing->f_op || !backing->f_op->aio_read ||
+	    !backing->f_op->aio_write) {
+		fput(backing);
+		return;
+	}
+
+	req->passthrough_filp = backing;
+}
+
+/*
+ * Take the backing file from the reply to the OPEN or CREATE request
+ * @req, if it allows all the access the FUSE file is opened with
+ */
+void fuse_passthrough_open(struct fuse_file *ff, struct fuse_req *req,
+			   int flags)
+{
+	struct file *backing = req->passthrough_filp;
+	fmode_t mode = OPEN_FMODE(flags) & (FMODE_READ | FMODE_WRITE);
+
+	if (!backing)
+		return;
+
+	req->passthrough_filp = NULL;
+	if ((mode & ~backing->f_mode) ||
+	    ((flags & O_APPEND) && !(backing->f_flags & O_APPEND))) {
+		fput(backing);
+		return;
+	}
+
+	ff->passthrough_filp = backing;
+}
+
+/*
+ * IO on the backing file bypasses the page cache of the FUSE inode:
+ * write back what is dirty there and drop the rest, so that cached
+ * pages don't hide data written through the backing file.  If pages
+ * can't be dropped, e.g. because they are mapped, use the daemon.
+ */
+void fuse_passthrough_finish_open(struct inode *inode, struct fuse_file *ff)
+{
+	struct address_space *mapping = inode->i_mapping;
+
+	if (filemap_write_and_wait(mapping) ||
+	    invalidate_inode_pages2(mapping))
+		fuse_passthrough_release(ff);
+}
+
+void fuse_passthrough_release(struct fuse_file *ff)
+{
+	if (ff->passthrough_filp) {
+		fput(ff->passthrough_filp);
+		ff->passthrough_filp = NULL;
+	}
+}
+
+/*
+ * The IO is done with the credentials of the daemon that opened the
+ * backing file; permission to do it was checked by FUSE at open.
+ */
+static ssize_t fuse_passthrough_rw(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos, int write)
+{
+	struct fuse_file *ff = iocb->ki_filp->private_data;
+	struct file *backing = ff->passthrough_filp;
+	const struct cred *old_cred;
+	struct kiocb kiocb;
+	ssize_t ret;
+
+	init_sync_kiocb(&kiocb, backing);
+	kiocb.ki_pos = pos;
+	kiocb.ki_left = iov_length(iov, nr_segs);
+	kiocb.ki_nbytes = kiocb.ki_left;
+
+	old_cred = override_creds(backing->f_cred);
+	if (write)
+		ret = backing->f_op->aio_write(&kiocb, iov, nr_segs, pos);
+	else
+		ret = backing->f_op->aio_read(&kiocb, iov, nr_segs, pos);
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+	revert_creds(old_cred);
+
+	if (ret > 0)
+		iocb->ki_pos = kiocb.ki_pos;
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_aio_read(struct kiocb *iocb, const struct iovec *iov,
+				  unsigned long nr_segs, loff_t pos)
+{
+	struct inode *inode = iocb->ki_filp->f_mapping->host;
+	ssize_t ret;
+
+	ret = fuse_passthrough_rw(iocb, iov, nr_segs, pos, 0);
+	fuse_invalidate_attr(inode); /* atime changed */
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_aio_write(struct kiocb *iocb, const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos)
+{
+	struct inode *inode = iocb->ki_filp->f_mapping->host;
+	ssize_t ret;
+
+	ret = fuse_passthrough_rw(iocb, iov, nr_segs, pos, 1);
+	if (ret > 0)
+		fuse_write_update_size(inode, iocb->ki_pos);
+	fuse_invalidate_attr(inode);
+
+	return ret;
+}
+
+/*
+ * Map the backing file directly: the vma is handed over to it, so page
+ * faults never come back to FUSE.
+ */
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough_filp;
+	int ret;
+
+	if (!backing->f_op->mmap)
+		return -ENODEV;
+
+	get_file(backing);
+	vma->vm_file = backing;
+	ret = backing->f_op->mmap(backing, vma);
+	if (ret) {
+		vma->vm_file = file;
+		fput(backing);
+	} else {
+		fput(file);
+	}
+
+	return ret;
+}
@@ -531,6 +531,12 @@ static void evict(struct inode *inode)
 
 	inode_sb_list_del(inode);
 
+	/*
+	 * Reclaim must not leave shadow entries behind the final
+	 * truncation, whether ->evict_inode does one or not.
+	 */
+	mapping_set_exiting(&inode->i_data);
+
 	if (op->evict_inode) {
 		op->evict_inode(inode);
 	} else {
@@ -538,6 +544,7 @@ static void evict(struct inode *inode)
 			truncate_inode_pages(&inode->i_data, 0);
 		end_writeback(inode);
 	}
+	truncate_shadow_entries(&inode->i_data, 0, ULONG_MAX);
 	if (S_ISBLK(inode->i_mode) && inode->i_bdev)
 		bd_forget(inode);
 	if (S_ISCHR(inode->i_mode) && inode->i_cdev)
@@ -42,6 +42,7 @@
 #include <linux/log2.h>
 #include <linux/vmalloc.h>
 #include <linux/backing-dev.h>
+#include <linux/blkdev.h>
 #include <linux/bitops.h>
 #include <linux/ratelimit.h>
 
@@ -95,6 +96,7 @@ EXPORT_SYMBOL(jbd2_journal_begin_ordered_truncate);
 EXPORT_SYMBOL(jbd2_inode_cache);
 
 static void __journal_abort_soft (journal_t *journal, int errno);
+static void jbd2_write_superblock(journal_t *journal, int write_op);
 static int jbd2_journal_create_slab(size_t slab_size);
 
 /*
@@ -692,6 +694,347 @@ wait_commit:
 }
 EXPORT_SYMBOL(jbd2_complete_transaction);
 
+/*
+ * Return 1 if transaction @tid is committed, 0 if it is still running
+ * or being committed.
+ */
+int jbd2_transaction_committed(journal_t *journal, tid_t tid)
+{
+	int ret;
+
+	read_lock(&journal->j_state_lock);
+	ret = tid_geq(journal->j_commit_sequence, tid);
+	read_unlock(&journal->j_state_lock);
+	return ret;
+}
+EXPORT_SYMBOL(jbd2_transaction_committed);
+
+/*
+ * Fast commits
+ *
+ * A journal with the fast commit feature keeps an area at its end, out of
+ * the circular log, to which the filesystem writes records of its own
+ * format describing changes made in the running transaction.  fsync()
+ * can then cost a few block writes and one cache flush instead of a full
+ * commit, and the running transaction keeps taking updates until it is
+ * committed as usual.  Each full commit makes the records in the area
+ * obsolete, so the area is reused from its start.  After a crash,
+ * recovery leaves in j_fc_replay_tid the transaction following the last
+ * one found in the log: its records are the ones to replay.
+ *
+ * The feature is set when fast commits are enabled, and cleared again,
+ * giving the area back to the log, when a journal that used them is
+ * destroyed with an empty log.  Only a journal left behind by a crash
+ * carries the feature, so a cleanly unmounted filesystem can still be
+ * recovered and checked by code that doesn't know about fast commits.
+ */
+
+/*
+ * Clear the fast commit feature and give the area back to the log.  The
+ * log must be empty.  Called with j_checkpoint_mutex held.
+ */
+static void jbd2_fc_clear_area(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	unsigned long num_fc_blks = journal->j_fc_last - journal->j_fc_first;
+
+	jbd2_journal_clear_features(journal, 0, 0,
+				    JBD2_FEATURE_INCOMPAT_FAST_COMMIT);
+	sb->s_num_fc_blks = 0;
+
+	write_lock(&journal->j_state_lock);
+	journal->j_last += num_fc_blks;
+	journal->j_free += num_fc_blks;
+	journal->j_fc_first = journal->j_fc_last = 0;
+	write_unlock(&journal->j_state_lock);
+
+	jbd2_write_superblock(journal, WRITE_FUA);
+}
+
+/**
+ * int jbd2_fc_init() - enable fast commits
+ * @journal: Journal to enable fast commits on
+ * @num_fc_blks: Number of blocks to take for the fast commit area
+ *
+ * Must be called after jbd2_journal_load() and before any transaction is
+ * started.  A journal without a fast commit area gets one of @num_fc_blks
+ * blocks from the end of the log, which is possible because the log is
+ * empty after loading; a journal that has one keeps its size.
+ */
+int jbd2_fc_init(journal_t *journal, unsigned int num_fc_blks)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	struct buffer_head **wbuf;
+
+	if (journal->j_running_transaction ||
+	    journal->j_committing_transaction ||
+	    journal->j_checkpoint_transactions ||
+	    journal->j_head != journal->j_first)
+		return -EBUSY;
+
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+		if (!num_fc_blks ||
+		    journal->j_first + JBD2_MIN_JOURNAL_BLOCKS + num_fc_blks >
+		    journal->j_last)
+			return -ENOSPC;
+		if (!jbd2_journal_set_features(journal, 0, 0,
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+			return -EINVAL;
+		sb->s_num_fc_blks = cpu_to_be32(num_fc_blks);
+
+		write_lock(&journal->j_state_lock);
+		journal->j_last -= num_fc_blks;
+		journal->j_free -= num_fc_blks;
+		journal->j_fc_first = journal->j_last;
+		journal->j_fc_last = journal->j_last + num_fc_blks;
+		write_unlock(&journal->j_state_lock);
+
+		/*
+		 * Recovery must know where the log ends before it first
+		 * wraps at the new end.
+		 */
+		jbd2_write_superblock(journal, WRITE_FUA);
+	}
+
+	wbuf = kmalloc((journal->j_fc_last - journal->j_fc_first) *
+		       sizeof(*wbuf), GFP_KERNEL);
+	if (!wbuf)
+		return -ENOMEM;
+	journal->j_fc_wbuf = wbuf;
+	journal->j_fc_off = 0;
+	journal->j_fc_nbufs = 0;
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_init);
+
+/**
+ * int jbd2_fc_disable() - remove the fast commit area
+ * @journal: Journal to remove it from
+ *
+ * For a journal mounted without fast commits that still has the area a
+ * crash left behind.  Must be called after jbd2_journal_load(), once the
+ * records have been replayed, and before any transaction is started.
+ */
+int jbd2_fc_disable(journal_t *journal)
+{
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return 0;
+	if (journal->j_running_transaction ||
+	    journal->j_committing_transaction ||
+	    journal->j_checkpoint_transactions ||
+	    journal->j_head != journal->j_first)
+		return -EBUSY;
+
+	mutex_lock(&journal->j_checkpoint_mutex);
+	jbd2_fc_clear_area(journal);
+	mutex_unlock(&journal->j_checkpoint_mutex);
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_disable);
+
+/**
+ * int jbd2_fc_begin_commit() - start a fast commit
+ * @journal: Journal to write the fast commit to
+ * @tid: Running transaction whose changes the fast commit records
+ *
+ * On success the caller owns the fast commit area: it fills records
+ * with jbd2_fc_get_buf() and finishes with jbd2_fc_end_commit(), or with
+ * jbd2_fc_end_commit_fallback() if it can't complete the record.  Returns
+ * -EALREADY if @tid is already committed, and another error if @tid
+ * can't be fast committed, in which case a full commit of it is needed.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	transaction_t *transaction;
+	DEFINE_WAIT(wait);
+
+	if (!journal->j_fc_wbuf)
+		return -EOPNOTSUPP;
+	if (is_journal_aborted(journal))
+		return -EIO;
+
+	write_lock(&journal->j_state_lock);
+	for (;;) {
+		if (tid_geq(journal->j_commit_sequence, tid)) {
+			write_unlock(&journal->j_state_lock);
+			return -EALREADY;
+		}
+		transaction = journal->j_running_transaction;
+		if (!transaction || transaction->t_tid != tid ||
+		    transaction->t_state != T_RUNNING ||
+		    journal->j_commit_request == tid) {
+			write_unlock(&journal->j_state_lock);
+			return -EAGAIN;
+		}
+		/* Records are only replayed after a fully committed log */
+		if (journal->j_committing_transaction) {
+			write_unlock(&journal->j_state_lock);
+			jbd2_log_wait_commit(journal, tid - 1);
+			write_lock(&journal->j_state_lock);
+			continue;
+		}
+		if (!(journal->j_flags & JBD2_FAST_COMMIT_ONGOING))
+			break;
+		prepare_to_wait(&journal->j_wait_fc, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		finish_wait(&journal->j_wait_fc, &wait);
+		write_lock(&journal->j_state_lock);
+	}
+	journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+
+	/* As a full commit would, erase the effects of a journal flush */
+	if (journal->j_flags & JBD2_FLUSHED) {
+		mutex_lock(&journal->j_checkpoint_mutex);
+		jbd2_journal_update_sb_log_tail(journal,
+						journal->j_tail_sequence,
+						journal->j_tail,
+						WRITE_SYNC);
+		mutex_unlock(&journal->j_checkpoint_mutex);
+	}
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+
+/**
+ * int jbd2_fc_get_buf() - get the next block of the fast commit area
+ * @journal: Journal the fast commit is written to
+ * @bh_out: Returns a zeroed buffer for the block
+ *
+ * The buffer stays owned by the journal, which writes and releases it in
+ * jbd2_fc_end_commit().  Returns -ENOSPC when the area is full.
+ */
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out)
+{
+	unsigned long long pblock;
+	struct buffer_head *bh;
+	unsigned long blocknr;
+	int err;
+
+	J_ASSERT(journal->j_flags & JBD2_FAST_COMMIT_ONGOING);
+
+	blocknr = journal->j_fc_first + journal->j_fc_off + journal->j_fc_nbufs;
+	if (blocknr >= journal->j_fc_last)
+		return -ENOSPC;
+	err = jbd2_journal_bmap(journal, blocknr, &pblock);
+	if (err)
+		return err;
+	bh = __getblk(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+
+	lock_buffer(bh);
+	memset(bh->b_data, 0, journal->j_blocksize);
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+	journal->j_fc_wbuf[journal->j_fc_nbufs++] = bh;
+	*bh_out = bh;
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+
+static void jbd2_fc_release(journal_t *journal, int written)
+{
+	int i;
+
+	for (i = 0; i < journal->j_fc_nbufs; i++)
+		brelse(journal->j_fc_wbuf[i]);
+
+	write_lock(&journal->j_state_lock);
+	if (written)
+		journal->j_fc_off += journal->j_fc_nbufs;
+	journal->j_fc_nbufs = 0;
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_wait_fc);
+}
+
+/**
+ * int jbd2_fc_end_commit() - write a fast commit out
+ * @journal: Journal the fast commit is written to
+ *
+ * Writes the blocks obtained since jbd2_fc_begin_commit() and flushes
+ * the device cache, so that on return both the records and the file data
+ * written before the fast commit started are on stable storage.
+ */
+int jbd2_fc_end_commit(journal_t *journal)
+{
+	struct buffer_head *bh;
+	int i, err = 0;
+
+	for (i = 0; i < journal->j_fc_nbufs; i++) {
+		bh = journal->j_fc_wbuf[i];
+		lock_buffer(bh);
+		clear_buffer_dirty(bh);
+		set_buffer_uptodate(bh);
+		bh->b_end_io = end_buffer_write_sync;
+		get_bh(bh);
+		submit_bh(WRITE_SYNC, bh);
+	}
+	for (i = 0; i < journal->j_fc_nbufs; i++) {
+		bh = journal->j_fc_wbuf[i];
+		wait_on_buffer(bh);
+		if (unlikely(!buffer_uptodate(bh)))
+			err = -EIO;
+	}
+
+	if (!err && (journal->j_flags & JBD2_BARRIER)) {
+		if (journal->j_fs_dev != journal->j_dev)
+			err = blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS,
+						 NULL);
+		if (!err)
+			err = blkdev_issue_flush(journal->j_dev, GFP_NOFS,
+						 NULL);
+	}
+
+	jbd2_fc_release(journal, !err);
+	return err;
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+
+/**
+ * void jbd2_fc_end_commit_fallback() - abandon a fast commit
+ * @journal: Journal the fast commit was to be written to
+ *
+ * Releases the blocks obtained since jbd2_fc_begin_commit() without
+ * writing them.  The caller then needs a full commit instead.
+ */
+void jbd2_fc_end_commit_fallback(journal_t *journal)
+{
+	jbd2_fc_release(journal, 0);
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit_fallback);
+
+/**
+ * int jbd2_fc_read_block() - read a block of the fast commit area
+ * @journal: Journal to read from
+ * @off: Offset of the block in the fast commit area
+ * @bh_out: Returns the buffer, to be released with brelse()
+ */
+int jbd2_fc_read_block(journal_t *journal, unsigned long off,
+		       struct buffer_head **bh_out)
+{
+	unsigned long long pblock;
+	struct buffer_head *bh;
+	int err;
+
+	if (off >= journal->j_fc_last - journal->j_fc_first)
+		return -EINVAL;
+	err = jbd2_journal_bmap(journal, journal->j_fc_first + off, &pblock);
+	if (err)
+		return err;
+	bh = __bread(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return -EIO;
+	*bh_out = bh;
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_read_block);
+
 /*
  * Log buffer allocation routines:
  */
@@ -1016,6 +1359,7 @@ static journal_t * journal_init_common (void)
 	init_waitqueue_head(&journal->j_wait_checkpoint);
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
+	init_waitqueue_head(&journal->j_wait_fc);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
@@ -1213,7 +1557,7 @@ static int journal_reset(journal_t *journal)
 	unsigned long long first, last;
 
 	first = be32_to_cpu(sb->s_first);
-	last = be32_to_cpu(sb->s_maxlen);
+	last = journal->j_last;	/* short of the fast commit area, if any */
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD2: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1479,6 +1823,22 @@ static int load_superblock(journal_t *journal)
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
+	/* The fast commit area is taken from the end of the journal */
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+		unsigned long num_fc_blks = be32_to_cpu(sb->s_num_fc_blks);
+
+		if (!num_fc_blks || journal->j_first +
+		    JBD2_MIN_JOURNAL_BLOCKS + num_fc_blks > journal->j_last) {
+			printk(KERN_ERR "JBD2: Invalid fast commit area size "
+			       "%lu on %s\n", num_fc_blks, journal->j_devname);
+			return -EINVAL;
+		}
+		journal->j_last -= num_fc_blks;
+		journal->j_fc_first = journal->j_last;
+		journal->j_fc_last = journal->j_last + num_fc_blks;
+	}
+
 	return 0;
 }
 
@@ -1589,6 +1949,10 @@ int jbd2_journal_destroy(journal_t *journal)
 		if (!is_journal_aborted(journal)) {
 			mutex_lock(&journal->j_checkpoint_mutex);
 			jbd2_mark_journal_empty(journal);
+			if (journal->j_fc_wbuf &&
+			    JBD2_HAS_INCOMPAT_FEATURE(journal,
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+				jbd2_fc_clear_area(journal);
 			mutex_unlock(&journal->j_checkpoint_mutex);
 		} else
 			err = -EIO;
@@ -1602,6 +1966,7 @@ int jbd2_journal_destroy(journal_t *journal)
 	if (journal->j_revoke)
 		jbd2_journal_destroy_revoke(journal);
 	kfree(journal->j_wbuf);
+	kfree(journal->j_fc_wbuf);
 	kfree(journal);
 
 	return err;
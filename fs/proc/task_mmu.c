@@ -11,6 +11,7 @@
 #include <linux/rmap.h>
 #include <linux/swap.h>
 #include <linux/swapops.h>
+#include <linux/mm_inline.h>
 
 #include <asm/elf.h>
 #include <asm/uaccess.h>
@@ -674,6 +675,210 @@ const struct file_operations proc_clear_refs_operations = {
 	.llseek		= noop_llseek,
 };
 
+#ifdef CONFIG_PROCESS_RECLAIM
+enum reclaim_type {
+	RECLAIM_FILE,
+	RECLAIM_ANON,
+	RECLAIM_ALL,
+};
+
+/* Result of the last request made through an open file */
+struct reclaim_result {
+	unsigned long nr_scanned;
+	unsigned long nr_reclaimed;
+};
+
+struct reclaim_walk {
+	struct vm_area_struct *vma;
+	struct reclaim_result *result;
+};
+
+static int reclaim_pte_range(pmd_t *pmd, unsigned long addr,
+			     unsigned long end, struct mm_walk *walk)
+{
+	struct reclaim_walk *rw = walk->private;
+	struct vm_area_struct *vma = rw->vma;
+	LIST_HEAD(page_list);
+	unsigned long nr_isolated = 0;
+	pte_t *pte, ptent;
+	spinlock_t *ptl;
+	struct page *page;
+
+	split_huge_page_pmd(walk->mm, pmd);
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		ptent = *pte;
+		if (!pte_present(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page)
+			continue;
+
+		/* Leave pages shared with other processes alone */
+		if (page_mapcount(page) != 1)
+			continue;
+
+		if (isolate_lru_page(page))
+			continue;
+
+		list_add(&page->lru, &page_list);
+		inc_zone_page_state(page, NR_ISOLATED_ANON +
+				    page_is_file_cache(page));
+		nr_isolated++;
+	}
+	pte_unmap_unlock(pte - 1, ptl);
+
+	if (nr_isolated) {
+		rw->result->nr_scanned += nr_isolated;
+		rw->result->nr_reclaimed += reclaim_pages_from_list(&page_list);
+	}
+	cond_resched();
+	return 0;
+}
+
+/*
+ * Parse "<type> [<start> <length>]", where type is "file", "anon" or
+ * "all" and the optional range is given in bytes.
+ */
+static int reclaim_parse(char *buffer, enum reclaim_type *type,
+			 unsigned long *start, unsigned long *end)
+{
+	char *token, *p = strstrip(buffer);
+	unsigned long len;
+
+	token = strsep(&p, " ");
+	if (!strcmp(token, "file"))
+		*type = RECLAIM_FILE;
+	else if (!strcmp(token, "anon"))
+		*type = RECLAIM_ANON;
+	else if (!strcmp(token, "all"))
+		*type = RECLAIM_ALL;
+	else
+		return -EINVAL;
+
+	*start = 0;
+	*end = TASK_SIZE;
+	if (!p)
+		return 0;
+
+	token = strsep(&p, " ");
+	if (!p || kstrtoul(token, 0, start) || kstrtoul(strim(p), 0, &len))
+		return -EINVAL;
+	if (!len || *start + len < *start)
+		return -EINVAL;
+	*start &= PAGE_MASK;
+	*end = PAGE_ALIGN(*start + len);
+	return 0;
+}
+
+static ssize_t reclaim_write(struct file *file, const char __user *buf,
+			     size_t count, loff_t *ppos)
+{
+	struct reclaim_result *result = file->private_data;
+	struct task_struct *task;
+	char buffer[64];
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;
+	enum reclaim_type type;
+	unsigned long start, end;
+	int rv;
+
+	memset(buffer, 0, sizeof(buffer));
+	if (count > sizeof(buffer) - 1)
+		count = sizeof(buffer) - 1;
+	if (copy_from_user(buffer, buf, count))
+		return -EFAULT;
+	rv = reclaim_parse(buffer, &type, &start, &end);
+	if (rv < 0)
+		return rv;
+
+	task = get_proc_task(file->f_path.dentry->d_inode);
+	if (!task)
+		return -ESRCH;
+	/* Pushing another task's memory out needs the right to attach */
+	mm = mm_access(task, PTRACE_MODE_ATTACH);
+	if (IS_ERR(mm)) {
+		put_task_struct(task);
+		return PTR_ERR(mm);
+	}
+	result->nr_scanned = 0;
+	result->nr_reclaimed = 0;
+	if (mm) {
+		struct reclaim_walk rw = {
+			.result = result,
+		};
+		struct mm_walk reclaim_walk = {
+			.pmd_entry = reclaim_pte_range,
+			.mm = mm,
+			.private = &rw,
+		};
+
+		down_read(&mm->mmap_sem);
+		for (vma = find_vma(mm, start); vma && vma->vm_start < end;
+		     vma = vma->vm_next) {
+			rw.vma = vma;
+			if (is_vm_hugetlb_page(vma))
+				continue;
+			if (vma->vm_flags & (VM_LOCKED | VM_PFNMAP))
+				continue;
+			if (type == RECLAIM_ANON && vma->vm_file)
+				continue;
+			if (type == RECLAIM_FILE && !vma->vm_file)
+				continue;
+			walk_page_range(max(vma->vm_start, start),
+					min(vma->vm_end, end), &reclaim_walk);
+			if (fatal_signal_pending(current))
+				break;
+		}
+		flush_tlb_mm(mm);
+		up_read(&mm->mmap_sem);
+		mmput(mm);
+	}
+	put_task_struct(task);
+
+	return count;
+}
+
+static ssize_t reclaim_read(struct file *file, char __user *buf,
+			    size_t count, loff_t *ppos)
+{
+	struct reclaim_result *result = file->private_data;
+	char buffer[64];
+	int len;
+
+	len = snprintf(buffer, sizeof(buffer), "scanned %lu\nreclaimed %lu\n",
+		       result->nr_scanned, result->nr_reclaimed);
+	return simple_read_from_buffer(buf, count, ppos, buffer, len);
+}
+
+static int reclaim_open(struct inode *inode, struct file *file)
+{
+	file->private_data = kzalloc(sizeof(struct reclaim_result),
+				     GFP_KERNEL);
+	if (!file->private_data)
+		return -ENOMEM;
+	return 0;
+}
+
+static int reclaim_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+
+const struct file_operations proc_reclaim_operations = {
+	.open		= reclaim_open,
+	.read		= reclaim_read,
+	.write		= reclaim_write,
+	.llseek		= noop_llseek,
+	.release	= reclaim_release,
+};
+#endif /* CONFIG_PROCESS_RECLAIM */
+
 typedef struct {
 	u64 pme;
 } pagemap_entry_t;
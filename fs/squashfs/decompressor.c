@@ -83,7 +83,11 @@ const struct squashfs_decompressor *squashfs_lookup_decompressor(int id)
 }
 
 
-void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
+/*
+ * Read the compressor options, if any, and set up the decompressor
+ * streams the way msblk->thread_ops shares them
+ */
+void *squashfs_decompressor_setup(struct super_block *sb, unsigned short flags)
 {
 	struct squashfs_sb_info *msblk = sb->s_fs_info;
 	void *strm, *buffer = NULL;
@@ -107,10 +111,17 @@ void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
 		}
 	}
 
-	strm = msblk->decompressor->init(msblk, buffer, length);
+	strm = msblk->thread_ops->create(msblk, buffer, length);
 
 finished:
 	kfree(buffer);
 
 	return strm;
 }
+
+
+void squashfs_decompressor_destroy(struct squashfs_sb_info *msblk)
+{
+	if (msblk->stream)
+		msblk->thread_ops->destroy(msblk);
+}
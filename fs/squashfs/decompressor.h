@@ -23,31 +23,47 @@
  * decompressor.h
  */
 
+struct squashfs_page_actor;
+
 struct squashfs_decompressor {
 	void	*(*init)(struct squashfs_sb_info *, void *, int);
 	void	(*free)(void *);
-	int	(*decompress)(struct squashfs_sb_info *, void **,
-		struct buffer_head **, int, int, int, int, int);
+	int	(*decompress)(struct squashfs_sb_info *, void *,
+		struct squashfs_page_actor *, struct buffer_head **, int, int,
+		int, int);
 	int	id;
 	char	*name;
 	int	supported;
 };
 
-static inline void squashfs_decompressor_free(struct squashfs_sb_info *msblk,
-	void *s)
-{
-	if (msblk->decompressor)
-		msblk->decompressor->free(s);
-}
+/*
+ * How decompressor streams are shared by concurrent readers, chosen at
+ * mount time with the threads= option
+ */
+struct squashfs_decompressor_thread_ops {
+	void	*(*create)(struct squashfs_sb_info *, void *, int);
+	void	(*destroy)(struct squashfs_sb_info *);
+	int	(*decompress)(struct squashfs_sb_info *,
+		struct squashfs_page_actor *, struct buffer_head **, int, int,
+		int, int);
+	char	*name;
+};
 
 static inline int squashfs_decompress(struct squashfs_sb_info *msblk,
-	void **buffer, struct buffer_head **bh, int b, int offset, int length,
-	int srclength, int pages)
+	struct squashfs_page_actor *output, struct buffer_head **bh, int b,
+	int offset, int length, int srclength)
 {
-	return msblk->decompressor->decompress(msblk, buffer, bh, b, offset,
-		length, srclength, pages);
+	return msblk->thread_ops->decompress(msblk, output, bh, b, offset,
+		length, srclength);
 }
 
+extern const struct squashfs_decompressor_thread_ops
+	squashfs_decompressor_single;
+extern const struct squashfs_decompressor_thread_ops
+	squashfs_decompressor_multi;
+extern const struct squashfs_decompressor_thread_ops
+	squashfs_decompressor_percpu;
+
 #ifdef CONFIG_SQUASHFS_XZ
 extern const struct squashfs_decompressor squashfs_xz_comp_ops;
 #endif
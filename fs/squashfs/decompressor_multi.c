@@ -0,0 +1,219 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * decompressor_multi.c
+ */
+
+#include <linux/types.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/buffer_head.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/cpumask.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "decompressor.h"
+#include "squashfs.h"
+
+/*
+ * This file implements multi-threaded decompression: a pool of streams
+ * shared by the readers of a filesystem.  A reader finding no idle stream
+ * allocates another one, up to squashfs_multi_max_decompressors(); beyond
+ * that, or if the allocation fails, it waits for one to be released.
+ */
+
+/* Two streams per CPU keep CPUs busy while some readers wait for IO */
+static int squashfs_multi_max_decompressors(void)
+{
+	return num_online_cpus() * 2;
+}
+
+struct squashfs_stream {
+	void			*comp_opts;
+	int			length;
+	struct list_head	strm_list;
+	struct mutex		mutex;
+	int			avail_decomp;
+	wait_queue_head_t	wait;
+};
+
+struct decomp_stream {
+	void			*stream;
+	struct list_head	list;
+};
+
+
+static void put_decomp_stream(struct decomp_stream *decomp_strm,
+	struct squashfs_stream *stream)
+{
+	mutex_lock(&stream->mutex);
+	list_add(&decomp_strm->list, &stream->strm_list);
+	mutex_unlock(&stream->mutex);
+	wake_up(&stream->wait);
+}
+
+
+static void *squashfs_multi_create(struct squashfs_sb_info *msblk,
+	void *comp_opts, int length)
+{
+	struct squashfs_stream *stream;
+	struct decomp_stream *decomp_strm = NULL;
+	int err = -ENOMEM;
+
+	stream = kzalloc(sizeof(*stream), GFP_KERNEL);
+	if (stream == NULL)
+		goto out;
+
+	/* Kept for the streams allocated later on */
+	if (comp_opts) {
+		stream->comp_opts = kmemdup(comp_opts, length, GFP_KERNEL);
+		if (stream->comp_opts == NULL)
+			goto out;
+		stream->length = length;
+	}
+
+	INIT_LIST_HEAD(&stream->strm_list);
+	mutex_init(&stream->mutex);
+	init_waitqueue_head(&stream->wait);
+
+	/*
+	 * One stream is allocated now, so that an unusable compressor
+	 * configuration fails the mount instead of the first read
+	 */
+	decomp_strm = kmalloc(sizeof(*decomp_strm), GFP_KERNEL);
+	if (decomp_strm == NULL)
+		goto out;
+
+	decomp_strm->stream = msblk->decompressor->init(msblk,
+		stream->comp_opts, stream->length);
+	if (IS_ERR(decomp_strm->stream)) {
+		err = PTR_ERR(decomp_strm->stream);
+		goto out;
+	}
+
+	list_add(&decomp_strm->list, &stream->strm_list);
+	stream->avail_decomp = 1;
+	return stream;
+
+out:
+	kfree(decomp_strm);
+	if (stream)
+		kfree(stream->comp_opts);
+	kfree(stream);
+	return ERR_PTR(err);
+}
+
+
+static void squashfs_multi_destroy(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_stream *stream = msblk->stream;
+	struct decomp_stream *decomp_strm;
+
+	while (!list_empty(&stream->strm_list)) {
+		decomp_strm = list_entry(stream->strm_list.prev,
+					struct decomp_stream, list);
+		list_del(&decomp_strm->list);
+		msblk->decompressor->free(decomp_strm->stream);
+		kfree(decomp_strm);
+		stream->avail_decomp--;
+	}
+
+	WARN_ON(stream->avail_decomp);
+	kfree(stream->comp_opts);
+	kfree(stream);
+}
+
+
+static struct decomp_stream *get_decomp_stream(struct squashfs_sb_info *msblk,
+	struct squashfs_stream *stream)
+{
+	struct decomp_stream *decomp_strm;
+
+	while (1) {
+		mutex_lock(&stream->mutex);
+
+		/* There is an idle stream */
+		if (!list_empty(&stream->strm_list)) {
+			decomp_strm = list_entry(stream->strm_list.prev,
+				struct decomp_stream, list);
+			list_del(&decomp_strm->list);
+			mutex_unlock(&stream->mutex);
+			break;
+		}
+
+		/*
+		 * No idle stream and the pool is full: wait for a stream
+		 * to be released
+		 */
+		if (stream->avail_decomp >= squashfs_multi_max_decompressors())
+			goto wait;
+
+		/* Grow the pool */
+		decomp_strm = kmalloc(sizeof(*decomp_strm), GFP_KERNEL);
+		if (decomp_strm == NULL)
+			goto wait;
+
+		decomp_strm->stream = msblk->decompressor->init(msblk,
+			stream->comp_opts, stream->length);
+		if (IS_ERR(decomp_strm->stream)) {
+			kfree(decomp_strm);
+			goto wait;
+		}
+
+		stream->avail_decomp++;
+		WARN_ON(stream->avail_decomp >
+			squashfs_multi_max_decompressors());
+
+		mutex_unlock(&stream->mutex);
+		break;
+wait:
+		/*
+		 * If memory is short or the pool is full, wait for another
+		 * reader to release its stream
+		 */
+		mutex_unlock(&stream->mutex);
+		wait_event(stream->wait,
+			!list_empty(&stream->strm_list));
+	}
+
+	return decomp_strm;
+}
+
+
+static int squashfs_multi_decompress(struct squashfs_sb_info *msblk,
+	struct squashfs_page_actor *output, struct buffer_head **bh, int b,
+	int offset, int length, int srclength)
+{
+	int res;
+	struct squashfs_stream *stream = msblk->stream;
+	struct decomp_stream *decomp_stream = get_decomp_stream(msblk, stream);
+
+	res = msblk->decompressor->decompress(msblk, decomp_stream->stream,
+		output, bh, b, offset, length, srclength);
+	put_decomp_stream(decomp_stream, stream);
+
+	return res;
+}
+
+const struct squashfs_decompressor_thread_ops squashfs_decompressor_multi = {
+	.create = squashfs_multi_create,
+	.destroy = squashfs_multi_destroy,
+	.decompress = squashfs_multi_decompress,
+	.name = "multi"
+};
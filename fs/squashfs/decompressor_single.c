@@ -0,0 +1,95 @@
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * Copyright (c) 2002, 2003, 2004, 2005, 2006, 2007, 2008, 2009
+ * Phillip Lougher <phillip@squashfs.org.uk>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * decompressor_single.c
+ */
+
+#include <linux/types.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/buffer_head.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "decompressor.h"
+#include "squashfs.h"
+
+/*
+ * This file implements single-threaded decompression: one stream per
+ * filesystem, used by one reader at a time
+ */
+
+struct squashfs_stream {
+	void		*stream;
+	struct mutex	mutex;
+};
+
+static void *squashfs_single_create(struct squashfs_sb_info *msblk,
+	void *comp_opts, int length)
+{
+	struct squashfs_stream *stream;
+	int err;
+
+	stream = kmalloc(sizeof(*stream), GFP_KERNEL);
+	if (stream == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	stream->stream = msblk->decompressor->init(msblk, comp_opts, length);
+	if (IS_ERR(stream->stream)) {
+		err = PTR_ERR(stream->stream);
+		kfree(stream);
+		return ERR_PTR(err);
+	}
+
+	mutex_init(&stream->mutex);
+	return stream;
+}
+
+
+static void squashfs_single_destroy(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_stream *stream = msblk->stream;
+
+	msblk->decompressor->free(stream->stream);
+	kfree(stream);
+}
+
+
+static int squashfs_single_decompress(struct squashfs_sb_info *msblk,
+	struct squashfs_page_actor *output, struct buffer_head **bh, int b,
+	int offset, int length, int srclength)
+{
+	struct squashfs_stream *stream = msblk->stream;
+	int res;
+
+	mutex_lock(&stream->mutex);
+	res = msblk->decompressor->decompress(msblk, stream->stream, output,
+		bh, b, offset, length, srclength);
+	mutex_unlock(&stream->mutex);
+
+	return res;
+}
+
+const struct squashfs_decompressor_thread_ops squashfs_decompressor_single = {
+	.create = squashfs_single_create,
+	.destroy = squashfs_single_destroy,
+	.decompress = squashfs_single_decompress,
+	.name = "single"
+};
@@ -47,11 +47,13 @@
 #include <linux/string.h>
 #include <linux/pagemap.h>
 #include <linux/mutex.h>
+#include <linux/highmem.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
 #include "squashfs_fs_i.h"
 #include "squashfs.h"
+#include "page_actor.h"
 
 /*
  * Locate cache slot in range [offset, index] for specified inode.  If
@@ -371,6 +373,99 @@ static int read_blocklist(struct inode *inode, int index, u64 *block)
 }
 
 
+/* Number of pages of datablock @index, holding data of @inode */
+static int squashfs_block_pages(struct inode *inode, int index)
+{
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_CACHE_SHIFT;
+	pgoff_t file_pages = (i_size_read(inode) + PAGE_CACHE_SIZE - 1) >>
+		PAGE_CACHE_SHIFT;
+
+	return min_t(pgoff_t, 1 << shift, file_pages - ((pgoff_t) index << shift));
+}
+
+
+/*
+ * Decompress datablock @index of @inode, @bsize bytes at @block on disk,
+ * straight into the page cache.  @pages has a slot for each of the
+ * @nr_pages pages the block covers: the caller fills in the pages it has
+ * locked, the others are grabbed here unless they are up to date or
+ * locked by someone else, in which case their share of the output goes
+ * to a scratch page.  The decompressor maps the pages one at a time as
+ * the output reaches them, so highmem pages need no kmap() held across
+ * the whole block.
+ *
+ * Returns -ENOMEM, with the caller's pages untouched, if the buffers
+ * can't be allocated.  Otherwise the caller's pages are unlocked, and up
+ * to date unless the block could not be read.  The caller keeps its
+ * references to them.
+ */
+static int squashfs_read_block_direct(struct inode *inode, int index,
+	struct page **pages, int nr_pages, u64 block, int bsize)
+{
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	pgoff_t start_index = (pgoff_t) index <<
+		(msblk->block_log - PAGE_CACHE_SHIFT);
+	struct squashfs_page_actor output;
+	struct page *scratch, **out;
+	int i, res, avail;
+
+	out = kmalloc(nr_pages * sizeof(*out), GFP_KERNEL);
+	scratch = alloc_page(GFP_KERNEL);
+	if (out == NULL || scratch == NULL) {
+		kfree(out);
+		if (scratch)
+			__free_page(scratch);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < nr_pages; i++) {
+		if (pages[i])
+			page_cache_get(pages[i]);
+		else {
+			pages[i] = grab_cache_page_nowait(inode->i_mapping,
+				start_index + i);
+			if (pages[i] && PageUptodate(pages[i])) {
+				unlock_page(pages[i]);
+				page_cache_release(pages[i]);
+				pages[i] = NULL;
+			}
+		}
+		out[i] = pages[i] ? pages[i] : scratch;
+	}
+
+	squashfs_actor_init_page(&output, out, nr_pages);
+	res = squashfs_read_data_actor(inode->i_sb, block, bsize, NULL,
+		msblk->block_size, &output);
+	if (res < 0)
+		ERROR("Unable to read page, block %llx, size %x\n", block,
+			bsize);
+
+	for (i = 0; i < nr_pages; i++) {
+		if (!pages[i])
+			continue;
+
+		if (res >= 0) {
+			avail = min_t(int, max(res - (i << PAGE_CACHE_SHIFT), 0),
+				PAGE_CACHE_SIZE);
+			zero_user_segment(pages[i], avail, PAGE_CACHE_SIZE);
+		}
+
+		if (res >= 0) {
+			flush_dcache_page(pages[i]);
+			SetPageUptodate(pages[i]);
+		} else
+			SetPageError(pages[i]);
+		unlock_page(pages[i]);
+		page_cache_release(pages[i]);
+	}
+
+	__free_page(scratch);
+	kfree(out);
+	return res < 0 ? res : 0;
+}
+
+
 static int squashfs_readpage(struct file *file, struct page *page)
 {
 	struct inode *inode = page->mapping->host;
@@ -409,6 +504,26 @@ static int squashfs_readpage(struct file *file, struct page *page)
 				 msblk->block_size;
 			sparse = 1;
 		} else {
+			struct page **pages;
+			int nr_pages = squashfs_block_pages(inode, index);
+
+			/*
+			 * Decompress the datablock into the page cache,
+			 * falling back to the datablock cache without the
+			 * memory to do so.
+			 */
+			pages = kcalloc(nr_pages, sizeof(*pages), GFP_KERNEL);
+			if (pages) {
+				pages[page->index - start_index] = page;
+				if (squashfs_read_block_direct(inode, index,
+					pages, nr_pages, block, bsize) !=
+					-ENOMEM) {
+					kfree(pages);
+					return 0;
+				}
+				kfree(pages);
+			}
+
 			/*
 			 * Read and decompress datablock.
 			 */
@@ -496,6 +611,72 @@ out:
 }
 
 
+/*
+ * Readahead: the pages of the readahead window are added to the page
+ * cache and filled a datablock at a time, each block decompressed
+ * directly into them.  Pages of fragments and holes, and of blocks that
+ * can't be read directly, go through squashfs_readpage().
+ */
+static int squashfs_readpages(struct file *file, struct address_space *mapping,
+	struct list_head *page_list, unsigned nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_CACHE_SHIFT;
+	int file_end = i_size_read(inode) >> msblk->block_log;
+	struct page **pages, *page;
+	int index, nr, i, bsize, direct;
+	u64 block;
+
+	pages = kmalloc((1 << shift) * sizeof(*pages), GFP_KERNEL);
+	if (pages == NULL)
+		return -ENOMEM;
+
+	while (!list_empty(page_list)) {
+		page = list_entry(page_list->prev, struct page, lru);
+		index = page->index >> shift;
+		nr = squashfs_block_pages(inode, index);
+		memset(pages, 0, nr * sizeof(*pages));
+
+		/* Take the pages of the list that are in the same block */
+		while (!list_empty(page_list)) {
+			page = list_entry(page_list->prev, struct page, lru);
+			if (page->index >> shift != index)
+				break;
+			list_del(&page->lru);
+			if (add_to_page_cache_lru(page, mapping, page->index,
+					GFP_KERNEL)) {
+				page_cache_release(page);
+				continue;
+			}
+			pages[page->index & ((1 << shift) - 1)] = page;
+		}
+
+		direct = 0;
+		if (index < file_end || squashfs_i(inode)->fragment_block ==
+						SQUASHFS_INVALID_BLK) {
+			block = 0;
+			bsize = read_blocklist(inode, index, &block);
+			if (bsize > 0 && squashfs_read_block_direct(inode,
+				index, pages, nr, block, bsize) != -ENOMEM)
+				direct = 1;
+		}
+
+		for (i = 0; i < nr; i++) {
+			if (!pages[i])
+				continue;
+			if (!direct)
+				squashfs_readpage(file, pages[i]);
+			page_cache_release(pages[i]);
+		}
+	}
+
+	kfree(pages);
+	return 0;
+}
+
+
 const struct address_space_operations squashfs_aops = {
-	.readpage = squashfs_readpage
+	.readpage = squashfs_readpage,
+	.readpages = squashfs_readpages
 };
@@ -0,0 +1,72 @@
+#ifndef PAGE_ACTOR_H
+#define PAGE_ACTOR_H
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ *
+ * page_actor.h
+ */
+
+#include <linux/highmem.h>
+
+/*
+ * The output buffer of a decompression: an array of lowmem buffers, as
+ * the caches have, or an array of pages, which are mapped one at a time
+ * with kmap_atomic() as the output reaches them.  Decompressors don't
+ * sleep (all the input is read before they run), so a single atomic
+ * mapping serves page cache pages in highmem without holding a kmap()
+ * of every page of the block.
+ */
+struct squashfs_page_actor {
+	void			**buffer;
+	struct page		**page;
+	void			*pageaddr;
+	int			pages;
+	int			next_page;
+};
+
+static inline void squashfs_actor_init_buffer(struct squashfs_page_actor *a,
+	void **buffer, int pages)
+{
+	a->buffer = buffer;
+	a->page = NULL;
+	a->pageaddr = NULL;
+	a->pages = pages;
+	a->next_page = 0;
+}
+
+static inline void squashfs_actor_init_page(struct squashfs_page_actor *a,
+	struct page **page, int pages)
+{
+	a->buffer = NULL;
+	a->page = page;
+	a->pageaddr = NULL;
+	a->pages = pages;
+	a->next_page = 0;
+}
+
+/* Unmap the page being written, if any */
+static inline void squashfs_finish_page(struct squashfs_page_actor *a)
+{
+	if (a->pageaddr) {
+		kunmap_atomic(a->pageaddr);
+		a->pageaddr = NULL;
+	}
+}
+
+/* Address of the next page of output, or NULL past the last one */
+static inline void *squashfs_next_page(struct squashfs_page_actor *a)
+{
+	squashfs_finish_page(a);
+	if (a->next_page == a->pages)
+		return NULL;
+	if (a->buffer)
+		return a->buffer[a->next_page++];
+	a->pageaddr = kmap_atomic(a->page[a->next_page++]);
+	return a->pageaddr;
+}
+#endif
@@ -36,6 +36,8 @@
 #include <linux/module.h>
 #include <linux/magic.h>
 #include <linux/xattr.h>
+#include <linux/parser.h>
+#include <linux/seq_file.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -47,6 +49,60 @@
 static struct file_system_type squashfs_fs_type;
 static const struct super_operations squashfs_super_ops;
 
+enum {
+	Opt_threads,
+	Opt_err
+};
+
+static const match_table_t squashfs_tokens = {
+	{Opt_threads, "threads=%s"},
+	{Opt_err, NULL}
+};
+
+static const struct squashfs_decompressor_thread_ops *squashfs_thread_ops[] = {
+	&squashfs_decompressor_single,
+	&squashfs_decompressor_multi,
+	&squashfs_decompressor_percpu,
+	NULL
+};
+
+static int squashfs_parse_options(struct squashfs_sb_info *msblk,
+	char *options)
+{
+	substring_t args[MAX_OPT_ARGS];
+	char *p;
+	int i, token;
+
+	msblk->thread_ops = &squashfs_decompressor_single;
+	if (!options)
+		return 0;
+
+	while ((p = strsep(&options, ",")) != NULL) {
+		if (!*p)
+			continue;
+
+		token = match_token(p, squashfs_tokens, args);
+		switch (token) {
+		case Opt_threads:
+			for (i = 0; squashfs_thread_ops[i]; i++)
+				if (!strcmp(args[0].from,
+						squashfs_thread_ops[i]->name))
+					break;
+			if (!squashfs_thread_ops[i]) {
+				ERROR("Unknown threads mode \"%s\"\n", args[0].from);
+				return -EINVAL;
+			}
+			msblk->thread_ops = squashfs_thread_ops[i];
+			break;
+		default:
+			ERROR("Unrecognized mount option \"%s\"\n", p);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
 static const struct squashfs_decompressor *supported_squashfs_filesystem(short
 	major, short minor, short id)
 {
@@ -98,9 +154,12 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	msblk->devblksize = sb_min_blocksize(sb, SQUASHFS_DEVBLK_SIZE);
 	msblk->devblksize_log2 = ffz(~msblk->devblksize);
 
-	mutex_init(&msblk->read_data_mutex);
 	mutex_init(&msblk->meta_index_mutex);
 
+	err = squashfs_parse_options(msblk, data);
+	if (err)
+		goto failed_mount;
+
 	/*
 	 * msblk->bytes_used is checked in squashfs_read_table to ensure reads
 	 * are not beyond filesystem end.  But as we're using
@@ -205,14 +264,17 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	if (msblk->block_cache == NULL)
 		goto failed_mount;
 
-	/* Allocate read_page block */
+	/*
+	 * Allocate read_page block, only used when datablocks can't be
+	 * decompressed directly into the page cache
+	 */
 	msblk->read_page = squashfs_cache_init("data", 1, msblk->block_size);
 	if (msblk->read_page == NULL) {
 		ERROR("Failed to allocate read_page block\n");
 		goto failed_mount;
 	}
 
-	msblk->stream = squashfs_decompressor_init(sb, flags);
+	msblk->stream = squashfs_decompressor_setup(sb, flags);
 	if (IS_ERR(msblk->stream)) {
 		err = PTR_ERR(msblk->stream);
 		msblk->stream = NULL;
@@ -336,7 +398,7 @@ failed_mount:
 	squashfs_cache_delete(msblk->block_cache);
 	squashfs_cache_delete(msblk->fragment_cache);
 	squashfs_cache_delete(msblk->read_page);
-	squashfs_decompressor_free(msblk, msblk->stream);
+	squashfs_decompressor_destroy(msblk);
 	kfree(msblk->inode_lookup_table);
 	kfree(msblk->fragment_index);
 	kfree(msblk->id_table);
@@ -369,6 +431,17 @@ static int squashfs_statfs(struct dentry *dentry, struct kstatfs *buf)
 }
 
 
+static int squashfs_show_options(struct seq_file *seq, struct dentry *root)
+{
+	struct squashfs_sb_info *msblk = root->d_sb->s_fs_info;
+
+	if (msblk->thread_ops != &squashfs_decompressor_single)
+		seq_printf(seq, ",threads=%s", msblk->thread_ops->name);
+	return 0;
+}
+
+
+/* The threads mode can't be changed once streams are set up */
 static int squashfs_remount(struct super_block *sb, int *flags, char *data)
 {
 	*flags |= MS_RDONLY;
@@ -383,7 +456,7 @@ static void squashfs_put_super(struct super_block *sb)
 		squashfs_cache_delete(sbi->block_cache);
 		squashfs_cache_delete(sbi->fragment_cache);
 		squashfs_cache_delete(sbi->read_page);
-		squashfs_decompressor_free(sbi, sbi->stream);
+		squashfs_decompressor_destroy(sbi);
 		kfree(sbi->id_table);
 		kfree(sbi->fragment_index);
 		kfree(sbi->meta_index);
@@ -490,6 +563,7 @@ static const struct super_operations squashfs_super_ops = {
 	.destroy_inode = squashfs_destroy_inode,
 	.statfs = squashfs_statfs,
 	.put_super = squashfs_put_super,
+	.show_options = squashfs_show_options,
 	.remount_fs = squashfs_remount
 };
 
@@ -22,7 +22,6 @@
  */
 
 
-#include <linux/mutex.h>
 #include <linux/buffer_head.h>
 #include <linux/slab.h>
 #include <linux/zlib.h>
@@ -32,6 +31,7 @@
 #include "squashfs_fs_sb.h"
 #include "squashfs.h"
 #include "decompressor.h"
+#include "page_actor.h"
 
 static void *zlib_init(struct squashfs_sb_info *dummy, void *buff, int len)
 {
@@ -61,15 +61,14 @@ static void zlib_free(void *strm)
 }
 
 
-static int zlib_uncompress(struct squashfs_sb_info *msblk, void **buffer,
-	struct buffer_head **bh, int b, int offset, int length, int srclength,
-	int pages)
+static int zlib_uncompress(struct squashfs_sb_info *msblk, void *strm,
+	struct squashfs_page_actor *output, struct buffer_head **bh, int b,
+	int offset, int length, int srclength)
 {
 	int zlib_err, zlib_init = 0;
-	int k = 0, page = 0;
-	z_stream *stream = msblk->stream;
-
-	mutex_lock(&msblk->read_data_mutex);
+	int k = 0;
+	z_stream *stream = strm;
+	void *out;
 
 	stream->avail_out = 0;
 	stream->avail_in = 0;
@@ -78,18 +77,17 @@ static int zlib_uncompress(struct squashfs_sb_info *msblk, void **buffer,
 		if (stream->avail_in == 0 && k < b) {
 			int avail = min(length, msblk->devblksize - offset);
 			length -= avail;
-			wait_on_buffer(bh[k]);
-			if (!buffer_uptodate(bh[k]))
-				goto release_mutex;
-
 			stream->next_in = bh[k]->b_data + offset;
 			stream->avail_in = avail;
 			offset = 0;
 		}
 
-		if (stream->avail_out == 0 && page < pages) {
-			stream->next_out = buffer[page++];
-			stream->avail_out = PAGE_CACHE_SIZE;
+		if (stream->avail_out == 0) {
+			out = squashfs_next_page(output);
+			if (out) {
+				stream->next_out = out;
+				stream->avail_out = PAGE_CACHE_SIZE;
+			}
 		}
 
 		if (!zlib_init) {
@@ -98,7 +96,7 @@ static int zlib_uncompress(struct squashfs_sb_info *msblk, void **buffer,
 				ERROR("zlib_inflateInit returned unexpected "
 					"result 0x%x, srclength %d\n",
 					zlib_err, srclength);
-				goto release_mutex;
+				goto out;
 			}
 			zlib_init = 1;
 		}
@@ -109,29 +107,28 @@ static int zlib_uncompress(struct squashfs_sb_info *msblk, void **buffer,
 			put_bh(bh[k++]);
 	} while (zlib_err == Z_OK);
 
+	squashfs_finish_page(output);
+
 	if (zlib_err != Z_STREAM_END) {
 		ERROR("zlib_inflate error, data probably corrupt\n");
-		goto release_mutex;
+		goto out;
 	}
 
 	zlib_err = zlib_inflateEnd(stream);
 	if (zlib_err != Z_OK) {
 		ERROR("zlib_inflate error, data probably corrupt\n");
-		goto release_mutex;
+		goto out;
 	}
 
 	if (k < b) {
 		ERROR("zlib_uncompress error, data remaining\n");
-		goto release_mutex;
+		goto out;
 	}
 
-	length = stream->total_out;
-	mutex_unlock(&msblk->read_data_mutex);
-	return length;
-
-release_mutex:
-	mutex_unlock(&msblk->read_data_mutex);
+	return stream->total_out;
 
+out:
+	squashfs_finish_page(output);
 	for (; k < b; k++)
 		put_bh(bh[k]);
 
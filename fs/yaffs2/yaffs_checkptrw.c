@@ -57,10 +57,19 @@ static int yaffs_checkpt_erase(struct yaffs_dev *dev)
 	}
 
 	dev->blocks_in_checkpt = 0;
+	dev->checkpt_append_ok = 0;
 
 	return 1;
 }
 
+/* A checkpoint block list of 1 checkpoint block per 16 block is (hopefully)
+ * going to be way more than we need, even with pieces appended to it.
+ */
+static int yaffs2_checkpt_max_blocks(struct yaffs_dev *dev)
+{
+	return (dev->internal_end_block - dev->internal_start_block) / 16 + 2;
+}
+
 static void yaffs2_checkpt_find_erased_block(struct yaffs_dev *dev)
 {
 	int i;
@@ -72,7 +81,8 @@ static void yaffs2_checkpt_find_erased_block(struct yaffs_dev *dev)
 
 	if (dev->checkpt_next_block >= 0 &&
 	    dev->checkpt_next_block <= dev->internal_end_block &&
-	    blocks_avail > 0) {
+	    blocks_avail > 0 &&
+	    dev->blocks_in_checkpt < yaffs2_checkpt_max_blocks(dev)) {
 
 		for (i = dev->checkpt_next_block; i <= dev->internal_end_block;
 		     i++) {
@@ -134,10 +144,10 @@ static void yaffs2_checkpt_find_block(struct yaffs_dev *dev)
 	dev->checkpt_cur_block = -1;
 }
 
-int yaffs2_checkpt_open(struct yaffs_dev *dev, int writing)
+static int yaffs2_checkpt_prepare(struct yaffs_dev *dev, int writing)
 {
-
 	dev->checkpt_open_write = writing;
+	dev->checkpt_piece_blocks = dev->blocks_in_checkpt;
 
 	/* Got the functions we need? */
 	if (!dev->param.write_chunk_tags_fn ||
@@ -154,29 +164,40 @@ int yaffs2_checkpt_open(struct yaffs_dev *dev, int writing)
 	if (!dev->checkpt_buffer)
 		return 0;
 
-	dev->checkpt_page_seq = 0;
 	dev->checkpt_byte_count = 0;
 	dev->checkpt_sum = 0;
 	dev->checkpt_xor = 0;
+
+	return 1;
+}
+
+int yaffs2_checkpt_open(struct yaffs_dev *dev, int writing)
+{
+	if (!yaffs2_checkpt_prepare(dev, writing))
+		return 0;
+
+	dev->checkpt_page_seq = 0;
 	dev->checkpt_cur_block = -1;
 	dev->checkpt_cur_chunk = -1;
 	dev->checkpt_next_block = dev->internal_start_block;
+	dev->checkpt_append_ok = 0;
 
 	/* Erase all the blocks in the checkpoint area */
 	if (writing) {
 		memset(dev->checkpt_buffer, 0, dev->data_bytes_per_chunk);
 		dev->checkpt_byte_offs = 0;
-		return yaffs_checkpt_erase(dev);
+		if (!yaffs_checkpt_erase(dev))
+			return 0;
+		dev->checkpt_piece_blocks = 0;
+		return 1;
 	} else {
 		int i;
 		/* Set to a value that will kick off a read */
 		dev->checkpt_byte_offs = dev->data_bytes_per_chunk;
-		/* A checkpoint block list of 1 checkpoint block per 16 block is (hopefully)
-		 * going to be way more than we need */
+		dev->checkpt_rd_end = 0;
 		dev->blocks_in_checkpt = 0;
-		dev->checkpt_max_blocks =
-		    (dev->internal_end_block - dev->internal_start_block) / 16 +
-		    2;
+		dev->checkpt_piece_blocks = 0;
+		dev->checkpt_max_blocks = yaffs2_checkpt_max_blocks(dev);
 		dev->checkpt_block_list =
 		    kmalloc(sizeof(int) * dev->checkpt_max_blocks, GFP_NOFS);
 		if (!dev->checkpt_block_list)
@@ -189,6 +210,53 @@ int yaffs2_checkpt_open(struct yaffs_dev *dev, int writing)
 	return 1;
 }
 
+/*
+ * Open the checkpoint for writing a piece after the end of the stream that
+ * is already on flash, where the last piece written or read ended.  The page
+ * sequence carries on, so the reader sees one stream.
+ */
+int yaffs2_checkpt_open_append(struct yaffs_dev *dev)
+{
+	if (!dev->checkpt_append_ok || !yaffs2_checkpt_prepare(dev, 1))
+		return 0;
+
+	/* Until this piece is closed the end of the stream is unknown */
+	dev->checkpt_append_ok = 0;
+
+	dev->checkpt_page_seq = dev->checkpt_append_seq;
+	dev->checkpt_cur_block = dev->checkpt_append_block;
+	dev->checkpt_cur_chunk = dev->checkpt_append_chunk;
+	dev->checkpt_next_block = dev->checkpt_append_next;
+
+	memset(dev->checkpt_buffer, 0, dev->data_bytes_per_chunk);
+	dev->checkpt_byte_offs = 0;
+
+	return 1;
+}
+
+/*
+ * Start reading the next piece of the stream.  Pieces begin on a chunk
+ * boundary and have their own checksum.
+ */
+void yaffs2_checkpt_rd_piece(struct yaffs_dev *dev)
+{
+	dev->checkpt_byte_offs = dev->data_bytes_per_chunk;
+	dev->checkpt_sum = 0;
+	dev->checkpt_xor = 0;
+	dev->checkpt_rd_end = 0;
+}
+
+/* The read found the end of the stream: the next piece can go there */
+static void yaffs2_checkpt_rd_end(struct yaffs_dev *dev, int blk, int chunk,
+				  int next_block)
+{
+	dev->checkpt_rd_end = 1;
+	dev->checkpt_append_block = blk;
+	dev->checkpt_append_chunk = chunk;
+	dev->checkpt_append_seq = dev->checkpt_page_seq;
+	dev->checkpt_append_next = next_block;
+}
+
 int yaffs2_get_checkpt_sum(struct yaffs_dev *dev, u32 * sum)
 {
 	u32 composite_sum;
@@ -292,6 +360,7 @@ int yaffs2_checkpt_rd(struct yaffs_dev *dev, void *data, int n_bytes)
 
 	int chunk;
 	int realigned_chunk;
+	int next_block;
 
 	u8 *data_bytes = (u8 *) data;
 
@@ -306,14 +375,16 @@ int yaffs2_checkpt_rd(struct yaffs_dev *dev, void *data, int n_bytes)
 		if (dev->checkpt_byte_offs < 0 ||
 		    dev->checkpt_byte_offs >= dev->data_bytes_per_chunk) {
 
+			next_block = dev->checkpt_next_block;
 			if (dev->checkpt_cur_block < 0) {
 				yaffs2_checkpt_find_block(dev);
 				dev->checkpt_cur_chunk = 0;
 			}
 
-			if (dev->checkpt_cur_block < 0)
+			if (dev->checkpt_cur_block < 0) {
 				ok = 0;
-			else {
+				yaffs2_checkpt_rd_end(dev, -1, 0, next_block);
+			} else {
 				chunk = dev->checkpt_cur_block *
 				    dev->param.chunks_per_block +
 				    dev->checkpt_cur_chunk;
@@ -335,6 +406,14 @@ int yaffs2_checkpt_rd(struct yaffs_dev *dev, void *data, int n_bytes)
 				    YAFFS_SEQUENCE_CHECKPOINT_DATA)
 					ok = 0;
 
+				/* An erased chunk is where the next piece goes */
+				if (!ok && !tags.chunk_used &&
+				    tags.ecc_result <= YAFFS_ECC_RESULT_FIXED)
+					yaffs2_checkpt_rd_end(dev,
+						dev->checkpt_cur_block,
+						dev->checkpt_cur_chunk,
+						dev->checkpt_next_block);
+
 				dev->checkpt_byte_offs = 0;
 				dev->checkpt_page_seq++;
 				dev->checkpt_cur_chunk++;
@@ -362,10 +441,17 @@ int yaffs2_checkpt_rd(struct yaffs_dev *dev, void *data, int n_bytes)
 
 int yaffs_checkpt_close(struct yaffs_dev *dev)
 {
+	int ok = 1;
 
 	if (dev->checkpt_open_write) {
-		if (dev->checkpt_byte_offs != 0)
-			yaffs2_checkpt_flush_buffer(dev);
+		if (dev->checkpt_buffer && dev->checkpt_byte_offs != 0)
+			ok = yaffs2_checkpt_flush_buffer(dev);
+
+		/* The next piece starts on the chunk after this one */
+		dev->checkpt_append_block = dev->checkpt_cur_block;
+		dev->checkpt_append_chunk = dev->checkpt_cur_chunk;
+		dev->checkpt_append_seq = dev->checkpt_page_seq;
+		dev->checkpt_append_next = dev->checkpt_next_block;
 	} else if (dev->checkpt_block_list) {
 		int i;
 		for (i = 0;
@@ -386,9 +472,15 @@ int yaffs_checkpt_close(struct yaffs_dev *dev)
 		dev->checkpt_block_list = NULL;
 	}
 
+	/* Only the blocks taken since the device state in the last piece was
+	 * recorded are not accounted for yet.
+	 */
 	dev->n_free_chunks -=
-	    dev->blocks_in_checkpt * dev->param.chunks_per_block;
-	dev->n_erased_blocks -= dev->blocks_in_checkpt;
+	    (dev->blocks_in_checkpt - dev->checkpt_piece_blocks) *
+	    dev->param.chunks_per_block;
+	dev->n_erased_blocks -=
+	    dev->blocks_in_checkpt - dev->checkpt_piece_blocks;
+	dev->checkpt_piece_blocks = dev->blocks_in_checkpt;
 
 	yaffs_trace(YAFFS_TRACE_CHECKPOINT,"checkpoint byte count %d",
 		dev->checkpt_byte_count);
@@ -397,7 +489,7 @@ int yaffs_checkpt_close(struct yaffs_dev *dev)
 		/* free the buffer */
 		kfree(dev->checkpt_buffer);
 		dev->checkpt_buffer = NULL;
-		return 1;
+		return ok;
 	} else {
 		return 0;
         }
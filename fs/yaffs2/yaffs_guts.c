@@ -24,6 +24,7 @@
 
 #include "yaffs_yaffs1.h"
 #include "yaffs_yaffs2.h"
+#include "yaffs_summary.h"
 #include "yaffs_bitmap.h"
 #include "yaffs_verify.h"
 
@@ -529,6 +530,7 @@ static int yaffs_write_new_chunk(struct yaffs_dev *dev,
 	int chunk;
 
 	yaffs2_checkpt_invalidate(dev);
+	yaffs2_checkpt_obj_changed(dev, tags->obj_id);
 
 	do {
 		struct yaffs_block_info *bi = 0;
@@ -604,6 +606,8 @@ static int yaffs_write_new_chunk(struct yaffs_dev *dev,
 		/* Copy the data into the robustification buffer */
 		yaffs_handle_chunk_wr_ok(dev, chunk, data, tags);
 
+		yaffs_summary_add(dev, tags, chunk);
+
 	} while (write_ok != YAFFS_OK &&
 		 (yaffs_wr_attempts <= 0 || attempts <= yaffs_wr_attempts));
 
@@ -1673,6 +1677,7 @@ static void yaffs_free_obj(struct yaffs_obj *obj)
 		return;
 	}
 
+	yaffs2_checkpt_obj_changed(dev, obj->obj_id);
 	yaffs_unhash_obj(obj);
 
 	yaffs_free_raw_obj(dev, obj);
@@ -1728,8 +1733,83 @@ static void yaffs_soft_del_file(struct yaffs_obj *obj)
 					      obj->variant.
 					      file_variant.top_level, 0);
 			obj->soft_del = 1;
+			yaffs2_checkpt_obj_changed(obj->my_dev, obj->obj_id);
+		}
+	}
+}
+
+static void yaffs_free_tnode_tree(struct yaffs_dev *dev,
+				  struct yaffs_tnode *tn, u32 level)
+{
+	int i;
+
+	if (!tn)
+		return;
+
+	if (level > 0)
+		for (i = 0; i < YAFFS_NTNODES_INTERNAL; i++)
+			yaffs_free_tnode_tree(dev, tn->internal[i], level - 1);
+
+	yaffs_free_tnode(dev, tn);
+}
+
+/* Drop the chunk map of a file, leaving it with an empty tree */
+int yaffs_reset_file_tnodes(struct yaffs_obj *obj)
+{
+	struct yaffs_file_var *file_var = &obj->variant.file_variant;
+
+	yaffs_free_tnode_tree(obj->my_dev, file_var->top, file_var->top_level);
+	file_var->top_level = 0;
+	file_var->top = yaffs_get_tnode(obj->my_dev);
+
+	return file_var->top ? YAFFS_OK : YAFFS_FAIL;
+}
+
+/*
+ * Drop an object from memory without touching the flash, as when a
+ * checkpoint says it no longer exists.  Whatever still refers to it is
+ * left to be fixed up by the caller.
+ */
+void yaffs_forget_obj(struct yaffs_obj *obj)
+{
+	struct yaffs_obj *child;
+	struct yaffs_obj *hl;
+
+	switch (obj->variant_type) {
+	case YAFFS_OBJECT_TYPE_FILE:
+		yaffs_free_tnode_tree(obj->my_dev,
+				      obj->variant.file_variant.top,
+				      obj->variant.file_variant.top_level);
+		obj->variant.file_variant.top = NULL;
+		break;
+	case YAFFS_OBJECT_TYPE_DIRECTORY:
+		while (!list_empty(&obj->variant.dir_variant.children)) {
+			child = list_entry(obj->variant.dir_variant.children.next,
+					   struct yaffs_obj, siblings);
+			list_del_init(&child->siblings);
+			child->parent = NULL;
 		}
+		list_del_init(&obj->variant.dir_variant.dirty);
+		break;
+	case YAFFS_OBJECT_TYPE_HARDLINK:
+		list_del_init(&obj->hard_links);
+		break;
+	default:
+		break;
 	}
+
+	/* Hard links to it */
+	while (!list_empty(&obj->hard_links)) {
+		hl = list_entry(obj->hard_links.next, struct yaffs_obj,
+				hard_links);
+		list_del_init(&hl->hard_links);
+		hl->variant.hardlink_variant.equiv_obj = NULL;
+	}
+
+	if (obj->parent)
+		yaffs_remove_obj_from_dir(obj);
+
+	yaffs_free_obj(obj);
 }
 
 /* Pruning removes any part of the file structure tree that is beyond the
@@ -2562,6 +2642,8 @@ static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
 					bi->soft_del_pages--;
 
 					object->n_data_chunks--;
+					yaffs2_checkpt_obj_changed(dev,
+							object->obj_id);
 
 					if (object->n_data_chunks <= 0) {
 						/* remeber to clean up the object */
@@ -3892,6 +3974,8 @@ int yaffs_resize_file(struct yaffs_obj *in, loff_t new_size)
 	if (in->variant_type != YAFFS_OBJECT_TYPE_FILE)
 		return YAFFS_FAIL;
 
+	yaffs2_checkpt_obj_changed(dev, in->obj_id);
+
 	if (new_size == old_size)
 		return YAFFS_OK;
 
@@ -4980,6 +5064,21 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 			init_failed = 1;
 	}
 
+	dev->checkpt_dirty = NULL;
+	dev->n_checkpt_dirty = 0;
+	dev->checkpt_blocks = NULL;
+	dev->checkpt_append_ok = 0;
+	dev->n_checkpt_deltas = 0;
+	if (!init_failed && dev->param.is_yaffs2) {
+		/* Without it every checkpoint is written in full */
+		dev->checkpt_dirty = kmalloc(YAFFS_OBJECT_SPACE / 8, GFP_NOFS);
+		if (dev->checkpt_dirty)
+			memset(dev->checkpt_dirty, 0, YAFFS_OBJECT_SPACE / 8);
+	}
+
+	if (!init_failed && !yaffs_summary_init(dev))
+		init_failed = 1;
+
 	if (dev->param.is_yaffs2)
 		dev->param.use_header_file_size = 1;
 
@@ -5089,6 +5188,10 @@ void yaffs_deinitialise(struct yaffs_dev *dev)
 		}
 
 		kfree(dev->gc_cleanup_list);
+		kfree(dev->checkpt_dirty);
+		dev->checkpt_dirty = NULL;
+		yaffs2_checkpt_free_blocks(dev);
+		yaffs_summary_deinit(dev);
 
 		for (i = 0; i < YAFFS_N_TEMP_BUFFERS; i++)
 			kfree(dev->temp_buffer[i].buffer);
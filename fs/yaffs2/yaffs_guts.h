@@ -60,7 +60,7 @@
 #define YAFFS_OBJECT_SPACE		0x40000
 #define YAFFS_MAX_OBJECT_ID		(YAFFS_OBJECT_SPACE -1)
 
-#define YAFFS_CHECKPOINT_VERSION 	4
+#define YAFFS_CHECKPOINT_VERSION 	6
 
 #ifdef CONFIG_YAFFS_UNICODE
 #define YAFFS_MAX_NAME_LENGTH		127
@@ -83,6 +83,10 @@
 #define YAFFS_OBJECTID_CHECKPOINT_DATA	0x20
 #define YAFFS_SEQUENCE_CHECKPOINT_DATA  0x21
 
+/* Pseudo object and chunk ids of block summary chunks */
+#define YAFFS_OBJECTID_SUMMARY		0x30
+#define YAFFS_SUMMARY_CHUNK_ID		(YAFFS_MAX_CHUNK_ID + 1)
+
 #define YAFFS_MAX_SHORT_OP_CACHES	20
 
 #define YAFFS_N_TEMP_BUFFERS		6
@@ -522,6 +526,8 @@ struct yaffs_param {
 	u8 skip_checkpt_rd;
 	u8 skip_checkpt_wr;
 
+	int disable_summary;	/* Don't write block summaries (yaffs2) */
+
 	int enable_xattr;	/* Enable xattribs */
 
 	/* NAND access functions (Must be set before calling YAFFS) */
@@ -632,6 +638,26 @@ struct yaffs_dev {
 
 	int checkpoint_blocks_required;	/* Number of blocks needed to store current checkpoint set */
 
+	/* Incremental checkpointing: changes are appended to the checkpoint
+	 * as pieces holding the objects that changed since the last piece.
+	 */
+	u32 *checkpt_dirty;	/* bitmap of object ids changed since the last piece */
+	int n_checkpt_dirty;
+	int checkpt_append_ok;	/* stream ends cleanly and can be appended to */
+	int checkpt_append_block;	/* where the next piece goes */
+	int checkpt_append_chunk;
+	int checkpt_append_seq;
+	int checkpt_append_next;
+	int checkpt_piece_blocks;	/* blocks_in_checkpt when the piece started */
+	int checkpt_rd_end;	/* read stopped at the clean end of the stream */
+	u8 *checkpt_blocks;	/* block_info and chunk_bits as the checkpoint has them */
+	unsigned checkpt_blocks_alt:1;	/* was allocated using alternative strategy */
+
+	/* Block summaries */
+	struct yaffs_summary_tags *sum_tags;
+	int chunks_per_summary;
+	int sum_block;		/* block whose summary is being gathered */
+
 	/* Block Info */
 	struct yaffs_block_info *block_info;
 	u8 *chunk_bits;		/* bitmap of chunks in use */
@@ -734,6 +760,7 @@ struct yaffs_dev {
 	u32 n_unmarked_deletions;
 	u32 refresh_count;
 	u32 cache_hits;
+	u32 n_checkpt_deltas;
 
 };
 
@@ -884,6 +911,8 @@ void yaffs_set_obj_name_from_oh(struct yaffs_obj *obj,
 void yaffs_add_obj_to_dir(struct yaffs_obj *directory, struct yaffs_obj *obj);
 YCHAR *yaffs_clone_str(const YCHAR * str);
 void yaffs_link_fixup(struct yaffs_dev *dev, struct yaffs_obj *hard_list);
+void yaffs_forget_obj(struct yaffs_obj *obj);
+int yaffs_reset_file_tnodes(struct yaffs_obj *obj);
 void yaffs_block_became_dirty(struct yaffs_dev *dev, int block_no);
 int yaffs_update_oh(struct yaffs_obj *in, const YCHAR * name,
 		    int force, int is_shrink, int shadows,
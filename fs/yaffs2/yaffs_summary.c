@@ -0,0 +1,240 @@
+/*
+ * YAFFS: Yet Another Flash File System. A NAND-flash specific file system.
+ *
+ * Copyright (C) 2002-2010 Aleph One Ltd.
+ *   for Toby Churchill Ltd and Brightstar Engineering
+ *
+ * Created by Charles Manning <charles@aleph1.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/*
+ * Block summaries.
+ *
+ * The tags of the chunks written to the allocation block are gathered as
+ * they are written.  When all but the last chunk of the block are used, the
+ * gathered tags go to the last chunk and the block is closed.  The summary
+ * chunk belongs to no object: it is not counted as in use, gc does not copy
+ * it and it is reclaimed when the block is erased.  Its tags have a chunk id
+ * above YAFFS_MAX_CHUNK_ID, so a kernel that does not know about summaries
+ * takes it for a chunk with bad tags when it scans, and counts it in
+ * n_free_chunks.  The free space such a kernel reports then includes one
+ * chunk per full block, which it can only get back when gc erases the block.
+ */
+
+#include "yaffs_summary.h"
+#include "yaffs_trace.h"
+#include "yaffs_nand.h"
+#include "yaffs_getblockinfo.h"
+#include "yaffs_tagsvalidity.h"
+
+#define YAFFS_SUMMARY_VERSION	1
+
+struct yaffs_summary_header {
+	u32 version;		/* Must be YAFFS_SUMMARY_VERSION */
+	u32 block;		/* Block described by the summary */
+	u32 seq;		/* Sequence number of that block */
+	u32 sum;		/* Checksum of the summary tags */
+};
+
+static int yaffs_summary_bytes(struct yaffs_dev *dev)
+{
+	return dev->chunks_per_summary * sizeof(struct yaffs_summary_tags);
+}
+
+static void yaffs_summary_clear(struct yaffs_dev *dev)
+{
+	memset(dev->sum_tags, 0, yaffs_summary_bytes(dev));
+}
+
+static u32 yaffs_summary_sum(struct yaffs_dev *dev)
+{
+	u8 *p = (u8 *) dev->sum_tags;
+	int n = yaffs_summary_bytes(dev);
+	u32 sum = 0;
+
+	while (n-- > 0)
+		sum = ((sum << 1) | (sum >> 31)) + *p++;
+
+	return sum;
+}
+
+int yaffs_summary_init(struct yaffs_dev *dev)
+{
+	int n_bytes;
+
+	dev->sum_tags = NULL;
+	dev->chunks_per_summary = 0;
+	dev->sum_block = -1;
+
+	if (!dev->param.is_yaffs2 || dev->param.disable_summary)
+		return YAFFS_OK;
+
+	/* The summary must fit in the one chunk it takes from the block */
+	n_bytes = (dev->param.chunks_per_block - 1) *
+	    sizeof(struct yaffs_summary_tags);
+	if (sizeof(struct yaffs_summary_header) + n_bytes >
+	    dev->data_bytes_per_chunk) {
+		yaffs_trace(YAFFS_TRACE_ALWAYS,
+			"yaffs: blocks too large for a summary chunk, summaries disabled");
+		return YAFFS_OK;
+	}
+
+	dev->sum_tags = kmalloc(n_bytes, GFP_NOFS);
+	if (!dev->sum_tags)
+		return YAFFS_FAIL;
+
+	dev->chunks_per_summary = dev->param.chunks_per_block - 1;
+	yaffs_summary_clear(dev);
+
+	return YAFFS_OK;
+}
+
+void yaffs_summary_deinit(struct yaffs_dev *dev)
+{
+	kfree(dev->sum_tags);
+	dev->sum_tags = NULL;
+	dev->chunks_per_summary = 0;
+}
+
+static void yaffs_summary_write(struct yaffs_dev *dev, int blk)
+{
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
+	struct yaffs_summary_header hdr;
+	struct yaffs_ext_tags tags;
+	int n_bytes = yaffs_summary_bytes(dev);
+	int chunk = blk * dev->param.chunks_per_block + dev->chunks_per_summary;
+	u8 *buffer;
+
+	buffer = yaffs_get_temp_buffer(dev, __LINE__);
+	memset(buffer, 0xff, dev->data_bytes_per_chunk);
+
+	hdr.version = YAFFS_SUMMARY_VERSION;
+	hdr.block = blk;
+	hdr.seq = bi->seq_number;
+	hdr.sum = yaffs_summary_sum(dev);
+	memcpy(buffer, &hdr, sizeof(hdr));
+	memcpy(buffer + sizeof(hdr), dev->sum_tags, n_bytes);
+
+	yaffs_init_tags(&tags);
+	tags.obj_id = YAFFS_OBJECTID_SUMMARY;
+	tags.chunk_id = YAFFS_SUMMARY_CHUNK_ID;
+	tags.n_bytes = sizeof(hdr) + n_bytes;
+
+	/* A block without a good summary is simply scanned chunk by chunk */
+	if (yaffs_wr_chunk_tags_nand(dev, chunk, buffer, &tags) != YAFFS_OK)
+		yaffs_trace(YAFFS_TRACE_ERROR,
+			"**>> yaffs summary write of block %d failed", blk);
+
+	yaffs_release_temp_buffer(dev, buffer, __LINE__);
+}
+
+/*
+ * Called for every chunk written to the allocation block.  Only blocks
+ * written from their first chunk get a summary: after a mount the tags of
+ * the chunks already in the allocation block are not known.
+ */
+void yaffs_summary_add(struct yaffs_dev *dev, struct yaffs_ext_tags *tags,
+		       int chunk_in_nand)
+{
+	int blk = chunk_in_nand / dev->param.chunks_per_block;
+	int chunk_in_block = chunk_in_nand % dev->param.chunks_per_block;
+	struct yaffs_summary_tags *st;
+
+	if (!dev->sum_tags)
+		return;
+
+	if (chunk_in_block == 0) {
+		yaffs_summary_clear(dev);
+		dev->sum_block = blk;
+	}
+
+	if (blk != dev->sum_block || chunk_in_block >= dev->chunks_per_summary)
+		return;
+
+	st = &dev->sum_tags[chunk_in_block];
+	st->obj_id = tags->obj_id;
+	st->chunk_id = tags->chunk_id;
+	st->n_bytes = tags->n_bytes;
+
+	if (chunk_in_block == dev->chunks_per_summary - 1) {
+		yaffs_summary_write(dev, blk);
+		dev->sum_block = -1;
+		yaffs_skip_rest_of_block(dev);
+	}
+}
+
+/*
+ * Load the summary of a block being scanned into dev->sum_tags.
+ * Returns 1 if the block has a good summary.
+ */
+int yaffs_summary_read(struct yaffs_dev *dev, int blk)
+{
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
+	struct yaffs_summary_header hdr;
+	struct yaffs_ext_tags tags;
+	int n_bytes = yaffs_summary_bytes(dev);
+	int chunk = blk * dev->param.chunks_per_block + dev->chunks_per_summary;
+	u8 *buffer;
+	int ok;
+
+	if (!dev->sum_tags)
+		return 0;
+
+	buffer = yaffs_get_temp_buffer(dev, __LINE__);
+
+	yaffs_rd_chunk_tags_nand(dev, chunk, buffer, &tags);
+
+	ok = tags.chunk_used &&
+	    tags.ecc_result <= YAFFS_ECC_RESULT_FIXED &&
+	    tags.obj_id == YAFFS_OBJECTID_SUMMARY &&
+	    tags.chunk_id == YAFFS_SUMMARY_CHUNK_ID &&
+	    tags.seq_number == bi->seq_number &&
+	    tags.n_bytes == sizeof(hdr) + n_bytes;
+
+	if (ok) {
+		memcpy(&hdr, buffer, sizeof(hdr));
+		memcpy(dev->sum_tags, buffer + sizeof(hdr), n_bytes);
+		ok = hdr.version == YAFFS_SUMMARY_VERSION &&
+		    hdr.block == blk &&
+		    hdr.seq == bi->seq_number &&
+		    hdr.sum == yaffs_summary_sum(dev);
+	}
+
+	yaffs_release_temp_buffer(dev, buffer, __LINE__);
+
+	yaffs_trace(YAFFS_TRACE_SCAN_DEBUG,
+		"block %d summary %s", blk, ok ? "ok" : "not used");
+
+	return ok;
+}
+
+/*
+ * Tags of a chunk of a block whose summary was read, as a scan would have
+ * read them from the chunk.  The summary chunk itself is included.
+ */
+void yaffs_summary_fetch(struct yaffs_dev *dev, struct yaffs_ext_tags *tags,
+			 int blk, int chunk_in_block)
+{
+	struct yaffs_summary_tags *st;
+
+	yaffs_init_tags(tags);
+	tags->chunk_used = 1;
+	tags->ecc_result = YAFFS_ECC_RESULT_NO_ERROR;
+	tags->seq_number = yaffs_get_block_info(dev, blk)->seq_number;
+
+	if (chunk_in_block < dev->chunks_per_summary) {
+		st = &dev->sum_tags[chunk_in_block];
+		tags->obj_id = st->obj_id;
+		tags->chunk_id = st->chunk_id;
+		tags->n_bytes = st->n_bytes;
+	} else {
+		tags->obj_id = YAFFS_OBJECTID_SUMMARY;
+		tags->chunk_id = YAFFS_SUMMARY_CHUNK_ID;
+		tags->n_bytes = sizeof(struct yaffs_summary_header) +
+		    yaffs_summary_bytes(dev);
+	}
+}
@@ -1758,6 +1758,7 @@ struct yaffs_options {
 	int skip_checkpoint_read;
 	int skip_checkpoint_write;
 	int no_cache;
+	int no_summary;
 	int tags_ecc_on;
 	int tags_ecc_overridden;
 	int lazy_loading_enabled;
@@ -1820,6 +1821,8 @@ static int yaffs_parse_options(struct yaffs_options *options,
 		} else if (!strcmp(cur_opt, "no-checkpoint")) {
 			options->skip_checkpoint_read = 1;
 			options->skip_checkpoint_write = 1;
+		} else if (!strcmp(cur_opt, "no-summary")) {
+			options->no_summary = 1;
 		} else {
 			printk(KERN_INFO "yaffs: Bad mount option \"%s\"\n",
 			       cur_opt);
@@ -2296,6 +2299,7 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 
 	param->skip_checkpt_rd = options.skip_checkpoint_read;
 	param->skip_checkpt_wr = options.skip_checkpoint_write;
+	param->disable_summary = options.no_summary;
 
 	mutex_lock(&yaffs_context_lock);
 	/* Get a mount id */
@@ -2442,6 +2446,8 @@ static char *yaffs_dump_dev_part0(char *buf, struct yaffs_dev *dev)
 			param->n_reserved_blocks);
 	buf += sprintf(buf, "always_check_erased... %d\n",
 			param->always_check_erased);
+	buf += sprintf(buf, "disable_summary....... %d\n",
+			param->disable_summary);
 
 	return buf;
 }
@@ -2457,6 +2463,8 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	    sprintf(buf, "n_erased_blocks....... %d\n", dev->n_erased_blocks);
 	buf +=
 	    sprintf(buf, "blocks_in_checkpt..... %d\n", dev->blocks_in_checkpt);
+	buf +=
+	    sprintf(buf, "n_checkpt_deltas...... %u\n", dev->n_checkpt_deltas);
 	buf += sprintf(buf, "\n");
 	buf += sprintf(buf, "n_tnodes.............. %d\n", dev->n_tnodes);
 	buf += sprintf(buf, "n_obj................. %d\n", dev->n_obj);
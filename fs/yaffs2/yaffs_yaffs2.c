@@ -15,6 +15,7 @@
 #include "yaffs_trace.h"
 #include "yaffs_yaffs2.h"
 #include "yaffs_checkptrw.h"
+#include "yaffs_summary.h"
 #include "yaffs_bitmap.h"
 #include "yaffs_nand.h"
 #include "yaffs_getblockinfo.h"
@@ -250,7 +251,21 @@ int yaffs_calc_checkpt_blocks_required(struct yaffs_dev *dev)
 
 /*--------------------- Checkpointing --------------------*/
 
-static int yaffs2_wr_checkpt_validity_marker(struct yaffs_dev *dev, int head)
+/*
+ * The checkpoint is a stream of pieces.  The first piece is a full (base)
+ * checkpoint.  Each later piece is either a delta, holding the device state
+ * and the blocks and objects that changed since the piece before it, or a
+ * stale marker, saying that the state has changed since the piece before it
+ * and is not in the checkpoint.  Each piece opens with a validity marker
+ * telling its kind.  All but stale pieces close with a tail marker, and all
+ * have a checksum.
+ */
+#define YAFFS_CHECKPT_TAIL	0
+#define YAFFS_CHECKPT_BASE	1
+#define YAFFS_CHECKPT_DELTA	2
+#define YAFFS_CHECKPT_STALE	3
+
+static int yaffs2_wr_checkpt_validity_marker(struct yaffs_dev *dev, int kind)
 {
 	struct yaffs_checkpt_validity cp;
 
@@ -259,12 +274,12 @@ static int yaffs2_wr_checkpt_validity_marker(struct yaffs_dev *dev, int head)
 	cp.struct_type = sizeof(cp);
 	cp.magic = YAFFS_MAGIC;
 	cp.version = YAFFS_CHECKPOINT_VERSION;
-	cp.head = (head) ? 1 : 0;
+	cp.head = kind;
 
 	return (yaffs2_checkpt_wr(dev, &cp, sizeof(cp)) == sizeof(cp)) ? 1 : 0;
 }
 
-static int yaffs2_rd_checkpt_validity_marker(struct yaffs_dev *dev, int head)
+static int yaffs2_rd_checkpt_marker(struct yaffs_dev *dev, int *kind)
 {
 	struct yaffs_checkpt_validity cp;
 	int ok;
@@ -274,11 +289,19 @@ static int yaffs2_rd_checkpt_validity_marker(struct yaffs_dev *dev, int head)
 	if (ok)
 		ok = (cp.struct_type == sizeof(cp)) &&
 		    (cp.magic == YAFFS_MAGIC) &&
-		    (cp.version == YAFFS_CHECKPOINT_VERSION) &&
-		    (cp.head == ((head) ? 1 : 0));
+		    (cp.version == YAFFS_CHECKPOINT_VERSION);
+	if (ok)
+		*kind = cp.head;
 	return ok ? 1 : 0;
 }
 
+static int yaffs2_rd_checkpt_validity_marker(struct yaffs_dev *dev, int kind)
+{
+	int found;
+
+	return yaffs2_rd_checkpt_marker(dev, &found) && found == kind;
+}
+
 static void yaffs2_dev_to_checkpt_dev(struct yaffs_checkpt_dev *cp,
 				      struct yaffs_dev *dev)
 {
@@ -308,6 +331,48 @@ static void yaffs_checkpt_dev_to_dev(struct yaffs_dev *dev,
 	dev->seq_number = cp->seq_number;
 }
 
+/*
+ * checkpt_blocks keeps a copy of the block info and chunk bits as the
+ * checkpoint on flash has them: the block info array followed by the
+ * chunk bits.  A delta only carries the blocks that differ from it.
+ */
+static void yaffs2_checkpt_copy_blocks(struct yaffs_dev *dev)
+{
+	u32 n_blocks =
+	    (dev->internal_end_block - dev->internal_start_block + 1);
+	u32 bi_bytes = n_blocks * sizeof(struct yaffs_block_info);
+	u32 bits_bytes = n_blocks * dev->chunk_bit_stride;
+
+	/* Without the dirty object map there are no deltas */
+	if (!dev->checkpt_dirty)
+		return;
+
+	/* If the first allocation strategy fails, try the alternate one */
+	if (!dev->checkpt_blocks) {
+		dev->checkpt_blocks = kmalloc(bi_bytes + bits_bytes, GFP_NOFS);
+		dev->checkpt_blocks_alt = 0;
+		if (!dev->checkpt_blocks) {
+			dev->checkpt_blocks = vmalloc(bi_bytes + bits_bytes);
+			dev->checkpt_blocks_alt = 1;
+		}
+		if (!dev->checkpt_blocks)
+			return;
+	}
+
+	memcpy(dev->checkpt_blocks, dev->block_info, bi_bytes);
+	memcpy(dev->checkpt_blocks + bi_bytes, dev->chunk_bits, bits_bytes);
+}
+
+void yaffs2_checkpt_free_blocks(struct yaffs_dev *dev)
+{
+	if (dev->checkpt_blocks_alt && dev->checkpt_blocks)
+		vfree(dev->checkpt_blocks);
+	else if (dev->checkpt_blocks)
+		kfree(dev->checkpt_blocks);
+	dev->checkpt_blocks_alt = 0;
+	dev->checkpt_blocks = NULL;
+}
+
 static int yaffs2_wr_checkpt_dev(struct yaffs_dev *dev)
 {
 	struct yaffs_checkpt_dev cp;
@@ -336,10 +401,60 @@ static int yaffs2_wr_checkpt_dev(struct yaffs_dev *dev)
 		ok = (yaffs2_checkpt_wr(dev, dev->chunk_bits, n_bytes) ==
 		      n_bytes);
 	}
+
+	if (ok)
+		yaffs2_checkpt_copy_blocks(dev);
+
 	return ok ? 1 : 0;
 
 }
 
+/*
+ * The device state for a delta: the runtime values, then the block info
+ * and chunk bits of each block that changed since the checkpoint last
+ * recorded it, as its index followed by both, ended by ~0.
+ */
+static int yaffs2_wr_checkpt_dev_delta(struct yaffs_dev *dev)
+{
+	struct yaffs_checkpt_dev cp;
+	u32 n_blocks =
+	    (dev->internal_end_block - dev->internal_start_block + 1);
+	u32 stride = dev->chunk_bit_stride;
+	struct yaffs_block_info *old_bi =
+	    (struct yaffs_block_info *)dev->checkpt_blocks;
+	u8 *old_bits = dev->checkpt_blocks + n_blocks * sizeof(*old_bi);
+	u8 *bits;
+	u32 i;
+	int ok;
+
+	yaffs2_dev_to_checkpt_dev(&cp, dev);
+	cp.struct_type = sizeof(cp);
+
+	ok = (yaffs2_checkpt_wr(dev, &cp, sizeof(cp)) == sizeof(cp));
+
+	for (i = 0; ok && i < n_blocks; i++) {
+		bits = dev->chunk_bits + i * stride;
+		if (!memcmp(&old_bi[i], &dev->block_info[i], sizeof(*old_bi)) &&
+		    !memcmp(old_bits + i * stride, bits, stride))
+			continue;
+
+		ok = (yaffs2_checkpt_wr(dev, &i, sizeof(i)) == sizeof(i)) &&
+		    (yaffs2_checkpt_wr(dev, &dev->block_info[i],
+				       sizeof(*old_bi)) == sizeof(*old_bi)) &&
+		    (yaffs2_checkpt_wr(dev, bits, stride) == stride);
+		if (ok) {
+			old_bi[i] = dev->block_info[i];
+			memcpy(old_bits + i * stride, bits, stride);
+		}
+	}
+
+	i = ~0;
+	if (ok)
+		ok = (yaffs2_checkpt_wr(dev, &i, sizeof(i)) == sizeof(i));
+
+	return ok ? 1 : 0;
+}
+
 static int yaffs2_rd_checkpt_dev(struct yaffs_dev *dev)
 {
 	struct yaffs_checkpt_dev cp;
@@ -371,6 +486,41 @@ static int yaffs2_rd_checkpt_dev(struct yaffs_dev *dev)
 	return ok ? 1 : 0;
 }
 
+static int yaffs2_rd_checkpt_dev_delta(struct yaffs_dev *dev)
+{
+	struct yaffs_checkpt_dev cp;
+	u32 n_blocks =
+	    (dev->internal_end_block - dev->internal_start_block + 1);
+	u32 stride = dev->chunk_bit_stride;
+	u32 i;
+	int ok;
+
+	ok = (yaffs2_checkpt_rd(dev, &cp, sizeof(cp)) == sizeof(cp));
+	if (!ok)
+		return 0;
+
+	if (cp.struct_type != sizeof(cp))
+		return 0;
+
+	yaffs_checkpt_dev_to_dev(dev, &cp);
+
+	while (ok) {
+		ok = (yaffs2_checkpt_rd(dev, &i, sizeof(i)) == sizeof(i));
+		if (!ok || i == ~0)
+			break;
+		if (i >= n_blocks)
+			return 0;
+
+		ok = (yaffs2_checkpt_rd(dev, &dev->block_info[i],
+					sizeof(struct yaffs_block_info)) ==
+		      sizeof(struct yaffs_block_info)) &&
+		    (yaffs2_checkpt_rd(dev, dev->chunk_bits + i * stride,
+				       stride) == stride);
+	}
+
+	return ok ? 1 : 0;
+}
+
 static void yaffs2_obj_checkpt_obj(struct yaffs_checkpt_obj *cp,
 				   struct yaffs_obj *obj)
 {
@@ -554,10 +704,39 @@ static int yaffs2_rd_checkpt_tnodes(struct yaffs_obj *obj)
 	return ok ? 1 : 0;
 }
 
+static int yaffs2_wr_checkpt_obj(struct yaffs_dev *dev, struct yaffs_obj *obj)
+{
+	struct yaffs_checkpt_obj cp;
+	int ok;
+
+	yaffs2_obj_checkpt_obj(&cp, obj);
+	cp.struct_type = sizeof(cp);
+
+	yaffs_trace(YAFFS_TRACE_CHECKPOINT,
+		"Checkpoint write object %d parent %d type %d chunk %d obj addr %p",
+		cp.obj_id, cp.parent_id, cp.variant_type, cp.hdr_chunk, obj);
+
+	ok = (yaffs2_checkpt_wr(dev, &cp, sizeof(cp)) == sizeof(cp));
+
+	if (ok && obj->variant_type == YAFFS_OBJECT_TYPE_FILE)
+		ok = yaffs2_wr_checkpt_tnodes(obj);
+
+	return ok ? 1 : 0;
+}
+
+static int yaffs2_wr_checkpt_objs_end(struct yaffs_dev *dev)
+{
+	struct yaffs_checkpt_obj cp;
+
+	memset(&cp, 0xFF, sizeof(struct yaffs_checkpt_obj));
+	cp.struct_type = sizeof(cp);
+
+	return (yaffs2_checkpt_wr(dev, &cp, sizeof(cp)) == sizeof(cp)) ? 1 : 0;
+}
+
 static int yaffs2_wr_checkpt_objs(struct yaffs_dev *dev)
 {
 	struct yaffs_obj *obj;
-	struct yaffs_checkpt_obj cp;
 	int i;
 	int ok = 1;
 	struct list_head *lh;
@@ -571,40 +750,135 @@ static int yaffs2_wr_checkpt_objs(struct yaffs_dev *dev)
 			if (lh) {
 				obj =
 				    list_entry(lh, struct yaffs_obj, hash_link);
-				if (!obj->defered_free) {
-					yaffs2_obj_checkpt_obj(&cp, obj);
-					cp.struct_type = sizeof(cp);
-
-					yaffs_trace(YAFFS_TRACE_CHECKPOINT,
-						"Checkpoint write object %d parent %d type %d chunk %d obj addr %p",
-						cp.obj_id, cp.parent_id,
-						cp.variant_type, cp.hdr_chunk, obj);
-
-					ok = (yaffs2_checkpt_wr
-					      (dev, &cp,
-					       sizeof(cp)) == sizeof(cp));
-
-					if (ok
-					    && obj->variant_type ==
-					    YAFFS_OBJECT_TYPE_FILE)
-						ok = yaffs2_wr_checkpt_tnodes
-						    (obj);
-				}
+				if (!obj->defered_free && ok)
+					ok = yaffs2_wr_checkpt_obj(dev, obj);
 			}
 		}
 	}
 
 	/* Dump end of list */
-	memset(&cp, 0xFF, sizeof(struct yaffs_checkpt_obj));
-	cp.struct_type = sizeof(cp);
+	if (ok)
+		ok = yaffs2_wr_checkpt_objs_end(dev);
+
+	return ok ? 1 : 0;
+}
+
+/*
+ * Objects changed since the last checkpoint piece are marked in the
+ * checkpt_dirty bitmap, by object id.
+ */
+void yaffs2_checkpt_obj_changed(struct yaffs_dev *dev, int obj_id)
+{
+	u32 mask = 1 << (obj_id & 31);
+	u32 *word;
+
+	if (!dev->checkpt_dirty || obj_id <= 0 || obj_id > YAFFS_MAX_OBJECT_ID)
+		return;
+
+	word = &dev->checkpt_dirty[obj_id >> 5];
+	if (!(*word & mask)) {
+		*word |= mask;
+		dev->n_checkpt_dirty++;
+	}
+}
+
+static void yaffs2_checkpt_clear_dirty(struct yaffs_dev *dev)
+{
+	if (dev->checkpt_dirty && dev->n_checkpt_dirty)
+		memset(dev->checkpt_dirty, 0, YAFFS_OBJECT_SPACE / 8);
+	dev->n_checkpt_dirty = 0;
+}
+
+/* Next changed object id from obj_id on, or -1 */
+static int yaffs2_checkpt_next_dirty(struct yaffs_dev *dev, int obj_id)
+{
+	u32 word;
+
+	while (obj_id < YAFFS_OBJECT_SPACE) {
+		word = dev->checkpt_dirty[obj_id >> 5] >> (obj_id & 31);
+		if (!word) {
+			obj_id = (obj_id | 31) + 1;
+			continue;
+		}
+		while (!(word & 1)) {
+			word >>= 1;
+			obj_id++;
+		}
+		return obj_id;
+	}
+	return -1;
+}
+
+/* The ids of changed objects that no longer exist, ended by ~0 */
+static int yaffs2_wr_checkpt_gone(struct yaffs_dev *dev)
+{
+	struct yaffs_obj *obj;
+	u32 obj_id;
+	int id;
+	int ok = 1;
+
+	for (id = yaffs2_checkpt_next_dirty(dev, 0); ok && id >= 0;
+	     id = yaffs2_checkpt_next_dirty(dev, id + 1)) {
+		obj = yaffs_find_by_number(dev, id);
+		if (obj && !obj->defered_free)
+			continue;
+		obj_id = id;
+		ok = (yaffs2_checkpt_wr(dev, &obj_id, sizeof(obj_id)) ==
+		      sizeof(obj_id));
+	}
+
+	obj_id = ~0;
+	if (ok)
+		ok = (yaffs2_checkpt_wr(dev, &obj_id, sizeof(obj_id)) ==
+		      sizeof(obj_id));
+
+	return ok ? 1 : 0;
+}
+
+static int yaffs2_rd_checkpt_gone(struct yaffs_dev *dev)
+{
+	struct yaffs_obj *obj;
+	u32 obj_id;
+	int ok;
+
+	do {
+		ok = (yaffs2_checkpt_rd(dev, &obj_id, sizeof(obj_id)) ==
+		      sizeof(obj_id));
+		if (!ok || obj_id == ~0)
+			break;
+
+		yaffs_trace(YAFFS_TRACE_CHECKPOINT,
+			"Checkpoint read gone object %d", obj_id);
+
+		obj = yaffs_find_by_number(dev, obj_id);
+		if (obj)
+			yaffs_forget_obj(obj);
+	} while (ok);
+
+	return ok ? 1 : 0;
+}
+
+/* The changed objects that still exist, as in a full checkpoint */
+static int yaffs2_wr_checkpt_dirty_objs(struct yaffs_dev *dev)
+{
+	struct yaffs_obj *obj;
+	int id;
+	int ok = 1;
+
+	for (id = yaffs2_checkpt_next_dirty(dev, 0); ok && id >= 0;
+	     id = yaffs2_checkpt_next_dirty(dev, id + 1)) {
+		obj = yaffs_find_by_number(dev, id);
+		if (obj && !obj->defered_free)
+			ok = yaffs2_wr_checkpt_obj(dev, obj);
+	}
 
 	if (ok)
-		ok = (yaffs2_checkpt_wr(dev, &cp, sizeof(cp)) == sizeof(cp));
+		ok = yaffs2_wr_checkpt_objs_end(dev);
 
 	return ok ? 1 : 0;
 }
 
-static int yaffs2_rd_checkpt_objs(struct yaffs_dev *dev)
+static int yaffs2_rd_checkpt_objs(struct yaffs_dev *dev, int delta)
 {
 	struct yaffs_obj *obj;
 	struct yaffs_checkpt_obj cp;
@@ -629,10 +903,25 @@ static int yaffs2_rd_checkpt_objs(struct yaffs_dev *dev)
 		if (ok && cp.obj_id == ~0) {
 			done = 1;
 		} else if (ok) {
-			obj =
-			    yaffs_find_or_create_by_number(dev, cp.obj_id,
-							   cp.variant_type);
-			if (obj) {
+			/* A delta replaces the object as it was, and an id
+			 * may have been reused for an object of another type.
+			 */
+			obj = delta ? yaffs_find_by_number(dev, cp.obj_id) :
+			    NULL;
+			if (obj && obj->variant_type != cp.variant_type) {
+				yaffs_forget_obj(obj);
+				obj = NULL;
+			}
+			if (!obj)
+				obj = yaffs_find_or_create_by_number(dev,
+						cp.obj_id, cp.variant_type);
+			else if (obj->variant_type == YAFFS_OBJECT_TYPE_FILE)
+				ok = yaffs_reset_file_tnodes(obj);
+			else if (obj->variant_type ==
+				 YAFFS_OBJECT_TYPE_HARDLINK)
+				list_del_init(&obj->hard_links);
+
+			if (obj && ok) {
 				ok = taffs2_checkpt_obj_to_obj(obj, &cp);
 				if (!ok)
 					break;
@@ -708,7 +997,7 @@ static int yaffs2_wr_checkpt_data(struct yaffs_dev *dev)
 	if (ok) {
 		yaffs_trace(YAFFS_TRACE_CHECKPOINT,
 			"write checkpoint validity");
-		ok = yaffs2_wr_checkpt_validity_marker(dev, 1);
+		ok = yaffs2_wr_checkpt_validity_marker(dev, YAFFS_CHECKPT_BASE);
 	}
 	if (ok) {
 		yaffs_trace(YAFFS_TRACE_CHECKPOINT,
@@ -723,7 +1012,7 @@ static int yaffs2_wr_checkpt_data(struct yaffs_dev *dev)
 	if (ok) {
 		yaffs_trace(YAFFS_TRACE_CHECKPOINT,
 			"write checkpoint validity");
-		ok = yaffs2_wr_checkpt_validity_marker(dev, 0);
+		ok = yaffs2_wr_checkpt_validity_marker(dev, YAFFS_CHECKPT_TAIL);
 	}
 
 	if (ok)
@@ -732,14 +1021,145 @@ static int yaffs2_wr_checkpt_data(struct yaffs_dev *dev)
 	if (!yaffs_checkpt_close(dev))
 		ok = 0;
 
-	if (ok)
+	if (ok) {
 		dev->is_checkpointed = 1;
-	else
+		dev->checkpt_append_ok = 1;
+		yaffs2_checkpt_clear_dirty(dev);
+	} else {
 		dev->is_checkpointed = 0;
+	}
 
 	return dev->is_checkpointed;
 }
 
+/*
+ * Append a delta piece holding the objects changed since the last piece.
+ * Returns 0 if a delta is not worth it or fails, and the whole checkpoint
+ * has to be rewritten instead.
+ */
+static int yaffs2_wr_checkpt_delta(struct yaffs_dev *dev)
+{
+	int ok = 1;
+
+	if (!yaffs2_checkpt_required(dev) || !dev->checkpt_dirty ||
+	    !dev->checkpt_blocks || !dev->checkpt_append_ok)
+		return 0;
+
+	/* Rewrite when most objects changed, or when the pieces take twice
+	 * the blocks that a full checkpoint needs.
+	 */
+	yaffs_calc_checkpt_blocks_required(dev);
+	if (dev->n_checkpt_dirty * 2 > dev->n_obj ||
+	    dev->blocks_in_checkpt > 2 * dev->checkpoint_blocks_required) {
+		yaffs_trace(YAFFS_TRACE_CHECKPOINT,
+			"checkpoint delta of %d objects, %d blocks: rewrite",
+			dev->n_checkpt_dirty, dev->blocks_in_checkpt);
+		return 0;
+	}
+
+	yaffs_trace(YAFFS_TRACE_CHECKPOINT,
+		"write checkpoint delta of %d objects", dev->n_checkpt_dirty);
+
+	if (!yaffs2_checkpt_open_append(dev))
+		return 0;
+
+	ok = yaffs2_wr_checkpt_validity_marker(dev, YAFFS_CHECKPT_DELTA);
+	if (ok)
+		ok = yaffs2_wr_checkpt_dev_delta(dev);
+	if (ok)
+		ok = yaffs2_wr_checkpt_gone(dev);
+	if (ok)
+		ok = yaffs2_wr_checkpt_dirty_objs(dev);
+	if (ok)
+		ok = yaffs2_wr_checkpt_validity_marker(dev, YAFFS_CHECKPT_TAIL);
+	if (ok)
+		ok = yaffs2_wr_checkpt_sum(dev);
+
+	if (!yaffs_checkpt_close(dev))
+		ok = 0;
+
+	dev->checkpt_append_ok = ok;
+	if (ok) {
+		dev->is_checkpointed = 1;
+		dev->n_checkpt_deltas++;
+		yaffs2_checkpt_clear_dirty(dev);
+	}
+
+	return ok;
+}
+
+/*
+ * Mark the checkpoint on flash as out of date.  Appending a stale marker is
+ * a single chunk write, where erasing the checkpoint would take all its
+ * blocks.
+ */
+static int yaffs2_wr_checkpt_stale(struct yaffs_dev *dev)
+{
+	int ok;
+
+	if (!yaffs2_checkpt_open_append(dev))
+		return 0;
+
+	ok = yaffs2_wr_checkpt_validity_marker(dev, YAFFS_CHECKPT_STALE);
+	if (ok)
+		ok = yaffs2_wr_checkpt_sum(dev);
+
+	if (!yaffs_checkpt_close(dev))
+		ok = 0;
+
+	dev->checkpt_append_ok = ok;
+
+	return ok;
+}
+
+/*
+ * Apply the pieces after the base checkpoint.  The stream must end cleanly,
+ * after a piece that is not a stale marker.
+ */
+static int yaffs2_rd_checkpt_pieces(struct yaffs_dev *dev)
+{
+	int ok = 1;
+	int stale = 0;
+	int kind;
+	int blocks;
+
+	while (ok) {
+		yaffs2_checkpt_rd_piece(dev);
+		blocks = dev->blocks_in_checkpt;
+
+		if (!yaffs2_rd_checkpt_marker(dev, &kind))
+			return dev->checkpt_rd_end && !stale;
+
+		yaffs_trace(YAFFS_TRACE_CHECKPOINT,
+			"read checkpoint piece kind %d", kind);
+
+		if (kind == YAFFS_CHECKPT_DELTA) {
+			/* Blocks taken from here on are not yet accounted
+			 * for in the device state of this piece.
+			 */
+			dev->checkpt_piece_blocks = blocks;
+			ok = yaffs2_rd_checkpt_dev_delta(dev);
+			if (ok)
+				ok = yaffs2_rd_checkpt_gone(dev);
+			if (ok)
+				ok = yaffs2_rd_checkpt_objs(dev, 1);
+			if (ok)
+				ok = yaffs2_rd_checkpt_validity_marker(dev,
+							YAFFS_CHECKPT_TAIL);
+			stale = 0;
+		} else if (kind == YAFFS_CHECKPT_STALE) {
+			stale = 1;
+		} else {
+			ok = 0;
+		}
+
+		if (ok)
+			ok = yaffs2_rd_checkpt_sum(dev);
+	}
+
+	return 0;
+}
+
 static int yaffs2_rd_checkpt_data(struct yaffs_dev *dev)
 {
 	int ok = 1;
@@ -759,7 +1179,7 @@ static int yaffs2_rd_checkpt_data(struct yaffs_dev *dev)
 	if (ok) {
 		yaffs_trace(YAFFS_TRACE_CHECKPOINT,
 			"read checkpoint validity");
-		ok = yaffs2_rd_checkpt_validity_marker(dev, 1);
+		ok = yaffs2_rd_checkpt_validity_marker(dev, YAFFS_CHECKPT_BASE);
 	}
 	if (ok) {
 		yaffs_trace(YAFFS_TRACE_CHECKPOINT,
@@ -769,12 +1189,12 @@ static int yaffs2_rd_checkpt_data(struct yaffs_dev *dev)
 	if (ok) {
 		yaffs_trace(YAFFS_TRACE_CHECKPOINT,
 			"read checkpoint objects");
-		ok = yaffs2_rd_checkpt_objs(dev);
+		ok = yaffs2_rd_checkpt_objs(dev, 0);
 	}
 	if (ok) {
 		yaffs_trace(YAFFS_TRACE_CHECKPOINT,
 			"read checkpoint validity");
-		ok = yaffs2_rd_checkpt_validity_marker(dev, 0);
+		ok = yaffs2_rd_checkpt_validity_marker(dev, YAFFS_CHECKPT_TAIL);
 	}
 
 	if (ok) {
@@ -783,13 +1203,23 @@ static int yaffs2_rd_checkpt_data(struct yaffs_dev *dev)
 			"read checkpoint checksum %d", ok);
 	}
 
+	if (ok) {
+		yaffs_trace(YAFFS_TRACE_CHECKPOINT,
+			"read checkpoint pieces");
+		ok = yaffs2_rd_checkpt_pieces(dev);
+	}
+
 	if (!yaffs_checkpt_close(dev))
 		ok = 0;
 
-	if (ok)
+	dev->checkpt_append_ok = ok;
+	if (ok) {
 		dev->is_checkpointed = 1;
-	else
+		yaffs2_checkpt_clear_dirty(dev);
+		yaffs2_checkpt_copy_blocks(dev);
+	} else {
 		dev->is_checkpointed = 0;
+	}
 
 	return ok ? 1 : 0;
 
@@ -797,8 +1227,11 @@ static int yaffs2_rd_checkpt_data(struct yaffs_dev *dev)
 
 void yaffs2_checkpt_invalidate(struct yaffs_dev *dev)
 {
-	if (dev->is_checkpointed || dev->blocks_in_checkpt > 0) {
+	if (dev->is_checkpointed) {
 		dev->is_checkpointed = 0;
+		if (!yaffs2_wr_checkpt_stale(dev))
+			yaffs2_checkpt_invalidate_stream(dev);
+	} else if (dev->blocks_in_checkpt > 0 && !dev->checkpt_append_ok) {
 		yaffs2_checkpt_invalidate_stream(dev);
 	}
 	if (dev->param.sb_dirty_fn)
@@ -816,7 +1249,7 @@ int yaffs_checkpoint_save(struct yaffs_dev *dev)
 	yaffs_verify_blocks(dev);
 	yaffs_verify_free_chunks(dev);
 
-	if (!dev->is_checkpointed) {
+	if (!dev->is_checkpointed && !yaffs2_wr_checkpt_delta(dev)) {
 		yaffs2_checkpt_invalidate(dev);
 		yaffs2_wr_checkpt_data(dev);
 	}
@@ -983,6 +1416,7 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	int found_chunks;
 	int equiv_id;
 	int alloc_failed = 0;
+	int summary_available;
 
 	struct yaffs_block_index *block_index = NULL;
 	int alt_block_index = 0;
@@ -1102,6 +1536,12 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 		deleted = 0;
 
+		/* A full block written with a summary needs only the summary
+		 * and its object headers read.
+		 */
+		summary_available = (state == YAFFS_BLOCK_STATE_NEEDS_SCANNING) &&
+		    yaffs_summary_read(dev, blk);
+
 		/* For each chunk in each block that needs scanning.... */
 		found_chunks = 0;
 		for (c = dev->param.chunks_per_block - 1;
@@ -1114,8 +1554,14 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 			chunk = blk * dev->param.chunks_per_block + c;
 
-			result = yaffs_rd_chunk_tags_nand(dev, chunk, NULL,
-							  &tags);
+			/* Object headers carry more in their tags than the
+			 * summary holds, so they are read anyway.
+			 */
+			if (summary_available)
+				yaffs_summary_fetch(dev, &tags, blk, c);
+			if (!summary_available || tags.chunk_id == 0)
+				result = yaffs_rd_chunk_tags_nand(dev, chunk,
+								  NULL, &tags);
 
 			/* Let's have a good look at this chunk... */
 
@@ -1176,6 +1622,11 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 				dev->n_free_chunks++;
 
+			} else if (tags.obj_id == YAFFS_OBJECTID_SUMMARY &&
+				   tags.chunk_id == YAFFS_SUMMARY_CHUNK_ID) {
+				/* Block summary: part of no object */
+				dev->n_free_chunks++;
+
 			} else if (tags.obj_id > YAFFS_MAX_OBJECT_ID ||
 				   tags.chunk_id > YAFFS_MAX_CHUNK_ID ||
 				   (tags.chunk_id > 0
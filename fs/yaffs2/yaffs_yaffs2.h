@@ -30,6 +30,8 @@ int yaffs2_checkpt_required(struct yaffs_dev *dev);
 int yaffs_calc_checkpt_blocks_required(struct yaffs_dev *dev);
 
 void yaffs2_checkpt_invalidate(struct yaffs_dev *dev);
+void yaffs2_checkpt_obj_changed(struct yaffs_dev *dev, int obj_id);
+void yaffs2_checkpt_free_blocks(struct yaffs_dev *dev);
 int yaffs2_checkpt_save(struct yaffs_dev *dev);
 int yaffs2_checkpt_restore(struct yaffs_dev *dev);
 
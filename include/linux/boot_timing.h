@@ -0,0 +1,40 @@
+/*
+ * boot_timing.h: wall-clock and CPU time of initcalls and driver probes
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; version 2
+ * of the License.
+ */
+#ifndef _LINUX_BOOT_TIMING_H
+#define _LINUX_BOOT_TIMING_H
+
+#include <linux/init.h>
+#include <linux/ktime.h>
+
+struct device;
+struct device_driver;
+
+struct boot_timing_stamp {
+	ktime_t		wall;
+	u64		cpu;
+};
+
+#ifdef CONFIG_BOOT_TIMING
+extern void boot_timing_start(struct boot_timing_stamp *stamp);
+extern void boot_timing_initcall(struct boot_timing_stamp *stamp,
+				 initcall_t fn, int ret);
+extern void boot_timing_probe(struct boot_timing_stamp *stamp,
+			      struct device *dev, struct device_driver *drv,
+			      bool async, int ret);
+#else
+static inline void boot_timing_start(struct boot_timing_stamp *stamp) { }
+static inline void boot_timing_initcall(struct boot_timing_stamp *stamp,
+					initcall_t fn, int ret) { }
+static inline void boot_timing_probe(struct boot_timing_stamp *stamp,
+				     struct device *dev,
+				     struct device_driver *drv,
+				     bool async, int ret) { }
+#endif
+
+#endif /* _LINUX_BOOT_TIMING_H */
@@ -23,9 +23,20 @@ extern int fragmentation_index(struct zone *zone, unsigned int order);
 extern unsigned long try_to_compact_pages(struct zonelist *zonelist,
 			int order, gfp_t gfp_mask, nodemask_t *mask,
 			bool sync);
-extern int compact_pgdat(pg_data_t *pgdat, int order);
 extern unsigned long compaction_suitable(struct zone *zone, int order);
 
+extern int sysctl_kcompactd_budget_ms;
+extern int sysctl_kcompactd_order;
+extern void wakeup_kcompactd(pg_data_t *pgdat, int order,
+			     enum zone_type classzone_idx);
+extern int kcompactd_run(int nid);
+extern void kcompactd_stop(int nid);
+
+static inline bool kcompactd_enabled(void)
+{
+	return sysctl_kcompactd_budget_ms != 0;
+}
+
 /* Do not skip compaction more than 64 times */
 #define COMPACT_MAX_DEFER_SHIFT 6
 
@@ -69,11 +80,6 @@ static inline unsigned long try_to_compact_pages(struct zonelist *zonelist,
 	return COMPACT_CONTINUE;
 }
 
-static inline int compact_pgdat(pg_data_t *pgdat, int order)
-{
-	return COMPACT_CONTINUE;
-}
-
 static inline unsigned long compaction_suitable(struct zone *zone, int order)
 {
 	return COMPACT_SKIPPED;
@@ -88,6 +94,25 @@ static inline bool compaction_deferred(struct zone *zone, int order)
 	return 1;
 }
 
+static inline void wakeup_kcompactd(pg_data_t *pgdat, int order,
+				    enum zone_type classzone_idx)
+{
+}
+
+static inline int kcompactd_run(int nid)
+{
+	return 0;
+}
+
+static inline void kcompactd_stop(int nid)
+{
+}
+
+static inline bool kcompactd_enabled(void)
+{
+	return false;
+}
+
 #endif /* CONFIG_COMPACTION */
 
 #if defined(CONFIG_COMPACTION) && defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
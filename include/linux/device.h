@@ -187,6 +187,8 @@ extern struct klist *bus_get_device_klist(struct bus_type *bus);
  * @owner:	The module owner.
  * @mod_name:	Used for built-in modules.
  * @suppress_bind_attrs: Disables bind/unbind via sysfs.
+ * @async_probe: Probe devices found at driver registration from the async
+ *		thread pool instead of the registering thread.
  * @of_match_table: The open firmware table.
  * @probe:	Called to query the existence of a specific device,
  *		whether this driver can work with it, and bind the driver
@@ -219,6 +221,7 @@ struct device_driver {
 	const char		*mod_name;	/* used for built-in modules */
 
 	bool suppress_bind_attrs;	/* disables bind/unbind via sysfs */
+	bool async_probe;		/* probe devices asynchronously */
 
 	const struct of_device_id	*of_match_table;
 
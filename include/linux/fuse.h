@@ -54,6 +54,14 @@
  * 7.18
  *  - add FUSE_IOCTL_DIR flag
  *  - add FUSE_NOTIFY_DELETE
+ *
+ * Local extensions, negotiated by their INIT flag alone so that the minor
+ * version keeps the meaning it has in the mainline protocol:
+ *  - FUSE_WRITEBACK_CACHE
+ *  - FUSE_MAX_PAGES, max_pages in fuse_init_out, read only from a reply
+ *    longer than FUSE_COMPAT_18_INIT_OUT_SIZE
+ *  - FUSE_PASSTHROUGH, FOPEN_PASSTHROUGH and passthrough_fd in
+ *    fuse_open_out
  */
 
 #ifndef _LINUX_FUSE_H
@@ -152,10 +160,13 @@ struct fuse_file_lock {
  * FOPEN_DIRECT_IO: bypass page cache for this open file
  * FOPEN_KEEP_CACHE: don't invalidate the data cache on open
  * FOPEN_NONSEEKABLE: the file is not seekable
+ * FOPEN_PASSTHROUGH: read, write and mmap go to the file referred to by
+ *		      open_out.passthrough_fd in the filesystem daemon
  */
 #define FOPEN_DIRECT_IO		(1 << 0)
 #define FOPEN_KEEP_CACHE	(1 << 1)
 #define FOPEN_NONSEEKABLE	(1 << 2)
+#define FOPEN_PASSTHROUGH	(1 << 7)
 
 /**
  * INIT request/reply flags
@@ -164,6 +175,10 @@ struct fuse_file_lock {
  * FUSE_EXPORT_SUPPORT: filesystem handles lookups of "." and ".."
  * FUSE_DONT_MASK: don't apply umask to file mode on create operations
  * FUSE_FLOCK_LOCKS: remote locking for BSD style file locks
+ * FUSE_WRITEBACK_CACHE: buffered writes go to the page cache and are
+ *			 written back later; the kernel owns size and mtime
+ * FUSE_MAX_PAGES: init_out.max_pages contains the max number of req pages
+ * FUSE_PASSTHROUGH: the filesystem may return FOPEN_PASSTHROUGH from open
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -173,6 +188,9 @@ struct fuse_file_lock {
 #define FUSE_BIG_WRITES		(1 << 5)
 #define FUSE_DONT_MASK		(1 << 6)
 #define FUSE_FLOCK_LOCKS	(1 << 10)
+#define FUSE_WRITEBACK_CACHE	(1 << 16)
+#define FUSE_MAX_PAGES		(1 << 22)
+#define FUSE_PASSTHROUGH	(1U << 31)
 
 /**
  * CUSE INIT request/reply flags
@@ -394,7 +412,7 @@ struct fuse_create_in {
 struct fuse_open_out {
 	__u64	fh;
 	__u32	open_flags;
-	__u32	padding;
+	__s32	passthrough_fd;
 };
 
 struct fuse_release_in {
@@ -489,6 +507,9 @@ struct fuse_init_in {
 	__u32	flags;
 };
 
+#define FUSE_COMPAT_INIT_OUT_SIZE 8
+#define FUSE_COMPAT_18_INIT_OUT_SIZE 24
+
 struct fuse_init_out {
 	__u32	major;
 	__u32	minor;
@@ -497,6 +518,9 @@ struct fuse_init_out {
 	__u16   max_background;
 	__u16   congestion_threshold;
 	__u32	max_write;
+	__u32	reserved;
+	__u16	max_pages;
+	__u16	padding;
 };
 
 #define CUSE_INIT_INFO_MAX 4096
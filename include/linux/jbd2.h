@@ -241,7 +241,16 @@ typedef struct journal_superblock_s
 	__be32	s_max_trans_data;	/* Limit of data blocks per trans. */
 
 /* 0x0050 */
-	__u32	s_padding[44];
+	__u32	s_padding2;
+	__u32	s_padding[41];
+
+/* 0x00F8 */
+	/*
+	 * Private to this tree, like the fast commit record format: kept
+	 * clear of the fields upstream has allocated.
+	 */
+	__be32	s_num_fc_blks;		/* Nr of blocks in fast commit area */
+	__u32	s_padding3;
 
 /* 0x0100 */
 	__u8	s_users[16*48];		/* ids of all fs'es sharing the log */
@@ -263,13 +272,20 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_REVOKE		0x00000001
 #define JBD2_FEATURE_INCOMPAT_64BIT		0x00000002
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
+/*
+ * Not upstream's fast commit feature: the area holds ext4 records of a
+ * private format, so a bit upstream has not allocated keeps its kernels
+ * and e2fsck from parsing them.
+ */
+#define JBD2_FEATURE_INCOMPAT_FAST_COMMIT	0x80000000
 
 /* Features known to this kernel version: */
 #define JBD2_KNOWN_COMPAT_FEATURES	JBD2_FEATURE_COMPAT_CHECKSUM
 #define JBD2_KNOWN_ROCOMPAT_FEATURES	0
 #define JBD2_KNOWN_INCOMPAT_FEATURES	(JBD2_FEATURE_INCOMPAT_REVOKE | \
 					JBD2_FEATURE_INCOMPAT_64BIT | \
-					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)
+					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
 
 #ifdef __KERNEL__
 
@@ -696,6 +712,14 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_wbuf: array of buffer_heads for jbd2_journal_commit_transaction
  * @j_wbufsize: maximum number of buffer_heads allowed in j_wbuf, the
  *	number that will fit in j_blocksize
+ * @j_fc_first: The block number of the first block of the fast commit area
+ * @j_fc_last: The block number one beyond the end of the fast commit area
+ * @j_fc_off: Offset in the fast commit area of the next record
+ * @j_fc_wbuf: array of buffer_heads for the fast commit being built
+ * @j_fc_nbufs: number of buffer_heads in j_fc_wbuf
+ * @j_fc_replay_tid: Transaction whose fast commit records recovery found
+ *	valid to replay
+ * @j_wait_fc: Wait queue for waiting for a fast commit to complete
  * @j_last_sync_writer: most recent pid which did a synchronous write
  * @j_history: Buffer storing the transactions statistics history
  * @j_history_max: Maximum number of transactions in the statistics history
@@ -901,6 +925,18 @@ struct journal_s
 	struct buffer_head	**j_wbuf;
 	int			j_wbufsize;
 
+	/*
+	 * Fast commit area at the end of the journal, if the journal has
+	 * one, and the fast commit being written to it [j_state_lock]
+	 */
+	unsigned long		j_fc_first;
+	unsigned long		j_fc_last;
+	unsigned long		j_fc_off;
+	struct buffer_head	**j_fc_wbuf;
+	int			j_fc_nbufs;
+	tid_t			j_fc_replay_tid;
+	wait_queue_head_t	j_wait_fc;
+
 	/*
 	 * this is the pid of hte last person to run a synchronous operation
 	 * through the journal
@@ -954,6 +990,10 @@ struct journal_s
 #define JBD2_ABORT_ON_SYNCDATA_ERR	0x040	/* Abort the journal on file
 						 * data write error in ordered
 						 * mode */
+#define JBD2_FAST_COMMIT_ONGOING	0x080	/* A fast commit is being
+						 * written */
+#define JBD2_FC_REPLAY	0x100	/* Recovery left fast commit records of
+				 * j_fc_replay_tid to replay */
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1181,6 +1221,17 @@ int jbd2_log_wait_commit(journal_t *journal, tid_t tid);
 int jbd2_complete_transaction(journal_t *journal, tid_t tid);
 int jbd2_log_do_checkpoint(journal_t *journal);
 int jbd2_trans_will_send_data_barrier(journal_t *journal, tid_t tid);
+int jbd2_transaction_committed(journal_t *journal, tid_t tid);
+
+/* Fast commits */
+int jbd2_fc_init(journal_t *journal, unsigned int num_fc_blks);
+int jbd2_fc_disable(journal_t *journal);
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid);
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out);
+int jbd2_fc_end_commit(journal_t *journal);
+void jbd2_fc_end_commit_fallback(journal_t *journal);
+int jbd2_fc_read_block(journal_t *journal, unsigned long off,
+		       struct buffer_head **bh_out);
 
 void __jbd2_log_wait_for_space(journal_t *journal);
 extern void __jbd2_journal_drop_transaction(journal_t *, transaction_t *);
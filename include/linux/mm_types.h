@@ -262,6 +262,10 @@ struct vm_area_struct {
 #ifdef CONFIG_NUMA
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
+#ifdef CONFIG_SWAP
+	unsigned long swap_ra_addr;	/* last swapin fault address */
+	unsigned int swap_ra_win;	/* and its readahead window */
+#endif
 };
 
 struct core_thread {
@@ -133,6 +133,9 @@ enum zone_stat_item {
 	NR_SHMEM,		/* shmem pages (included tmpfs/GEM pages) */
 	NR_DIRTIED,		/* page dirtyings since bootup */
 	NR_WRITTEN,		/* page writings since bootup */
+	WORKINGSET_REFAULT,	/* evicted file pages faulted back in */
+	WORKINGSET_ACTIVATE,	/* refaults activated straight away */
+	WORKINGSET_NODERECLAIM,	/* shadow-only tree nodes reclaimed */
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		/* allocated in intended node */
 	NUMA_MISS,		/* allocated in non intended node */
@@ -324,6 +327,13 @@ struct zone_reclaim_stat {
 	 */
 	unsigned long		recent_rotated[2];
 	unsigned long		recent_scanned[2];
+
+	/*
+	 * Time in usecs recently spent reclaiming and faulting back pages
+	 * of each type: swap compression and swapin for anon, writeback
+	 * and read faults for file.  See lru_note_cost().
+	 */
+	unsigned long		recent_cost[2];
 };
 
 struct zone {
@@ -399,6 +409,10 @@ struct zone {
 	unsigned int		compact_considered;
 	unsigned int		compact_defer_shift;
 	int			compact_order_failed;
+
+	/* Scanner positions where kcompactd's last run in the zone ended */
+	unsigned long		compact_cached_migrate_pfn;
+	unsigned long		compact_cached_free_pfn;
 #endif
 
 	ZONE_PADDING(_pad1_)
@@ -415,6 +429,9 @@ struct zone {
 	/* Zone statistics */
 	atomic_long_t		vm_stat[NR_VM_ZONE_STAT_ITEMS];
 
+	/* Evictions & activations on the inactive file list */
+	atomic_long_t		inactive_age;
+
 	/*
 	 * The target ratio of ACTIVE_ANON to INACTIVE_ANON pages on
 	 * this zone's LRU.  Maintained by the pageout code.
@@ -699,6 +716,12 @@ typedef struct pglist_data {
 	struct task_struct *kswapd;	/* Protected by lock_memory_hotplug() */
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
+#ifdef CONFIG_COMPACTION
+	int kcompactd_max_order;
+	enum zone_type kcompactd_classzone_idx;
+	wait_queue_head_t kcompactd_wait;
+	struct task_struct *kcompactd;
+#endif
 } pg_data_t;
 
 #define node_present_pages(nid)	(NODE_DATA(nid)->node_present_pages)
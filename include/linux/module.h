@@ -217,6 +217,8 @@ struct module_ref {
 	unsigned long decs;
 } __attribute((aligned(2 * sizeof(unsigned long))));
 
+struct ksym_hash_table;
+
 struct module
 {
 	enum module_state state;
@@ -239,6 +241,9 @@ struct module
 	const unsigned long *crcs;
 	unsigned int num_syms;
 
+	/* All exported symbols, as linked into the global symbol hash */
+	struct ksym_hash_table *ksym_hash;
+
 	/* Kernel parameters. */
 	struct kernel_param *kp;
 	unsigned int num_kp;
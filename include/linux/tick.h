@@ -142,4 +142,18 @@ static inline u64 get_cpu_idle_time_us(int cpu, u64 *unused) { return -1; }
 static inline u64 get_cpu_iowait_time_us(int cpu, u64 *unused) { return -1; }
 # endif /* !NO_HZ */
 
+# ifdef CONFIG_TICK_IDLE_STATS
+extern void tick_idle_stats_sleep(int cpu, ktime_t now, int first);
+extern void tick_idle_stats_wakeup(int cpu, ktime_t now);
+extern void tick_idle_stats_timer(void *func);
+extern void tick_idle_stats_hrtimer(struct hrtimer *timer);
+extern void tick_idle_stats_irq_exit(int cpu);
+# else
+static inline void tick_idle_stats_sleep(int cpu, ktime_t now, int first) { }
+static inline void tick_idle_stats_wakeup(int cpu, ktime_t now) { }
+static inline void tick_idle_stats_timer(void *func) { }
+static inline void tick_idle_stats_hrtimer(struct hrtimer *timer) { }
+static inline void tick_idle_stats_irq_exit(int cpu) { }
+# endif /* !TICK_IDLE_STATS */
+
 #endif
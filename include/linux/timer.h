@@ -8,6 +8,7 @@
 #include <linux/stringify.h>
 
 struct tvec_base;
+struct timer_slack_domain;
 
 struct timer_list {
 	/*
@@ -23,6 +24,9 @@ struct timer_list {
 
 	int slack;
 
+#ifdef CONFIG_TIMER_COALESCING
+	struct timer_slack_domain *slack_domain;
+#endif
 #ifdef CONFIG_TIMER_STATS
 	int start_pid;
 	void *start_site;
@@ -214,6 +218,52 @@ extern int mod_timer_pinned(struct timer_list *timer, unsigned long expires);
 
 extern void set_timer_slack(struct timer_list *time, int slack_hz);
 
+/**
+ * struct timer_slack_domain - slack shared by a group of timers
+ * @name:	name shown in /proc/timer_slack
+ * @slack_us:	allowed slack in microseconds, or -1 for the default
+ *		percentage based slack
+ * @list:	entry in the list of registered domains
+ *
+ * Timers attached to a domain pick up changes of @slack_us on their
+ * next mod_timer(), so a subsystem (or the administrator through
+ * /proc/timer_slack) can widen the window in which all of its timers
+ * may expire and let the timer wheel batch them into fewer wakeups.
+ */
+struct timer_slack_domain {
+	const char		*name;
+	int			slack_us;
+	struct list_head	list;
+};
+
+#define TIMER_SLACK_DOMAIN_INIT(_var, _name, _slack_us) {		\
+		.name = (_name),					\
+		.slack_us = (_slack_us),				\
+		.list = LIST_HEAD_INIT((_var).list),			\
+	}
+
+#define DEFINE_TIMER_SLACK_DOMAIN(_var, _name, _slack_us)		\
+	struct timer_slack_domain _var =				\
+		TIMER_SLACK_DOMAIN_INIT(_var, _name, _slack_us)
+
+#ifdef CONFIG_TIMER_COALESCING
+extern void register_timer_slack_domain(struct timer_slack_domain *domain);
+extern void unregister_timer_slack_domain(struct timer_slack_domain *domain);
+extern void set_timer_slack_domain(struct timer_list *timer,
+				   struct timer_slack_domain *domain);
+#else
+static inline void
+register_timer_slack_domain(struct timer_slack_domain *domain) { }
+static inline void
+unregister_timer_slack_domain(struct timer_slack_domain *domain) { }
+static inline void set_timer_slack_domain(struct timer_list *timer,
+					  struct timer_slack_domain *domain)
+{
+	if (domain->slack_us >= 0)
+		set_timer_slack(timer, usecs_to_jiffies(domain->slack_us));
+}
+#endif
+
 #define TIMER_NOT_PINNED	0
 #define TIMER_PINNED		1
 /*
@@ -37,9 +37,13 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		KSWAPD_LOW_WMARK_HIT_QUICKLY, KSWAPD_HIGH_WMARK_HIT_QUICKLY,
 		KSWAPD_SKIP_CONGESTION_WAIT,
 		PAGEOUTRUN, ALLOCSTALL, PGROTATED,
+		RECLAIM_COST_ANON, RECLAIM_COST_ANON_US,
+		RECLAIM_COST_FILE, RECLAIM_COST_FILE_US,
 #ifdef CONFIG_COMPACTION
 		COMPACTBLOCKS, COMPACTPAGES, COMPACTPAGEFAILED,
 		COMPACTSTALL, COMPACTFAIL, COMPACTSUCCESS,
+		KCOMPACTD_WAKE, KCOMPACTD_SUCCESS, KCOMPACTD_FAIL,
+		KCOMPACTD_BUDGET_EXHAUSTED,
 #endif
 #ifdef CONFIG_HUGETLB_PAGE
 		HTLB_BUDDY_PGALLOC, HTLB_BUDDY_PGALLOC_FAIL,
@@ -58,6 +62,16 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		THP_COLLAPSE_ALLOC,
 		THP_COLLAPSE_ALLOC_FAILED,
 		THP_SPLIT,
+#endif
+#ifdef CONFIG_SWAP
+		SWAP_SLOTS_ALLOC_CACHED,	/* entries from per-CPU cache */
+		SWAP_SLOTS_REFILL,		/* per-CPU cache refills */
+		SWAP_SLOTS_FREE_BATCHED,	/* frees queued for batching */
+		SWAP_SLOTS_FREE_FLUSH,		/* batched frees issued */
+		SWAP_RA_CLUSTER_HIT,		/* swapin readahead, by policy */
+		SWAP_RA_CLUSTER_MISS,
+		SWAP_RA_VMA_HIT,
+		SWAP_RA_VMA_MISS,
 #endif
 		NR_VM_EVENT_ITEMS
 };
@@ -0,0 +1,115 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM cma
+
+#if !defined(_TRACE_CMA_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_CMA_H
+
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(cma_alloc,
+
+	TP_PROTO(unsigned long pfn, int count, unsigned int align,
+		 unsigned long nr_migrated, unsigned long nr_prepared,
+		 unsigned int nr_busy, s64 latency_us),
+
+	TP_ARGS(pfn, count, align, nr_migrated, nr_prepared, nr_busy,
+		latency_us),
+
+	TP_STRUCT__entry(
+		__field(unsigned long, pfn)
+		__field(int, count)
+		__field(unsigned int, align)
+		__field(unsigned long, nr_migrated)
+		__field(unsigned long, nr_prepared)
+		__field(unsigned int, nr_busy)
+		__field(s64, latency_us)
+	),
+
+	TP_fast_assign(
+		__entry->pfn = pfn;
+		__entry->count = count;
+		__entry->align = align;
+		__entry->nr_migrated = nr_migrated;
+		__entry->nr_prepared = nr_prepared;
+		__entry->nr_busy = nr_busy;
+		__entry->latency_us = latency_us;
+	),
+
+	TP_printk("pfn=%lx count=%d align=%u migrated=%lu prepared=%lu busy=%u latency_us=%lld",
+		__entry->pfn,
+		__entry->count,
+		__entry->align,
+		__entry->nr_migrated,
+		__entry->nr_prepared,
+		__entry->nr_busy,
+		__entry->latency_us)
+);
+
+DECLARE_EVENT_CLASS(cma_range_template,
+
+	TP_PROTO(unsigned long pfn, unsigned long count),
+
+	TP_ARGS(pfn, count),
+
+	TP_STRUCT__entry(
+		__field(unsigned long, pfn)
+		__field(unsigned long, count)
+	),
+
+	TP_fast_assign(
+		__entry->pfn = pfn;
+		__entry->count = count;
+	),
+
+	TP_printk("pfn=%lx count=%lu",
+		__entry->pfn,
+		__entry->count)
+);
+
+DEFINE_EVENT(cma_range_template, cma_release,
+
+	TP_PROTO(unsigned long pfn, unsigned long count),
+
+	TP_ARGS(pfn, count)
+);
+
+DEFINE_EVENT(cma_range_template, cma_unprepare,
+
+	TP_PROTO(unsigned long pfn, unsigned long count),
+
+	TP_ARGS(pfn, count)
+);
+
+TRACE_EVENT(cma_prepare,
+
+	TP_PROTO(unsigned long pfn, unsigned long count,
+		 unsigned long nr_migrated, int ret),
+
+	TP_ARGS(pfn, count, nr_migrated, ret),
+
+	TP_STRUCT__entry(
+		__field(unsigned long, pfn)
+		__field(unsigned long, count)
+		__field(unsigned long, nr_migrated)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__entry->pfn = pfn;
+		__entry->count = count;
+		__entry->nr_migrated = nr_migrated;
+		__entry->ret = ret;
+	),
+
+	TP_printk("pfn=%lx count=%lu migrated=%lu ret=%d",
+		__entry->pfn,
+		__entry->count,
+		__entry->nr_migrated,
+		__entry->ret)
+);
+
+#endif /* _TRACE_CMA_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -0,0 +1,177 @@
+/*
+ *  linux/init/boot_timing.c
+ *
+ *  Record the wall-clock and CPU time spent in every initcall and every
+ *  driver probe while the system is booting, so that the effect of
+ *  asynchronous probing and other boot-time work can be measured.
+ *
+ *  The report is available in debugfs:
+ *
+ *	# cat /sys/kernel/debug/boot_timing
+ *
+ *  Wall-clock time is measured with ktime_get(), CPU time is the CPU time
+ *  consumed by the calling task only; time spent in work that an initcall
+ *  or probe hands off to other threads is not included in it.
+ */
+
+#include <linux/boot_timing.h>
+#include <linux/debugfs.h>
+#include <linux/device.h>
+#include <linux/kallsyms.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+enum boot_timing_type {
+	BOOT_TIMING_INITCALL,
+	BOOT_TIMING_PROBE,
+};
+
+struct boot_timing_entry {
+	struct list_head	list;
+	enum boot_timing_type	type;
+	s64			wall_ns;
+	u64			cpu_ns;
+	int			ret;
+	bool			async;
+	char			name[KSYM_SYMBOL_LEN];
+};
+
+static LIST_HEAD(boot_timing_list);
+static DEFINE_SPINLOCK(boot_timing_lock);
+
+static inline bool boot_timing_active(void)
+{
+	return system_state == SYSTEM_BOOTING;
+}
+
+void boot_timing_start(struct boot_timing_stamp *stamp)
+{
+	if (!boot_timing_active()) {
+		stamp->wall.tv64 = 0;
+		return;
+	}
+
+	stamp->wall = ktime_get();
+	stamp->cpu = task_sched_runtime(current);
+}
+
+static struct boot_timing_entry *
+boot_timing_alloc(struct boot_timing_stamp *stamp, enum boot_timing_type type,
+		  int ret)
+{
+	struct boot_timing_entry *entry;
+
+	entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+	if (!entry)
+		return NULL;
+
+	entry->type = type;
+	entry->ret = ret;
+	entry->wall_ns = ktime_to_ns(ktime_sub(ktime_get(), stamp->wall));
+	entry->cpu_ns = task_sched_runtime(current) - stamp->cpu;
+	return entry;
+}
+
+static void boot_timing_add(struct boot_timing_entry *entry)
+{
+	spin_lock(&boot_timing_lock);
+	list_add_tail(&entry->list, &boot_timing_list);
+	spin_unlock(&boot_timing_lock);
+}
+
+void boot_timing_initcall(struct boot_timing_stamp *stamp, initcall_t fn,
+			  int ret)
+{
+	struct boot_timing_entry *entry;
+
+	if (!stamp->wall.tv64)
+		return;
+
+	entry = boot_timing_alloc(stamp, BOOT_TIMING_INITCALL, ret);
+	if (!entry)
+		return;
+
+	sprint_symbol(entry->name, (unsigned long)fn);
+	boot_timing_add(entry);
+}
+
+void boot_timing_probe(struct boot_timing_stamp *stamp, struct device *dev,
+		       struct device_driver *drv, bool async, int ret)
+{
+	struct boot_timing_entry *entry;
+
+	if (!stamp->wall.tv64)
+		return;
+
+	entry = boot_timing_alloc(stamp, BOOT_TIMING_PROBE, ret);
+	if (!entry)
+		return;
+
+	entry->async = async;
+	snprintf(entry->name, sizeof(entry->name), "%s %s", drv->name,
+		 dev_name(dev));
+	boot_timing_add(entry);
+}
+
+static int boot_timing_show(struct seq_file *m, void *v)
+{
+	struct boot_timing_entry *entry;
+	s64 wall[2] = { 0, 0 };
+	u64 cpu[2] = { 0, 0 };
+	unsigned int nr_async = 0;
+
+	seq_puts(m, "# type     wall_us   cpu_us  ret  name\n");
+
+	spin_lock(&boot_timing_lock);
+	list_for_each_entry(entry, &boot_timing_list, list) {
+		seq_printf(m, "%-8s %8lld %8llu %4d  %s\n",
+			   entry->type == BOOT_TIMING_INITCALL ? "initcall" :
+			   entry->async ? "aprobe" : "probe",
+			   (long long)div_s64(entry->wall_ns, NSEC_PER_USEC),
+			   (unsigned long long)div_u64(entry->cpu_ns,
+						       NSEC_PER_USEC),
+			   entry->ret, entry->name);
+		wall[entry->type] += entry->wall_ns;
+		cpu[entry->type] += entry->cpu_ns;
+		if (entry->async)
+			nr_async++;
+	}
+	spin_unlock(&boot_timing_lock);
+
+	seq_printf(m, "# initcalls: wall %lld us, cpu %llu us\n",
+		   (long long)div_s64(wall[BOOT_TIMING_INITCALL],
+				      NSEC_PER_USEC),
+		   (unsigned long long)div_u64(cpu[BOOT_TIMING_INITCALL],
+					       NSEC_PER_USEC));
+	seq_printf(m, "# probes: wall %lld us, cpu %llu us, %u async\n",
+		   (long long)div_s64(wall[BOOT_TIMING_PROBE], NSEC_PER_USEC),
+		   (unsigned long long)div_u64(cpu[BOOT_TIMING_PROBE],
+					       NSEC_PER_USEC),
+		   nr_async);
+	return 0;
+}
+
+static int boot_timing_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, boot_timing_show, NULL);
+}
+
+static const struct file_operations boot_timing_fops = {
+	.open		= boot_timing_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init boot_timing_debugfs_init(void)
+{
+	debugfs_create_file("boot_timing", S_IRUSR, NULL, NULL,
+			    &boot_timing_fops);
+	return 0;
+}
+late_initcall(boot_timing_debugfs_init);
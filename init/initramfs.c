@@ -8,6 +8,12 @@
 #include <linux/dirent.h>
 #include <linux/syscalls.h>
 #include <linux/utime.h>
+#include <linux/file.h>
+#include <linux/pagemap.h>
+#include <linux/highmem.h>
+#include <linux/vmalloc.h>
+#include <linux/async.h>
+#include <linux/export.h>
 
 static __initdata char *message;
 static void __init error(char *x)
@@ -333,15 +339,20 @@ static int __init do_name(void)
 	return 0;
 }
 
+static void __init close_copied_file(void)
+{
+	sys_close(wfd);
+	do_utime(vcollected, mtime);
+	kfree(vcollected);
+	state = SkipIt;
+}
+
 static int __init do_copy(void)
 {
 	if (count >= body_len) {
 		sys_write(wfd, victim, body_len);
-		sys_close(wfd);
-		do_utime(vcollected, mtime);
-		kfree(vcollected);
 		eat(body_len);
-		state = SkipIt;
+		close_copied_file();
 		return 0;
 	} else {
 		sys_write(wfd, victim, count);
@@ -411,6 +422,152 @@ static unsigned my_inptr;   /* index of next byte to be processed in inbuf */
 
 #include <linux/decompress/generic.h>
 
+#ifdef CONFIG_DECOMPRESS_GZIP
+#include <linux/zlib.h>
+
+/*
+ * gzip compressed archives are inflated without the generic decompressor
+ * interface: while the FSM is in CopyFile state the output goes straight
+ * into the page cache pages of the file being extracted, instead of into
+ * a bounce buffer that do_copy() then copies with sys_write(). Only the
+ * cpio headers, names, symlink targets and the first bytes of each file
+ * go through the small bounce buffer and flush_buffer().
+ */
+#define GUNZIP_BOUNCE_SIZE	512
+
+static int __init gunzip_to_file(struct z_stream_s *strm)
+{
+	struct file *file = fget(wfd);
+	struct address_space *mapping;
+	loff_t pos;
+	int rc = Z_OK;
+
+	if (!file) {
+		error("write error");
+		return Z_DATA_ERROR;
+	}
+	mapping = file->f_mapping;
+	pos = file->f_pos;
+
+	while (body_len && rc == Z_OK && strm->avail_in) {
+		unsigned offset = pos & (PAGE_CACHE_SIZE - 1);
+		unsigned bytes = min_t(unsigned long, PAGE_CACHE_SIZE - offset,
+				       body_len);
+		unsigned copied;
+		struct page *page;
+		void *fsdata;
+		char *kaddr;
+
+		if (pagecache_write_begin(file, mapping, pos, bytes,
+					  AOP_FLAG_UNINTERRUPTIBLE,
+					  &page, &fsdata)) {
+			error("write error");
+			rc = Z_DATA_ERROR;
+			break;
+		}
+
+		kaddr = kmap(page);
+		strm->next_out = kaddr + offset;
+		strm->avail_out = bytes;
+		rc = zlib_inflate(strm, 0);
+		copied = bytes - strm->avail_out;
+		flush_dcache_page(page);
+		kunmap(page);
+
+		pagecache_write_end(file, mapping, pos, bytes, copied,
+				    page, fsdata);
+		pos += copied;
+		body_len -= copied;
+		this_header += copied;
+	}
+
+	file->f_pos = pos;
+	fput(file);
+
+	if (!body_len)
+		close_copied_file();
+	return rc;
+}
+
+static int __init gunzip_to_rootfs(unsigned char *buf, int len, int *pos)
+{
+	struct z_stream_s *strm;
+	char *out_buf;
+	int rc = -1;
+
+	/* verify the gzip header, see lib/decompress_inflate.c */
+	if (len < 10 || buf[0] != 0x1f || buf[1] != 0x8b || buf[2] != 0x08) {
+		*pos = 0;
+		error("Not a gzip file");
+		return -1;
+	}
+
+	strm = kzalloc(sizeof(*strm), GFP_KERNEL);
+	out_buf = kmalloc(GUNZIP_BOUNCE_SIZE, GFP_KERNEL);
+	if (strm)
+		strm->workspace = vmalloc(zlib_inflate_workspacesize());
+	if (!strm || !strm->workspace || !out_buf) {
+		error("Out of memory while allocating z_stream");
+		goto out;
+	}
+
+	strm->next_in = buf + 10;
+	strm->avail_in = len - 10;
+	/* skip over asciz filename */
+	if (buf[3] & 0x8) {
+		do {
+			if (strm->avail_in == 0) {
+				error("header error");
+				goto out;
+			}
+			--strm->avail_in;
+		} while (*strm->next_in++);
+	}
+
+	rc = zlib_inflateInit2(strm, -MAX_WBITS);
+	while (rc == Z_OK) {
+		if (strm->avail_in == 0) {
+			error("uncompression error");
+			rc = -1;
+			break;
+		}
+
+		if (state == CopyFile && body_len) {
+			rc = gunzip_to_file(strm);
+		} else {
+			unsigned l;
+
+			strm->next_out = out_buf;
+			strm->avail_out = GUNZIP_BOUNCE_SIZE;
+			rc = zlib_inflate(strm, 0);
+			l = strm->next_out - (unsigned char *)out_buf;
+			if (l && flush_buffer(out_buf, l) != l) {
+				error("write error");
+				rc = -1;
+				break;
+			}
+		}
+
+		if (rc == Z_STREAM_END) {
+			rc = 0;
+			break;
+		} else if (rc != Z_OK) {
+			error("uncompression error");
+			rc = -1;
+		}
+	}
+	zlib_inflateEnd(strm);
+	/* add + 8 to skip over trailer */
+	*pos = strm->next_in - buf + 8;
+out:
+	if (strm)
+		vfree(strm->workspace);
+	kfree(strm);
+	kfree(out_buf);
+	return rc;
+}
+#endif
+
 static char * __init unpack_to_rootfs(char *buf, unsigned len)
 {
 	int written, res;
@@ -445,6 +602,13 @@ static char * __init unpack_to_rootfs(char *buf, unsigned len)
 		}
 		this_header = 0;
 		decompress = decompress_method(buf, len, &compress_name);
+#ifdef CONFIG_DECOMPRESS_GZIP
+		if (decompress && !strcmp(compress_name, "gzip")) {
+			res = gunzip_to_rootfs(buf, len, &my_inptr);
+			if (res)
+				error("decompressor failed");
+		} else
+#endif
 		if (decompress) {
 			res = decompress(buf, len, NULL, flush_buffer, NULL,
 				   &my_inptr, error);
@@ -569,9 +733,75 @@ static void __init clean_rootfs(void)
 }
 #endif
 
-static int __init populate_rootfs(void)
+/*
+ * The initramfs is unpacked from the async thread pool, concurrently with
+ * the device and late initcalls. Everything that needs the contents of
+ * rootfs must call wait_for_initramfs() first: the usermode helper before
+ * exec'ing, the firmware loader before reading from the filesystem and
+ * kernel_init() before opening /dev/console and looking for /init.
+ */
+static LIST_HEAD(initramfs_domain);
+static async_cookie_t initramfs_cookie;
+static ktime_t initramfs_unpack_start, initramfs_unpack_end;
+static ktime_t initramfs_first_wait;
+static unsigned long initramfs_reported;
+
+static int __initdata initramfs_async = 1;
+
+static int __init initramfs_async_setup(char *str)
+{
+	return kstrtoint(str, 0, &initramfs_async) == 0;
+}
+__setup("initramfs_async=", initramfs_async_setup);
+
+static void initramfs_report(void)
+{
+	s64 total, blocked;
+
+	total = ktime_us_delta(initramfs_unpack_end, initramfs_unpack_start);
+	blocked = ktime_us_delta(initramfs_unpack_end, initramfs_first_wait);
+	blocked = clamp_t(s64, blocked, 0, total);
+
+	printk(KERN_INFO "Initramfs unpacked in %lld us, %lld us overlapped "
+	       "with other boot work\n", total, total - blocked);
+}
+
+/**
+ * wait_for_initramfs - wait until the initramfs has been unpacked
+ *
+ * Must be called, from process context, before anything looks at files
+ * that may come from the initramfs. After boot this returns immediately.
+ */
+void wait_for_initramfs(void)
+{
+	if (!initramfs_cookie) {
+		/*
+		 * Something before rootfs_initcall wants to access the
+		 * filesystem; the initramfs can't be there yet.
+		 */
+		pr_warn_once("wait_for_initramfs() called before "
+			     "rootfs_initcalls\n");
+		return;
+	}
+
+	if (!initramfs_first_wait.tv64)
+		initramfs_first_wait = ktime_get();
+
+	async_synchronize_cookie_domain(initramfs_cookie + 1,
+					&initramfs_domain);
+
+	if (!test_and_set_bit(0, &initramfs_reported))
+		initramfs_report();
+}
+EXPORT_SYMBOL_GPL(wait_for_initramfs);
+
+static void __init do_populate_rootfs(void *unused, async_cookie_t cookie)
 {
-	char *err = unpack_to_rootfs(__initramfs_start, __initramfs_size);
+	char *err;
+
+	initramfs_unpack_start = ktime_get();
+
+	err = unpack_to_rootfs(__initramfs_start, __initramfs_size);
 	if (err)
 		panic(err);	/* Failed to decompress INTERNAL initramfs */
 	if (initrd_start) {
@@ -582,7 +812,7 @@ static int __init populate_rootfs(void)
 			initrd_end - initrd_start);
 		if (!err) {
 			free_initrd();
-			return 0;
+			goto done;
 		} else {
 			clean_rootfs();
 			unpack_to_rootfs(__initramfs_start, __initramfs_size);
@@ -606,6 +836,16 @@ static int __init populate_rootfs(void)
 		free_initrd();
 #endif
 	}
+done:
+	initramfs_unpack_end = ktime_get();
+}
+
+static int __init populate_rootfs(void)
+{
+	initramfs_cookie = async_schedule_domain(do_populate_rootfs, NULL,
+						 &initramfs_domain);
+	if (!initramfs_async)
+		wait_for_initramfs();
 	return 0;
 }
 rootfs_initcall(populate_rootfs);
@@ -69,6 +69,7 @@
 #include <linux/slab.h>
 #include <linux/perf_event.h>
 #include <linux/random.h>
+#include <linux/boot_timing.h>
 
 #include <asm/io.h>
 #include <asm/bugs.h>
@@ -677,12 +678,15 @@ static int __init_or_module do_one_initcall_debug(initcall_t fn)
 int __init_or_module do_one_initcall(initcall_t fn)
 {
 	int count = preempt_count();
+	struct boot_timing_stamp stamp;
 	int ret;
 
+	boot_timing_start(&stamp);
 	if (initcall_debug)
 		ret = do_one_initcall_debug(fn);
 	else
 		ret = fn();
+	boot_timing_initcall(&stamp, fn, ret);
 
 	msgbuf[0] = 0;
 
@@ -869,6 +873,9 @@ static int __init kernel_init(void * unused)
 
 	do_basic_setup();
 
+	/* The initramfs has been unpacking while the initcalls ran */
+	wait_for_initramfs();
+
 	/* Open the /dev/console on the rootfs, this should never fail */
 	if (sys_open((const char __user *) "/dev/console", O_RDWR, 0) < 0)
 		printk(KERN_WARNING "Warning: unable to open an initial console.\n");
@@ -1226,6 +1226,7 @@ static void __run_hrtimer(struct hrtimer *timer, ktime_t *now)
 	debug_deactivate(timer);
 	__remove_hrtimer(timer, base, HRTIMER_STATE_CALLBACK, 0);
 	timer_stats_account_hrtimer(timer);
+	tick_idle_stats_hrtimer(timer);
 	fn = timer->function;
 
 	/*
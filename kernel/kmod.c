@@ -37,6 +37,7 @@
 #include <linux/notifier.h>
 #include <linux/suspend.h>
 #include <linux/rwsem.h>
+#include <linux/initrd.h>
 #include <asm/uaccess.h>
 
 #include <trace/events/module.h>
@@ -211,6 +212,9 @@ static int ____call_usermodehelper(void *data)
 
 	commit_creds(new);
 
+	/* The helper binary may well live in the initramfs */
+	wait_for_initramfs();
+
 	retval = kernel_execve(sub_info->path,
 			       (const char *const *)sub_info->argv,
 			       (const char *const *)sub_info->envp);
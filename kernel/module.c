@@ -58,6 +58,9 @@
 #include <linux/jump_label.h>
 #include <linux/pfn.h>
 #include <linux/bsearch.h>
+#include <linux/jhash.h>
+#include <linux/hash.h>
+#include <linux/debugfs.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/module.h>
@@ -248,6 +251,56 @@ static bool each_symbol_in_section(const struct symsearch *arr,
 	return false;
 }
 
+#ifdef CONFIG_UNUSED_SYMBOLS
+#define KSYM_NR_SECTIONS 5
+#else
+#define KSYM_NR_SECTIONS 3
+#endif
+
+static const struct symsearch core_symsearch[KSYM_NR_SECTIONS] = {
+	{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
+	  NOT_GPL_ONLY, false },
+	{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
+	  __start___kcrctab_gpl,
+	  GPL_ONLY, false },
+	{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
+	  __start___kcrctab_gpl_future,
+	  WILL_BE_GPL_ONLY, false },
+#ifdef CONFIG_UNUSED_SYMBOLS
+	{ __start___ksymtab_unused, __stop___ksymtab_unused,
+	  __start___kcrctab_unused,
+	  NOT_GPL_ONLY, true },
+	{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
+	  __start___kcrctab_unused_gpl,
+	  GPL_ONLY, true },
+#endif
+};
+
+static void module_symsearch(struct module *mod,
+			     struct symsearch arr[KSYM_NR_SECTIONS])
+{
+	struct symsearch *s = arr;
+
+	*s++ = (struct symsearch){ mod->syms, mod->syms + mod->num_syms,
+				   mod->crcs, NOT_GPL_ONLY, false };
+	*s++ = (struct symsearch){ mod->gpl_syms,
+				   mod->gpl_syms + mod->num_gpl_syms,
+				   mod->gpl_crcs, GPL_ONLY, false };
+	*s++ = (struct symsearch){ mod->gpl_future_syms,
+				   mod->gpl_future_syms +
+				   mod->num_gpl_future_syms,
+				   mod->gpl_future_crcs, WILL_BE_GPL_ONLY, false };
+#ifdef CONFIG_UNUSED_SYMBOLS
+	*s++ = (struct symsearch){ mod->unused_syms,
+				   mod->unused_syms + mod->num_unused_syms,
+				   mod->unused_crcs, NOT_GPL_ONLY, true };
+	*s++ = (struct symsearch){ mod->unused_gpl_syms,
+				   mod->unused_gpl_syms +
+				   mod->num_unused_gpl_syms,
+				   mod->unused_gpl_crcs, GPL_ONLY, true };
+#endif
+}
+
 /* Returns true as soon as fn returns true, otherwise false. */
 bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
 				    struct module *owner,
@@ -255,51 +308,15 @@ bool each_symbol_section(bool (*fn)(const struct symsearch *arr,
 			 void *data)
 {
 	struct module *mod;
-	static const struct symsearch arr[] = {
-		{ __start___ksymtab, __stop___ksymtab, __start___kcrctab,
-		  NOT_GPL_ONLY, false },
-		{ __start___ksymtab_gpl, __stop___ksymtab_gpl,
-		  __start___kcrctab_gpl,
-		  GPL_ONLY, false },
-		{ __start___ksymtab_gpl_future, __stop___ksymtab_gpl_future,
-		  __start___kcrctab_gpl_future,
-		  WILL_BE_GPL_ONLY, false },
-#ifdef CONFIG_UNUSED_SYMBOLS
-		{ __start___ksymtab_unused, __stop___ksymtab_unused,
-		  __start___kcrctab_unused,
-		  NOT_GPL_ONLY, true },
-		{ __start___ksymtab_unused_gpl, __stop___ksymtab_unused_gpl,
-		  __start___kcrctab_unused_gpl,
-		  GPL_ONLY, true },
-#endif
-	};
 
-	if (each_symbol_in_section(arr, ARRAY_SIZE(arr), NULL, fn, data))
+	if (each_symbol_in_section(core_symsearch, ARRAY_SIZE(core_symsearch),
+				   NULL, fn, data))
 		return true;
 
 	list_for_each_entry_rcu(mod, &modules, list) {
-		struct symsearch arr[] = {
-			{ mod->syms, mod->syms + mod->num_syms, mod->crcs,
-			  NOT_GPL_ONLY, false },
-			{ mod->gpl_syms, mod->gpl_syms + mod->num_gpl_syms,
-			  mod->gpl_crcs,
-			  GPL_ONLY, false },
-			{ mod->gpl_future_syms,
-			  mod->gpl_future_syms + mod->num_gpl_future_syms,
-			  mod->gpl_future_crcs,
-			  WILL_BE_GPL_ONLY, false },
-#ifdef CONFIG_UNUSED_SYMBOLS
-			{ mod->unused_syms,
-			  mod->unused_syms + mod->num_unused_syms,
-			  mod->unused_crcs,
-			  NOT_GPL_ONLY, true },
-			{ mod->unused_gpl_syms,
-			  mod->unused_gpl_syms + mod->num_unused_gpl_syms,
-			  mod->unused_gpl_crcs,
-			  GPL_ONLY, true },
-#endif
-		};
+		struct symsearch arr[KSYM_NR_SECTIONS];
 
+		module_symsearch(mod, arr);
 		if (each_symbol_in_section(arr, ARRAY_SIZE(arr), mod, fn, data))
 			return true;
 	}
@@ -382,6 +399,121 @@ static bool find_symbol_in_section(const struct symsearch *syms,
 	return false;
 }
 
+/*
+ * Global hash of every exported symbol, so that resolving a symbol does
+ * not have to bsearch the kernel's tables and then each loaded module's
+ * in turn.  Nodes are added under module_mutex, removed under
+ * stop_machine() (or followed by synchronize_sched() on the load error
+ * path) and looked up with preemption disabled, like the module list.
+ */
+#define KSYM_HASH_BITS	12
+
+struct ksym_hash_node {
+	struct hlist_node node;
+	const struct kernel_symbol *sym;
+	const struct symsearch *syms;
+	struct module *owner;
+};
+
+struct ksym_hash_table {
+	struct symsearch syms[KSYM_NR_SECTIONS];
+	unsigned int nr_nodes;
+	struct ksym_hash_node nodes[];
+};
+
+static struct hlist_head ksym_hash[1 << KSYM_HASH_BITS];
+/* Set once the kernel's own exports are in the hash */
+static bool ksym_hash_ready;
+
+static struct hlist_head *ksym_hash_bucket(const char *name)
+{
+	return &ksym_hash[hash_32(jhash(name, strlen(name), 0),
+				  KSYM_HASH_BITS)];
+}
+
+static struct ksym_hash_table *
+ksym_hash_alloc(const struct symsearch *arr, struct module *owner)
+{
+	struct ksym_hash_table *table;
+	const struct kernel_symbol *sym;
+	struct ksym_hash_node *node;
+	unsigned int i, nr = 0;
+	size_t size;
+
+	for (i = 0; i < KSYM_NR_SECTIONS; i++)
+		nr += arr[i].stop - arr[i].start;
+
+	size = sizeof(*table) + nr * sizeof(table->nodes[0]);
+	/* The kernel exports thousands of symbols, a module a handful */
+	table = owner ? kmalloc(size, GFP_KERNEL) : vmalloc(size);
+	if (!table)
+		return NULL;
+
+	memcpy(table->syms, arr, sizeof(table->syms));
+	table->nr_nodes = nr;
+
+	node = table->nodes;
+	for (i = 0; i < KSYM_NR_SECTIONS; i++) {
+		for (sym = arr[i].start; sym < arr[i].stop; sym++, node++) {
+			node->sym = sym;
+			node->syms = &table->syms[i];
+			node->owner = owner;
+		}
+	}
+	return table;
+}
+
+static void ksym_hash_link(struct ksym_hash_table *table)
+{
+	unsigned int i;
+
+	for (i = 0; i < table->nr_nodes; i++)
+		hlist_add_head_rcu(&table->nodes[i].node,
+				   ksym_hash_bucket(table->nodes[i].sym->name));
+}
+
+static void ksym_hash_unlink(struct ksym_hash_table *table)
+{
+	unsigned int i;
+
+	for (i = 0; i < table->nr_nodes; i++)
+		hlist_del_rcu(&table->nodes[i].node);
+}
+
+static bool find_symbol_in_hash(struct find_symbol_arg *fsa)
+{
+	struct ksym_hash_node *node;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry_rcu(node, pos, ksym_hash_bucket(fsa->name), node) {
+		if (strcmp(node->sym->name, fsa->name))
+			continue;
+		if (check_symbol(node->syms, node->owner,
+				 node->sym - node->syms->start, fsa))
+			return true;
+	}
+	return false;
+}
+
+static int __init ksym_hash_init(void)
+{
+	struct ksym_hash_table *table;
+
+	table = ksym_hash_alloc(core_symsearch, NULL);
+	if (!table) {
+		printk(KERN_WARNING "Failed to allocate the kernel symbol "
+		       "hash, falling back to table search\n");
+		return -ENOMEM;
+	}
+
+	mutex_lock(&module_mutex);
+	ksym_hash_link(table);
+	ksym_hash_ready = true;
+	mutex_unlock(&module_mutex);
+	return 0;
+}
+pure_initcall(ksym_hash_init);
+
 /* Find a symbol and return it, along with, (optional) crc and
  * (optional) module which owns it.  Needs preempt disabled or module_mutex. */
 const struct kernel_symbol *find_symbol(const char *name,
@@ -396,7 +528,8 @@ const struct kernel_symbol *find_symbol(const char *name,
 	fsa.gplok = gplok;
 	fsa.warn = warn;
 
-	if (each_symbol_section(find_symbol_in_section, &fsa)) {
+	if (ACCESS_ONCE(ksym_hash_ready) ? find_symbol_in_hash(&fsa) :
+	    each_symbol_section(find_symbol_in_section, &fsa)) {
 		if (owner)
 			*owner = fsa.owner;
 		if (crc)
@@ -1203,11 +1336,31 @@ static const struct kernel_symbol *resolve_symbol(struct module *mod,
 	struct module *owner;
 	const struct kernel_symbol *sym;
 	const unsigned long *crc;
+	bool gplok = !(mod->taints & (1 << TAINT_PROPRIETARY_MODULE));
 	int err;
 
+	/*
+	 * Most symbols a module needs are exported by the kernel proper,
+	 * which cannot go away and needs no module reference: resolve
+	 * those without module_mutex.  Only take it, and look again, when
+	 * the symbol belongs to a module that could be unloaded under us.
+	 */
+	preempt_disable();
+	sym = find_symbol(name, &owner, &crc, gplok, true);
+	preempt_enable();
+	if (!sym)
+		return NULL;
+
+	if (!owner) {
+		if (!check_version(info->sechdrs, info->index.vers, name, mod,
+				   crc, owner))
+			sym = ERR_PTR(-EINVAL);
+		strncpy(ownername, module_name(owner), MODULE_NAME_LEN);
+		return sym;
+	}
+
 	mutex_lock(&module_mutex);
-	sym = find_symbol(name, &owner, &crc,
-			  !(mod->taints & (1 << TAINT_PROPRIETARY_MODULE)), true);
+	sym = find_symbol(name, &owner, &crc, gplok, false);
 	if (!sym)
 		goto unlock;
 
@@ -1671,6 +1824,7 @@ static int __unlink_module(void *_mod)
 {
 	struct module *mod = _mod;
 	list_del(&mod->list);
+	ksym_hash_unlink(mod->ksym_hash);
 	module_bug_cleanup(mod);
 	return 0;
 }
@@ -1804,6 +1958,7 @@ static void free_module(struct module *mod)
 	mutex_lock(&module_mutex);
 	stop_machine(__unlink_module, mod, NULL);
 	mutex_unlock(&module_mutex);
+	kfree(mod->ksym_hash);
 	mod_sysfs_teardown(mod);
 
 	/* Remove dynamic debug info */
@@ -2869,13 +3024,141 @@ static int post_relocation(struct module *mod, const struct load_info *info)
 	return module_finalize(info->hdr, info->sechdrs, mod);
 }
 
+#ifdef CONFIG_MODULE_LOAD_TIMING
+/*
+ * Per-module load time, split into the phases of load_module() and the
+ * module's init, reported in debugfs:
+ *
+ *	# cat /sys/kernel/debug/module_load_times
+ */
+enum module_load_phase {
+	MODULE_LOAD_COPY,	/* copy from userspace, layout, list and sysfs setup */
+	MODULE_LOAD_RESOLVE,	/* simplify_symbols() */
+	MODULE_LOAD_RELOCATE,	/* relocations and arch finalizing */
+	MODULE_LOAD_INIT,	/* constructors and the init function */
+	MODULE_LOAD_NR_PHASES,
+};
+
+struct module_load_times {
+	ktime_t last;
+	s64 ns[MODULE_LOAD_NR_PHASES];
+};
+
+struct module_load_entry {
+	struct list_head list;
+	char name[MODULE_NAME_LEN];
+	unsigned int size;
+	int ret;
+	s64 ns[MODULE_LOAD_NR_PHASES];
+};
+
+static LIST_HEAD(module_load_entries);
+static DEFINE_MUTEX(module_load_entries_mutex);
+
+static void module_load_times_start(struct module_load_times *t)
+{
+	memset(t, 0, sizeof(*t));
+	t->last = ktime_get();
+}
+
+static void module_load_times_phase(struct module_load_times *t,
+				    enum module_load_phase phase)
+{
+	ktime_t now = ktime_get();
+
+	t->ns[phase] += ktime_to_ns(ktime_sub(now, t->last));
+	t->last = now;
+}
+
+static void module_load_times_record(struct module *mod,
+				     struct module_load_times *t, int ret)
+{
+	struct module_load_entry *entry;
+
+	entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+	if (!entry)
+		return;
+
+	strlcpy(entry->name, mod->name, sizeof(entry->name));
+	entry->size = mod->core_size + mod->init_size;
+	entry->ret = ret;
+	memcpy(entry->ns, t->ns, sizeof(entry->ns));
+
+	mutex_lock(&module_load_entries_mutex);
+	list_add_tail(&entry->list, &module_load_entries);
+	mutex_unlock(&module_load_entries_mutex);
+}
+
+static int module_load_times_show(struct seq_file *m, void *v)
+{
+	struct module_load_entry *entry;
+	s64 total[MODULE_LOAD_NR_PHASES] = { 0, };
+	int i;
+
+	seq_puts(m, "# copy_us resolve_us reloc_us  init_us     size  ret name\n");
+
+	mutex_lock(&module_load_entries_mutex);
+	list_for_each_entry(entry, &module_load_entries, list) {
+		for (i = 0; i < MODULE_LOAD_NR_PHASES; i++)
+			total[i] += entry->ns[i];
+		seq_printf(m, "%9lld %10lld %8lld %8lld %8u %4d %s\n",
+			   div_s64(entry->ns[MODULE_LOAD_COPY], NSEC_PER_USEC),
+			   div_s64(entry->ns[MODULE_LOAD_RESOLVE],
+				   NSEC_PER_USEC),
+			   div_s64(entry->ns[MODULE_LOAD_RELOCATE],
+				   NSEC_PER_USEC),
+			   div_s64(entry->ns[MODULE_LOAD_INIT], NSEC_PER_USEC),
+			   entry->size, entry->ret, entry->name);
+	}
+	mutex_unlock(&module_load_entries_mutex);
+
+	seq_printf(m, "# total: copy %lld us, resolve %lld us, reloc %lld us, "
+		   "init %lld us\n",
+		   div_s64(total[MODULE_LOAD_COPY], NSEC_PER_USEC),
+		   div_s64(total[MODULE_LOAD_RESOLVE], NSEC_PER_USEC),
+		   div_s64(total[MODULE_LOAD_RELOCATE], NSEC_PER_USEC),
+		   div_s64(total[MODULE_LOAD_INIT], NSEC_PER_USEC));
+	return 0;
+}
+
+static int module_load_times_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, module_load_times_show, NULL);
+}
+
+static const struct file_operations module_load_times_fops = {
+	.open		= module_load_times_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init module_load_times_init(void)
+{
+	debugfs_create_file("module_load_times", S_IRUSR, NULL, NULL,
+			    &module_load_times_fops);
+	return 0;
+}
+late_initcall(module_load_times_init);
+#else
+struct module_load_times { };
+
+static inline void module_load_times_start(struct module_load_times *t) { }
+#define module_load_times_phase(t, phase) do { } while (0)
+static inline void module_load_times_record(struct module *mod,
+					    struct module_load_times *t,
+					    int ret) { }
+#endif /* CONFIG_MODULE_LOAD_TIMING */
+
 /* Allocate and load the module: note that size of section 0 is always
    zero, and we rely on this for optional sections. */
 static struct module *load_module(void __user *umod,
 				  unsigned long len,
-				  const char __user *uargs)
+				  const char __user *uargs,
+				  struct module_load_times *times)
 {
 	struct load_info info = { NULL, };
+	struct symsearch syms[KSYM_NR_SECTIONS];
 	struct module *mod;
 	long err;
 
@@ -2910,11 +3193,15 @@ static struct module *load_module(void __user *umod,
 	/* Set up MODINFO_ATTR fields */
 	setup_modinfo(mod, &info);
 
+	module_load_times_phase(times, MODULE_LOAD_COPY);
+
 	/* Fix up syms, so that st_value is a pointer to location. */
 	err = simplify_symbols(mod, &info);
 	if (err < 0)
 		goto free_modinfo;
 
+	module_load_times_phase(times, MODULE_LOAD_RESOLVE);
+
 	err = apply_relocations(mod, &info);
 	if (err < 0)
 		goto free_modinfo;
@@ -2925,11 +3212,21 @@ static struct module *load_module(void __user *umod,
 
 	flush_module_icache(mod);
 
+	module_load_times_phase(times, MODULE_LOAD_RELOCATE);
+
+	/* Hash our exports now, so that only linking them needs the mutex. */
+	module_symsearch(mod, syms);
+	mod->ksym_hash = ksym_hash_alloc(syms, mod);
+	if (!mod->ksym_hash) {
+		err = -ENOMEM;
+		goto free_arch_cleanup;
+	}
+
 	/* Now copy in args */
 	mod->args = strndup_user(uargs, ~0UL >> 1);
 	if (IS_ERR(mod->args)) {
 		err = PTR_ERR(mod->args);
-		goto free_arch_cleanup;
+		goto free_ksym_hash;
 	}
 
 	/* Mark state as coming so strong_try_module_get() ignores us. */
@@ -2958,6 +3255,7 @@ static struct module *load_module(void __user *umod,
 
 	module_bug_finalize(info.hdr, info.sechdrs, mod);
 	list_add_rcu(&mod->list, &modules);
+	ksym_hash_link(mod->ksym_hash);
 	mutex_unlock(&module_mutex);
 
 	/* Module is ready to execute: parsing args may do that. */
@@ -2974,6 +3272,8 @@ static struct module *load_module(void __user *umod,
 	/* Get rid of temporary copy. */
 	free_copy(&info);
 
+	module_load_times_phase(times, MODULE_LOAD_COPY);
+
 	/* Done! */
 	trace_module_load(mod);
 	return mod;
@@ -2982,6 +3282,7 @@ static struct module *load_module(void __user *umod,
 	mutex_lock(&module_mutex);
 	/* Unlink carefully: kallsyms could be walking list. */
 	list_del_rcu(&mod->list);
+	ksym_hash_unlink(mod->ksym_hash);
 	module_bug_cleanup(mod);
 
  ddebug:
@@ -2990,6 +3291,8 @@ static struct module *load_module(void __user *umod,
 	mutex_unlock(&module_mutex);
 	synchronize_sched();
 	kfree(mod->args);
+ free_ksym_hash:
+	kfree(mod->ksym_hash);
  free_arch_cleanup:
 	module_arch_cleanup(mod);
  free_modinfo:
@@ -3018,6 +3321,7 @@ static void do_mod_ctors(struct module *mod)
 SYSCALL_DEFINE3(init_module, void __user *, umod,
 		unsigned long, len, const char __user *, uargs)
 {
+	struct module_load_times times;
 	struct module *mod;
 	int ret = 0;
 
@@ -3025,8 +3329,10 @@ SYSCALL_DEFINE3(init_module, void __user *, umod,
 	if (!capable(CAP_SYS_MODULE) || modules_disabled)
 		return -EPERM;
 
+	module_load_times_start(&times);
+
 	/* Do all the hard work */
-	mod = load_module(umod, len, uargs);
+	mod = load_module(umod, len, uargs, &times);
 	if (IS_ERR(mod))
 		return PTR_ERR(mod);
 
@@ -3049,6 +3355,8 @@ SYSCALL_DEFINE3(init_module, void __user *, umod,
 	/* Start the module */
 	if (mod->init != NULL)
 		ret = do_one_initcall(mod->init);
+	module_load_times_phase(&times, MODULE_LOAD_INIT);
+	module_load_times_record(mod, &times, ret);
 	if (ret < 0) {
 		/* Init routine failed: abort.  Try to protect us from
                    buggy refcounters. */
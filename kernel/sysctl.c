@@ -255,6 +255,8 @@ static int max_sched_tunable_scaling = SCHED_TUNABLESCALING_END-1;
 #ifdef CONFIG_COMPACTION
 static int min_extfrag_threshold;
 static int max_extfrag_threshold = 1000;
+static int max_kcompactd_budget_ms = 1000;
+static int max_kcompactd_order = MAX_ORDER - 1;
 #endif
 
 static struct ctl_table kern_table[] = {
@@ -1047,6 +1049,17 @@ static struct ctl_table vm_table[] = {
 		.proc_handler	= proc_dointvec_minmax,
 		.extra1		= &zero,
 	},
+#ifdef CONFIG_SWAP
+	{
+		.procname	= "swap_vma_readahead",
+		.data		= &sysctl_swap_vma_readahead,
+		.maxlen		= sizeof(sysctl_swap_vma_readahead),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &one,
+	},
+#endif
 	{
 		.procname	= "dirty_background_ratio",
 		.data		= &dirty_background_ratio,
@@ -1112,6 +1125,15 @@ static struct ctl_table vm_table[] = {
 		.extra1		= &zero,
 		.extra2		= &one_hundred,
 	},
+	{
+		.procname	= "reclaim_cost_balance",
+		.data		= &sysctl_reclaim_cost_balance,
+		.maxlen		= sizeof(sysctl_reclaim_cost_balance),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &one,
+	},
 #ifdef CONFIG_HUGETLB_PAGE
 	{
 		.procname	= "nr_hugepages",
@@ -1190,6 +1212,24 @@ static struct ctl_table vm_table[] = {
 		.extra1		= &min_extfrag_threshold,
 		.extra2		= &max_extfrag_threshold,
 	},
+	{
+		.procname	= "kcompactd_budget_ms",
+		.data		= &sysctl_kcompactd_budget_ms,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &max_kcompactd_budget_ms,
+	},
+	{
+		.procname	= "kcompactd_order",
+		.data		= &sysctl_kcompactd_order,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &max_kcompactd_order,
+	},
 
 #endif /* CONFIG_COMPACTION */
 	{
@@ -0,0 +1,267 @@
+/*
+ * kernel/time/tick-idle-stats.c
+ *
+ * Per-CPU statistics of tickless idle sleeps.
+ *
+ * For every CPU we count how often the tick was stopped in idle, how
+ * long each tickless sleep lasted (log2 histogram in milliseconds) and
+ * what woke the CPU up: the first timer callback that ran after the
+ * wakeup, or "other" when the wakeup interrupt did not expire a timer.
+ *
+ * Display the statistics collected since boot or the last reset:
+ * # cat /proc/tick_idle_stats
+ *
+ * Reset them:
+ * # echo 0 > /proc/tick_idle_stats
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/proc_fs.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/seq_file.h>
+#include <linux/smp.h>
+#include <linux/hrtimer.h>
+#include <linux/tick.h>
+#include <linux/log2.h>
+
+#include <asm/uaccess.h>
+#include <asm/div64.h>
+
+/*
+ * Sleep length buckets: [0,1ms), [1ms,2ms), [2ms,4ms) ... [512ms,1s), >=1s
+ */
+#define TIS_NR_BUCKETS		12
+#define TIS_NR_CAUSES		16
+
+struct tick_idle_cause {
+	void			*func;
+	unsigned long		count;
+};
+
+struct tick_idle_stats {
+	unsigned long		entries;
+	unsigned long		wakeups;
+	unsigned long		other_wakeups;
+	unsigned long		dropped_causes;
+	unsigned long		sleep_hist[TIS_NR_BUCKETS];
+	struct tick_idle_cause	causes[TIS_NR_CAUSES];
+	ktime_t			sleep_start;
+	int			sleeping;
+	int			wake_pending;
+};
+
+static DEFINE_PER_CPU(struct tick_idle_stats, tick_idle_stats);
+static DEFINE_MUTEX(tis_mutex);
+static ktime_t tis_time_start;
+
+/*
+ * Called with interrupts disabled each time the tick is (re)programmed
+ * for a tickless idle sleep. @first is set when the tick was running
+ * before, i.e. this is a new idle entry rather than a re-arm after an
+ * interrupt that did not end idle.
+ */
+void tick_idle_stats_sleep(int cpu, ktime_t now, int first)
+{
+	struct tick_idle_stats *tis = &per_cpu(tick_idle_stats, cpu);
+
+	if (first)
+		tis->entries++;
+	tis->sleep_start = now;
+	tis->sleeping = 1;
+}
+
+/*
+ * Called from irq_enter() when an interrupt hits a CPU whose tick is
+ * stopped. Accounts the sleep that just ended and arms the wakeup cause
+ * recording for the timer callbacks run by this interrupt.
+ */
+void tick_idle_stats_wakeup(int cpu, ktime_t now)
+{
+	struct tick_idle_stats *tis = &per_cpu(tick_idle_stats, cpu);
+	s64 ms;
+	int bucket = 0;
+
+	if (!tis->sleeping)
+		return;
+
+	tis->sleeping = 0;
+	tis->wakeups++;
+	tis->wake_pending = 1;
+
+	ms = ktime_to_ms(ktime_sub(now, tis->sleep_start));
+	if (ms > 0)
+		bucket = min_t(int, ilog2(ms) + 1, TIS_NR_BUCKETS - 1);
+	tis->sleep_hist[bucket]++;
+}
+
+/*
+ * Called for every expiring timer wheel and hrtimer callback. Only the
+ * first one after a tickless wakeup is recorded.
+ */
+void tick_idle_stats_timer(void *func)
+{
+	struct tick_idle_stats *tis = &__get_cpu_var(tick_idle_stats);
+	struct tick_idle_cause *cause;
+	int i;
+
+	if (likely(!tis->wake_pending))
+		return;
+
+	tis->wake_pending = 0;
+
+	for (i = 0; i < TIS_NR_CAUSES; i++) {
+		cause = &tis->causes[i];
+		if (cause->func == func || !cause->func) {
+			cause->func = func;
+			cause->count++;
+			return;
+		}
+	}
+	tis->dropped_causes++;
+}
+
+/*
+ * Called from hrtimer expiry. The sched tick timer is only the carrier
+ * for the next timer wheel event while the tick is stopped, so skip it
+ * and attribute the wakeup to the wheel timer it leads to.
+ */
+void tick_idle_stats_hrtimer(struct hrtimer *timer)
+{
+	struct tick_sched *ts = tick_get_tick_sched(smp_processor_id());
+
+	if (timer == &ts->sched_timer)
+		return;
+	tick_idle_stats_timer(timer->function);
+}
+
+/*
+ * Called when the wakeup interrupt is over. If no timer callback ran,
+ * something else (a device interrupt, an IPI) woke the CPU.
+ */
+void tick_idle_stats_irq_exit(int cpu)
+{
+	struct tick_idle_stats *tis = &per_cpu(tick_idle_stats, cpu);
+
+	if (tis->wake_pending) {
+		tis->wake_pending = 0;
+		tis->other_wakeups++;
+	}
+}
+
+static void tis_print_rate(struct seq_file *m, const char *what,
+			   unsigned long events, unsigned long ms)
+{
+	u64 rate = (u64)events * 1000000;
+
+	do_div(rate, ms);
+	seq_printf(m, "  %-16s %10lu  %lu.%03lu/s\n", what, events,
+		   (unsigned long)rate / 1000, (unsigned long)rate % 1000);
+}
+
+static int tis_show(struct seq_file *m, void *v)
+{
+	struct timespec period;
+	unsigned long ms;
+	int cpu, i;
+
+	mutex_lock(&tis_mutex);
+
+	period = ktime_to_timespec(ktime_sub(ktime_get(), tis_time_start));
+	ms = period.tv_sec * 1000 + period.tv_nsec / NSEC_PER_MSEC;
+	if (!ms)
+		ms = 1;
+
+	seq_puts(m, "Tick Idle Stats Version: v0.1\n");
+	seq_printf(m, "Sample period: %ld.%03ld s\n", period.tv_sec,
+		   period.tv_nsec / NSEC_PER_MSEC);
+
+	for_each_online_cpu(cpu) {
+		struct tick_idle_stats *tis = &per_cpu(tick_idle_stats, cpu);
+
+		seq_printf(m, "cpu%d:\n", cpu);
+		tis_print_rate(m, "idle entries", tis->entries, ms);
+		tis_print_rate(m, "wakeups", tis->wakeups, ms);
+		tis_print_rate(m, "other wakeups", tis->other_wakeups, ms);
+
+		seq_puts(m, "  sleep ms:");
+		for (i = 0; i < TIS_NR_BUCKETS - 1; i++)
+			seq_printf(m, " <%d:%lu", 1 << i, tis->sleep_hist[i]);
+		seq_printf(m, " >=%d:%lu\n", 1 << (i - 1),
+			   tis->sleep_hist[i]);
+
+		for (i = 0; i < TIS_NR_CAUSES && tis->causes[i].func; i++)
+			seq_printf(m, "  %10lu %pf\n", tis->causes[i].count,
+				   tis->causes[i].func);
+		if (tis->dropped_causes)
+			seq_printf(m, "  %10lu (untracked timers)\n",
+				   tis->dropped_causes);
+	}
+
+	mutex_unlock(&tis_mutex);
+
+	return 0;
+}
+
+static void tis_reset_cpu(void *unused)
+{
+	struct tick_idle_stats *tis = &__get_cpu_var(tick_idle_stats);
+	int sleeping = tis->sleeping;
+	ktime_t sleep_start = tis->sleep_start;
+
+	memset(tis, 0, sizeof(*tis));
+	tis->sleeping = sleeping;
+	tis->sleep_start = sleep_start;
+}
+
+static ssize_t tis_write(struct file *file, const char __user *buf,
+			 size_t count, loff_t *offs)
+{
+	char ctl[2];
+
+	if (count != 2 || *offs)
+		return -EINVAL;
+
+	if (copy_from_user(ctl, buf, count))
+		return -EFAULT;
+
+	if (ctl[0] != '0')
+		return -EINVAL;
+
+	mutex_lock(&tis_mutex);
+	on_each_cpu(tis_reset_cpu, NULL, 1);
+	tis_time_start = ktime_get();
+	mutex_unlock(&tis_mutex);
+
+	return count;
+}
+
+static int tis_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, tis_show, NULL);
+}
+
+static const struct file_operations tis_fops = {
+	.open		= tis_open,
+	.read		= seq_read,
+	.write		= tis_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init init_tick_idle_stats_procfs(void)
+{
+	struct proc_dir_entry *pe;
+
+	tis_time_start = ktime_get();
+
+	pe = proc_create("tick_idle_stats", 0644, NULL, &tis_fops);
+	if (!pe)
+		return -ENOMEM;
+	return 0;
+}
+__initcall(init_tick_idle_stats_procfs);
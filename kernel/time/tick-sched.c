@@ -388,6 +388,8 @@ static void tick_nohz_stop_sched_tick(struct tick_sched *ts)
 		else
 			expires.tv64 = KTIME_MAX;
 
+		tick_idle_stats_sleep(cpu, now, !ts->tick_stopped);
+
 		/* Skip reprogram of event if its not changed */
 		if (ts->tick_stopped && ktime_equal(expires, dev->next_event))
 			goto out;
@@ -503,6 +505,7 @@ void tick_nohz_irq_exit(void)
 
 	local_irq_save(flags);
 
+	tick_idle_stats_irq_exit(smp_processor_id());
 	tick_nohz_stop_sched_tick(ts);
 
 	local_irq_restore(flags);
@@ -579,6 +582,9 @@ void tick_nohz_idle_exit(void)
 		return;
 	}
 
+	tick_idle_stats_wakeup(cpu, now);
+	tick_idle_stats_irq_exit(cpu);
+
 	/* Update jiffies first */
 	select_nohz_load_balancer(0);
 	tick_do_update_jiffies64(now);
@@ -743,6 +749,7 @@ static inline void tick_check_nohz(int cpu)
 	if (ts->idle_active)
 		tick_nohz_stop_idle(cpu, now);
 	if (ts->tick_stopped) {
+		tick_idle_stats_wakeup(cpu, now);
 		tick_nohz_update_jiffies(now);
 		tick_nohz_kick_tick(cpu, now);
 	}
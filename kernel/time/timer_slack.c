@@ -0,0 +1,137 @@
+/*
+ * kernel/time/timer_slack.c
+ *
+ * Registry of timer slack domains.
+ *
+ * A slack domain groups the timers of one subsystem under a single
+ * tunable slack value. apply_slack() in kernel/timer.c rounds the
+ * expiry of every timer in the domain to a coarse boundary inside the
+ * allowed window, so timers from different subsystems tend to land on
+ * the same jiffy and an idle CPU is woken once instead of several times.
+ *
+ * Display the registered domains:
+ * # cat /proc/timer_slack
+ *
+ * Change the slack (in usecs, -1 for the default heuristic) of a domain:
+ * # echo "cpufreq_interactive 40000" > /proc/timer_slack
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/proc_fs.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/timer.h>
+#include <linux/string.h>
+
+#include <asm/uaccess.h>
+
+static LIST_HEAD(timer_slack_domains);
+static DEFINE_MUTEX(timer_slack_mutex);
+
+/**
+ * register_timer_slack_domain - make a slack domain visible and tunable
+ * @domain: the domain to register
+ *
+ * Timers can be attached to a domain with set_timer_slack_domain()
+ * whether or not it is registered; registering only publishes it in
+ * /proc/timer_slack.
+ */
+void register_timer_slack_domain(struct timer_slack_domain *domain)
+{
+	mutex_lock(&timer_slack_mutex);
+	if (list_empty(&domain->list))
+		list_add_tail(&domain->list, &timer_slack_domains);
+	mutex_unlock(&timer_slack_mutex);
+}
+EXPORT_SYMBOL_GPL(register_timer_slack_domain);
+
+/**
+ * unregister_timer_slack_domain - remove a slack domain from the registry
+ * @domain: the domain to remove
+ */
+void unregister_timer_slack_domain(struct timer_slack_domain *domain)
+{
+	mutex_lock(&timer_slack_mutex);
+	list_del_init(&domain->list);
+	mutex_unlock(&timer_slack_mutex);
+}
+EXPORT_SYMBOL_GPL(unregister_timer_slack_domain);
+
+static int timer_slack_show(struct seq_file *m, void *v)
+{
+	struct timer_slack_domain *domain;
+
+	mutex_lock(&timer_slack_mutex);
+	list_for_each_entry(domain, &timer_slack_domains, list)
+		seq_printf(m, "%-24s %d\n", domain->name, domain->slack_us);
+	mutex_unlock(&timer_slack_mutex);
+
+	return 0;
+}
+
+static ssize_t timer_slack_write(struct file *file, const char __user *buf,
+				 size_t count, loff_t *offs)
+{
+	struct timer_slack_domain *domain;
+	char kbuf[64], *name, *val;
+	int slack_us, ret;
+
+	if (count >= sizeof(kbuf) || *offs)
+		return -EINVAL;
+
+	if (copy_from_user(kbuf, buf, count))
+		return -EFAULT;
+	kbuf[count] = '\0';
+
+	val = strim(kbuf);
+	name = strsep(&val, " \t");
+	if (!val)
+		return -EINVAL;
+
+	ret = kstrtoint(skip_spaces(val), 10, &slack_us);
+	if (ret)
+		return ret;
+	if (slack_us < -1)
+		return -EINVAL;
+
+	ret = -ENOENT;
+	mutex_lock(&timer_slack_mutex);
+	list_for_each_entry(domain, &timer_slack_domains, list) {
+		if (!strcmp(domain->name, name)) {
+			ACCESS_ONCE(domain->slack_us) = slack_us;
+			ret = count;
+			break;
+		}
+	}
+	mutex_unlock(&timer_slack_mutex);
+
+	return ret;
+}
+
+static int timer_slack_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, timer_slack_show, NULL);
+}
+
+static const struct file_operations timer_slack_fops = {
+	.open		= timer_slack_open,
+	.read		= seq_read,
+	.write		= timer_slack_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init init_timer_slack_procfs(void)
+{
+	struct proc_dir_entry *pe;
+
+	pe = proc_create("timer_slack", 0644, NULL, &timer_slack_fops);
+	if (!pe)
+		return -ENOMEM;
+	return 0;
+}
+__initcall(init_timer_slack_procfs);
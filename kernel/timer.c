@@ -333,6 +333,36 @@ void set_timer_slack(struct timer_list *timer, int slack_hz)
 }
 EXPORT_SYMBOL_GPL(set_timer_slack);
 
+#ifdef CONFIG_TIMER_COALESCING
+/**
+ * set_timer_slack_domain - let a timer use the slack of a domain
+ * @timer: the timer to be modified
+ * @domain: the slack domain, or NULL to go back to the timer's own slack
+ *
+ * While a domain is set, its current slack_us value overrides the
+ * per-timer slack every time the timer is (re)armed, including via
+ * mod_timer_pinned().
+ */
+void set_timer_slack_domain(struct timer_list *timer,
+			    struct timer_slack_domain *domain)
+{
+	timer->slack_domain = domain;
+}
+EXPORT_SYMBOL_GPL(set_timer_slack_domain);
+
+static inline struct timer_slack_domain *
+timer_get_slack_domain(struct timer_list *timer)
+{
+	return timer->slack_domain;
+}
+#else
+static inline struct timer_slack_domain *
+timer_get_slack_domain(struct timer_list *timer)
+{
+	return NULL;
+}
+#endif
+
 static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 {
 	unsigned long expires = timer->expires;
@@ -609,6 +639,9 @@ static void __init_timer(struct timer_list *timer,
 	timer->entry.next = NULL;
 	timer->base = __raw_get_cpu_var(tvec_bases);
 	timer->slack = -1;
+#ifdef CONFIG_TIMER_COALESCING
+	timer->slack_domain = NULL;
+#endif
 #ifdef CONFIG_TIMER_STATS
 	timer->start_site = NULL;
 	timer->start_pid = -1;
@@ -796,11 +829,19 @@ EXPORT_SYMBOL(mod_timer_pending);
 static inline
 unsigned long apply_slack(struct timer_list *timer, unsigned long expires)
 {
+	struct timer_slack_domain *domain = timer_get_slack_domain(timer);
 	unsigned long expires_limit, mask;
+	int slack = timer->slack;
 	int bit;
 
-	if (timer->slack >= 0) {
-		expires_limit = expires + timer->slack;
+	if (domain) {
+		int slack_us = ACCESS_ONCE(domain->slack_us);
+
+		slack = slack_us < 0 ? -1 : usecs_to_jiffies(slack_us);
+	}
+
+	if (slack >= 0) {
+		expires_limit = expires + slack;
 	} else {
 		long delta = expires - jiffies;
 
@@ -870,9 +911,14 @@ EXPORT_SYMBOL(mod_timer);
  * mod_timer_pinned(timer, expires) is equivalent to:
  *
  *     del_timer(timer); timer->expires = expires; add_timer(timer);
+ *
+ * Slack is only applied when the timer belongs to a slack domain.
  */
 int mod_timer_pinned(struct timer_list *timer, unsigned long expires)
 {
+	if (timer_get_slack_domain(timer))
+		expires = apply_slack(timer, expires);
+
 	if (timer->expires == expires && timer_pending(timer))
 		return 1;
 
@@ -1115,6 +1161,7 @@ static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 	 */
 	lock_map_acquire(&lockdep_map);
 
+	tick_idle_stats_timer(fn);
 	trace_timer_expire_entry(timer);
 	fn(data);
 	trace_timer_expire_exit(timer);
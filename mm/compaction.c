@@ -14,6 +14,11 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/log2.h>
 #include "internal.h"
 
 #if defined CONFIG_COMPACTION || defined CONFIG_CMA
@@ -502,6 +507,38 @@ static struct page *compaction_alloc(struct page *migratepage,
  * running as migrate_pages() has no knowledge of compact_control. When
  * migration is complete, we count the number of pages on the lists by hand.
  */
+/*
+ * Migrate the isolated pages one at a time until the deadline passes, so
+ * that a sync migration waiting on page locks overruns the budget by the
+ * migration of one page at most.  Pages not migrated are left on
+ * cc->migratepages, returns their number or an error like migrate_pages().
+ */
+static int migrate_pages_deadline(struct compact_control *cc)
+{
+	LIST_HEAD(failed);
+	int ret = 0;
+
+	while (!list_empty(&cc->migratepages)) {
+		LIST_HEAD(one);
+
+		if (ktime_get().tv64 >= cc->deadline.tv64)
+			break;
+
+		list_move(cc->migratepages.next, &one);
+		ret = migrate_pages(&one, compaction_alloc, (unsigned long)cc,
+				false,
+				cc->sync ? MIGRATE_SYNC_LIGHT : MIGRATE_ASYNC);
+		list_splice(&one, &failed);
+		if (ret < 0)
+			break;
+	}
+
+	list_splice(&failed, &cc->migratepages);
+	if (ret < 0)
+		return ret;
+	return list_empty(&cc->migratepages) ? 0 : 1;
+}
+
 static void update_nr_listpages(struct compact_control *cc)
 {
 	int nr_migratepages = 0;
@@ -568,6 +605,10 @@ static int compact_finished(struct zone *zone,
 	if (cc->free_pfn <= cc->migrate_pfn)
 		return COMPACT_COMPLETE;
 
+	/* Background compaction: the time budget of this run is used up */
+	if (cc->deadline.tv64 && ktime_get().tv64 >= cc->deadline.tv64)
+		return COMPACT_PARTIAL;
+
 	/*
 	 * order == -1 is expected when compacting via
 	 * /proc/sys/vm/compact_memory
@@ -666,6 +707,15 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 	cc->free_pfn = cc->migrate_pfn + zone->spanned_pages;
 	cc->free_pfn &= ~(pageblock_nr_pages-1);
 
+	/* Pick up where the last incremental run in this zone stopped */
+	if (cc->incremental &&
+	    zone->compact_cached_free_pfn > zone->compact_cached_migrate_pfn &&
+	    zone->compact_cached_migrate_pfn >= cc->migrate_pfn &&
+	    zone->compact_cached_free_pfn <= cc->free_pfn) {
+		cc->migrate_pfn = zone->compact_cached_migrate_pfn;
+		cc->free_pfn = zone->compact_cached_free_pfn;
+	}
+
 	migrate_prep_local();
 
 	while ((ret = compact_finished(zone, cc)) == COMPACT_CONTINUE) {
@@ -683,7 +733,10 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 		}
 
 		nr_migrate = cc->nr_migratepages;
-		err = migrate_pages(&cc->migratepages, compaction_alloc,
+		if (cc->deadline.tv64)
+			err = migrate_pages_deadline(cc);
+		else
+			err = migrate_pages(&cc->migratepages, compaction_alloc,
 				(unsigned long)cc, false,
 				cc->sync ? MIGRATE_SYNC_LIGHT : MIGRATE_ASYNC);
 		update_nr_listpages(cc);
@@ -712,6 +765,16 @@ out:
 	cc->nr_freepages -= release_freepages(&cc->freepages);
 	VM_BUG_ON(cc->nr_freepages != 0);
 
+	if (cc->incremental) {
+		if (ret == COMPACT_COMPLETE) {
+			zone->compact_cached_migrate_pfn = 0;
+			zone->compact_cached_free_pfn = 0;
+		} else {
+			zone->compact_cached_migrate_pfn = cc->migrate_pfn;
+			zone->compact_cached_free_pfn = cc->free_pfn;
+		}
+	}
+
 	return ret;
 }
 
@@ -735,6 +798,38 @@ static unsigned long compact_zone_order(struct zone *zone,
 
 int sysctl_extfrag_threshold = 500;
 
+/* Latency buckets: [0,1ms), [1ms,2ms), [2ms,4ms) ... [256ms,512ms), >=512ms */
+#define COMPACT_LAT_BUCKETS	11
+
+struct compact_latency {
+	unsigned long		count;
+	u64			total_us;
+	u64			max_us;
+	unsigned long		hist[COMPACT_LAT_BUCKETS];
+};
+
+static struct compact_latency direct_latency;
+static struct compact_latency kcompactd_latency;
+static DEFINE_SPINLOCK(compact_latency_lock);
+
+static void compact_latency_add(struct compact_latency *lat, ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	unsigned long ms = div_u64(us, USEC_PER_MSEC);
+	int bucket = 0;
+
+	if (ms)
+		bucket = min_t(int, ilog2(ms) + 1, COMPACT_LAT_BUCKETS - 1);
+
+	spin_lock(&compact_latency_lock);
+	lat->count++;
+	lat->total_us += us;
+	if (us > lat->max_us)
+		lat->max_us = us;
+	lat->hist[bucket]++;
+	spin_unlock(&compact_latency_lock);
+}
+
 /**
  * try_to_compact_pages - Direct compact to satisfy a high-order allocation
  * @zonelist: The zonelist used for the current allocation
@@ -755,6 +850,7 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 	struct zoneref *z;
 	struct zone *zone;
 	int rc = COMPACT_SKIPPED;
+	ktime_t start;
 
 	/*
 	 * Check whether it is worth even starting compaction. The order check is
@@ -765,6 +861,7 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 		return rc;
 
 	count_vm_event(COMPACTSTALL);
+	start = ktime_get();
 
 	/* Compact each zone in the list */
 	for_each_zone_zonelist_nodemask(zone, z, zonelist, high_zoneidx,
@@ -779,6 +876,7 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 			break;
 	}
 
+	compact_latency_add(&direct_latency, start);
 	return rc;
 }
 
@@ -821,16 +919,6 @@ static int __compact_pgdat(pg_data_t *pgdat, struct compact_control *cc)
 	return 0;
 }
 
-int compact_pgdat(pg_data_t *pgdat, int order)
-{
-	struct compact_control cc = {
-		.order = order,
-		.sync = false,
-	};
-
-	return __compact_pgdat(pgdat, &cc);
-}
-
 static int compact_node(int nid)
 {
 	struct compact_control cc = {
@@ -903,4 +991,287 @@ void compaction_unregister_node(struct node *node)
 }
 #endif /* CONFIG_SYSFS && CONFIG_NUMA */
 
+/*
+ * kcompactd: per-node background compaction.
+ *
+ * kcompactd is woken by allocations that fall short of free pages of some
+ * order, and by kswapd with the proactive sysctl_kcompactd_order before it
+ * goes to sleep.  It compacts only the zones whose fragmentation index is
+ * above sysctl_extfrag_threshold, see compaction_suitable(), and gives up
+ * on a zone for a while when a full pass did not help, like direct
+ * compaction does.
+ *
+ * Each run is limited to sysctl_kcompactd_budget_ms, checked between the
+ * migration of single pages, and runs start at least KCOMPACTD_PERIOD
+ * apart.  A run that uses up its budget remembers where the scanners
+ * stopped in the zone, and the next run continues from there.
+ * Writing 0 to the budget stops kcompactd and brings back direct
+ * compaction for __GFP_NORETRY allocations.
+ */
+#define KCOMPACTD_PERIOD	HZ
+
+int sysctl_kcompactd_budget_ms = 10;
+int sysctl_kcompactd_order = PAGE_ALLOC_COSTLY_ORDER;
+
+static bool kcompactd_node_suitable(pg_data_t *pgdat, int order,
+				    enum zone_type classzone_idx)
+{
+	int zoneid;
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone),
+				      0, 0))
+			continue;
+		if (compaction_suitable(zone, order) == COMPACT_CONTINUE)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * wakeup_kcompactd - ask kcompactd to compact a node in the background
+ * @pgdat: node to compact
+ * @order: order the caller is short of, 0 for the proactive order alone
+ * @classzone_idx: highest zone to compact
+ */
+void wakeup_kcompactd(pg_data_t *pgdat, int order,
+		      enum zone_type classzone_idx)
+{
+	if (!kcompactd_enabled())
+		return;
+
+	order = max(order, sysctl_kcompactd_order);
+	if (!order)
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+	if (pgdat->kcompactd_classzone_idx < classzone_idx)
+		pgdat->kcompactd_classzone_idx = classzone_idx;
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+	if (!kcompactd_node_suitable(pgdat, order, classzone_idx))
+		return;
+
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+/*
+ * Compact the node for the order kcompactd was woken with.  Returns false
+ * if there was nothing to do, true if some of the budget was spent.
+ */
+static bool kcompactd_do_work(pg_data_t *pgdat)
+{
+	int order = pgdat->kcompactd_max_order;
+	enum zone_type classzone_idx = pgdat->kcompactd_classzone_idx;
+	struct compact_control cc = {
+		.order = order,
+		.migratetype = MIGRATE_MOVABLE,
+		.sync = true,
+		.incremental = true,
+	};
+	bool exhausted = false;
+	ktime_t start;
+	int zoneid;
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = 0;
+
+	if (!order || !kcompactd_node_suitable(pgdat, order, classzone_idx))
+		return false;
+
+	count_vm_event(KCOMPACTD_WAKE);
+	start = ktime_get();
+	cc.deadline = ktime_add_ns(start,
+			(u64)sysctl_kcompactd_budget_ms * NSEC_PER_MSEC);
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+		int status;
+
+		if (!populated_zone(zone))
+			continue;
+		if (compaction_deferred(zone, order))
+			continue;
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone),
+				      0, 0))
+			continue;
+
+		cc.nr_freepages = 0;
+		cc.nr_migratepages = 0;
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		status = compact_zone(zone, &cc);
+
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone),
+				      0, 0)) {
+			zone->compact_considered = 0;
+			zone->compact_defer_shift = 0;
+			if (order >= zone->compact_order_failed)
+				zone->compact_order_failed = order + 1;
+			count_vm_event(KCOMPACTD_SUCCESS);
+		} else if (status == COMPACT_COMPLETE) {
+			/* A whole pass did not help: back off for a while */
+			defer_compaction(zone, order);
+			count_vm_event(KCOMPACTD_FAIL);
+		}
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+
+		if (ktime_get().tv64 >= cc.deadline.tv64) {
+			exhausted = kcompactd_node_suitable(pgdat, order,
+							    classzone_idx);
+			break;
+		}
+	}
+
+	compact_latency_add(&kcompactd_latency, start);
+
+	if (exhausted) {
+		count_vm_event(KCOMPACTD_BUDGET_EXHAUSTED);
+		/* Come back for the rest */
+		if (pgdat->kcompactd_max_order < order)
+			pgdat->kcompactd_max_order = order;
+		if (pgdat->kcompactd_classzone_idx < classzone_idx)
+			pgdat->kcompactd_classzone_idx = classzone_idx;
+	}
+	return true;
+}
+
+static bool kcompactd_work_requested(pg_data_t *pgdat)
+{
+	return kthread_should_stop() || pgdat->kcompactd_max_order > 0;
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		unsigned long period_end;
+		long left;
+
+		wait_event_freezable(pgdat->kcompactd_wait,
+				     kcompactd_work_requested(pgdat));
+
+		/* One budget per period: later wakeups wait for the next one */
+		period_end = jiffies + KCOMPACTD_PERIOD;
+		if (!kcompactd_do_work(pgdat))
+			continue;
+		left = (long)(period_end - jiffies);
+		if (left > 0)
+			wait_event_freezable_timeout(pgdat->kcompactd_wait,
+						     kthread_should_stop(),
+						     left);
+	}
+
+	return 0;
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		pr_err("Failed to start kcompactd on node %d\n", nid);
+		ret = PTR_ERR(pgdat->kcompactd);
+		pgdat->kcompactd = NULL;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.  Caller must
+ * hold lock_memory_hotplug().
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+module_init(kcompactd_init)
+
+#ifdef CONFIG_DEBUG_FS
+static void compact_latency_show(struct seq_file *m, const char *name,
+				 struct compact_latency *lat)
+{
+	struct compact_latency snap;
+	int i;
+
+	spin_lock(&compact_latency_lock);
+	snap = *lat;
+	spin_unlock(&compact_latency_lock);
+
+	seq_printf(m, "%s: runs %lu total_us %llu max_us %llu\n", name,
+		   snap.count, (unsigned long long)snap.total_us,
+		   (unsigned long long)snap.max_us);
+	seq_puts(m, "  latency ms:");
+	for (i = 0; i < COMPACT_LAT_BUCKETS - 1; i++)
+		seq_printf(m, " <%d:%lu", 1 << i, snap.hist[i]);
+	seq_printf(m, " >=%d:%lu\n", 1 << (i - 1), snap.hist[i]);
+}
+
+static int compaction_latency_show(struct seq_file *m, void *v)
+{
+	compact_latency_show(m, "direct", &direct_latency);
+	compact_latency_show(m, "kcompactd", &kcompactd_latency);
+	return 0;
+}
+
+static int compaction_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, compaction_latency_show, NULL);
+}
+
+static const struct file_operations compaction_latency_fops = {
+	.open		= compaction_latency_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init compaction_debugfs_init(void)
+{
+	debugfs_create_file("compaction_latency", S_IRUSR, NULL, NULL,
+			    &compaction_latency_fops);
+	return 0;
+}
+late_initcall(compaction_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
+
 #endif /* CONFIG_COMPACTION */
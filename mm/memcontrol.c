@@ -39,6 +39,7 @@
 #include <linux/slab.h>
 #include <linux/swap.h>
 #include <linux/swapops.h>
+#include <linux/shmem_fs.h>
 #include <linux/spinlock.h>
 #include <linux/eventfd.h>
 #include <linux/sort.h>
@@ -273,6 +274,8 @@ struct mem_cgroup {
 	atomic_t	refcnt;
 
 	int	swappiness;
+	/* swappiness in global reclaim, -1 to follow vm_swappiness */
+	int	global_swappiness;
 	/* OOM-Killer disable */
 	int		oom_kill_disable;
 
@@ -1292,6 +1295,21 @@ int mem_cgroup_swappiness(struct mem_cgroup *memcg)
 	return memcg->swappiness;
 }
 
+/*
+ * Swappiness applied to the group's pages during global reclaim: the
+ * group's global_swappiness if set, vm_swappiness otherwise.
+ */
+int mem_cgroup_global_swappiness(struct mem_cgroup *memcg)
+{
+	int swappiness;
+
+	if (!memcg)
+		return vm_swappiness;
+
+	swappiness = ACCESS_ONCE(memcg->global_swappiness);
+	return swappiness < 0 ? vm_swappiness : swappiness;
+}
+
 /*
  * memcg->moving_account is used for checking possibility that some thread is
  * calling move_account(). When a thread on CPU-A starts moving pages under
@@ -4282,6 +4300,26 @@ static int mem_cgroup_swappiness_write(struct cgroup *cgrp, struct cftype *cft,
 	return 0;
 }
 
+static s64 mem_cgroup_global_swappiness_read(struct cgroup *cgrp,
+					     struct cftype *cft)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+
+	return memcg->global_swappiness;
+}
+
+static int mem_cgroup_global_swappiness_write(struct cgroup *cgrp,
+					      struct cftype *cft, s64 val)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+
+	if (val < -1 || val > 100)
+		return -EINVAL;
+
+	memcg->global_swappiness = val;
+	return 0;
+}
+
 static void __mem_cgroup_threshold(struct mem_cgroup *memcg, bool swap)
 {
 	struct mem_cgroup_threshold_ary *t;
@@ -4716,6 +4754,11 @@ static struct cftype mem_cgroup_files[] = {
 		.read_u64 = mem_cgroup_swappiness_read,
 		.write_u64 = mem_cgroup_swappiness_write,
 	},
+	{
+		.name = "global_swappiness",
+		.read_s64 = mem_cgroup_global_swappiness_read,
+		.write_s64 = mem_cgroup_global_swappiness_write,
+	},
 	{
 		.name = "move_charge_at_immigrate",
 		.read_u64 = mem_cgroup_move_charge_read,
@@ -5027,6 +5070,7 @@ mem_cgroup_create(struct cgroup *cont)
 
 	if (parent)
 		memcg->swappiness = mem_cgroup_swappiness(parent);
+	memcg->global_swappiness = -1;
 	atomic_set(&memcg->refcnt, 1);
 	memcg->move_charge_at_immigrate = 0;
 	mutex_init(&memcg->thresholds_lock);
@@ -5215,16 +5259,20 @@ static struct page *mc_handle_file_pte(struct vm_area_struct *vma,
 		pgoff = pte_to_pgoff(ptent);
 
 	/* page is moved even if it's not RSS of this task(page-faulted). */
-	page = find_get_page(mapping, pgoff);
-
 #ifdef CONFIG_SWAP
 	/* shmem/tmpfs may report page out on swap: account for that too. */
-	if (radix_tree_exceptional_entry(page)) {
-		swp_entry_t swap = radix_to_swp_entry(page);
-		if (do_swap_account)
-			*entry = swap;
-		page = find_get_page(&swapper_space, swap.val);
-	}
+	if (shmem_mapping(mapping)) {
+		page = find_get_entry(mapping, pgoff);
+		if (radix_tree_exceptional_entry(page)) {
+			swp_entry_t swap = radix_to_swp_entry(page);
+			if (do_swap_account)
+				*entry = swap;
+			page = find_get_page(&swapper_space, swap.val);
+		}
+	} else
+		page = find_get_page(mapping, pgoff);
+#else
+	page = find_get_page(mapping, pgoff);
 #endif
 	return page;
 }
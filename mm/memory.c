@@ -2942,6 +2942,7 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	pte_t pte;
 	int locked;
 	struct mem_cgroup *ptr;
+	ktime_t swapin_start = ktime_set(0, 0);
 	int exclusive = 0;
 	int ret = 0;
 
@@ -2964,7 +2965,12 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	page = lookup_swap_cache(entry);
 	if (!page) {
 		grab_swap_token(mm); /* Contend for token _before_ read-in */
-		page = swapin_readahead(entry,
+		swapin_start = ktime_get();
+		if (swap_use_vma_readahead())
+			page = swap_vma_readahead(entry,
+					GFP_HIGHUSER_MOVABLE, vma, address);
+		else
+			page = swapin_readahead(entry,
 					GFP_HIGHUSER_MOVABLE, vma, address);
 		if (!page) {
 			/*
@@ -2999,6 +3005,10 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		goto out_release;
 	}
 
+	/* Swapin (decompression, for zram) counts as anon reclaim cost */
+	if (ret & VM_FAULT_MAJOR)
+		lru_note_cost(page, 0, ktime_us_delta(ktime_get(), swapin_start));
+
 	/*
 	 * Make sure try_to_free_swap or reuse_swap_page or swapoff did not
 	 * release the swapcache from under us.  The page pin, and pte_same
@@ -29,6 +29,7 @@
 #include <linux/suspend.h>
 #include <linux/mm_inline.h>
 #include <linux/firmware-map.h>
+#include <linux/compaction.h>
 
 #include <asm/tlbflush.h>
 
@@ -527,8 +528,10 @@ int __ref online_pages(unsigned long pfn, unsigned long nr_pages)
 
 	init_per_zone_wmark_min();
 
-	if (onlined_pages)
+	if (onlined_pages) {
 		kswapd_run(zone_to_nid(zone));
+		kcompactd_run(zone_to_nid(zone));
+	}
 
 	vm_total_pages = nr_free_pagecache_pages();
 
@@ -972,6 +975,7 @@ repeat:
 	if (!node_present_pages(node)) {
 		node_clear_state(node, N_HIGH_MEMORY);
 		kswapd_stop(node);
+		kcompactd_stop(node);
 	}
 
 	vm_total_pages = nr_free_pagecache_pages();
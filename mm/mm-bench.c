@@ -0,0 +1,593 @@
+/*
+ * mm/mm-bench.c
+ *
+ * Allocator benchmarks, run when the module is loaded.  The "tests"
+ * parameter selects some of them, all run by default:
+ *
+ * vmalloc:	throughput of vmalloc/vfree and vmap/vunmap of
+ *		"vmalloc_pages" pages, for "seconds" on two CPUs at once so
+ *		that contention on the vmap area allocator shows up.
+ *
+ * page_alloc:	cost per page of order-0 pages allocated in batches of
+ *		several sizes, with an alloc_page() loop and with
+ *		alloc_pages_bulk(), and of blocks of each order up to
+ *		"max_order" with alloc_pages().  Each test goes through
+ *		"pages" pages.
+ *
+ * slab:	cost per object of kmem_cache_alloc()/kmem_cache_free() and
+ *		of kmem_cache_alloc_bulk()/kmem_cache_free_bulk() with "bulk"
+ *		objects per call, for several object sizes.  Each test
+ *		allocates "objects" objects, then frees them all.
+ *
+ *	# modprobe mm-bench tests=page_alloc,slab
+ *	mm-bench: page_alloc: batch 1: alloc_page 180 ns, alloc_pages_bulk 175 ns
+ *	mm-bench: page_alloc: batch 32: alloc_page 170 ns, alloc_pages_bulk 90 ns
+ *	...
+ *	mm-bench: slab: 64 single: alloc 98 cycles 81 ns, free 112 cycles 93 ns
+ *	mm-bench: slab: 64 bulk16: alloc 41 cycles 34 ns, free 52 cycles 43 ns
+ *	...
+ *
+ * The page_alloc and slab tests run on one CPU, so they measure the
+ * per-cpu page lists and cpu slabs rather than lock contention.  Slab
+ * cycles come from get_cycles() where the architecture implements it;
+ * elsewhere, ARM included, they are estimated from the elapsed time and
+ * the cpufreq frequency of the CPU.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) "mm-bench: " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/cpufreq.h>
+#include <linux/gfp.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/mmzone.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/timex.h>
+#include <linux/vmalloc.h>
+
+static char *tests;
+module_param(tests, charp, 0444);
+MODULE_PARM_DESC(tests, "comma separated tests to run: vmalloc, page_alloc, slab");
+
+static unsigned int seconds = 5;
+module_param(seconds, uint, 0444);
+MODULE_PARM_DESC(seconds, "vmalloc: duration of each test in seconds");
+
+static unsigned int vmalloc_pages = 1;
+module_param(vmalloc_pages, uint, 0444);
+MODULE_PARM_DESC(vmalloc_pages, "vmalloc: size of each mapping in pages");
+
+static unsigned int pages = 16384;
+module_param(pages, uint, 0444);
+MODULE_PARM_DESC(pages, "page_alloc: number of pages allocated per test");
+
+static unsigned int max_order = 3;
+module_param(max_order, uint, 0444);
+MODULE_PARM_DESC(max_order, "page_alloc: highest order tested with alloc_pages()");
+
+static unsigned int objects = 10000;
+module_param(objects, uint, 0444);
+MODULE_PARM_DESC(objects, "slab: number of objects allocated per test");
+
+static unsigned int bulk = 16;
+module_param(bulk, uint, 0444);
+MODULE_PARM_DESC(bulk, "slab: number of objects per bulk call");
+
+/*
+ * Each test runs in kernel threads bound to CPUs of their own, started
+ * together, while module init waits for them.
+ */
+struct bench_thread {
+	int			(*fn)(struct bench_thread *bt);
+	void			*data;
+	int			cpu;
+	int			ret;
+	struct completion	done;
+};
+
+static atomic_t bench_ready;
+static DECLARE_WAIT_QUEUE_HEAD(bench_start_wait);
+
+static int bench_thread_fn(void *data)
+{
+	struct bench_thread *bt = data;
+
+	atomic_dec(&bench_ready);
+	wake_up_all(&bench_start_wait);
+	wait_event(bench_start_wait, !atomic_read(&bench_ready));
+
+	bt->ret = bt->fn(bt);
+	complete(&bt->done);
+	return 0;
+}
+
+/*
+ * Run bt[0..nr-1] on the first nr online CPUs and wait for them.  Returns
+ * how many ran, fewer than nr if there are fewer CPUs or a thread could
+ * not be created.
+ */
+static int __init bench_run_threads(struct bench_thread *bt, int nr)
+{
+	struct task_struct *tsk;
+	int cpu, i, started = 0;
+
+	atomic_set(&bench_ready, nr);
+	for_each_online_cpu(cpu) {
+		if (started == nr)
+			break;
+		bt[started].cpu = cpu;
+		init_completion(&bt[started].done);
+		tsk = kthread_create(bench_thread_fn, &bt[started],
+				     "mm-bench/%d", cpu);
+		if (IS_ERR(tsk))
+			break;
+		kthread_bind(tsk, cpu);
+		wake_up_process(tsk);
+		started++;
+	}
+
+	/* Don't leave the started threads waiting for the missing ones */
+	if (started < nr) {
+		atomic_sub(nr - started, &bench_ready);
+		wake_up_all(&bench_start_wait);
+	}
+
+	for (i = 0; i < started; i++)
+		wait_for_completion(&bt[i].done);
+	return started;
+}
+
+static int __init bench_run_one(int (*fn)(struct bench_thread *bt),
+				void *data)
+{
+	struct bench_thread bt = {
+		.fn	= fn,
+		.data	= data,
+	};
+
+	if (!bench_run_threads(&bt, 1))
+		return -ENOMEM;
+	return bt.ret;
+}
+
+/* vmalloc */
+
+#define VMALLOC_NR_THREADS	2
+
+struct vmalloc_thread {
+	bool			vmap;
+	struct page		**pages;
+	unsigned long		ops;
+	unsigned long		elapsed;	/* jiffies */
+};
+
+static int vmalloc_one(struct vmalloc_thread *vt)
+{
+	void *p;
+
+	if (vt->vmap) {
+		p = vmap(vt->pages, vmalloc_pages, VM_MAP, PAGE_KERNEL);
+		if (!p)
+			return -ENOMEM;
+		vunmap(p);
+	} else {
+		p = vmalloc(vmalloc_pages * PAGE_SIZE);
+		if (!p)
+			return -ENOMEM;
+		vfree(p);
+	}
+	return 0;
+}
+
+static int vmalloc_thread_fn(struct bench_thread *bt)
+{
+	struct vmalloc_thread *vt = bt->data;
+	unsigned long start, end;
+	int ret = 0;
+
+	start = jiffies;
+	end = start + seconds * HZ;
+	while (time_before(jiffies, end)) {
+		ret = vmalloc_one(vt);
+		if (ret)
+			break;
+		vt->ops++;
+		cond_resched();
+	}
+	vt->elapsed = jiffies - start;
+	return ret;
+}
+
+static int __init vmalloc_run(bool vmap, struct page **map_pages)
+{
+	struct bench_thread bt[VMALLOC_NR_THREADS];
+	struct vmalloc_thread vt[VMALLOC_NR_THREADS];
+	int i, nr;
+
+	memset(bt, 0, sizeof(bt));
+	memset(vt, 0, sizeof(vt));
+	for (i = 0; i < VMALLOC_NR_THREADS; i++) {
+		vt[i].vmap = vmap;
+		vt[i].pages = map_pages;
+		bt[i].fn = vmalloc_thread_fn;
+		bt[i].data = &vt[i];
+	}
+
+	nr = bench_run_threads(bt, VMALLOC_NR_THREADS);
+	if (!nr)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		unsigned long ms = jiffies_to_msecs(vt[i].elapsed) ?: 1;
+
+		pr_info("vmalloc: %s cpu%d %lu ops/s%s\n",
+			vmap ? "vmap/vunmap" : "vmalloc/vfree", bt[i].cpu,
+			(unsigned long)div_u64((u64)vt[i].ops * MSEC_PER_SEC,
+					       ms),
+			bt[i].ret ? " (allocation failed)" : "");
+	}
+	return 0;
+}
+
+static int __init vmalloc_bench(void)
+{
+	struct page **map_pages;
+	unsigned int i;
+	int ret = -ENOMEM;
+
+	if (!vmalloc_pages || !seconds)
+		return -EINVAL;
+
+	map_pages = kcalloc(vmalloc_pages, sizeof(*map_pages), GFP_KERNEL);
+	if (!map_pages)
+		return -ENOMEM;
+	for (i = 0; i < vmalloc_pages; i++) {
+		map_pages[i] = alloc_page(GFP_KERNEL);
+		if (!map_pages[i])
+			goto out;
+	}
+
+	pr_info("vmalloc: %u page(s), %u s per test\n", vmalloc_pages,
+		seconds);
+	ret = vmalloc_run(false, map_pages);
+	if (!ret)
+		ret = vmalloc_run(true, map_pages);
+out:
+	for (i = 0; i < vmalloc_pages && map_pages[i]; i++)
+		__free_page(map_pages[i]);
+	kfree(map_pages);
+	return ret;
+}
+
+/* page_alloc */
+
+static const unsigned int page_alloc_batches[] = { 1, 8, 16, 32, 64, 128 };
+#define PAGE_ALLOC_MAX_BATCH	128
+
+/* Returns the alloc+free time per page in ns, or 0 if allocation failed */
+static u64 page_alloc_batch(struct page **pagev, unsigned int batch,
+			    bool bulk)
+{
+	unsigned int done, nr, i;
+	ktime_t start;
+
+	start = ktime_get();
+	for (done = 0; done < pages; done += batch) {
+		if (bulk) {
+			nr = alloc_pages_bulk(GFP_KERNEL, batch, pagev);
+		} else {
+			for (nr = 0; nr < batch; nr++) {
+				pagev[nr] = alloc_page(GFP_KERNEL);
+				if (!pagev[nr])
+					break;
+			}
+		}
+		for (i = 0; i < nr; i++)
+			__free_page(pagev[i]);
+		if (nr < batch)
+			return 0;
+	}
+	return div_u64(ktime_to_ns(ktime_sub(ktime_get(), start)), done) ?: 1;
+}
+
+static u64 page_alloc_order(unsigned int order)
+{
+	unsigned int done;
+	struct page *page;
+	ktime_t start;
+
+	start = ktime_get();
+	for (done = 0; done < pages; done += 1 << order) {
+		page = alloc_pages(GFP_KERNEL, order);
+		if (!page)
+			return 0;
+		__free_pages(page, order);
+	}
+	return div_u64(ktime_to_ns(ktime_sub(ktime_get(), start)), done) ?: 1;
+}
+
+static int page_alloc_thread_fn(struct bench_thread *bt)
+{
+	struct page **pagev = bt->data;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(page_alloc_batches); i++) {
+		unsigned int batch = page_alloc_batches[i];
+		u64 single, bulk;
+
+		single = page_alloc_batch(pagev, batch, false);
+		cond_resched();
+		bulk = page_alloc_batch(pagev, batch, true);
+		cond_resched();
+		if (!single || !bulk)
+			goto fail;
+		pr_info("page_alloc: batch %u: alloc_page %llu ns, alloc_pages_bulk %llu ns\n",
+			batch, single, bulk);
+	}
+
+	for (i = 0; i <= max_order; i++) {
+		u64 ns = page_alloc_order(i);
+
+		cond_resched();
+		if (!ns)
+			goto fail;
+		pr_info("page_alloc: order %u: %llu ns per page\n", i, ns);
+	}
+	return 0;
+fail:
+	pr_info("page_alloc: allocation failed\n");
+	return -ENOMEM;
+}
+
+static int __init page_alloc_bench(void)
+{
+	struct page **pagev;
+	int ret;
+
+	if (!pages || max_order >= MAX_ORDER)
+		return -EINVAL;
+
+	pagev = kcalloc(PAGE_ALLOC_MAX_BATCH, sizeof(*pagev), GFP_KERNEL);
+	if (!pagev)
+		return -ENOMEM;
+
+	pr_info("page_alloc: %u pages per test\n", pages);
+	ret = bench_run_one(page_alloc_thread_fn, pagev);
+
+	kfree(pagev);
+	return ret;
+}
+
+/* slab */
+
+static const unsigned int slab_sizes[] = { 16, 64, 128, 256, 512, 1024 };
+static const char * const slab_names[] = {
+	"mm-bench-16", "mm-bench-64", "mm-bench-128",
+	"mm-bench-256", "mm-bench-512", "mm-bench-1024",
+};
+
+struct slab_time {
+	ktime_t		wall;
+	cycles_t	cycles;
+};
+
+struct slab_result {
+	u64		ns;
+	u64		cycles;
+};
+
+struct slab_state {
+	struct kmem_cache	*cache;
+	unsigned int		size;
+	void			**objs;
+	struct slab_result	alloc[2];	/* single, bulk */
+	struct slab_result	free[2];
+};
+
+/*
+ * SLUB would merge the test caches into the kmalloc caches of the same
+ * size, whose objects other users allocate and free concurrently.  It
+ * never merges a cache with SLAB_NOLEAKTRACE, which unlike the debug
+ * flags leaves the fast paths and the object layout alone (a constructor
+ * would move the free pointer out of the object): the test objects are
+ * freed before the test returns, kmemleak has nothing to track in them.
+ */
+#define SLAB_BENCH_FLAGS	SLAB_NOLEAKTRACE
+
+static void slab_stamp(struct slab_time *t)
+{
+	t->wall = ktime_get();
+	t->cycles = get_cycles();
+}
+
+static void slab_account(struct slab_result *r, struct slab_time *start,
+			 struct slab_time *end)
+{
+	u64 ns = ktime_to_ns(ktime_sub(end->wall, start->wall));
+	u64 cycles = end->cycles - start->cycles;
+
+	if (!cycles)
+		cycles = div_u64(ns * cpufreq_quick_get(raw_smp_processor_id()),
+				 USEC_PER_SEC);
+	r->ns += ns;
+	r->cycles += cycles;
+}
+
+static int slab_single(struct slab_state *ss)
+{
+	struct slab_time t0, t1, t2;
+	unsigned int i;
+
+	slab_stamp(&t0);
+	for (i = 0; i < objects; i++) {
+		ss->objs[i] = kmem_cache_alloc(ss->cache, GFP_KERNEL);
+		if (!ss->objs[i])
+			break;
+	}
+	slab_stamp(&t1);
+	if (i < objects) {
+		while (i--)
+			kmem_cache_free(ss->cache, ss->objs[i]);
+		return -ENOMEM;
+	}
+	for (i = 0; i < objects; i++)
+		kmem_cache_free(ss->cache, ss->objs[i]);
+	slab_stamp(&t2);
+
+	slab_account(&ss->alloc[0], &t0, &t1);
+	slab_account(&ss->free[0], &t1, &t2);
+	return 0;
+}
+
+static int slab_bulk(struct slab_state *ss)
+{
+	struct slab_time t0, t1, t2;
+	unsigned int i, nr;
+
+	slab_stamp(&t0);
+	for (i = 0; i < objects; i += nr) {
+		nr = min(bulk, objects - i);
+		if (!kmem_cache_alloc_bulk(ss->cache, GFP_KERNEL, nr,
+					   ss->objs + i))
+			break;
+	}
+	slab_stamp(&t1);
+	if (i < objects) {
+		kmem_cache_free_bulk(ss->cache, i, ss->objs);
+		return -ENOMEM;
+	}
+	for (i = 0; i < objects; i += nr) {
+		nr = min(bulk, objects - i);
+		kmem_cache_free_bulk(ss->cache, nr, ss->objs + i);
+	}
+	slab_stamp(&t2);
+
+	slab_account(&ss->alloc[1], &t0, &t1);
+	slab_account(&ss->free[1], &t1, &t2);
+	return 0;
+}
+
+static int slab_thread_fn(struct bench_thread *bt)
+{
+	struct slab_state *ss = bt->data;
+	int ret;
+
+	/* A first round to populate the cache, then the measured one */
+	ret = slab_single(ss);
+	if (!ret) {
+		memset(ss->alloc, 0, sizeof(ss->alloc));
+		memset(ss->free, 0, sizeof(ss->free));
+		ret = slab_single(ss);
+	}
+	if (!ret)
+		ret = slab_bulk(ss);
+	return ret;
+}
+
+static void __init slab_report(struct slab_state *ss, int i,
+			       const char *name)
+{
+	pr_info("slab: %u %s: alloc %llu cycles %llu ns, free %llu cycles %llu ns\n",
+		ss->size, name,
+		div_u64(ss->alloc[i].cycles, objects),
+		div_u64(ss->alloc[i].ns, objects),
+		div_u64(ss->free[i].cycles, objects),
+		div_u64(ss->free[i].ns, objects));
+}
+
+static int __init slab_bench(void)
+{
+	struct slab_state ss;
+	char name[16];
+	unsigned int i;
+	int ret = 0;
+
+	if (!objects || !bulk)
+		return -EINVAL;
+
+	memset(&ss, 0, sizeof(ss));
+	ss.objs = vmalloc(objects * sizeof(*ss.objs));
+	if (!ss.objs)
+		return -ENOMEM;
+
+	pr_info("slab: %u objects, %u per bulk call\n", objects, bulk);
+	snprintf(name, sizeof(name), "bulk%u", bulk);
+	for (i = 0; i < ARRAY_SIZE(slab_sizes) && !ret; i++) {
+		ss.size = slab_sizes[i];
+		ss.cache = kmem_cache_create(slab_names[i], ss.size, 0,
+					     SLAB_BENCH_FLAGS, NULL);
+		if (!ss.cache) {
+			ret = -ENOMEM;
+			break;
+		}
+		memset(ss.alloc, 0, sizeof(ss.alloc));
+		memset(ss.free, 0, sizeof(ss.free));
+		ret = bench_run_one(slab_thread_fn, &ss);
+		kmem_cache_destroy(ss.cache);
+		if (ret) {
+			pr_info("slab: %u: allocation failed\n", ss.size);
+			break;
+		}
+		slab_report(&ss, 0, "single");
+		slab_report(&ss, 1, name);
+	}
+
+	vfree(ss.objs);
+	return ret;
+}
+
+static const struct {
+	const char	*name;
+	int		(*run)(void);
+} bench_tests[] __initconst = {
+	{ "vmalloc",	vmalloc_bench },
+	{ "page_alloc",	page_alloc_bench },
+	{ "slab",	slab_bench },
+};
+
+static bool __init bench_selected(const char *name)
+{
+	size_t len = strlen(name);
+	const char *p = tests;
+
+	if (!p || !*p)
+		return true;
+	while ((p = strstr(p, name)) != NULL) {
+		if ((p == tests || p[-1] == ',') &&
+		    (p[len] == '\0' || p[len] == ','))
+			return true;
+		p += len;
+	}
+	return false;
+}
+
+static int __init mm_bench_init(void)
+{
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < ARRAY_SIZE(bench_tests) && !ret; i++)
+		if (bench_selected(bench_tests[i].name))
+			ret = bench_tests[i].run();
+	return ret;
+}
+module_init(mm_bench_init);
+
+static void __exit mm_bench_exit(void)
+{
+}
+module_exit(mm_bench_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("vmalloc, page and slab allocator benchmarks");
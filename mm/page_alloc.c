@@ -2090,6 +2090,15 @@ __alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
 	if (!order)
 		return NULL;
 
+	/*
+	 * Callers that can fall back to a smaller allocation do not stall
+	 * in direct compaction: kcompactd was woken for this request and
+	 * defragments the node in the background instead.
+	 */
+	if ((gfp_mask & (__GFP_NORETRY | __GFP_NO_KSWAPD)) == __GFP_NORETRY &&
+	    kcompactd_enabled())
+		return NULL;
+
 	if (compaction_deferred(preferred_zone, order)) {
 		*deferred_compaction = true;
 		return NULL;
@@ -2248,8 +2257,12 @@ void wake_all_kswapd(unsigned int order, struct zonelist *zonelist,
 	struct zoneref *z;
 	struct zone *zone;
 
-	for_each_zone_zonelist(zone, z, zonelist, high_zoneidx)
+	for_each_zone_zonelist(zone, z, zonelist, high_zoneidx) {
 		wakeup_kswapd(zone, order, classzone_idx);
+		if (order)
+			wakeup_kcompactd(zone->zone_pgdat, order,
+					 classzone_idx);
+	}
 }
 
 static inline int
@@ -2552,6 +2565,121 @@ out:
 }
 EXPORT_SYMBOL(__alloc_pages_nodemask);
 
+/**
+ * alloc_pages_bulk - allocate a batch of order-0 pages
+ * @gfp_mask: GFP flags for the allocation
+ * @nr_pages: number of pages to allocate
+ * @page_array: array the pages are stored in
+ *
+ * Fills @page_array with up to @nr_pages order-0 pages.  As long as the
+ * preferred zone of the local node is comfortably above its low
+ * watermark, the pages are taken from the per-cpu list and refilled
+ * from the buddy lists with a single watermark check and a single
+ * interrupt disable for the whole batch.  Otherwise, and for whatever
+ * the fast path could not provide, pages are allocated one at a time
+ * with alloc_page() and the usual reclaim and fallback rules.
+ *
+ * Returns the number of pages stored in @page_array, which is less than
+ * @nr_pages only if alloc_page() failed.  The pages that were stored
+ * belong to the caller also on a short count.
+ */
+unsigned long alloc_pages_bulk(gfp_t gfp_mask, unsigned long nr_pages,
+			       struct page **page_array)
+{
+	enum zone_type high_zoneidx = gfp_zone(gfp_mask);
+	int migratetype = allocflags_to_migratetype(gfp_mask);
+	int cold = !!(gfp_mask & __GFP_COLD);
+	struct per_cpu_pages *pcp;
+	struct list_head *list;
+	struct zonelist *zonelist;
+	struct zone *zone;
+	struct page *page;
+	unsigned long flags;
+	unsigned long nr = 0, nr_taken = 0, i;
+
+	gfp_mask &= gfp_allowed_mask;
+
+	lockdep_trace_alloc(gfp_mask);
+
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	if (nr_pages < 2 || should_fail_alloc_page(gfp_mask, 0))
+		goto fallback;
+#ifdef CONFIG_NUMA
+	/* Leave memory policies to alloc_pages_current() */
+	if (current->mempolicy)
+		goto fallback;
+#endif
+
+	zonelist = node_zonelist(numa_node_id(), gfp_mask);
+	first_zones_zonelist(zonelist, high_zoneidx,
+			     &cpuset_current_mems_allowed, &zone);
+	if (!zone)
+		goto fallback;
+	if ((gfp_mask & __GFP_WRITE) && !zone_dirty_ok(zone))
+		goto fallback;
+	if (!zone_watermark_ok(zone, 0, low_wmark_pages(zone) + nr_pages,
+			       zone_idx(zone), 0))
+		goto fallback;
+
+	/*
+	 * Interrupts are enabled again after every per-cpu list worth of
+	 * pages so that large batches do not add to interrupt latency.
+	 */
+	while (nr_taken < nr_pages) {
+		unsigned long start = nr_taken;
+
+		local_irq_save(flags);
+		pcp = &this_cpu_ptr(zone->pageset)->pcp;
+		list = &pcp->lists[migratetype];
+		if (list_empty(list)) {
+			pcp->count += rmqueue_bulk(zone, 0,
+					clamp_t(unsigned long,
+						nr_pages - nr_taken,
+						pcp->batch, pcp->high),
+					list, migratetype, cold);
+			if (unlikely(list_empty(list))) {
+				local_irq_restore(flags);
+				break;
+			}
+		}
+
+		while (nr_taken < nr_pages && !list_empty(list)) {
+			if (cold)
+				page = list_entry(list->prev, struct page, lru);
+			else
+				page = list_entry(list->next, struct page, lru);
+
+			list_del(&page->lru);
+			pcp->count--;
+			page_array[nr_taken++] = page;
+			zone_statistics(zone, zone, gfp_mask);
+		}
+		__count_zone_vm_events(PGALLOC, zone, nr_taken - start);
+		local_irq_restore(flags);
+	}
+
+	for (i = 0; i < nr_taken; i++) {
+		page = page_array[i];
+		VM_BUG_ON(bad_range(zone, page));
+		/* A bad page is taken out of circulation, as in buffered_rmqueue */
+		if (prep_new_page(page, 0, gfp_mask))
+			continue;
+		trace_mm_page_alloc(page, 0, gfp_mask, migratetype);
+		page_array[nr++] = page;
+	}
+
+fallback:
+	while (nr < nr_pages) {
+		page = alloc_page(gfp_mask);
+		if (!page)
+			break;
+		page_array[nr++] = page;
+	}
+	return nr;
+}
+EXPORT_SYMBOL(alloc_pages_bulk);
+
 /*
  * Common helper functions.
  */
@@ -4376,6 +4504,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 	pgdat->nr_zones = 0;
 	init_waitqueue_head(&pgdat->kswapd_wait);
 	pgdat->kswapd_max_order = 0;
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat_page_cgroup_init(pgdat);
 
 	for (j = 0; j < MAX_NR_ZONES; j++) {
@@ -5676,12 +5807,14 @@ __alloc_contig_migrate_alloc(struct page *page, unsigned long private,
 }
 
 /* [start, end) must belong to a single zone. */
-static int __alloc_contig_migrate_range(unsigned long start, unsigned long end)
+static int __alloc_contig_migrate_range(unsigned long start, unsigned long end,
+					unsigned long *nr_migrated)
 {
 	/* This function is based on compact_zone() from compaction.c. */
 
 	unsigned long pfn = start;
-	unsigned int tries = 0;
+	unsigned int tries = 0, nr_listed;
+	struct page *page;
 	int ret = 0;
 
 	struct compact_control cc = {
@@ -5714,9 +5847,21 @@ static int __alloc_contig_migrate_range(unsigned long start, unsigned long end)
 			break;
 		}
 
+		nr_listed = 0;
+		list_for_each_entry(page, &cc.migratepages, lru)
+			nr_listed++;
+
 		ret = migrate_pages(&cc.migratepages,
 				    __alloc_contig_migrate_alloc,
 				    0, false, true);
+
+		/*
+		 * migrate_pages() returns the number of pages it did not
+		 * migrate: those that failed for good, which it put back,
+		 * and those left on the list to retry.
+		 */
+		if (nr_migrated && ret >= 0)
+			*nr_migrated += nr_listed - ret;
 	}
 
 	putback_lru_pages(&cc.migratepages);
@@ -5779,6 +5924,8 @@ static int __reclaim_pages(struct zone *zone, gfp_t gfp_mask, int count)
  *			#MIGRATE_MOVABLE or #MIGRATE_CMA).  All pageblocks
  *			in range must have the same migratetype and it must
  *			be either of the two.
+ * @nr_migrated:	if not NULL, incremented by the number of pages
+ *			migrated out of the range.
  *
  * The PFN range does not have to be pageblock or MAX_ORDER_NR_PAGES
  * aligned, however it's the caller's responsibility to guarantee that
@@ -5792,7 +5939,7 @@ static int __reclaim_pages(struct zone *zone, gfp_t gfp_mask, int count)
  * need to be freed with free_contig_range().
  */
 int alloc_contig_range(unsigned long start, unsigned long end,
-		       unsigned migratetype)
+		       unsigned migratetype, unsigned long *nr_migrated)
 {
 	struct zone *zone = page_zone(pfn_to_page(start));
 	unsigned long outer_start, outer_end;
@@ -5827,7 +5974,7 @@ int alloc_contig_range(unsigned long start, unsigned long end,
 	if (ret)
 		goto done;
 
-	ret = __alloc_contig_migrate_range(start, end);
+	ret = __alloc_contig_migrate_range(start, end, nr_migrated);
 	if (ret)
 		goto done;
 
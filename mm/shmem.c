@@ -391,6 +391,11 @@ static void shmem_deswap_pagevec(struct pagevec *pvec)
 	pvec->nr = j;
 }
 
+bool shmem_mapping(struct address_space *mapping)
+{
+	return mapping->backing_dev_info == &shmem_backing_dev_info;
+}
+
 /*
  * SysV IPC SHM_UNLOCK restore Unevictable pages to their evictable lists.
  */
@@ -883,7 +888,7 @@ static int shmem_getpage_gfp(struct inode *inode, pgoff_t index,
 		return -EFBIG;
 repeat:
 	swap.val = 0;
-	page = find_lock_page(mapping, index);
+	page = find_lock_entry(mapping, index);
 	if (radix_tree_exceptional_entry(page)) {
 		swap = radix_to_swp_entry(page);
 		page = NULL;
@@ -1031,7 +1036,7 @@ unacct:
 	shmem_unacct_blocks(info->flags, 1);
 failed:
 	if (swap.val && error != -EINVAL) {
-		struct page *test = find_get_page(mapping, index);
+		struct page *test = find_get_entry(mapping, index);
 		if (test && !radix_tree_exceptional_entry(test))
 			page_cache_release(test);
 		/* Have another try if the entry has changed */
@@ -2532,6 +2537,11 @@ int shmem_unuse(swp_entry_t swap, struct page *page)
 	return 0;
 }
 
+bool shmem_mapping(struct address_space *mapping)
+{
+	return false;
+}
+
 int shmem_lock(struct file *file, int lock, struct user_struct *user)
 {
 	return 0;
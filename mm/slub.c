@@ -2433,12 +2433,16 @@ EXPORT_SYMBOL(kmem_cache_alloc_node_trace);
  * So we still attempt to reduce cache line usage. Just take the slab
  * lock and free the item. If there is no additional partial page
  * handling required then we can return immediately.
+ *
+ * @head to @tail is a freelist of @cnt objects, all in @page, that is
+ * spliced into the slab as a whole.  It is a single object unless called
+ * from kmem_cache_free_bulk(), which does not use this for debug caches.
  */
 static void __slab_free(struct kmem_cache *s, struct page *page,
-			void *x, unsigned long addr)
+			void *head, void *tail, int cnt, unsigned long addr)
 {
 	void *prior;
-	void **object = (void *)x;
+	void **object = head;
 	int was_frozen;
 	int inuse;
 	struct page new;
@@ -2448,16 +2452,16 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 
 	stat(s, FREE_SLOWPATH);
 
-	if (kmem_cache_debug(s) && !free_debug_processing(s, page, x, addr))
+	if (kmem_cache_debug(s) && !free_debug_processing(s, page, head, addr))
 		return;
 
 	do {
 		prior = page->freelist;
 		counters = page->counters;
-		set_freepointer(s, object, prior);
+		set_freepointer(s, tail, prior);
 		new.counters = counters;
 		was_frozen = new.frozen;
-		new.inuse--;
+		new.inuse -= cnt;
 		if ((!new.inuse || !prior) && !was_frozen && !n) {
 
 			if (!kmem_cache_debug(s) && !prior)
@@ -2558,16 +2562,18 @@ slab_empty:
  *
  * If fastpath is not possible then fall back to __slab_free where we deal
  * with all sorts of special processing.
+ *
+ * do_slab_free() frees the @cnt objects of the freelist @head to @tail in
+ * one go; the free hooks must have been run on all of them already.
  */
-static __always_inline void slab_free(struct kmem_cache *s,
-			struct page *page, void *x, unsigned long addr)
+static __always_inline void do_slab_free(struct kmem_cache *s,
+			struct page *page, void *head, void *tail, int cnt,
+			unsigned long addr)
 {
-	void **object = (void *)x;
+	void **object = head;
 	struct kmem_cache_cpu *c;
 	unsigned long tid;
 
-	slab_free_hook(s, x);
-
 redo:
 	/*
 	 * Determine the currently cpus per cpu slab.
@@ -2581,7 +2587,7 @@ redo:
 	barrier();
 
 	if (likely(page == c->page)) {
-		set_freepointer(s, object, c->freelist);
+		set_freepointer(s, tail, c->freelist);
 
 		if (unlikely(!this_cpu_cmpxchg_double(
 				s->cpu_slab->freelist, s->cpu_slab->tid,
@@ -2593,10 +2599,17 @@ redo:
 		}
 		stat(s, FREE_FASTPATH);
 	} else
-		__slab_free(s, page, x, addr);
+		__slab_free(s, page, head, tail, cnt, addr);
 
 }
 
+static __always_inline void slab_free(struct kmem_cache *s,
+			struct page *page, void *x, unsigned long addr)
+{
+	slab_free_hook(s, x);
+	do_slab_free(s, page, x, x, 1, addr);
+}
+
 void kmem_cache_free(struct kmem_cache *s, void *x)
 {
 	struct page *page;
@@ -2609,6 +2622,175 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+struct detached_freelist {
+	struct page *page;
+	void *head;
+	void *tail;
+	int cnt;
+};
+
+/*
+ * Link the last unprocessed object of @p and the other objects of its slab
+ * found before it into a freelist that is detached from any slab, so that
+ * it can be handed back with one cmpxchg.  Objects taken are set to NULL
+ * in @p.  The search gives up after a few objects from other slabs.
+ *
+ * Returns the number of entries of @p that remain to be processed.
+ */
+static size_t build_detached_freelist(struct kmem_cache *s, size_t size,
+				      void **p, struct detached_freelist *df)
+{
+	size_t first_skipped = 0;
+	int lookahead = 3;
+	void *object;
+
+	df->page = NULL;
+
+	do {
+		object = p[--size];
+	} while (!object && size);
+
+	if (!object)
+		return 0;
+
+	df->page = virt_to_head_page(object);
+	set_freepointer(s, object, NULL);
+	df->head = object;
+	df->tail = object;
+	df->cnt = 1;
+	p[size] = NULL;
+
+	while (size) {
+		object = p[--size];
+		if (!object)
+			continue;
+
+		if (virt_to_head_page(object) == df->page) {
+			set_freepointer(s, object, df->head);
+			df->head = object;
+			df->cnt++;
+			p[size] = NULL;
+			continue;
+		}
+
+		if (!--lookahead)
+			break;
+		if (!first_skipped)
+			first_skipped = size + 1;
+	}
+
+	return first_skipped;
+}
+
+/**
+ * kmem_cache_free_bulk - free an array of objects
+ * @s: the cache the objects were allocated from
+ * @size: number of objects in @p
+ * @p: the objects; the array is clobbered
+ *
+ * Objects are grouped by the slab they belong to and each group goes
+ * back with a single cmpxchg, either onto the cpu freelist or into its
+ * slab.  A full slab that becomes partially free this way is moved to
+ * the cpu partial list once instead of once per object.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	size_t i;
+
+	if (unlikely(!size))
+		return;
+
+	for (i = 0; i < size; i++) {
+		slab_free_hook(s, p[i]);
+		trace_kmem_cache_free(_RET_IP_, p[i]);
+	}
+
+	if (kmem_cache_debug(s)) {
+		for (i = 0; i < size; i++)
+			do_slab_free(s, virt_to_head_page(p[i]), p[i], p[i],
+				     1, _RET_IP_);
+		return;
+	}
+
+	do {
+		struct detached_freelist df;
+
+		size = build_detached_freelist(s, size, p, &df);
+		if (df.page)
+			do_slab_free(s, df.page, df.head, df.tail, df.cnt,
+				     _RET_IP_);
+	} while (size);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
+/**
+ * kmem_cache_alloc_bulk - allocate an array of objects
+ * @s: the cache to allocate from
+ * @flags: GFP flags for the allocation
+ * @size: number of objects to allocate
+ * @p: array the objects are stored in
+ *
+ * Objects are taken straight off the cpu freelist with interrupts
+ * disabled, without a cmpxchg per object, and the freelist is refilled
+ * through the slow path as often as needed.
+ *
+ * Returns @size, or 0 if not all objects could be allocated, in which
+ * case nothing is allocated.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			  void **p)
+{
+	struct kmem_cache_cpu *c;
+	size_t i;
+
+	if (slab_pre_alloc_hook(s, flags))
+		return 0;
+
+	local_irq_disable();
+	c = this_cpu_ptr(s->cpu_slab);
+
+	for (i = 0; i < size; i++) {
+		void *object = c->freelist;
+
+		if (unlikely(!object)) {
+			/*
+			 * Bump the tid so that a fastpath on this cpu that we
+			 * interrupted fails its cmpxchg, then go the slow
+			 * way, which may enable interrupts to get a new slab.
+			 */
+			c->tid = next_tid(c->tid);
+			p[i] = __slab_alloc(s, flags, NUMA_NO_NODE, _RET_IP_, c);
+			if (unlikely(!p[i]))
+				goto error;
+
+			c = this_cpu_ptr(s->cpu_slab);
+			continue;
+		}
+		c->freelist = get_freepointer(s, object);
+		p[i] = object;
+	}
+	c->tid = next_tid(c->tid);
+	local_irq_enable();
+
+	for (i = 0; i < size; i++) {
+		if (unlikely(flags & __GFP_ZERO))
+			memset(p[i], 0, s->objsize);
+		slab_post_alloc_hook(s, flags, p[i]);
+		trace_kmem_cache_alloc(_RET_IP_, p[i], s->objsize, s->size,
+				       flags);
+	}
+	return size;
+
+error:
+	local_irq_enable();
+	size = i;
+	for (i = 0; i < size; i++)
+		slab_post_alloc_hook(s, flags, p[i]);
+	kmem_cache_free_bulk(s, size, p);
+	return 0;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 /*
  * Object placement in a slab is made very easy because we always start at
  * offset 0. If we tune the size of the object to the alignment then we can
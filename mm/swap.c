@@ -372,6 +372,36 @@ static void update_page_reclaim_stat(struct zone *zone, struct page *page,
 		memcg_reclaim_stat->recent_rotated[file]++;
 }
 
+/**
+ * lru_note_cost - account time spent reclaiming or refaulting a page
+ * @page: the page
+ * @file: 1 for a file page, 0 for anon
+ * @cost_us: the time it took
+ *
+ * get_scan_count() puts more pressure on the LRU type that is cheaper
+ * to reclaim, when vm.reclaim_cost_balance is set.
+ */
+void lru_note_cost(struct page *page, int file, s64 cost_us)
+{
+	struct zone *zone = page_zone(page);
+	struct zone_reclaim_stat *memcg_reclaim_stat;
+	unsigned long flags;
+
+	if (cost_us <= 0)
+		return;
+
+	spin_lock_irqsave(&zone->lru_lock, flags);
+	zone->reclaim_stat.recent_cost[file] += cost_us;
+	memcg_reclaim_stat = mem_cgroup_get_reclaim_stat_from_page(page);
+	if (memcg_reclaim_stat)
+		memcg_reclaim_stat->recent_cost[file] += cost_us;
+	spin_unlock_irqrestore(&zone->lru_lock, flags);
+
+	count_vm_events(file ? RECLAIM_COST_FILE_US : RECLAIM_COST_ANON_US,
+			cost_us);
+	count_vm_event(file ? RECLAIM_COST_FILE : RECLAIM_COST_ANON);
+}
+
 static void __activate_page(struct page *page, void *arg)
 {
 	struct zone *zone = page_zone(page);
@@ -441,6 +471,8 @@ void mark_page_accessed(struct page *page)
 			PageReferenced(page) && PageLRU(page)) {
 		activate_page(page);
 		ClearPageReferenced(page);
+		if (page_is_file_cache(page))
+			workingset_activation(page);
 	} else if (!PageReferenced(page)) {
 		SetPageReferenced(page);
 	}
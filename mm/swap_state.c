@@ -17,6 +17,7 @@
 #include <linux/pagevec.h>
 #include <linux/migrate.h>
 #include <linux/page_cgroup.h>
+#include <linux/log2.h>
 
 #include <asm/pgtable.h>
 
@@ -52,6 +53,24 @@ static struct {
 	unsigned long find_total;
 } swap_cache_info;
 
+/*
+ * Swapin readahead comes in two policies.  swapin_readahead() reads the
+ * aligned cluster of swap offsets around the faulting entry, which pays
+ * off when offsets follow the order pages were written in.  On SSD and
+ * compressed RAM swap there is no seek to save, and neighbouring offsets
+ * are just whatever was swapped out at about the same time, so
+ * swap_vma_readahead() instead reads the entries mapped around the
+ * faulting address, in a window sized by the recent readahead hits.  The
+ * VMA policy is used when enabled and no rotating swap device is active.
+ */
+int sysctl_swap_vma_readahead __read_mostly = 1;
+
+/* Readahead pages found in the swap cache since the last swapin */
+static atomic_t swap_ra_hits = ATOMIC_INIT(0);
+
+/* Largest VMA readahead window, in pages */
+#define SWAP_RA_VMA_MAX		32
+
 void show_swap_cache_info(void)
 {
 	printk("%lu pages in swap cache\n", total_swapcache_pages);
@@ -264,8 +283,14 @@ struct page * lookup_swap_cache(swp_entry_t entry)
 
 	page = find_get_page(&swapper_space, entry.val);
 
-	if (page)
+	if (page) {
 		INC_CACHE_INFO(find_success);
+		if (unlikely(TestClearPageReadahead(page))) {
+			atomic_inc(&swap_ra_hits);
+			count_vm_event(swap_use_vma_readahead() ?
+				       SWAP_RA_VMA_HIT : SWAP_RA_CLUSTER_HIT);
+		}
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
@@ -276,9 +301,12 @@ struct page * lookup_swap_cache(swp_entry_t entry)
  * and reading the disk if it is not already cached.
  * A failure return means that either the page allocation failed or that
  * the swap entry is no longer in use.
+ * A page newly read for @readahead is marked, so that its first lookup
+ * can be counted as a readahead hit.
  */
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+static struct page *__read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			bool readahead)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
@@ -329,7 +357,12 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 			 * busy looping, we just conditionally invoke the
 			 * scheduler here, if there are some more important
 			 * tasks to run.
+			 *
+			 * The entry may also be a freed one still queued in
+			 * a per-CPU batch; flush those so we cannot wait on
+			 * it forever.
 			 */
+			swap_slots_flush_frees();
 			cond_resched();
 			continue;
 		}
@@ -348,6 +381,8 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 			 * Initiate read into locked page and return.
 			 */
 			lru_cache_add_anon(new_page);
+			if (readahead)
+				SetPageReadahead(new_page);
 			swap_readpage(new_page);
 			return new_page;
 		}
@@ -366,6 +401,12 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	return __read_swap_cache_async(entry, gfp_mask, vma, addr, false);
+}
+
 /**
  * swapin_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
@@ -393,6 +434,8 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	unsigned long start_offset, end_offset;
 	unsigned long mask = (1UL << page_cluster) - 1;
 
+	count_vm_event(SWAP_RA_CLUSTER_MISS);
+
 	/* Read a page_cluster sized and aligned cluster around offset. */
 	start_offset = offset & ~mask;
 	end_offset = offset | mask;
@@ -401,8 +444,8 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 
 	for (offset = start_offset; offset <= end_offset ; offset++) {
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
+		page = __read_swap_cache_async(swp_entry(swp_type(entry), offset),
+				gfp_mask, vma, addr, offset != swp_offset(entry));
 		if (!page)
 			continue;
 		page_cache_release(page);
@@ -410,3 +453,119 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	lru_add_drain();	/* Push any new pages onto the LRU now */
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
+
+/*
+ * Size the next VMA readahead window: grow it with the readahead pages
+ * that were hit since the last swapin, keep reading ahead for faults on
+ * adjacent pages, and otherwise shrink it by half at a time.
+ */
+static unsigned int swap_vma_ra_window(struct vm_area_struct *vma,
+				       unsigned long faddr, unsigned long prev)
+{
+	unsigned int hits, pages, max_pages;
+
+	max_pages = min_t(unsigned int, 1U << page_cluster, SWAP_RA_VMA_MAX);
+	hits = atomic_xchg(&swap_ra_hits, 0);
+
+	pages = hits + 2;
+	if (pages == 2) {
+		if (faddr != prev + PAGE_SIZE && faddr + PAGE_SIZE != prev)
+			pages = 1;
+	} else
+		pages = roundup_pow_of_two(pages);
+
+	pages = max(pages, vma->swap_ra_win / 2);
+	pages = min(pages, max_pages);
+
+	vma->swap_ra_win = pages;
+	vma->swap_ra_addr = faddr;
+	return pages;
+}
+
+/**
+ * swap_vma_readahead - swap in the pages around a faulting address
+ * @fentry: swap entry of the faulting page
+ * @gfp_mask: memory allocation flags
+ * @vma: user vma the faulting address belongs to
+ * @addr: faulting address
+ *
+ * Returns the struct page for @fentry, after queueing swapin of the
+ * swapped out pages mapped next to @addr in @vma.  The window extends
+ * in the direction of consecutive faults and never crosses the vma or
+ * the page table of @addr.
+ *
+ * Caller must hold down_read on the vma->vm_mm.
+ */
+struct page *swap_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	swp_entry_t entries[SWAP_RA_VMA_MAX];
+	unsigned long faddr = addr & PAGE_MASK;
+	unsigned long prev, start, end, lo, hi, ra_addr;
+	unsigned int win, nr = 0, i;
+	struct page *page;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte, *orig_pte;
+
+	count_vm_event(SWAP_RA_VMA_MISS);
+
+	prev = vma->swap_ra_addr;
+	win = swap_vma_ra_window(vma, faddr, prev);
+	if (win <= 1)
+		goto skip;
+
+	lo = max(vma->vm_start, faddr & PMD_MASK);
+	hi = min(vma->vm_end, (faddr & PMD_MASK) + PMD_SIZE);
+
+	if (faddr == prev + PAGE_SIZE)
+		start = faddr;
+	else if (faddr + PAGE_SIZE == prev)
+		start = faddr - (win - 1) * PAGE_SIZE;
+	else
+		start = faddr - (win / 2) * PAGE_SIZE;
+	if (start < lo || start > faddr)
+		start = lo;
+	end = min(start + win * PAGE_SIZE, hi);
+
+	pgd = pgd_offset(vma->vm_mm, faddr);
+	if (pgd_none(*pgd) || pgd_bad(*pgd))
+		goto skip;
+	pud = pud_offset(pgd, faddr);
+	if (pud_none(*pud) || pud_bad(*pud))
+		goto skip;
+	pmd = pmd_offset(pud, faddr);
+	if (pmd_none(*pmd) || pmd_trans_huge(*pmd) || pmd_bad(*pmd))
+		goto skip;
+
+	/*
+	 * The ptes are only sampled: read_swap_cache_async() copes with
+	 * entries that have been freed since.
+	 */
+	orig_pte = pte = pte_offset_map(pmd, start);
+	for (ra_addr = start; ra_addr < end; ra_addr += PAGE_SIZE, pte++) {
+		pte_t ptent = *pte;
+		swp_entry_t entry;
+
+		if (ra_addr == faddr)
+			continue;
+		if (pte_none(ptent) || pte_present(ptent) || pte_file(ptent))
+			continue;
+		entry = pte_to_swp_entry(ptent);
+		if (unlikely(non_swap_entry(entry)))
+			continue;
+		entries[nr++] = entry;
+	}
+	pte_unmap(orig_pte);
+
+	for (i = 0; i < nr; i++) {
+		page = __read_swap_cache_async(entries[i], gfp_mask, vma,
+					       faddr, true);
+		if (page)
+			page_cache_release(page);
+	}
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+skip:
+	return read_swap_cache_async(fentry, gfp_mask, vma, addr);
+}
@@ -46,6 +46,7 @@ static DEFINE_SPINLOCK(swap_lock);
 static unsigned int nr_swapfiles;
 long nr_swap_pages;
 long total_swap_pages;
+atomic_t nr_rotate_swap = ATOMIC_INIT(0);	/* active non-SSD swap */
 static int least_priority;
 
 static const char Bad_file[] = "Bad swap file entry ";
@@ -408,17 +409,23 @@ no_page:
 	return 0;
 }
 
-swp_entry_t get_swap_page(void)
+/*
+ * Allocate up to @n entries for the swap cache into @slots, all with a
+ * single acquisition of swap_lock.  Returns the number allocated.
+ */
+static int get_swap_pages(int n, swp_entry_t slots[])
 {
 	struct swap_info_struct *si;
 	pgoff_t offset;
 	int type, next;
 	int wrapped = 0;
+	int nr = 0;
 
 	spin_lock(&swap_lock);
 	if (nr_swap_pages <= 0)
-		goto noswap;
-	nr_swap_pages--;
+		goto out;
+	n = min_t(long, n, nr_swap_pages);
+	nr_swap_pages -= n;
 
 	for (type = swap_list.next; type >= 0 && wrapped < 2; type = next) {
 		si = swap_info[type];
@@ -436,18 +443,97 @@ swp_entry_t get_swap_page(void)
 
 		swap_list.next = next;
 		/* This is called for allocating swap entry for cache */
-		offset = scan_swap_map(si, SWAP_HAS_CACHE);
-		if (offset) {
-			spin_unlock(&swap_lock);
-			return swp_entry(type, offset);
+		while (nr < n) {
+			offset = scan_swap_map(si, SWAP_HAS_CACHE);
+			if (!offset)
+				break;
+			slots[nr++] = swp_entry(type, offset);
 		}
+		if (nr == n)
+			goto out;
 		next = swap_list.next;
 	}
 
-	nr_swap_pages++;
-noswap:
+	nr_swap_pages += n - nr;
+out:
 	spin_unlock(&swap_lock);
-	return (swp_entry_t) {0};
+	return nr;
+}
+
+/*
+ * Per-CPU swap slot caches.  get_swap_page() hands out entries from a
+ * small per-CPU array that is refilled SWAP_SLOTS_CACHE_SIZE entries at a
+ * time, and swapcache_free() of an entry that nothing else references
+ * queues it on a per-CPU array that is freed in one batch; either way
+ * swap_lock is taken once per batch instead of once per page.  Cached
+ * entries keep SWAP_HAS_CACHE set in the swap_map, so the rest of the
+ * swap code sees them as in use.
+ */
+#define SWAP_SLOTS_CACHE_SIZE	64
+
+struct swap_slots_cache {
+	struct mutex	alloc_lock;	/* refilling may sleep */
+	int		cur;
+	int		nr;
+	swp_entry_t	slots[SWAP_SLOTS_CACHE_SIZE];
+	spinlock_t	free_lock;
+	int		n_ret;
+	swp_entry_t	slots_ret[SWAP_SLOTS_CACHE_SIZE];
+};
+
+static DEFINE_PER_CPU(struct swap_slots_cache, swp_slots);
+static bool swap_slots_cache_ready __read_mostly;
+/* Set when a refill may have parked slots in the caches */
+static atomic_t swap_slots_parked = ATOMIC_INIT(0);
+
+static void swap_slots_drain(void);
+
+/*
+ * Stop caching once swap is nearly full, so that slots parked on other
+ * CPUs cannot make an allocation fail.
+ */
+static inline bool swap_slots_cache_active(void)
+{
+	return swap_slots_cache_ready &&
+		nr_swap_pages > 2L * SWAP_SLOTS_CACHE_SIZE * num_online_cpus();
+}
+
+/*
+ * When caching stops, the slots parked in the caches go back to the swap
+ * devices; until then what is left in the local cache is used up first.
+ */
+swp_entry_t get_swap_page(void)
+{
+	struct swap_slots_cache *cache;
+	swp_entry_t entry = { 0 };
+	bool active = swap_slots_cache_active();
+
+	if (swap_slots_cache_ready && !active &&
+	    atomic_xchg(&swap_slots_parked, 0))
+		swap_slots_drain();
+
+	if (swap_slots_cache_ready) {
+		cache = &per_cpu(swp_slots, raw_smp_processor_id());
+
+		mutex_lock(&cache->alloc_lock);
+		if (active && cache->cur == cache->nr) {
+			cache->cur = 0;
+			cache->nr = get_swap_pages(SWAP_SLOTS_CACHE_SIZE,
+						   cache->slots);
+			atomic_set(&swap_slots_parked, 1);
+			count_vm_event(SWAP_SLOTS_REFILL);
+		}
+		if (cache->cur < cache->nr) {
+			entry = cache->slots[cache->cur++];
+			count_vm_event(SWAP_SLOTS_ALLOC_CACHED);
+		}
+		mutex_unlock(&cache->alloc_lock);
+		if (entry.val)
+			return entry;
+	}
+
+	get_swap_pages(1, &entry);
+	return entry;
 }
 
 /* The only caller of this function is now susupend routine */
@@ -472,7 +558,7 @@ swp_entry_t get_swap_page_of_type(int type)
 	return (swp_entry_t) {0};
 }
 
-static struct swap_info_struct *swap_info_get(swp_entry_t entry)
+static struct swap_info_struct *__swap_info_get(swp_entry_t entry)
 {
 	struct swap_info_struct *p;
 	unsigned long offset, type;
@@ -490,7 +576,6 @@ static struct swap_info_struct *swap_info_get(swp_entry_t entry)
 		goto bad_offset;
 	if (!p->swap_map[offset])
 		goto bad_free;
-	spin_lock(&swap_lock);
 	return p;
 
 bad_free:
@@ -508,6 +593,16 @@ out:
 	return NULL;
 }
 
+static struct swap_info_struct *swap_info_get(swp_entry_t entry)
+{
+	struct swap_info_struct *p;
+
+	p = __swap_info_get(entry);
+	if (p)
+		spin_lock(&swap_lock);
+	return p;
+}
+
 static unsigned char swap_entry_free(struct swap_info_struct *p,
 				     swp_entry_t entry, unsigned char usage)
 {
@@ -579,6 +674,116 @@ void swap_free(swp_entry_t entry)
 	}
 }
 
+/* Drop the swap cache reference of a batch of entries.  */
+static void swap_slots_free_entries(swp_entry_t entries[], int n)
+{
+	int i;
+
+	spin_lock(&swap_lock);
+	for (i = 0; i < n; i++)
+		swap_entry_free(swap_info[swp_type(entries[i])], entries[i],
+				SWAP_HAS_CACHE);
+	spin_unlock(&swap_lock);
+	count_vm_event(SWAP_SLOTS_FREE_FLUSH);
+}
+
+/*
+ * Queue the last reference to @entry for a batched free.  Returns false
+ * if the entry is still referenced elsewhere, so must be freed now.
+ */
+static bool swapcache_free_batched(swp_entry_t entry, struct page *page)
+{
+	struct swap_info_struct *p;
+	struct swap_slots_cache *cache;
+
+	p = __swap_info_get(entry);
+	if (!p)
+		return true;	/* already reported */
+	if (swap_count(ACCESS_ONCE(p->swap_map[swp_offset(entry)])))
+		return false;
+
+	/* swap_entry_free() would have passed swapout=false here too */
+	if (page)
+		mem_cgroup_uncharge_swapcache(page, entry, false);
+
+	cache = &get_cpu_var(swp_slots);
+	spin_lock(&cache->free_lock);
+	if (cache->n_ret == SWAP_SLOTS_CACHE_SIZE) {
+		swap_slots_free_entries(cache->slots_ret, cache->n_ret);
+		cache->n_ret = 0;
+	}
+	cache->slots_ret[cache->n_ret++] = entry;
+	spin_unlock(&cache->free_lock);
+	put_cpu_var(swp_slots);
+
+	count_vm_event(SWAP_SLOTS_FREE_BATCHED);
+	return true;
+}
+
+/**
+ * swap_slots_flush_frees - free the entries queued on every CPU
+ *
+ * For readers that find an entry still marked SWAP_HAS_CACHE with no
+ * page in the swap cache: it may be waiting in a free batch.
+ */
+void swap_slots_flush_frees(void)
+{
+	int cpu;
+
+	if (!swap_slots_cache_ready)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct swap_slots_cache *cache = &per_cpu(swp_slots, cpu);
+
+		spin_lock(&cache->free_lock);
+		if (cache->n_ret) {
+			swap_slots_free_entries(cache->slots_ret, cache->n_ret);
+			cache->n_ret = 0;
+		}
+		spin_unlock(&cache->free_lock);
+	}
+}
+
+/*
+ * Give back every cached slot, before swapoff looks for busy entries and
+ * when swap gets too full for caching.
+ */
+static void swap_slots_drain(void)
+{
+	int cpu;
+
+	if (!swap_slots_cache_ready)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct swap_slots_cache *cache = &per_cpu(swp_slots, cpu);
+
+		mutex_lock(&cache->alloc_lock);
+		if (cache->cur < cache->nr)
+			swap_slots_free_entries(cache->slots + cache->cur,
+						cache->nr - cache->cur);
+		cache->cur = cache->nr = 0;
+		mutex_unlock(&cache->alloc_lock);
+	}
+	swap_slots_flush_frees();
+}
+
+static int __init swap_slots_cache_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct swap_slots_cache *cache = &per_cpu(swp_slots, cpu);
+
+		mutex_init(&cache->alloc_lock);
+		spin_lock_init(&cache->free_lock);
+	}
+	swap_slots_cache_ready = true;
+	return 0;
+}
+__initcall(swap_slots_cache_init);
+
 /*
  * Called after dropping swapcache to decrease refcnt to swap entries.
  */
@@ -587,6 +792,9 @@ void swapcache_free(swp_entry_t entry, struct page *page)
 	struct swap_info_struct *p;
 	unsigned char count;
 
+	if (swap_slots_cache_ready && swapcache_free_batched(entry, page))
+		return;
+
 	p = swap_info_get(entry);
 	if (p) {
 		count = swap_entry_free(p, entry, SWAP_HAS_CACHE);
@@ -1615,6 +1823,9 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->flags &= ~SWP_WRITEOK;
 	spin_unlock(&swap_lock);
 
+	/* Slots parked in the per-CPU caches would look busy forever */
+	swap_slots_drain();
+
 	oom_score_adj = test_set_oom_score_adj(OOM_SCORE_ADJ_MAX);
 	err = try_to_unuse(type);
 	compare_swap_oom_score_adj(OOM_SCORE_ADJ_MAX, oom_score_adj);
@@ -1652,6 +1863,8 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->max = 0;
 	swap_map = p->swap_map;
 	p->swap_map = NULL;
+	if (!(p->flags & SWP_SOLIDSTATE))
+		atomic_dec(&nr_rotate_swap);
 	p->flags = 0;
 	spin_unlock(&swap_lock);
 	mutex_unlock(&swapon_mutex);
@@ -2114,6 +2327,8 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 		prio =
 		  (swap_flags & SWAP_FLAG_PRIO_MASK) >> SWAP_FLAG_PRIO_SHIFT;
 	enable_swap_info(p, prio, swap_map);
+	if (!(p->flags & SWP_SOLIDSTATE))
+		atomic_inc(&nr_rotate_swap);
 
 	printk(KERN_INFO "Adding %uk swap on %s.  "
 			"Priority:%d extents:%d across:%lluk %s%s\n",
@@ -183,6 +183,76 @@ int invalidate_inode_page(struct page *page)
 	return invalidate_complete_page(mapping, page);
 }
 
+static void clear_shadow_entry(struct address_space *mapping, pgoff_t index)
+{
+	struct radix_tree_node *node;
+	void **slot;
+
+	__radix_tree_lookup(&mapping->page_tree, index, &node, &slot);
+	radix_tree_replace_slot(slot, NULL);
+	mapping->nrshadows--;
+	if (!node)
+		return;
+	workingset_node_shadows_dec(node);
+	/* Untrack the node before it is possibly freed */
+	workingset_update_node(mapping, node);
+	__radix_tree_delete_node(&mapping->page_tree, node);
+}
+
+/**
+ * truncate_shadow_entries - drop the shadow entries of evicted pages
+ * @mapping: mapping to clean
+ * @start: first page index
+ * @end: last page index, inclusive
+ *
+ * Removes the workingset shadow entries in the given range so that
+ * truncated or freed mappings do not keep stale eviction information
+ * in the page cache radix tree.  shmem/tmpfs swap entries are never
+ * counted in ->nrshadows and must not be passed in here.
+ */
+void truncate_shadow_entries(struct address_space *mapping,
+			     pgoff_t start, pgoff_t end)
+{
+	unsigned long indices[PAGEVEC_SIZE];
+	void **slots[PAGEVEC_SIZE];
+	pgoff_t index = start;
+	unsigned int nr, nr_shadows, i;
+	bool done;
+
+	spin_lock_irq(&mapping->tree_lock);
+	while (mapping->nrshadows && index <= end) {
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, index, PAGEVEC_SIZE);
+		if (!nr)
+			break;
+
+		index = indices[nr - 1] + 1;
+		nr_shadows = 0;
+		for (i = 0; i < nr; i++) {
+			void *entry;
+
+			if (indices[i] > end)
+				break;
+			entry = radix_tree_deref_slot_protected(slots[i],
+							&mapping->tree_lock);
+			if (radix_tree_exceptional_entry(entry))
+				indices[nr_shadows++] = indices[i];
+		}
+		done = i < nr || !index;
+
+		/* Deleting may free tree nodes: collect the indices first */
+		for (i = 0; i < nr_shadows; i++)
+			clear_shadow_entry(mapping, indices[i]);
+		if (done)
+			break;
+
+		spin_unlock_irq(&mapping->tree_lock);
+		cond_resched();
+		spin_lock_irq(&mapping->tree_lock);
+	}
+	spin_unlock_irq(&mapping->tree_lock);
+}
+
 /**
  * truncate_inode_pages_range - truncate range of pages specified by start & end byte offsets
  * @mapping: mapping to truncate
@@ -214,11 +284,10 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	int i;
 
 	cleancache_invalidate_inode(mapping);
-	if (mapping->nrpages == 0)
-		return;
-
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
 	end = (lend >> PAGE_CACHE_SHIFT);
+	if (mapping->nrpages == 0)
+		goto out;
 
 	pagevec_init(&pvec, 0);
 	index = start;
@@ -293,6 +362,10 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		index++;
 	}
 	cleancache_invalidate_inode(mapping);
+out:
+	/* Pages evicted before or during the truncation left shadows */
+	if (mapping->nrshadows)
+		truncate_shadow_entries(mapping, start, end);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
 
@@ -401,7 +474,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 		goto failed;
 
 	BUG_ON(page_has_private(page));
-	__delete_from_page_cache(page);
+	__delete_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
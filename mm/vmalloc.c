@@ -258,20 +258,83 @@ struct vmap_area {
 	struct list_head purge_list;	/* "lazy purge" list */
 	struct vm_struct *vm;
 	struct rcu_head rcu_head;
+	unsigned long gap;		/* free space below va_start */
+	unsigned long subtree_max_gap;	/* largest gap in this subtree */
 };
 
 static DEFINE_SPINLOCK(vmap_area_lock);
 static LIST_HEAD(vmap_area_list);
 static struct rb_root vmap_area_root = RB_ROOT;
 
-/* The vmap cache globals are protected by vmap_area_lock */
-static struct rb_node *free_vmap_cache;
-static unsigned long cached_hole_size;
-static unsigned long cached_vstart;
-static unsigned long cached_align;
-
 static unsigned long vmap_area_pcpu_hole;
 
+/*
+ * The rbtree of busy areas is augmented with the largest free gap in
+ * each subtree, so that the lowest hole fitting an allocation is found
+ * in O(log n) instead of walking every area below it.
+ */
+static inline struct vmap_area *rb_to_va(struct rb_node *n)
+{
+	return rb_entry(n, struct vmap_area, rb_node);
+}
+
+static inline unsigned long va_subtree_max_gap(struct rb_node *n)
+{
+	return n ? rb_to_va(n)->subtree_max_gap : 0;
+}
+
+static void vmap_area_augment_cb(struct rb_node *n, void *unused)
+{
+	struct vmap_area *va = rb_to_va(n);
+
+	va->subtree_max_gap = max3(va->gap, va_subtree_max_gap(n->rb_left),
+				   va_subtree_max_gap(n->rb_right));
+}
+
+/* Recompute the gap below @n and propagate it up the tree */
+static void vmap_area_update_gap(struct rb_node *n)
+{
+	struct rb_node *prev = rb_prev(n);
+	struct vmap_area *va = rb_to_va(n);
+
+	va->gap = va->va_start - (prev ? rb_to_va(prev)->va_end : 0);
+	rb_augment_insert(n, vmap_area_augment_cb, NULL);
+}
+
+/*
+ * Find the lowest area above @va with a gap of at least @length below
+ * it.  Caller holds vmap_area_lock.
+ */
+static struct vmap_area *vmap_area_next_gap(struct vmap_area *va,
+					    unsigned long length)
+{
+	struct rb_node *node = &va->rb_node, *parent;
+
+	for (;;) {
+		if (va_subtree_max_gap(node->rb_right) >= length) {
+			/* Leftmost fitting node of the right subtree */
+			node = node->rb_right;
+			for (;;) {
+				if (va_subtree_max_gap(node->rb_left) >= length)
+					node = node->rb_left;
+				else if (rb_to_va(node)->gap >= length)
+					return rb_to_va(node);
+				else
+					node = node->rb_right;
+			}
+		}
+
+		/* Nothing there: next in order is the first left-of ancestor */
+		while ((parent = rb_parent(node)) && node == parent->rb_right)
+			node = parent;
+		if (!parent)
+			return NULL;
+		node = parent;
+		if (rb_to_va(node)->gap >= length)
+			return rb_to_va(node);
+	}
+}
+
 static struct vmap_area *__find_vmap_area(unsigned long addr)
 {
 	struct rb_node *n = vmap_area_root.rb_node;
@@ -321,10 +384,120 @@ static void __insert_vmap_area(struct vmap_area *va)
 		list_add_rcu(&va->list, &prev->list);
 	} else
 		list_add_rcu(&va->list, &vmap_area_list);
+
+	vmap_area_update_gap(&va->rb_node);
+	tmp = rb_next(&va->rb_node);
+	if (tmp)
+		vmap_area_update_gap(tmp);
 }
 
 static void purge_vmap_area_lazy(void);
 
+/*
+ * Per-CPU caches of free vmap areas of the common small sizes.  A cached
+ * area stays in the rbtree, already unmapped and flushed from the TLB by
+ * the lazy purge, so handing it out again needs neither vmap_area_lock
+ * nor a search.  Only areas of the default vmalloc range are cached;
+ * sizes include the guard page.
+ */
+#define VMAP_CACHE_PAGES	8
+#define VMAP_CACHE_DEPTH	4
+
+struct vmap_area_cache {
+	spinlock_t lock;
+	unsigned int nr[VMAP_CACHE_PAGES];
+	struct list_head free[VMAP_CACHE_PAGES];	/* via purge_list */
+};
+
+static DEFINE_PER_CPU(struct vmap_area_cache, vmap_area_cache);
+static bool vmap_initialized __read_mostly = false;
+
+static inline bool vmap_cacheable(unsigned long size, unsigned long vstart,
+				  unsigned long vend)
+{
+	return vmap_initialized && size <= VMAP_CACHE_PAGES * PAGE_SIZE &&
+		vstart == VMALLOC_START && vend == VMALLOC_END;
+}
+
+static struct vmap_area *vmap_cache_get(unsigned long size,
+					unsigned long align)
+{
+	struct vmap_area_cache *cache = &get_cpu_var(vmap_area_cache);
+	unsigned int idx = (size >> PAGE_SHIFT) - 1;
+	struct vmap_area *va, *found = NULL;
+
+	spin_lock(&cache->lock);
+	list_for_each_entry(va, &cache->free[idx], purge_list) {
+		if (!(va->va_start & (align - 1))) {
+			list_del(&va->purge_list);
+			cache->nr[idx]--;
+			found = va;
+			break;
+		}
+	}
+	spin_unlock(&cache->lock);
+	put_cpu_var(vmap_area_cache);
+
+	if (found) {
+		found->flags = 0;
+		found->vm = NULL;
+	}
+	return found;
+}
+
+/* Called from the lazy purge, with preemption disabled. */
+static bool vmap_cache_put(struct vmap_area *va)
+{
+	unsigned long size = va->va_end - va->va_start;
+	struct vmap_area_cache *cache;
+	unsigned int idx;
+	bool cached = false;
+
+	if (!vmap_initialized || size > VMAP_CACHE_PAGES * PAGE_SIZE ||
+	    va->va_start < VMALLOC_START || va->va_end > VMALLOC_END)
+		return false;
+
+	idx = (size >> PAGE_SHIFT) - 1;
+	cache = this_cpu_ptr(&vmap_area_cache);
+	spin_lock(&cache->lock);
+	if (cache->nr[idx] < VMAP_CACHE_DEPTH) {
+		list_add(&va->purge_list, &cache->free[idx]);
+		cache->nr[idx]++;
+		cached = true;
+	}
+	spin_unlock(&cache->lock);
+	return cached;
+}
+
+static void __free_vmap_area(struct vmap_area *va);
+
+/* Give every cached area back to the rbtree, when running out of space */
+static void vmap_cache_drain(void)
+{
+	struct vmap_area *va, *n_va;
+	LIST_HEAD(valist);
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		struct vmap_area_cache *cache = &per_cpu(vmap_area_cache, cpu);
+
+		spin_lock(&cache->lock);
+		for (i = 0; i < VMAP_CACHE_PAGES; i++) {
+			list_splice_init(&cache->free[i], &valist);
+			cache->nr[i] = 0;
+		}
+		spin_unlock(&cache->lock);
+	}
+
+	if (list_empty(&valist))
+		return;
+
+	spin_lock(&vmap_area_lock);
+	list_for_each_entry_safe(va, n_va, &valist, purge_list)
+		__free_vmap_area(va);
+	spin_unlock(&vmap_area_lock);
+}
+
 /*
  * Allocate a region of KVA of the specified size and alignment, within the
  * vstart and vend.
@@ -336,7 +509,7 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 {
 	struct vmap_area *va;
 	struct rb_node *n;
-	unsigned long addr;
+	unsigned long addr, length;
 	int purged = 0;
 	struct vmap_area *first;
 
@@ -344,82 +517,55 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 	BUG_ON(size & ~PAGE_MASK);
 	BUG_ON(!is_power_of_2(align));
 
+	if (vmap_cacheable(size, vstart, vend)) {
+		va = vmap_cache_get(size, align);
+		if (va)
+			return va;
+	}
+
 	va = kmalloc_node(sizeof(struct vmap_area),
 			gfp_mask & GFP_RECLAIM_MASK, node);
 	if (unlikely(!va))
 		return ERR_PTR(-ENOMEM);
 
+	/* A gap this large fits the area whatever its alignment */
+	length = size + (align > PAGE_SIZE ? align - PAGE_SIZE : 0);
+
 retry:
 	spin_lock(&vmap_area_lock);
-	/*
-	 * Invalidate cache if we have more permissive parameters.
-	 * cached_hole_size notes the largest hole noticed _below_
-	 * the vmap_area cached in free_vmap_cache: if size fits
-	 * into that hole, we want to scan from vstart to reuse
-	 * the hole instead of allocating above free_vmap_cache.
-	 * Note that __free_vmap_area may update free_vmap_cache
-	 * without updating cached_hole_size or cached_align.
-	 */
-	if (!free_vmap_cache ||
-			size < cached_hole_size ||
-			vstart < cached_vstart ||
-			align < cached_align) {
-nocache:
-		cached_hole_size = 0;
-		free_vmap_cache = NULL;
-	}
-	/* record if we encounter less permissive parameters */
-	cached_vstart = vstart;
-	cached_align = align;
-
-	/* find starting point for our search */
-	if (free_vmap_cache) {
-		first = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-		addr = ALIGN(first->va_end, align);
-		if (addr < vstart)
-			goto nocache;
-		if (addr + size - 1 < addr)
-			goto overflow;
 
-	} else {
-		addr = ALIGN(vstart, align);
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-		n = vmap_area_root.rb_node;
-		first = NULL;
-
-		while (n) {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				first = tmp;
-				if (tmp->va_start <= addr)
-					break;
-				n = n->rb_left;
-			} else
-				n = n->rb_right;
-		}
+	addr = ALIGN(vstart, align);
+	if (addr + size - 1 < addr)
+		goto overflow;
 
-		if (!first)
-			goto found;
-	}
+	/* find the first area ending at or above the start of the range */
+	n = vmap_area_root.rb_node;
+	first = NULL;
 
-	/* from the starting point, walk areas until a suitable hole is found */
-	while (addr + size > first->va_start && addr + size <= vend) {
-		if (addr + cached_hole_size < first->va_start)
-			cached_hole_size = first->va_start - addr;
-		addr = ALIGN(first->va_end, align);
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-		n = rb_next(&first->rb_node);
-		if (n)
-			first = rb_entry(n, struct vmap_area, rb_node);
-		else
-			goto found;
+	while (n) {
+		struct vmap_area *tmp;
+		tmp = rb_entry(n, struct vmap_area, rb_node);
+		if (tmp->va_end >= addr) {
+			first = tmp;
+			if (tmp->va_start <= addr)
+				break;
+			n = n->rb_left;
+		} else
+			n = n->rb_right;
 	}
 
+	if (!first || addr + size <= first->va_start)
+		goto found;
+
+	/* then the lowest hole above it that is large enough */
+	first = vmap_area_next_gap(first, length);
+	if (first)
+		addr = ALIGN(first->va_start - first->gap, align);
+	else
+		addr = ALIGN(rb_to_va(rb_last(&vmap_area_root))->va_end, align);
+	if (addr + size - 1 < addr)
+		goto overflow;
+
 found:
 	if (addr + size > vend)
 		goto overflow;
@@ -428,7 +574,6 @@ found:
 	va->va_end = addr + size;
 	va->flags = 0;
 	__insert_vmap_area(va);
-	free_vmap_cache = &va->rb_node;
 	spin_unlock(&vmap_area_lock);
 
 	BUG_ON(va->va_start & (align-1));
@@ -441,6 +586,7 @@ overflow:
 	spin_unlock(&vmap_area_lock);
 	if (!purged) {
 		purge_vmap_area_lazy();
+		vmap_cache_drain();
 		purged = 1;
 		goto retry;
 	}
@@ -454,25 +600,17 @@ overflow:
 
 static void __free_vmap_area(struct vmap_area *va)
 {
+	struct rb_node *next, *deepest;
+
 	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
 
-	if (free_vmap_cache) {
-		if (va->va_end < cached_vstart) {
-			free_vmap_cache = NULL;
-		} else {
-			struct vmap_area *cache;
-			cache = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-			if (va->va_start <= cache->va_start) {
-				free_vmap_cache = rb_prev(&va->rb_node);
-				/*
-				 * We don't try to update cached_hole_size or
-				 * cached_align, but it won't go very wrong.
-				 */
-			}
-		}
-	}
+	next = rb_next(&va->rb_node);
+	deepest = rb_augment_erase_begin(&va->rb_node);
 	rb_erase(&va->rb_node, &vmap_area_root);
 	RB_CLEAR_NODE(&va->rb_node);
+	rb_augment_erase_end(deepest, vmap_area_augment_cb, NULL);
+	if (next)
+		vmap_area_update_gap(next);
 	list_del_rcu(&va->list);
 
 	/*
@@ -553,6 +691,16 @@ static unsigned long lazy_max_pages(void)
 
 static atomic_t vmap_lazy_nr = ATOMIC_INIT(0);
 
+/* Lazily freed areas, so that a purge does not walk every area */
+static DEFINE_SPINLOCK(vmap_purge_lock);
+static LIST_HEAD(vmap_purge_list);
+
+/*
+ * Above this many scattered areas a purge flushes the whole TLB rather
+ * than each area in turn.
+ */
+#define VMAP_PURGE_FLUSH_MAX	32
+
 /* for per-CPU blocks */
 static void purge_fragmented_blocks_allcpus(void);
 
@@ -580,9 +728,10 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 {
 	static DEFINE_SPINLOCK(purge_lock);
 	LIST_HEAD(valist);
+	LIST_HEAD(freelist);
 	struct vmap_area *va;
 	struct vmap_area *n_va;
-	int nr = 0;
+	int nr = 0, nr_areas = 0;
 
 	/*
 	 * If sync is 0 but force_flush is 1, we'll go sync anyway but callers
@@ -598,30 +747,46 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 	if (sync)
 		purge_fragmented_blocks_allcpus();
 
-	rcu_read_lock();
-	list_for_each_entry_rcu(va, &vmap_area_list, list) {
-		if (va->flags & VM_LAZY_FREE) {
-			if (va->va_start < *start)
-				*start = va->va_start;
-			if (va->va_end > *end)
-				*end = va->va_end;
-			nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
-			list_add_tail(&va->purge_list, &valist);
-			va->flags |= VM_LAZY_FREEING;
-			va->flags &= ~VM_LAZY_FREE;
-		}
+	spin_lock(&vmap_purge_lock);
+	list_splice_init(&vmap_purge_list, &valist);
+	spin_unlock(&vmap_purge_lock);
+
+	list_for_each_entry(va, &valist, purge_list) {
+		if (va->va_start < *start)
+			*start = va->va_start;
+		if (va->va_end > *end)
+			*end = va->va_end;
+		nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
+		nr_areas++;
+		va->flags |= VM_LAZY_FREEING;
+		va->flags &= ~VM_LAZY_FREE;
 	}
-	rcu_read_unlock();
 
 	if (nr)
 		atomic_sub(nr, &vmap_lazy_nr);
 
-	if (nr || force_flush)
+	/*
+	 * One ranged flush is cheapest when the freed areas are close
+	 * together; when they are scattered over the vmalloc space, flush
+	 * them one by one, or the whole TLB if there are too many.
+	 */
+	if (force_flush || (nr && ((*end - *start) >> PAGE_SHIFT) <= 2 * nr))
 		flush_tlb_kernel_range(*start, *end);
+	else if (nr_areas <= VMAP_PURGE_FLUSH_MAX)
+		list_for_each_entry(va, &valist, purge_list)
+			flush_tlb_kernel_range(va->va_start, va->va_end);
+	else
+		flush_tlb_all();
 
 	if (nr) {
+		/* Small areas go to this CPU's cache, still in the rbtree */
+		list_for_each_entry_safe(va, n_va, &valist, purge_list) {
+			list_del(&va->purge_list);
+			if (!vmap_cache_put(va))
+				list_add_tail(&va->purge_list, &freelist);
+		}
 		spin_lock(&vmap_area_lock);
-		list_for_each_entry_safe(va, n_va, &valist, purge_list)
+		list_for_each_entry_safe(va, n_va, &freelist, purge_list)
 			__free_vmap_area(va);
 		spin_unlock(&vmap_area_lock);
 	}
@@ -657,6 +822,9 @@ static void purge_vmap_area_lazy(void)
 static void free_vmap_area_noflush(struct vmap_area *va)
 {
 	va->flags |= VM_LAZY_FREE;
+	spin_lock(&vmap_purge_lock);
+	list_add_tail(&va->purge_list, &vmap_purge_list);
+	spin_unlock(&vmap_purge_lock);
 	atomic_add((va->va_end - va->va_start) >> PAGE_SHIFT, &vmap_lazy_nr);
 	if (unlikely(atomic_read(&vmap_lazy_nr) > lazy_max_pages()))
 		try_purge_vmap_area_lazy();
@@ -732,8 +900,6 @@ static void free_unmap_vmap_area_addr(unsigned long addr)
 
 #define VMAP_BLOCK_SIZE		(VMAP_BBMAP_BITS * PAGE_SIZE)
 
-static bool vmap_initialized __read_mostly = false;
-
 struct vmap_block_queue {
 	spinlock_t lock;
 	struct list_head free;
@@ -1176,10 +1342,17 @@ void __init vmalloc_init(void)
 
 	for_each_possible_cpu(i) {
 		struct vmap_block_queue *vbq;
+		struct vmap_area_cache *cache;
+		int j;
 
 		vbq = &per_cpu(vmap_block_queue, i);
 		spin_lock_init(&vbq->lock);
 		INIT_LIST_HEAD(&vbq->free);
+
+		cache = &per_cpu(vmap_area_cache, i);
+		spin_lock_init(&cache->lock);
+		for (j = 0; j < VMAP_CACHE_PAGES; j++)
+			INIT_LIST_HEAD(&cache->free[j]);
 	}
 
 	/* Import existing vmlist entries. */
@@ -154,6 +154,13 @@ struct mem_cgroup_zone {
  * From 0 .. 100.  Higher means more swappy.
  */
 int vm_swappiness = 60;
+int sysctl_reclaim_cost_balance __read_mostly = 1;
+
+/*
+ * Once this much reclaim cost is recorded in usecs, the recent costs
+ * are halved, so that they follow changes in the workload.
+ */
+#define RECLAIM_COST_DECAY_US	(1000 * USEC_PER_MSEC)
 long vm_total_pages;	/* The total number of pages which the VM controls */
 
 static LIST_HEAD(shrinker_list);
@@ -534,9 +541,12 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
 
 /*
  * Same as remove_mapping, but if the page is removed from the mapping, it
- * gets returned with a refcount of 0.
+ * gets returned with a refcount of 0.  @reclaimed is set when the page is
+ * evicted by reclaim, as opposed to invalidated, and leaves a shadow entry
+ * in the page cache for workingset detection.
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
@@ -582,10 +592,18 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *);
+		void *shadow = NULL;
 
 		freepage = mapping->a_ops->freepage;
-
-		__delete_from_page_cache(page);
+		/*
+		 * Remember when the page was evicted, unless the inode
+		 * is on its way out: its final truncation must not race
+		 * with reclaim leaving new shadow entries behind.  Both
+		 * are serialized by the tree_lock.
+		 */
+		if (reclaimed && !mapping_exiting(mapping))
+			shadow = workingset_eviction(mapping, page);
+		__delete_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 
@@ -608,7 +626,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -767,7 +785,8 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 				      struct scan_control *sc,
 				      int priority,
 				      unsigned long *ret_nr_dirty,
-				      unsigned long *ret_nr_writeback)
+				      unsigned long *ret_nr_writeback,
+				      bool force_reclaim)
 {
 	LIST_HEAD(ret_pages);
 	LIST_HEAD(free_pages);
@@ -784,6 +803,8 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		struct address_space *mapping;
 		struct page *page;
 		int may_enter_fs;
+		pageout_t pageout_ret;
+		ktime_t pageout_start;
 
 		cond_resched();
 
@@ -828,7 +849,9 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		references = page_check_references(page, mz, sc);
+		references = PAGEREF_RECLAIM;
+		if (!force_reclaim)
+			references = page_check_references(page, mz, sc);
 		switch (references) {
 		case PAGEREF_ACTIVATE:
 			goto activate_locked;
@@ -899,8 +922,16 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			if (!sc->may_writepage)
 				goto keep_locked;
 
-			/* Page is dirty, try to write it out here */
-			switch (pageout(page, mapping, sc)) {
+			/*
+			 * Page is dirty, try to write it out here.  For zram
+			 * swap the time taken is mostly the compression.
+			 */
+			pageout_start = ktime_get();
+			pageout_ret = pageout(page, mapping, sc);
+			lru_note_cost(page, page_is_file_cache(page),
+				ktime_us_delta(ktime_get(), pageout_start));
+
+			switch (pageout_ret) {
 			case PAGE_KEEP:
 				nr_congested++;
 				goto keep_locked;
@@ -968,7 +999,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
 		/*
@@ -1031,6 +1062,60 @@ keep_lumpy:
 	return nr_reclaimed;
 }
 
+#ifdef CONFIG_PROCESS_RECLAIM
+/**
+ * reclaim_pages_from_list - reclaim pages isolated by the caller
+ * @page_list: pages taken off the LRU with isolate_lru_page() and
+ *	       accounted in NR_ISOLATED_ANON/NR_ISOLATED_FILE
+ *
+ * Used by per-process reclaim, which finds its pages by walking page
+ * tables rather than the LRU lists.  The pages are reclaimed whether
+ * they were referenced recently or not; whatever cannot be reclaimed
+ * is put back on the LRU.  Returns the number of pages reclaimed.
+ */
+unsigned long reclaim_pages_from_list(struct list_head *page_list)
+{
+	struct scan_control sc = {
+		.gfp_mask = GFP_KERNEL,
+		.may_writepage = 1,
+		.may_unmap = 1,
+		.may_swap = 1,
+	};
+	unsigned long nr_reclaimed = 0;
+	unsigned long nr_dirty = 0, nr_writeback = 0;
+	struct page *page, *next;
+	LIST_HEAD(zone_pages);
+
+	/* shrink_page_list() works on one zone at a time */
+	while (!list_empty(page_list)) {
+		struct mem_cgroup_zone mz = {
+			.mem_cgroup = NULL,
+			.zone = page_zone(lru_to_page(page_list)),
+		};
+
+		list_for_each_entry_safe(page, next, page_list, lru) {
+			if (page_zone(page) != mz.zone)
+				continue;
+			ClearPageActive(page);
+			dec_zone_page_state(page, NR_ISOLATED_ANON +
+					    page_is_file_cache(page));
+			list_move(&page->lru, &zone_pages);
+		}
+
+		nr_reclaimed += shrink_page_list(&zone_pages, &mz, &sc,
+						 DEF_PRIORITY, &nr_dirty,
+						 &nr_writeback, true);
+
+		while (!list_empty(&zone_pages)) {
+			page = lru_to_page(&zone_pages);
+			list_del(&page->lru);
+			putback_lru_page(page);
+		}
+	}
+	return nr_reclaimed;
+}
+#endif /* CONFIG_PROCESS_RECLAIM */
+
 /*
  * Attempt to remove the specified page from its LRU.  Only take this page
  * if it is of the appropriate PageActive status.  Pages which are being
@@ -1554,13 +1639,13 @@ shrink_inactive_list(unsigned long nr_to_scan, struct mem_cgroup_zone *mz,
 	update_isolated_counts(mz, &page_list, &nr_anon, &nr_file);
 
 	nr_reclaimed = shrink_page_list(&page_list, mz, sc, priority,
-						&nr_dirty, &nr_writeback);
+					&nr_dirty, &nr_writeback, false);
 
 	/* Check if we should syncronously wait for writeback */
 	if (should_reclaim_stall(nr_taken, nr_reclaimed, priority, sc)) {
 		set_reclaim_mode(priority, sc, true);
 		nr_reclaimed += shrink_page_list(&page_list, mz, sc,
-					priority, &nr_dirty, &nr_writeback);
+				priority, &nr_dirty, &nr_writeback, false);
 	}
 
 	spin_lock_irq(&zone->lru_lock);
@@ -1884,7 +1969,7 @@ static int vmscan_swappiness(struct mem_cgroup_zone *mz,
 			     struct scan_control *sc)
 {
 	if (global_reclaim(sc))
-		return vm_swappiness;
+		return mem_cgroup_global_swappiness(mz->mem_cgroup);
 	return mem_cgroup_swappiness(mz->mem_cgroup);
 }
 
@@ -1892,7 +1977,8 @@ static int vmscan_swappiness(struct mem_cgroup_zone *mz,
  * Determine how aggressively the anon and file LRU lists should be
  * scanned.  The relative value of each set of LRU lists is determined
  * by looking at the fraction of the pages scanned we did rotate back
- * onto the active list instead of evict.
+ * onto the active list instead of evict, and optionally by the time
+ * recently spent reclaiming and refaulting each type.
  *
  * nr[0] = anon pages to scan; nr[1] = file pages to scan
  */
@@ -1901,7 +1987,7 @@ static void get_scan_count(struct mem_cgroup_zone *mz, struct scan_control *sc,
 {
 	unsigned long anon, file, free;
 	unsigned long anon_prio, file_prio;
-	unsigned long ap, fp;
+	u64 ap, fp;
 	struct zone_reclaim_stat *reclaim_stat = get_reclaim_stat(mz);
 	u64 fraction[2], denominator;
 	enum lru_list lru;
@@ -1988,6 +2074,28 @@ static void get_scan_count(struct mem_cgroup_zone *mz, struct scan_control *sc,
 
 	fp = file_prio * (reclaim_stat->recent_scanned[1] + 1);
 	fp /= reclaim_stat->recent_rotated[1] + 1;
+
+	/*
+	 * With zram, reclaiming anon is a little CPU time while a file
+	 * refault waits for flash, so also weigh each type inversely to
+	 * its recent cost.  Each side's cost is blended with the total,
+	 * which bounds the correction to a factor of two either way and
+	 * keeps a type with no recorded cost from taking all pressure.
+	 */
+	if (sysctl_reclaim_cost_balance) {
+		unsigned long *cost = reclaim_stat->recent_cost;
+		u64 total, anon_cost, file_cost;
+
+		if (unlikely(cost[0] + cost[1] > RECLAIM_COST_DECAY_US)) {
+			cost[0] /= 2;
+			cost[1] /= 2;
+		}
+		total = cost[0] + cost[1];
+		anon_cost = total + cost[0];
+		file_cost = total + cost[1];
+		ap = div64_u64(ap * (file_cost + 1), anon_cost + 1);
+		fp = div64_u64(fp * (anon_cost + 1), file_cost + 1);
+	}
 	spin_unlock_irq(&mz->zone->lru_lock);
 
 	fraction[0] = ap;
@@ -2976,7 +3084,7 @@ out:
 		}
 
 		if (zones_need_compaction)
-			compact_pgdat(pgdat, order);
+			wakeup_kcompactd(pgdat, order, end_zone);
 	}
 
 	/*
@@ -3023,6 +3131,12 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
 		 */
 		set_pgdat_percpu_threshold(pgdat, calculate_normal_threshold);
 
+		/*
+		 * The node is balanced: let kcompactd restore free pages
+		 * of the proactive order before everything goes idle.
+		 */
+		wakeup_kcompactd(pgdat, order, classzone_idx);
+
 		if (!kthread_should_stop())
 			schedule();
 
@@ -712,6 +712,9 @@ const char * const vmstat_text[] = {
 	"nr_shmem",
 	"nr_dirtied",
 	"nr_written",
+	"workingset_refault",
+	"workingset_activate",
+	"workingset_nodereclaim",
 
 #ifdef CONFIG_NUMA
 	"numa_hit",
@@ -759,6 +762,10 @@ const char * const vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+	"reclaim_cost_anon",
+	"reclaim_cost_anon_us",
+	"reclaim_cost_file",
+	"reclaim_cost_file_us",
 
 #ifdef CONFIG_COMPACTION
 	"compact_blocks_moved",
@@ -767,6 +774,10 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"kcompactd_wake",
+	"kcompactd_success",
+	"kcompactd_fail",
+	"kcompactd_budget_exhausted",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -789,6 +800,16 @@ const char * const vmstat_text[] = {
 	"thp_collapse_alloc_failed",
 	"thp_split",
 #endif
+#ifdef CONFIG_SWAP
+	"swap_slots_alloc_cached",
+	"swap_slots_refill",
+	"swap_slots_free_batched",
+	"swap_slots_free_flush",
+	"swap_ra_cluster_hit",
+	"swap_ra_cluster_miss",
+	"swap_ra_vma_hit",
+	"swap_ra_vma_miss",
+#endif
 
 #endif /* CONFIG_VM_EVENTS_COUNTERS */
 };
@@ -0,0 +1,273 @@
+/*
+ * mm/workingset.c
+ *
+ * Workingset detection: tell thrashing apart from streaming IO by
+ * remembering when each page cache page was evicted.
+ *
+ * Every zone keeps an "inactive age" clock, inactive_age, that ticks
+ * once for every page that leaves the inactive file list: when it is
+ * evicted, and when it is activated.  When reclaim evicts a page, the
+ * current reading of the clock is packed into a shadow entry that is
+ * left in the page's slot of the page cache radix tree.
+ *
+ * When the page is faulted back in, the distance between the clock
+ * now and the clock stored in the shadow is the number of pages that
+ * left the inactive list in the meantime: the "refault distance".  Had
+ * the inactive list been that much bigger, the page would not have
+ * been evicted before being used again.  The inactive list can only
+ * grow at the expense of the active list, so if the refault distance
+ * is not larger than the active file list, the page is part of a
+ * working set that does not fit the current inactive list, and it is
+ * activated right away instead of being thrashed out again.  A page
+ * whose refault distance is larger than that could not have stayed
+ * resident by rebalancing the lists and goes to the inactive list as
+ * a new page would.
+ *
+ * Refaults and activations are counted in the workingset_refault and
+ * workingset_activate fields of /proc/vmstat and /proc/zoneinfo.
+ *
+ * Shadow entries are plain radix tree exceptional entries and live in
+ * the page cache until the page is read back in, the range is
+ * truncated, or the inode is evicted.  Radix tree nodes that hold
+ * nothing but shadow entries are put on a list, and a shrinker frees
+ * them once they take up more memory than the refault information is
+ * worth.
+ */
+
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/swap.h>
+#include <linux/vmstat.h>
+#include <linux/atomic.h>
+#include <linux/radix-tree.h>
+#include <linux/spinlock.h>
+#include <linux/module.h>
+
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction;
+	unsigned long refault;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+
+	refault = atomic_long_read(&(*zone)->inactive_age);
+	/*
+	 * The clock may have wrapped around since the eviction; the
+	 * masked difference is still right as long as it did not wrap
+	 * more than once, after which the page is long gone from any
+	 * working set anyway.
+	 */
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates the refault distance of the page and counts the refault
+ * in the zone the page was evicted from.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+/*
+ * Radix tree nodes that contain only shadow entries, oldest first.
+ * Nodes are added and removed with the tree_lock of their mapping
+ * held, so the list_empty() test on a node is stable under it.  The
+ * list lock nests inside the tree_lock.
+ */
+static LIST_HEAD(shadow_nodes);
+static DEFINE_SPINLOCK(shadow_nodes_lock);
+static unsigned long nr_shadow_nodes;
+
+/**
+ * workingset_update_node - track or untrack a page cache tree node
+ * @mapping: address space the node belongs to
+ * @node: bottom-level node of @mapping->page_tree
+ *
+ * Must be called under @mapping->tree_lock after the page or shadow
+ * count of @node changed, and before the node is freed.
+ */
+void workingset_update_node(struct address_space *mapping,
+			    struct radix_tree_node *node)
+{
+	if (workingset_node_shadows(node) && !workingset_node_pages(node)) {
+		if (list_empty(&node->private_list)) {
+			node->private_data = mapping;
+			spin_lock(&shadow_nodes_lock);
+			list_add_tail(&node->private_list, &shadow_nodes);
+			nr_shadow_nodes++;
+			spin_unlock(&shadow_nodes_lock);
+		}
+	} else if (!list_empty(&node->private_list)) {
+		spin_lock(&shadow_nodes_lock);
+		list_del_init(&node->private_list);
+		nr_shadow_nodes--;
+		spin_unlock(&shadow_nodes_lock);
+	}
+}
+
+static unsigned long count_shadow_nodes(void)
+{
+	unsigned long max_nodes;
+
+	/*
+	 * Active cache pages are limited to 50% of memory, and shadow
+	 * entries that represent a refault distance bigger than that
+	 * do not have any effect.  Limit the number of shadow nodes
+	 * such that shadow entries do not exceed the number of active
+	 * cache pages, assuming a worst-case node population density
+	 * of 1/8th on average.
+	 *
+	 * On 64-bit with 7 radix_tree_nodes per page and 64 slots
+	 * each, this reclaims shadow nodes once they take up ~2% of
+	 * memory.
+	 */
+	max_nodes = totalram_pages >> (1 + RADIX_TREE_MAP_SHIFT - 3);
+
+	if (nr_shadow_nodes <= max_nodes)
+		return 0;
+	return nr_shadow_nodes - max_nodes;
+}
+
+/*
+ * Called with shadow_nodes_lock held and interrupts disabled.  Frees
+ * @node if its mapping's tree_lock can be taken, and returns with the
+ * list lock dropped and interrupts enabled in that case.
+ */
+static bool shadow_node_reclaim(struct radix_tree_node *node)
+{
+	struct address_space *mapping = node->private_data;
+	unsigned int i;
+
+	/* Coming from the list, invert the lock order */
+	if (!spin_trylock(&mapping->tree_lock)) {
+		list_move_tail(&node->private_list, &shadow_nodes);
+		return false;
+	}
+
+	list_del_init(&node->private_list);
+	nr_shadow_nodes--;
+	spin_unlock(&shadow_nodes_lock);
+
+	/*
+	 * The node holds one or more shadow entries and no pages, so
+	 * all of them can be dropped and the empty node freed.
+	 */
+	BUG_ON(workingset_node_pages(node));
+	for (i = 0; i < RADIX_TREE_MAP_SIZE; i++) {
+		if (node->slots[i]) {
+			BUG_ON(!radix_tree_exceptional_entry(node->slots[i]));
+			node->slots[i] = NULL;
+			workingset_node_shadows_dec(node);
+			BUG_ON(!mapping->nrshadows);
+			mapping->nrshadows--;
+		}
+	}
+	BUG_ON(node->count);
+	inc_zone_state(page_zone(virt_to_page(node)), WORKINGSET_NODERECLAIM);
+	if (!__radix_tree_delete_node(&mapping->page_tree, node))
+		BUG();
+
+	spin_unlock_irq(&mapping->tree_lock);
+	return true;
+}
+
+static int shrink_shadow_nodes(struct shrinker *shrink,
+			       struct shrink_control *sc)
+{
+	unsigned long nr_to_scan = sc->nr_to_scan;
+
+	if (!nr_to_scan)
+		return count_shadow_nodes();
+
+	spin_lock_irq(&shadow_nodes_lock);
+	while (nr_to_scan-- && !list_empty(&shadow_nodes)) {
+		struct radix_tree_node *node;
+
+		node = list_first_entry(&shadow_nodes, struct radix_tree_node,
+					private_list);
+		if (shadow_node_reclaim(node)) {
+			cond_resched();
+			spin_lock_irq(&shadow_nodes_lock);
+		}
+	}
+	spin_unlock_irq(&shadow_nodes_lock);
+
+	return count_shadow_nodes();
+}
+
+static struct shrinker workingset_shadow_shrinker = {
+	.shrink = shrink_shadow_nodes,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init workingset_init(void)
+{
+	register_shrinker(&workingset_shadow_shrinker);
+	return 0;
+}
+module_init(workingset_init);
@@ -0,0 +1,46 @@
+/*
+ * bench.h - helpers shared by the filesystem benchmarks
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _FS_BENCH_H
+#define _FS_BENCH_H
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Monotonic time in seconds */
+static inline double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Write back and drop the page cache, dentries and inodes; needs root */
+static inline int drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0) {
+		perror("/proc/sys/vm/drop_caches");
+		return -1;
+	}
+	if (write(fd, "3\n", 2) != 2) {
+		perror("drop_caches");
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+#endif
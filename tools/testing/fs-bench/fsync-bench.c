@@ -0,0 +1,222 @@
+/*
+ * fsync-bench.c - fsync() latency of an SQLite-like transaction load
+ *
+ * Each transaction appends a few pages to a write-ahead log and fsync()s
+ * it, as SQLite does in WAL mode; every -c transactions the log is copied
+ * back into the database file, fsync()ed, and the log is rewritten from
+ * its start.  With -r the rollback journal mode is used instead: the old
+ * pages go to a journal that is fsync()ed and deleted, the database pages
+ * are overwritten in place and fsync()ed.  The fsync() latency histogram
+ * is printed at the end, in power of two microsecond buckets:
+ *
+ *	# fsync-bench -n 2000 /data
+ *	2000 transactions, 4000 fsyncs, 1234.5 tps
+ *	  usecs        count
+ *	    256 -    511    12
+ *	    512 -   1023  3870
+ *	   ...
+ *
+ * On ext4, compare with the fast_commit mount option off and on, and with
+ * /proc/fs/ext4/<dev>/fsync_stats.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+#define PAGE_SIZE	4096
+#define DB_PAGES	1024
+#define NR_SLOTS	32
+
+static unsigned long hist[NR_SLOTS];
+static unsigned long nr_fsyncs;
+static char page[PAGE_SIZE];
+
+static int timed_fsync(int fd)
+{
+	unsigned long us;
+	double start;
+	int slot = 0;
+
+	start = now();
+	if (fsync(fd)) {
+		perror("fsync");
+		return -1;
+	}
+	us = (now() - start) * 1e6;
+	while (us && slot < NR_SLOTS - 1) {
+		us >>= 1;
+		slot++;
+	}
+	hist[slot]++;
+	nr_fsyncs++;
+	return 0;
+}
+
+static int write_page(int fd, off_t pgno)
+{
+	memset(page, (int)pgno, sizeof(page));
+	if (pwrite(fd, page, PAGE_SIZE, pgno * PAGE_SIZE) != PAGE_SIZE) {
+		perror("pwrite");
+		return -1;
+	}
+	return 0;
+}
+
+static int wal_txn(int db, int wal, unsigned long *wal_pages,
+		   unsigned int pages, unsigned int ckpt, unsigned long txn)
+{
+	unsigned int i;
+
+	for (i = 0; i < pages; i++)
+		if (write_page(wal, (*wal_pages)++))
+			return -1;
+	if (timed_fsync(wal))
+		return -1;
+
+	if ((txn + 1) % ckpt)
+		return 0;
+
+	/* Checkpoint: the log is copied back, then reused from its start */
+	for (i = 0; i < *wal_pages; i++)
+		if (write_page(db, random() % DB_PAGES))
+			return -1;
+	if (timed_fsync(db))
+		return -1;
+	*wal_pages = 0;
+	return 0;
+}
+
+static int rollback_txn(int db, const char *jpath, unsigned int pages)
+{
+	unsigned int i;
+	int fd;
+
+	fd = open(jpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(jpath);
+		return -1;
+	}
+	for (i = 0; i < pages; i++)
+		if (write_page(fd, i))
+			goto fail;
+	if (timed_fsync(fd))
+		goto fail;
+	close(fd);
+
+	for (i = 0; i < pages; i++)
+		if (write_page(db, random() % DB_PAGES))
+			return -1;
+	if (timed_fsync(db))
+		return -1;
+	return unlink(jpath);
+
+fail:
+	close(fd);
+	return -1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-n txns] [-p pages] [-c ckpt] [-r] dir\n"
+		"  -n txns   number of transactions (default 1000)\n"
+		"  -p pages  pages written per transaction (default 2)\n"
+		"  -c ckpt   transactions between WAL checkpoints (default 100)\n"
+		"  -r        rollback journal instead of WAL\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long txns = 1000, wal_pages = 0, i;
+	unsigned int pages = 2, ckpt = 100;
+	char dbpath[4096], auxpath[4096];
+	int rollback = 0, db, wal = -1, opt, ret = 1;
+	double start, elapsed;
+
+	while ((opt = getopt(argc, argv, "n:p:c:r")) != -1) {
+		switch (opt) {
+		case 'n':
+			txns = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			pages = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			ckpt = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			rollback = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || !txns || !pages || !ckpt)
+		usage(argv[0]);
+
+	snprintf(dbpath, sizeof(dbpath), "%s/fsync-bench.%d.db",
+		 argv[optind], getpid());
+	snprintf(auxpath, sizeof(auxpath), "%s/fsync-bench.%d.%s",
+		 argv[optind], getpid(), rollback ? "journal" : "wal");
+
+	db = open(dbpath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (db < 0) {
+		perror(dbpath);
+		return 1;
+	}
+	for (i = 0; i < DB_PAGES; i++)
+		if (write_page(db, i))
+			goto out;
+	if (fsync(db)) {
+		perror("fsync");
+		goto out;
+	}
+	if (!rollback) {
+		wal = open(auxpath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (wal < 0) {
+			perror(auxpath);
+			goto out;
+		}
+	}
+
+	srandom(getpid());
+	start = now();
+	for (i = 0; i < txns; i++) {
+		if (rollback ? rollback_txn(db, auxpath, pages) :
+			       wal_txn(db, wal, &wal_pages, pages, ckpt, i))
+			goto out;
+	}
+	elapsed = now() - start;
+
+	printf("%lu transactions, %lu fsyncs, %.1f tps\n", txns, nr_fsyncs,
+	       txns / elapsed);
+	printf("  usecs        count\n");
+	for (i = 0; i < NR_SLOTS; i++) {
+		if (!hist[i])
+			continue;
+		printf("%7lu - %6lu %6lu\n", i ? 1UL << (i - 1) : 0,
+		       (1UL << i) - 1, hist[i]);
+	}
+	ret = 0;
+out:
+	if (wal >= 0)
+		close(wal);
+	close(db);
+	unlink(auxpath);
+	unlink(dbpath);
+	return ret;
+}
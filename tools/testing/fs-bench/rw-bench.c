@@ -0,0 +1,173 @@
+/*
+ * rw-bench.c - sequential read and write throughput of several directories
+ *
+ * Writes and reads back a file in each directory given and reports the
+ * throughput, the write including the final fsync(), relative to the
+ * first directory.  Give the backing filesystem first and a FUSE mount
+ * of it next to see what FUSE costs, for instance with and without
+ * passthrough enabled by the filesystem daemon:
+ *
+ *	# rw-bench -d /data/media /sdcard
+ *	/data/media      write    123.4 MB/s  read    456.7 MB/s
+ *	/sdcard          write    120.1 MB/s  read    440.2 MB/s   (97% / 96%)
+ *
+ * With -d the page cache is dropped before reading, which needs root.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+
+struct result {
+	double write;
+	double read;
+};
+
+static size_t total = 64 << 20;
+static size_t bs = 128 << 10;
+static int drop;
+
+static int bench_write(const char *path, char *buf, double *mbs)
+{
+	double start;
+	size_t done;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+
+	start = now();
+	for (done = 0; done < total; done += bs) {
+		if (write(fd, buf, bs) != (ssize_t)bs) {
+			perror("write");
+			close(fd);
+			return -1;
+		}
+	}
+	if (fsync(fd)) {
+		perror("fsync");
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	*mbs = total / (now() - start) / (1024 * 1024);
+	return 0;
+}
+
+static int bench_read(const char *path, char *buf, double *mbs)
+{
+	double start;
+	size_t done;
+	ssize_t ret;
+	int fd;
+
+	if (drop && drop_caches())
+		return -1;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return -1;
+	}
+
+	start = now();
+	for (done = 0; done < total; done += ret) {
+		ret = read(fd, buf, bs);
+		if (ret <= 0) {
+			if (ret < 0)
+				perror("read");
+			else
+				fprintf(stderr, "%s: short file\n", path);
+			close(fd);
+			return -1;
+		}
+	}
+	close(fd);
+	*mbs = total / (now() - start) / (1024 * 1024);
+	return 0;
+}
+
+static int bench(const char *dir, char *buf, struct result *res)
+{
+	char path[4096];
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/rw-bench.%d", dir, getpid());
+	ret = bench_write(path, buf, &res->write);
+	if (!ret)
+		ret = bench_read(path, buf, &res->read);
+	unlink(path);
+	return ret;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-s size_mb] [-b block_kb] [-d] dir...\n"
+		"  -s size_mb   size of the file written per directory (default 64)\n"
+		"  -b block_kb  size of each read and write (default 128)\n"
+		"  -d           drop the page cache before reading\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct result first = { 0, 0 }, res;
+	char *buf;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "s:b:d")) != -1) {
+		switch (opt) {
+		case 's':
+			total = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'b':
+			bs = strtoul(optarg, NULL, 0) << 10;
+			break;
+		case 'd':
+			drop = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind == argc || !total || !bs)
+		usage(argv[0]);
+
+	buf = malloc(bs);
+	if (!buf)
+		return 1;
+	memset(buf, 0x5a, bs);
+
+	for (i = optind; i < argc; i++) {
+		if (bench(argv[i], buf, &res))
+			return 1;
+		printf("%-16s write %8.1f MB/s  read %8.1f MB/s",
+		       argv[i], res.write, res.read);
+		if (i == optind)
+			first = res;
+		else
+			printf("   (%.0f%% / %.0f%%)",
+			       100 * res.write / first.write,
+			       100 * res.read / first.read);
+		printf("\n");
+	}
+
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,89 @@
+#!/bin/sh
+#
+# mount-time.sh - yaffs2 mount time against file system size, on nandsim
+#
+# For each size, loads nandsim as a 2 KiB page, 128 KiB block NAND of
+# 2^N blocks, fills half of it with files, and times the mount when the
+# checkpoint is read, when it is not and the flash is scanned using the
+# block summaries, and when it is scanned chunk by chunk (no-summary).
+# The sync time after a small change shows the incremental checkpoint.
+# Needs root, and yaffs2, nandsim and mtdblock as modules or built in:
+#
+#	# tools/yaffs2/mount-time.sh 9 10 11
+#	  MiB  checkpt(ms)  summary(ms)  full scan(ms)  sync(ms)
+#	   64          ...
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License version 2 as
+# published by the Free Software Foundation.
+
+MNT=${MNT:-/mnt/yaffs2-test}
+SIZES=${*:-9 10 11 12}
+
+now_ms()
+{
+	echo $(($(date +%s%N) / 1000000))
+}
+
+# Time mounting with the given options, in milliseconds
+timed_mount()
+{
+	start=$(now_ms)
+	mount -t yaffs2 ${1:+-o $1} "$dev" "$MNT" || exit 1
+	end=$(now_ms)
+	umount "$MNT"
+	echo $((end - start))
+}
+
+fill()
+{
+	mount -t yaffs2 "$dev" "$MNT" || exit 1
+	n=0
+	while [ $n -lt $(($1 / 2)) ]; do
+		mkdir -p "$MNT/d$((n % 64))"
+		dd if=/dev/urandom of="$MNT/d$((n % 64))/f$n" bs=64k count=16 \
+			2>/dev/null || break
+		n=$((n + 1))
+	done
+	umount "$MNT"
+}
+
+# Time a sync after changing one file, as the incremental checkpoint sees it
+timed_sync()
+{
+	mount -t yaffs2 "$dev" "$MNT" || exit 1
+	echo change > "$MNT/d0/f0"
+	start=$(now_ms)
+	sync
+	end=$(now_ms)
+	umount "$MNT"
+	echo $((end - start))
+}
+
+mkdir -p "$MNT"
+modprobe mtdblock 2>/dev/null
+
+printf "%5s  %11s  %11s  %13s  %8s\n" MiB "checkpt(ms)" "summary(ms)" \
+	"full scan(ms)" "sync(ms)"
+
+for n in $SIZES; do
+	rmmod nandsim 2>/dev/null
+	modprobe nandsim second_id_byte=0xd3 third_id_byte=0x10 \
+		fourth_id_byte=0x95 overridesize=$n || exit 1
+
+	mtd=$(grep "NAND simulator" /proc/mtd | cut -d: -f1 | head -n 1)
+	dev=/dev/mtdblock${mtd#mtd}
+	mib=$(((1 << n) / 8))
+
+	# Unmounting after the fill leaves a checkpoint to read
+	fill $mib
+	checkpt=$(timed_mount)
+	summary=$(timed_mount no-checkpoint-read)
+	full=$(timed_mount no-checkpoint-read,no-summary)
+	sync_ms=$(timed_sync)
+
+	printf "%5d  %11d  %11d  %13d  %8d\n" $mib $checkpt $summary $full \
+		$sync_ms
+done
+
+rmmod nandsim